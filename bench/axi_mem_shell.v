@@ -0,0 +1,71 @@
+`timescale 1ns / 100ps
+/**
+ * Transaction-level AXI4 memory, driven by the '$axi_mem' VPI model (see
+ * 'vpi/axi_mem.h'), with C-side storage, and a fixed (or random) latency.
+ */
+module axi_mem_shell #(
+    parameter DATA_WIDTH = 32,
+    localparam MSB = DATA_WIDTH - 1,
+    localparam STROBES = DATA_WIDTH / 8,
+    localparam SSB = STROBES - 1,
+    parameter ADDRS = 28,
+    localparam ASB = ADDRS - 1,
+    parameter ID_WIDTH = 4,
+    localparam ISB = ID_WIDTH - 1,
+    parameter LATENCY = 8,
+    parameter JITTER = 0,
+    parameter SEED = 1
+) (
+    input clock,
+    input reset,
+
+    input awvalid,
+    output reg awready,
+    input [ASB:0] awaddr,
+    input [ISB:0] awid,
+    input [7:0] awlen,
+    input [1:0] awburst,
+
+    input wvalid,
+    output reg wready,
+    input wlast,
+    input [SSB:0] wstrb,
+    input [MSB:0] wdata,
+
+    output reg bvalid,
+    input bready,
+    output reg [1:0] bresp,
+    output reg [ISB:0] bid,
+
+    input arvalid,
+    output reg arready,
+    input [ASB:0] araddr,
+    input [ISB:0] arid,
+    input [7:0] arlen,
+    input [1:0] arburst,
+
+    output reg rvalid,
+    input rready,
+    output reg rlast,
+    output reg [1:0] rresp,
+    output reg [ISB:0] rid,
+    output reg [MSB:0] rdata
+);
+
+  initial begin
+    awready = 1'b0;
+    wready = 1'b0;
+    bvalid = 1'b0;
+    bresp = 2'b00;
+    bid = {ID_WIDTH{1'b0}};
+    arready = 1'b0;
+    rvalid = 1'b0;
+    rlast = 1'b0;
+    rresp = 2'b00;
+    rid = {ID_WIDTH{1'b0}};
+    rdata = {DATA_WIDTH{1'b0}};
+
+    $axi_mem(clock, reset, LATENCY, JITTER, SEED);
+  end
+
+endmodule  /* axi_mem_shell */
@@ -395,7 +395,10 @@ module ddr3 (
     end
 
     // Memory Storage
-`ifdef MAX_MEM
+`ifdef __ddr3_vpi_mem
+    // Sparse, paged storage, in C, via '$ddr3_mem_write/read/erase' (of
+    // 'ulpisim.vpi'), which also handles any '+ddr3_preload=<file>'
+`elsif MAX_MEM
     parameter RFF_BITS = DQ_BITS*BL_MAX;
      // %z format uses 8 bytes for every 32 bits or less.
     parameter RFF_CHUNK = 8 * (RFF_BITS/32 + (RFF_BITS%32 ? 1 : 0));
@@ -630,7 +633,9 @@ module ddr3 (
         min = (a > b) ? b : a;
     endfunction
 
-`ifdef MAX_MEM
+`ifdef __ddr3_vpi_mem
+    // No file I/O, nor look-ups, as the storage is in C
+`elsif MAX_MEM
 
     function integer open_bank_file( input integer bank );
         integer fd;
@@ -782,7 +787,10 @@ module ddr3 (
         input  [BL_MAX*DQ_BITS-1:0] data;
         reg    [`MAX_BITS-1:0] addr;
         begin
-`ifdef MAX_MEM
+`ifdef __ddr3_vpi_mem
+            addr = {bank, row, col}/BL_MAX;
+            $ddr3_mem_write(addr, data);
+`elsif MAX_MEM
             addr = {row, col}/BL_MAX;
             write_to_file( memfd[bank], addr, data );
 `else
@@ -810,7 +818,10 @@ module ddr3 (
         output [BL_MAX*DQ_BITS-1:0] data;
         reg    [`MAX_BITS-1:0] addr;
         begin
-`ifdef MAX_MEM
+`ifdef __ddr3_vpi_mem
+            addr = {bank, row, col}/BL_MAX;
+            $ddr3_mem_read(addr, data);
+`elsif MAX_MEM
             addr = {row, col}/BL_MAX;
             data = read_from_file( memfd[bank], addr );
 `else
@@ -849,7 +860,13 @@ module ddr3 (
 
         begin
 
-`ifdef MAX_MEM
+`ifdef __ddr3_vpi_mem
+        for (bank = 0; bank < `BANKS; bank = bank + 1)
+            if (banks[bank] === 1'b1) begin
+                i = bank << (ROW_BITS+COL_BITS-BL_BITS);
+                $ddr3_mem_erase(i, 1 << (ROW_BITS+COL_BITS-BL_BITS));
+            end
+`elsif MAX_MEM
         for (bank = 0; bank < `BANKS; bank = bank + 1)
             if (banks[bank] === 1'b1) begin
             $fclose(memfd[bank]);
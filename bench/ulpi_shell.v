@@ -1,6 +1,9 @@
 `timescale 1ns / 100ps
-module ulpi_shell
-  ( input clock,
+module ulpi_shell #(
+    // Set to 0 when the DDR3 end-points do not reach a memory, to skip the
+    // DDR3 test-cases (and the random STOREs and FETCHes)
+    parameter DDR3 = 1
+) ( input clock,
     input rst_n,
     output reg dir,
     output reg nxt,
@@ -10,11 +13,18 @@ module ulpi_shell
 
   reg dir_q;
   reg [7:0] dat_q;
+  reg dump = 1'b0;
 
   assign data = dir_q ? dat_q : 8'bz;
 
   initial begin
-    $ulpi_step(clock, rst_n, dir, nxt, stp, data, dat_q);
+    $ulpi_step(clock, rst_n, dir, nxt, stp, data, dat_q, dump, DDR3);
+  end
+
+  // The harness selects the waveform capture-window (see 'vpi/ulpidump.h')
+  always @(dump) begin
+    if (dump) $dumpon;
+    else $dumpoff;
   end
 
   always @(negedge clock) begin
@@ -0,0 +1,214 @@
+/**
+ * Verilator testbench for the USB ULPI core, which drives the ULPI bus using
+ * the same (C) PHY model, USB host model, and test-cases as '$ulpi_step', but
+ * calls them directly, instead of via VPI callbacks.
+ *
+ * Note: the timing matches 'vpi_usb_ulpi_tb.v'; i.e., a 12 ns ULPI clock, a
+ *   40 ns 'clk25' oscillator, and a 3.8 ms limit on the simulation time.
+ */
+#include "Vvl_usb_ulpi_top.h"
+#include "verilated.h"
+
+#ifdef __trace
+#include "verilated_fst_c.h"
+#endif /* __trace */
+
+extern "C" {
+#include "ulpisim.h"
+}
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define CLOCK_HALF_NS 6
+#define CLK25_HALF_NS 20
+#define ARESET_NS 40
+#define TIME_LIMIT_NS 3800000ul
+
+
+/**
+ * Sample the ULPI bus, for the PHY model, just before a 'clock' rising edge.
+ */
+static void vl_fetch_bus(ut_state_t* state, const Vvl_usb_ulpi_top* top)
+{
+    state->bus.clock = SIG1;
+    state->bus.rst_n = top->ulpi_rst_n ? SIG1 : SIG0;
+    state->bus.dir = top->ulpi_dir ? SIG1 : SIG0;
+    state->bus.nxt = top->ulpi_nxt ? SIG1 : SIG0;
+    state->bus.stp = top->ulpi_stp ? SIG1 : SIG0;
+
+    // Verilator has no 'Z', so use the PHY's own value while it is driving
+    state->bus.data.a = top->ulpi_dir_q ? state->phy.bus.data.a : top->ulpi_dati;
+    state->bus.data.b = top->ulpi_dir_q ? state->phy.bus.data.b : 0x00;
+}
+
+/**
+ * Drive the PHY-side signals, using the outputs from the PHY model.
+ */
+static void vl_update_bus(ut_state_t* state, Vvl_usb_ulpi_top* top, const ulpi_bus_t* next)
+{
+    top->ulpi_dir = next->dir == SIG1;
+    top->ulpi_nxt = next->nxt == SIG1;
+    top->ulpi_dato = next->data.a & ~next->data.b;
+    memcpy(&state->phy.bus, next, sizeof(ulpi_bus_t));
+}
+
+int main(int argc, char** argv)
+{
+    VerilatedContext* ctx = new VerilatedContext;
+    ctx->commandArgs(argc, argv);
+
+    Vvl_usb_ulpi_top* top = new Vvl_usb_ulpi_top{ctx};
+
+#ifdef __trace
+    VerilatedFstC* tfp = NULL;
+    const char* flag = ctx->commandArgsPlusMatch("trace");
+    if (flag && 0 == strcmp(flag, "+trace")) {
+        ctx->traceEverOn(true);
+        tfp = new VerilatedFstC;
+        top->trace(tfp, 99);
+        tfp->open("vl_usb_ulpi_tb.fst");
+    }
+#endif /* __trace */
+
+    ut_state_t* state = (ut_state_t*)malloc(sizeof(ut_state_t));
+    memset(state, 0, sizeof(ut_state_t));
+#ifdef __use_ddr3_because_reasons
+    state->ddr3 = true;
+#endif /* __use_ddr3_because_reasons */
+    ut_init(state);
+
+    // Scale-factor for converting nanoseconds into simulator time-units
+    uint64_t t_recip = 1;
+    for (int scale = -9 - ctx->timeprecision(); scale > 0; scale--) {
+        t_recip *= 10;
+    }
+    state->t_recip = t_recip;
+
+    // Golden-trace recording ('+ulpi_trace=<file>'), or regression-checking
+    // ('+ulpi_golden=<file>'), of the ULPI bus
+    ulpi_trace_t trace;
+    const char* record = ctx->commandArgsPlusMatch("ulpi_trace=");
+    const char* golden = ctx->commandArgsPlusMatch("ulpi_golden=");
+    const char* window = ctx->commandArgsPlusMatch("ulpi_window=");
+    const char* path = golden[0] ? strchr(golden, '=') + 1 :
+        record[0] ? strchr(record, '=') + 1 : NULL;
+
+    // Show the flight-recorder at '+ulpi_ring=<cycle>' (on demand)
+    const char* ring_at = ctx->commandArgsPlusMatch("ulpi_ring=");
+    if (ring_at[0]) {
+        state->ring->show_at = strtoull(strchr(ring_at, '=') + 1, NULL, 0);
+    }
+
+    if (path != NULL) {
+        uint32_t size = window[0] ? (uint32_t)atoi(strchr(window, '=') + 1) : 0;
+        if (ulpi_trace_open(&trace, path, golden[0] != 0, size) < 0) {
+            delete top;
+            delete ctx;
+            return 1;
+        }
+        state->trace = &trace;
+    }
+
+    top->clock = 1;
+    top->clk25 = 1;
+    top->arst_n = 0;
+    top->ulpi_dir = 0;
+    top->ulpi_nxt = 0;
+    top->ulpi_dato = 0;
+    top->eval();
+
+    ulpi_bus_t next;
+    uint64_t t_ns = 0;
+    int result = 0;
+
+    while (!ctx->gotFinish() && t_ns < TIME_LIMIT_NS) {
+        t_ns += 2;
+        ctx->time(t_ns * t_recip);
+
+        if (t_ns == ARESET_NS) {
+            top->arst_n = 1;
+        }
+
+        if (t_ns % CLK25_HALF_NS == 0) {
+            top->clk25 = !top->clk25;
+        }
+
+        if (t_ns % CLOCK_HALF_NS != 0) {
+            top->eval();
+        } else if (top->clock) {
+            top->clock = 0;
+            top->eval();
+        } else {
+            // Rising edge of the ULPI clock, so sample the bus, evaluate the
+            // design, and then step the models (like 'cbReadWriteSynch')
+            vl_fetch_bus(state, top);
+            state->tick_ns = t_ns;
+
+            if (state->trace != NULL && ulpi_trace_step(state->trace, &state->bus) < 0) {
+                result = -1;
+                break;
+            }
+
+            top->clock = 1;
+            top->eval();
+
+            if (state->op == UT_Done) {
+                state->cycle++;
+                break;
+            }
+
+            result = ut_step(state, &next);
+            if (result < 0) {
+                printf("Oh noes [%s:%d]\n", __FILE__, __LINE__);
+                break;
+            }
+
+            vl_update_bus(state, top, &next);
+            top->eval();
+
+            if (state->ring->cycle == state->ring->show_at + 1) {
+                ut_ring_show(state->ring, 0);
+            }
+        }
+
+#ifdef __trace
+        if (tfp) {
+            tfp->dump(ctx->time());
+        }
+#endif /* __trace */
+    }
+
+    top->final();
+
+    if (state->trace != NULL && ulpi_trace_close(state->trace) < 0) {
+        result = -1;
+    }
+
+#ifdef __trace
+    if (tfp) {
+        tfp->close();
+        delete tfp;
+    }
+#endif /* __trace */
+
+    int status = 1;
+    if (result < 0 || (ctx->gotFinish() && state->op != UT_Done)) {
+        printf("ERROR: simulation stopped at %lu ns (%lu cycles)\n",
+               t_ns, state->cycle);
+    } else if (state->op != UT_Done) {
+        printf("ERROR: timed out at %lu ns (test %d of %d)\n", t_ns,
+               state->test_curr, state->test_num);
+    } else {
+        printf("Simulation finished at %lu ns (%lu cycles)\n", t_ns, state->cycle);
+        status = 0;
+    }
+
+    delete top;
+    delete ctx;
+
+    return status;
+}
@@ -0,0 +1,243 @@
+`timescale 1ns / 100ps
+/**
+ * Verilator top-level for the USB ULPI core, with the ULPI PHY side exposed as
+ * ports, so that the (C) PHY & USB host models can drive it directly, from
+ * 'vl_usb_ulpi_tb.cpp'.
+ *
+ * Note: mirrors 'vpi_usb_ulpi_tb' + 'ulpi_shell', except that the clocks and
+ *   reset are inputs, and the bidirectional ULPI data-bus is split into 'dato'
+ *   (from the PHY) and 'dati' (the resolved bus value).
+ */
+module vl_usb_ulpi_top (
+    input clock,
+    input clk25,
+    input arst_n,
+
+    output ulpi_rst_n,
+    input ulpi_dir,
+    input ulpi_nxt,
+    output ulpi_stp,
+    output ulpi_dir_q,
+    input [7:0] ulpi_dato,
+    output [7:0] ulpi_dati
+);
+
+  localparam DEBUG = 1;
+  localparam LOGGER = 0;
+
+  localparam DATA_FIFO_BYPASS = 1;
+  localparam DDR_FREQ_MHZ = 100;
+
+  // DDR3 settings
+  localparam WR_PREFETCH = 0;
+  localparam LOW_LATENCY = 1;
+  localparam WRITE_DELAY = 2'b01;  // Default value (sim)
+  localparam CLOCK_SHIFT = 2'b01;  // Default value
+  localparam PHY_WR_DELAY = 3;
+  localparam PHY_RD_DELAY = 3;  // 125 MHz
+
+  // USB settings
+  localparam MAX_PACKET_LENGTH = 512;
+  localparam MAX_CONFIG_LENGTH = 64;
+
+  localparam ENDPOINT1 = 4'd2;
+  localparam ENDPOINT2 = 4'd1;
+  localparam ENDPOINT3 = 4'd3;
+  localparam ENDPOINT4 = 4'd5;
+
+
+  // -- PHY-side of the ULPI bus -- //
+
+  reg dir_q;
+  wire usb_rst_n;
+  wire [7:0] ulpi_data;
+
+  assign ulpi_rst_n = usb_rst_n;
+  assign ulpi_dir_q = dir_q;
+  assign ulpi_dati = ulpi_data;
+
+  assign ulpi_data = dir_q ? ulpi_dato : 8'bz;
+
+  always @(negedge clock) begin
+    if (!usb_rst_n) begin
+      dir_q <= 1'b0;
+    end else begin
+      dir_q <= ulpi_dir;
+    end
+  end
+
+
+  //
+  // Core Under Test
+  ///
+
+  wire dev_clock, dev_reset, configured, conf_event;
+  wire [2:0] usb_config;
+
+  wire io_tvalid, io_tready, io_tlast;
+  wire x_tvalid, x_tready, x_tkeep, x_tlast;
+  wire y_tvalid, y_tready, y_tkeep, y_tlast;
+  wire [7:0] x_tdata, y_tdata, io_tdata;
+
+  usb_ulpi_core #(
+      .MAX_PACKET_LENGTH(MAX_PACKET_LENGTH),
+      .MAX_CONFIG_LENGTH(MAX_CONFIG_LENGTH),
+      .ENDPOINT1        (ENDPOINT1),
+      .ENDPOINT2        (ENDPOINT2),
+      .ENDPOINTD        (ENDPOINT3),
+      .ENDPOINT4        (ENDPOINT4),
+      .USE_EP4_OUT      (1),
+      .DEBUG            (DEBUG),
+      .LOGGER           (LOGGER),
+      .USE_UART         (0)
+  ) U_USB1 (
+      .osc_in(clk25),
+      .arst_n(arst_n),
+
+      .ulpi_clk (clock),
+      .ulpi_rst (usb_rst_n),
+      .ulpi_dir (ulpi_dir),
+      .ulpi_nxt (ulpi_nxt),
+      .ulpi_stp (ulpi_stp),
+      .ulpi_data(ulpi_data),
+
+      .send_ni  (1'b1),
+      .uart_rx_i(1'b1),
+      .uart_tx_o(),
+
+      .usb_clock_o(dev_clock),
+      .usb_reset_o(dev_reset),
+
+      .configured_o(configured),
+      .conf_event_o(conf_event),
+      .conf_value_o(usb_config),
+      .crc_error_o (),
+
+      .blki_tvalid_i(io_tvalid),  // USB 'BULK IN' EP data-path
+      .blki_tready_o(io_tready),
+      .blki_tlast_i (io_tlast),
+      .blki_tdata_i (io_tdata),
+
+      .blko_tvalid_o(io_tvalid),  // USB 'BULK OUT' EP data-path
+      .blko_tready_i(io_tready),
+      .blko_tlast_o (io_tlast),
+      .blko_tdata_o (io_tdata),
+
+      .blkx_tvalid_i(x_tvalid),  // DDR3 -> USB 'BULK IN' EP
+      .blkx_tready_o(x_tready),
+      .blkx_tlast_i (x_tlast),
+      .blkx_tdata_i (x_tdata),
+
+      .blky_tvalid_o(y_tvalid),  // USB 'BULK OUT' EP -> DDR3
+      .blky_tready_i(y_tready),
+      .blky_tlast_o (y_tlast),
+      .blky_tdata_o (y_tdata)
+  );
+
+
+  //
+  //  DDR3 Controller & SDRAM Model
+  ///
+
+`ifdef __use_ddr3_because_reasons
+
+  reg drst_n = 1'b1;
+  wire drst_w = ~drst_n;
+
+  wire ddr3_conf_w, sys_clk, sys_rst;
+  wire ddr_rst_n, ddr_ck_p, ddr_ck_n, ddr_cke, ddr_odt;
+  wire ddr_cs_n, ddr_ras_n, ddr_cas_n, ddr_we_n;
+  wire [1:0] ddr_dm, ddr_dqs_p, ddr_dqs_n;
+  wire [ 2:0] ddr_ba;
+  wire [12:0] ddr_a;
+  wire [15:0] ddr_dq;
+
+  assign y_tkeep = y_tvalid;  // Todo ...
+
+  initial begin
+    drst_n <= 1'b0;
+    #500000 drst_n <= 1'b1;
+  end
+
+  ddr3_top #(
+      .DDR_FREQ_MHZ(DDR_FREQ_MHZ),
+      .SRAM_BYTES  (2048),
+      .DATA_WIDTH  (32),
+      .DFIFO_BYPASS(DATA_FIFO_BYPASS),
+      .PHY_WR_DELAY(PHY_WR_DELAY),
+      .PHY_RD_DELAY(PHY_RD_DELAY),
+      .WRITE_DELAY (WRITE_DELAY),
+      .CLOCK_SHIFT (CLOCK_SHIFT),
+      .WR_PREFETCH (WR_PREFETCH),
+      .LOW_LATENCY (LOW_LATENCY)
+  ) U_DDRC1 (
+      .osc_in(clk25),
+      .arst_n(drst_n),
+
+      .bus_clock(clock),
+      .bus_reset(drst_w),
+
+      .ddr3_conf_o(ddr3_conf_w),
+      .ddr_clock_o(sys_clk),
+      .ddr_reset_o(sys_rst),
+
+      .s_tvalid(y_tvalid),
+      .s_tready(y_tready),
+      .s_tkeep (y_tkeep),
+      .s_tlast (y_tlast),
+      .s_tdata (y_tdata),
+
+      .m_tvalid(x_tvalid),
+      .m_tready(x_tready),
+      .m_tkeep (x_tkeep),
+      .m_tlast (x_tlast),
+      .m_tdata (x_tdata),
+
+      .ddr_ck(ddr_ck_p),
+      .ddr_ck_n(ddr_ck_n),
+      .ddr_cke(ddr_cke),
+      .ddr_rst_n(ddr_rst_n),
+      .ddr_cs(ddr_cs_n),
+      .ddr_ras(ddr_ras_n),
+      .ddr_cas(ddr_cas_n),
+      .ddr_we(ddr_we_n),
+      .ddr_odt(ddr_odt),
+      .ddr_bank(ddr_ba),
+      .ddr_addr(ddr_a),
+      .ddr_dm(ddr_dm),
+      .ddr_dqs(ddr_dqs_p),
+      .ddr_dqs_n(ddr_dqs_n),
+      .ddr_dq(ddr_dq)
+  );
+
+  ddr3 ddr3_sdram_inst (
+      .rst_n(ddr_rst_n),
+      .ck(ddr_ck_p),
+      .ck_n(ddr_ck_n),
+      .cke(ddr_cke),
+      .cs_n(ddr_cs_n),
+      .ras_n(ddr_ras_n),
+      .cas_n(ddr_cas_n),
+      .we_n(ddr_we_n),
+      .dm_tdqs(ddr_dm),
+      .ba(ddr_ba),
+      .addr({1'b0, ddr_a}),
+      .dq(ddr_dq),
+      .dqs(ddr_dqs_p),
+      .dqs_n(ddr_dqs_n),
+      .tdqs_n(),
+      .odt(ddr_odt)
+  );
+
+`else  /* !__use_ddr3_because_reasons */
+
+  // Without the DDR3 controller, the DDR3 endpoints just loop back the data
+  assign x_tvalid = y_tvalid;
+  assign y_tready = x_tready;
+  assign x_tlast  = y_tlast;
+  assign x_tdata  = y_tdata;
+
+`endif  /* !__use_ddr3_because_reasons */
+
+
+endmodule  /* vl_usb_ulpi_top */
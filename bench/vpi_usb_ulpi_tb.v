@@ -4,7 +4,11 @@
 module vpi_usb_ulpi_tb;
 
   localparam DEBUG = 1;
+`ifdef __use_vpi_telemetry
+  localparam LOGGER = 1;  // Note: EP3 IN then returns the telemetry
+`else  /* !__use_vpi_telemetry */
   localparam LOGGER = 0;
+`endif  /* !__use_vpi_telemetry */
 
   localparam DATA_FIFO_BYPASS = 1;
   localparam DDR_FREQ_MHZ = 100;
@@ -67,10 +71,12 @@ module vpi_usb_ulpi_tb;
 
   // -- Simulation Data -- //
 
+  // Dumping is turned on/off by '$ulpi_step', using '+ulpi_dump=<from>:<to>'
+  // or '+ulpi_dump_test=<N>' (or '+ulpi_dump=all')
   initial begin
-    #659000 $dumpfile("vpi_usb_ulpi_tb.vcd");
-    // $dumpfile("vpi_usb_ulpi_tb.vcd");
+    $dumpfile("vpi_usb_ulpi_tb.vcd");
     $dumpvars;
+    $dumpoff;
   end
 
   // initial #670000 $finish;
@@ -107,9 +113,12 @@ module vpi_usb_ulpi_tb;
   // -- Simulation Stimulus -- //
 
   /**
-   * Wrapper to the VPI model of a USB host, for providing the stimulus.
+   * Wrapper to the VPI model of a USB host, for providing the stimulus. The
+   * logger takes EP3 IN, so the DDR3 test-cases are skipped when it is on.
    */
-  ulpi_shell U_ULPI_HOST1 (
+  ulpi_shell #(
+      .DDR3(LOGGER == 0)
+  ) U_ULPI_HOST1 (
       .clock(usb_clock),
       .rst_n(usb_rst_n),
       .dir  (ulpi_dir),
@@ -118,6 +127,14 @@ module vpi_usb_ulpi_tb;
       .data (ulpi_data)
   );
 
+`ifdef __use_vpi_monitor
+  // Decodes the ULPI bus into USB packets (see 'vpi/monitor.c'), which are
+  // only written to a pcap file if given '+ulpi_pcap=<file>'
+  always @(posedge usb_clock) begin
+    $ulpi_monitor(usb_clock, usb_rst_n, ulpi_dir, ulpi_nxt, ulpi_stp, ulpi_data);
+  end
+`endif  /* __use_vpi_monitor */
+
   //
   // Cores Under New Tests
   ///
@@ -183,12 +200,152 @@ module vpi_usb_ulpi_tb;
       .blky_tdata_o (y_tdata)
   );
 
+`ifdef __use_vpi_telemetry
+  // Decodes the records of the core's 'axis_logger', as the driver does
+  initial begin
+    $telemetry("U_USB1.g_debug.U_LOG1");
+  end
+`endif  /* __use_vpi_telemetry */
+
 
   //
   //  DDR3 Cores Under Next-generation Tests
   ///
 
-`ifdef __use_ddr3_because_reasons
+`ifdef __use_vpi_axi_mem
+
+  // -- Transaction-Level AXI4 Memory -- //
+
+  // Replaces the DDR3 controller, PHY, and SDRAM model, behind the memory-
+  // request unit, with a VPI-driven AXI4 slave (see 'vpi/axi_mem.h'), as the
+  // USB-path tests do not need the DDR3 command timing
+  localparam AXI_LATENCY = 8;
+  localparam AXI_JITTER = 0;
+
+  reg drst_n = 1'b1;
+  wire drst_w = ~drst_n;
+
+  wire awvalid, wvalid, wlast, bready, arvalid, rready;
+  wire awready, wready, bvalid, arready, rvalid, rlast;
+  wire [REQID-1:0] awid, arid, bid, rid;
+  wire [7:0] awlen, arlen;
+  wire [1:0] awburst, arburst, bresp, rresp;
+  wire [27:0] awaddr, araddr;
+  wire [3:0] wstrb;
+  wire [31:0] wdata, rdata;
+
+  assign y_tkeep = 1'b1;  // Bulk OUT has no null bytes, so keep every beat
+
+  assign ddr3_conf_w = drst_n;
+  assign sys_clk = clock;
+  assign sys_rst = drst_w;
+
+  initial begin
+    drst_n <= 1'b0;
+    #1000 drst_n <= 1'b1;
+  end
+
+  memreq #(
+      .FIFO_DEPTH(2048 * 8 / 32),
+      .DATA_WIDTH(32),
+      .STROBES(4),
+      .WR_FRAME_FIFO(1)
+  ) U_MEMREQ1 (
+      .mem_clock(clock),
+      .mem_reset(drst_w),
+
+      .bus_clock(clock),
+      .bus_reset(drst_w),
+
+      .s_tvalid(y_tvalid),
+      .s_tready(y_tready),
+      .s_tkeep (y_tkeep),
+      .s_tlast (y_tlast),
+      .s_tdata (y_tdata),
+
+      .m_tvalid(x_tvalid),
+      .m_tready(x_tready),
+      .m_tkeep (x_tkeep),
+      .m_tlast (x_tlast),
+      .m_tdata (x_tdata),
+
+      .awvalid_o(awvalid),
+      .awready_i(awready),
+      .awaddr_o(awaddr),
+      .awid_o(awid),
+      .awlen_o(awlen),
+      .awburst_o(awburst),
+
+      .wvalid_o(wvalid),
+      .wready_i(wready),
+      .wlast_o (wlast),
+      .wstrb_o (wstrb),
+      .wdata_o (wdata),
+
+      .bvalid_i(bvalid),
+      .bready_o(bready),
+      .bresp_i(bresp),
+      .bid_i(bid),
+
+      .arvalid_o(arvalid),
+      .arready_i(arready),
+      .araddr_o(araddr),
+      .arid_o(arid),
+      .arlen_o(arlen),
+      .arburst_o(arburst),
+
+      .rvalid_i(rvalid),
+      .rready_o(rready),
+      .rlast_i(rlast),
+      .rresp_i(rresp),
+      .rid_i(rid),
+      .rdata_i(rdata)
+  );
+
+  axi_mem_shell #(
+      .DATA_WIDTH(32),
+      .ADDRS(28),
+      .ID_WIDTH(REQID),
+      .LATENCY(AXI_LATENCY),
+      .JITTER(AXI_JITTER)
+  ) U_AXIMEM1 (
+      .clock(clock),
+      .reset(drst_w),
+
+      .awvalid(awvalid),
+      .awready(awready),
+      .awaddr(awaddr),
+      .awid(awid),
+      .awlen(awlen),
+      .awburst(awburst),
+
+      .wvalid(wvalid),
+      .wready(wready),
+      .wlast(wlast),
+      .wstrb(wstrb),
+      .wdata(wdata),
+
+      .bvalid(bvalid),
+      .bready(bready),
+      .bresp(bresp),
+      .bid(bid),
+
+      .arvalid(arvalid),
+      .arready(arready),
+      .araddr(araddr),
+      .arid(arid),
+      .arlen(arlen),
+      .arburst(arburst),
+
+      .rvalid(rvalid),
+      .rready(rready),
+      .rlast(rlast),
+      .rresp(rresp),
+      .rid(rid),
+      .rdata(rdata)
+  );
+
+`elsif __use_ddr3_because_reasons
 
   reg drst_n = 1'b1, send_q = 1'b1;
   wire drst_w = ~drst_n;
@@ -200,7 +357,7 @@ module vpi_usb_ulpi_tb;
   wire [12:0] ddr_a;
   wire [15:0] ddr_dq;
 
-  assign y_tkeep = y_tvalid;  // Todo ...
+  assign y_tkeep = 1'b1;  // Bulk OUT has no null bytes, so keep every beat
 
   initial begin
     drst_n <= 1'b0;
@@ -285,13 +442,13 @@ module vpi_usb_ulpi_tb;
       .odt(ddr_odt)
   );
 
-`else  /* !__use_ddr3_because_reasons */
+`else  /* !__use_vpi_axi_mem && !__use_ddr3_because_reasons */
 
   assign ddr3_conf_w = 1'b0;
   assign sys_clk = clk25;
   assign sys_rst = 1'b0;
 
-`endif  /* !__use_ddr3_because_reasons */
+`endif  /* !__use_vpi_axi_mem && !__use_ddr3_because_reasons */
 
 
 endmodule  /* vpi_usb_ulpi_tb */
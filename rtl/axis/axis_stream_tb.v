@@ -0,0 +1,214 @@
+`timescale 1ns / 100ps
+/**
+ * Exercises, and measures the throughput of, several AXI4-Stream cores using
+ * the '$axis_source', '$axis_sink', and '$axis_monitor' VPI tasks. Run with:
+ *   vvp -M../vpi -mulpisim ./axis_stream_tb.out
+ */
+module axis_stream_tb;
+
+  localparam integer PACKETS = 200;
+  localparam integer MAXLEN = 64;
+
+
+  // -- Simulation Data -- //
+
+  initial begin
+    $dumpfile("axis_stream_tb.vcd");
+    $dumpvars;
+
+    #2000000 $finish;  // timeout, as the sinks finish once all data is checked
+  end
+
+
+  // -- Globals -- //
+
+  reg clock = 1'b1;
+  reg reset = 1'b1;
+
+  always #5 clock <= ~clock;
+
+  initial begin
+    #20 reset <= 1'b0;
+  end
+
+
+  //
+  //  Skid-register (8-bit), at full-rate
+  ///
+
+  reg skid_s_tvalid, skid_s_tlast, skid_m_tready;
+  reg [7:0] skid_s_tdata;
+  wire skid_s_tready, skid_m_tvalid, skid_m_tlast;
+  wire [7:0] skid_m_tdata;
+
+  initial begin
+    $axis_source(clock, reset, "skid_s", PACKETS, 100, MAXLEN);
+    $axis_sink(clock, reset, "skid_m", "skid_s", 100);
+  end
+
+  axis_skid #(
+      .BYPASS(0),
+      .WIDTH (8)
+  ) U_SKID1 (
+      .clock(clock),
+      .reset(reset),
+
+      .s_tvalid(skid_s_tvalid),
+      .s_tready(skid_s_tready),
+      .s_tlast (skid_s_tlast),
+      .s_tdata (skid_s_tdata),
+
+      .m_tvalid(skid_m_tvalid),
+      .m_tready(skid_m_tready),
+      .m_tlast (skid_m_tlast),
+      .m_tdata (skid_m_tdata)
+  );
+
+
+  //
+  //  Synchronous FIFO (8-bit), with random back-pressure
+  ///
+
+  reg sync_s_tvalid, sync_m_tready;
+  reg [7:0] sync_s_tdata;
+  wire sync_s_tready, sync_m_tvalid;
+  wire [7:0] sync_m_tdata;
+
+  initial begin
+    $axis_source(clock, reset, "sync_s", PACKETS, 80, 1);
+    $axis_sink(clock, reset, "sync_m", "sync_s", 50);
+  end
+
+  sync_fifo #(
+      .OUTREG(1),
+      .WIDTH (8),
+      .ABITS (4)
+  ) U_SYNC1 (
+      .clock(clock),
+      .reset(reset),
+
+      .level_o(),
+
+      .valid_i(sync_s_tvalid),
+      .ready_o(sync_s_tready),
+      .data_i (sync_s_tdata),
+
+      .valid_o(sync_m_tvalid),
+      .ready_i(sync_m_tready),
+      .data_o (sync_m_tdata)
+  );
+
+
+  //
+  //  AXI4-Stream FIFO (32-bit), with 'tkeep', 'tlast', 'tuser', and 'tid'
+  ///
+
+  reg fifo_s_tvalid, fifo_s_tlast, fifo_m_tready;
+  reg [31:0] fifo_s_tdata;
+  reg [3:0] fifo_s_tkeep;
+  reg [0:0] fifo_s_tuser;
+  reg [7:0] fifo_s_tid;
+  wire fifo_s_tready, fifo_m_tvalid, fifo_m_tlast;
+  wire [31:0] fifo_m_tdata;
+  wire [3:0] fifo_m_tkeep;
+  wire [0:0] fifo_m_tuser;
+  wire [7:0] fifo_m_tid;
+
+  initial begin
+    $axis_source(clock, reset, "fifo_s", PACKETS, 90, MAXLEN);
+    $axis_sink(clock, reset, "fifo_m", "fifo_s", 70);
+    $axis_monitor(clock, reset, "fifo_m");
+  end
+
+  axis_fifo #(
+      .DEPTH(64),
+      .DATA_WIDTH(32),
+      .KEEP_ENABLE(1),
+      .LAST_ENABLE(1),
+      .ID_ENABLE(1),
+      .ID_WIDTH(8),
+      .DEST_ENABLE(0),
+      .USER_ENABLE(1),
+      .USER_WIDTH(1),
+      .FRAME_FIFO(0)
+  ) U_FIFO1 (
+      .clk(clock),
+      .rst(reset),
+
+      .s_axis_tdata (fifo_s_tdata),
+      .s_axis_tkeep (fifo_s_tkeep),
+      .s_axis_tvalid(fifo_s_tvalid),
+      .s_axis_tready(fifo_s_tready),
+      .s_axis_tlast (fifo_s_tlast),
+      .s_axis_tid   (fifo_s_tid),
+      .s_axis_tdest (8'd0),
+      .s_axis_tuser (fifo_s_tuser),
+
+      .m_axis_tdata (fifo_m_tdata),
+      .m_axis_tkeep (fifo_m_tkeep),
+      .m_axis_tvalid(fifo_m_tvalid),
+      .m_axis_tready(fifo_m_tready),
+      .m_axis_tlast (fifo_m_tlast),
+      .m_axis_tid   (fifo_m_tid),
+      .m_axis_tdest (),
+      .m_axis_tuser (fifo_m_tuser),
+
+      .pause_req(1'b0),
+      .pause_ack(),
+
+      .status_depth(),
+      .status_depth_commit(),
+      .status_overflow(),
+      .status_bad_frame(),
+      .status_good_frame()
+  );
+
+
+  //
+  //  Width-adapter (32-bit to 8-bit)
+  ///
+
+  reg adapt_s_tvalid, adapt_s_tlast, adapt_m_tready;
+  reg [31:0] adapt_s_tdata;
+  reg [3:0] adapt_s_tkeep;
+  wire adapt_s_tready, adapt_m_tvalid, adapt_m_tlast;
+  wire [7:0] adapt_m_tdata;
+
+  initial begin
+    $axis_source(clock, reset, "adapt_s", PACKETS, 100, MAXLEN);
+    $axis_sink(clock, reset, "adapt_m", "adapt_s", 100);
+  end
+
+  axis_adapter #(
+      .S_DATA_WIDTH(32),
+      .S_KEEP_ENABLE(1),
+      .M_DATA_WIDTH(8),
+      .M_KEEP_ENABLE(0),
+      .ID_ENABLE(0),
+      .DEST_ENABLE(0),
+      .USER_ENABLE(0)
+  ) U_ADAPT1 (
+      .clk(clock),
+      .rst(reset),
+
+      .s_axis_tdata (adapt_s_tdata),
+      .s_axis_tkeep (adapt_s_tkeep),
+      .s_axis_tvalid(adapt_s_tvalid),
+      .s_axis_tready(adapt_s_tready),
+      .s_axis_tlast (adapt_s_tlast),
+      .s_axis_tid   (8'd0),
+      .s_axis_tdest (8'd0),
+      .s_axis_tuser (1'b0),
+
+      .m_axis_tdata (adapt_m_tdata),
+      .m_axis_tkeep (),
+      .m_axis_tvalid(adapt_m_tvalid),
+      .m_axis_tready(adapt_m_tready),
+      .m_axis_tlast (adapt_m_tlast),
+      .m_axis_tid   (),
+      .m_axis_tdest (),
+      .m_axis_tuser ()
+  );
+
+
+endmodule  // axis_stream_tb
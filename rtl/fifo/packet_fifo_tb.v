@@ -13,10 +13,12 @@ module packet_fifo_tb;
   // -- Simulation Data -- //
 
   initial begin
-    $dumpfile("packet_fifo_tb.vcd");
-    $dumpvars;
+    if ($test$plusargs("dump")) begin
+      $dumpfile("packet_fifo_tb.vcd");
+      $dumpvars;
+    end
 
-    #8000 $finish;  // todo ...
+    #2000000 $finish;  // timeout, as '$packet_tb' finishes once all tests pass
   end
 
 
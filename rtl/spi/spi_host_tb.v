@@ -0,0 +1,156 @@
+`timescale 1ns / 100ps
+/**
+ * Measures the register-access throughput, and latency, of 'spi_target', at
+ * several SCK ratios, using the '$spi_host' VPI model (see 'vpi/spi_host.h'),
+ * and a register-file on the AXI4-Stream side of the target. Run with:
+ *   vvp -M../vpi -mulpisim ./spi_host_tb.out
+ */
+module spi_host_tb;
+
+  parameter [7:0] HEADER = 8'ha7;
+  parameter [6:0] STATUS = 7'h3c;
+  parameter integer SPI_MODE = 0;
+
+  localparam [7:0] MARKER = 8'h5a;
+  localparam [7:0] IDLE = 8'hff;
+
+
+  // -- Simulation Data -- //
+
+  initial begin
+    if ($test$plusargs("dump")) begin
+      $dumpfile("spi_host_tb.vcd");
+      $dumpvars;
+    end
+
+    #10000000 $finish;  // timeout, as '$spi_host' finishes once all tests pass
+  end
+
+
+  // -- Globals -- //
+
+  reg clock = 1'b1;
+  reg reset = 1'b1;
+
+  always #5 clock <= ~clock;
+
+  initial begin
+    #20 reset <= 1'b0;
+  end
+
+
+  // -- SPI Host -- //
+
+  reg SCK, SSEL, MOSI;
+  wire MISO;
+
+  initial begin
+    $spi_host(clock, reset, SPI_MODE, 1);
+  end
+
+
+  //
+  //  Register-File
+  ///
+  // Parses '{RnW, addr[6:0]}, {count - 1}, data ..' commands, where the MOSI
+  // filler-bytes are no-op commands, and responds to reads with a marker, then
+  // the register values.
+  localparam [1:0] ST_CMD = 2'd0, ST_LEN = 2'd1, ST_DATA = 2'd2;
+
+  reg [1:0] state;
+  reg [7:0] regs[0:127];
+  reg [6:0] addr, raddr;
+  reg [7:0] count;
+  reg [8:0] rcount;
+  reg rnw, mark;
+
+  wire rvalid, fetch;
+  wire [7:0] rdata, tdata;
+  wire overflow, underrun;
+
+  assign tdata = mark ? MARKER : rcount != 9'd0 ? regs[raddr] : IDLE;
+
+  integer i;
+
+  initial begin
+    for (i = 0; i < 128; i = i + 1) begin
+      regs[i] = 8'h00;
+    end
+  end
+
+  always @(posedge clock) begin
+    if (reset) begin
+      state  <= ST_CMD;
+      mark   <= 1'b0;
+      rcount <= 9'd0;
+    end else begin
+      if (fetch && mark) begin
+        mark <= 1'b0;
+      end else if (fetch && rcount != 9'd0) begin
+        raddr  <= raddr + 7'd1;
+        rcount <= rcount - 9'd1;
+      end
+
+      if (rvalid) begin
+        case (state)
+          ST_CMD:
+          if (rdata != IDLE) begin
+            rnw   <= rdata[7];
+            addr  <= rdata[6:0];
+            state <= ST_LEN;
+          end
+          ST_LEN:
+          if (rnw) begin
+            mark   <= 1'b1;
+            raddr  <= addr;
+            rcount <= {1'b0, rdata} + 9'd1;
+            state  <= ST_CMD;
+          end else begin
+            count <= rdata;
+            state <= ST_DATA;
+          end
+          default: begin
+            regs[addr] <= rdata;
+            addr <= addr + 7'd1;
+            count <= count - 8'd1;
+            state <= count == 8'd0 ? ST_CMD : ST_DATA;
+          end
+        endcase
+      end
+    end
+  end
+
+
+  // -- Core Under Test -- //
+
+  spi_target #(
+      .WIDTH(8),
+      .HEADER(HEADER),
+      .BYTES(16),
+      .SPI_CPOL(SPI_MODE >> 1),
+      .SPI_CPHA(SPI_MODE & 1)
+  ) U_SPI_TARGET1 (
+      .clock(clock),
+      .reset(reset),
+
+      .status_i  (STATUS),
+      .overflow_o(overflow),
+      .underrun_o(underrun),
+
+      .s_tvalid(1'b1),
+      .s_tready(fetch),
+      .s_tlast (1'b0),
+      .s_tdata (tdata),
+
+      .m_tvalid(rvalid),
+      .m_tready(1'b1),
+      .m_tdata (rdata),
+
+      .SCK_pin(SCK),
+      .SSEL(SSEL),
+      .MOSI(MOSI),
+      .MISO(MISO)
+  );
+
+
+endmodule  // spi_host_tb
@@ -0,0 +1,83 @@
+`timescale 1ns / 100ps
+/**
+ * Measures the echo throughput, and the error-recovery, of 'uart', from
+ * console rates up to 12.5 Mbaud, using the '$uart_peer' VPI model (see
+ * 'vpi/uart_peer.h'), with the received bytes looped back to the transmitter.
+ * Run with:
+ *   vvp -M../vpi -mulpisim ./uart_peer_tb.out
+ */
+module uart_peer_tb;
+
+  parameter integer PARITY = 0;  // 0 (none), 1 (even), or 2 (odd)
+
+  localparam integer CLOCK_HZ = 100000000;
+  localparam integer WIDTH = PARITY != 0 ? 9 : 8;  // parity is echoed, as data
+
+
+  // -- Simulation Data -- //
+
+  initial begin
+    if ($test$plusargs("dump")) begin
+      $dumpfile("uart_peer_tb.vcd");
+      $dumpvars;
+    end
+
+    #20000000 $finish;  // timeout, as '$uart_peer' finishes once all tests pass
+  end
+
+
+  // -- Globals -- //
+
+  reg clock = 1'b1;
+  reg reset = 1'b1;
+
+  always #5 clock <= ~clock;
+
+  initial begin
+    #20 reset <= 1'b0;
+  end
+
+
+  // -- UART Peer -- //
+
+  reg rxd = 1'b1;
+  reg [15:0] prescale = 16'd1;
+  wire txd, tx_busy, rx_busy, rx_overrun_error, rx_frame_error;
+
+  initial begin
+    #100 $uart_peer(CLOCK_HZ, PARITY, 1);
+  end
+
+
+  // -- Core Under Test -- //
+
+  wire tvalid, tready;
+  wire [WIDTH-1:0] tdata;
+
+  uart #(
+      .DATA_WIDTH(WIDTH)
+  ) U_UART1 (
+      .clk(clock),
+      .rst(reset),
+
+      .s_axis_tdata (tdata),
+      .s_axis_tvalid(tvalid),
+      .s_axis_tready(tready),
+
+      .m_axis_tdata (tdata),
+      .m_axis_tvalid(tvalid),
+      .m_axis_tready(tready),
+
+      .rxd(rxd),
+      .txd(txd),
+
+      .tx_busy(tx_busy),
+      .rx_busy(rx_busy),
+      .rx_overrun_error(rx_overrun_error),
+      .rx_frame_error(rx_frame_error),
+
+      .prescale(prescale)
+  );
+
+
+endmodule  // uart_peer_tb
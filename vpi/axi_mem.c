@@ -0,0 +1,615 @@
+#include "axi_mem.h"
+#include "ulpivpi.h"
+
+#include <vpi_user.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define AXI_LATENCY_PLUSARG "+axi_latency="
+#define AXI_JITTER_PLUSARG  "+axi_jitter="
+#define AXI_SEED_PLUSARG    "+axi_seed="
+#define AXI_PRELOAD_PLUSARG "+axi_preload="
+#define AXI_BASE_PLUSARG    "+axi_base="
+#define AXI_DUMP_PLUSARG    "+axi_dump="
+
+/**
+ * Table of AXI4 signals, and which of them the slave drives.
+ */
+typedef struct {
+    const char* name;
+    bool required;
+    bool slave;
+} axi_sig_info_t;
+
+static const axi_sig_info_t axi_sigs[AXI_NUM_SIGS] = {
+    {"awvalid", true,  false},
+    {"awready", true,  true },
+    {"awaddr",  true,  false},
+    {"awid",    false, false},
+    {"awlen",   true,  false},
+    {"awburst", false, false},
+    {"wvalid",  true,  false},
+    {"wready",  true,  true },
+    {"wlast",   true,  false},
+    {"wstrb",   true,  false},
+    {"wdata",   true,  false},
+    {"bvalid",  true,  true },
+    {"bready",  true,  false},
+    {"bresp",   true,  true },
+    {"bid",     false, true },
+    {"arvalid", true,  false},
+    {"arready", true,  true },
+    {"araddr",  true,  false},
+    {"arid",    false, false},
+    {"arlen",   true,  false},
+    {"arburst", false, false},
+    {"rvalid",  true,  true },
+    {"rready",  true,  false},
+    {"rlast",   true,  true },
+    {"rresp",   true,  true },
+    {"rid",     false, true },
+    {"rdata",   true,  true },
+};
+
+static axi_mem_t* axi_mems[AXI_MEM_MAX_PORTS];
+static int axi_num_mems = 0;
+
+
+// -- Helpers -- //
+
+static int axi_mem_error(const char* reason)
+{
+    vpi_printf("ERROR: $axi_mem %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+static uint32_t axi_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static bool axi_bit(const axi_mem_t* mem, axi_sig_t sig)
+{
+    return mem->sigs[sig] != NULL && (mem->vals[sig].a[0] & 1) && !(mem->vals[sig].b[0] & 1);
+}
+
+static uint32_t axi_value(const axi_mem_t* mem, axi_sig_t sig, uint32_t def)
+{
+    return mem->sigs[sig] != NULL ? mem->vals[sig].a[0] : def;
+}
+
+static void axi_vec_set(axi_mem_t* mem, axi_sig_t sig, uint32_t value)
+{
+    const uint32_t width = mem->width[sig];
+    axi_vec_t* vec = &mem->next[sig];
+
+    memset(vec, 0, sizeof(axi_vec_t));
+    vec->a[0] = width < 32 ? value & ((1u << width) - 1) : value;
+}
+
+static uint32_t axi_latency(axi_mem_t* mem)
+{
+    return mem->latency + (mem->jitter > 0 ? axi_rand(&mem->rng) % (mem->jitter + 1) : 0);
+}
+
+static uint32_t axi_plusarg(const char* name, uint32_t def)
+{
+    const char* arg = ulpi_plusarg(name, NULL);
+    return arg != NULL ? (uint32_t)strtoul(arg, NULL, 0) : def;
+}
+
+
+// -- Burst Queues -- //
+
+static axi_xact_t* axi_head(axi_queue_t* q)
+{
+    return q->count > 0 ? &q->xacts[q->head] : NULL;
+}
+
+static axi_xact_t* axi_push(axi_queue_t* q)
+{
+    axi_xact_t* x = &q->xacts[(q->head + q->count) % AXI_MEM_QUEUE];
+    q->count++;
+    return x;
+}
+
+static void axi_pop(axi_queue_t* q)
+{
+    q->head = (q->head + 1) % AXI_MEM_QUEUE;
+    q->count--;
+}
+
+/**
+ * Byte-address of a beat, aligned to the data-width, for each burst-type.
+ */
+static uint32_t axi_beat_addr(const axi_mem_t* mem, const axi_xact_t* x)
+{
+    const uint32_t base = x->addr & ~(mem->nbytes - 1);
+    uint32_t addr;
+
+    if (x->burst == AxiFixed) {
+        addr = base;
+    } else if (x->burst == AxiWrap) {
+        const uint32_t size = x->len * mem->nbytes;
+        const uint32_t wrap = x->addr & ~(size - 1);
+        addr = wrap + ((base - wrap + x->beat * mem->nbytes) & (size - 1));
+    } else {
+        addr = base + x->beat * mem->nbytes;
+    }
+
+    return addr & SHADOW_ADDR_MASK;
+}
+
+static void axi_accept(axi_mem_t* mem, axi_queue_t* q, axi_sig_t addr, axi_sig_t id,
+                       axi_sig_t len, axi_sig_t burst)
+{
+    axi_xact_t* x = axi_push(q);
+
+    x->addr  = axi_value(mem, addr, 0);
+    x->id    = axi_value(mem, id, 0);
+    x->len   = (uint16_t)(axi_value(mem, len, 0) & 0xFF) + 1;
+    x->burst = (axi_burst_t)axi_value(mem, burst, AxiIncr);
+    x->beat  = 0;
+    x->start = mem->cycle;
+    x->due   = mem->cycle + axi_latency(mem);
+}
+
+static void axi_stats_done(axi_mem_stats_t* st, const axi_xact_t* x, uint64_t cycle)
+{
+    const uint32_t lat = (uint32_t)(cycle - x->start);
+
+    st->lat_min = st->bursts == 0 || lat < st->lat_min ? lat : st->lat_min;
+    st->lat_max = lat > st->lat_max ? lat : st->lat_max;
+    st->latency += lat;
+    st->bursts++;
+}
+
+
+// -- Signal Values -- //
+
+static void axi_fetch_values(axi_mem_t* mem)
+{
+    s_vpi_value value;
+
+    for (int i=0; i<AXI_NUM_SIGS; i++) {
+        if (mem->sigs[i] == NULL) {
+            continue;
+        }
+        const uint32_t words = (mem->width[i] + 31) >> 5;
+        value.format = vpiVectorVal;
+        vpi_get_value(mem->sigs[i], &value);
+        for (uint32_t j=0; j<words; j++) {
+            mem->vals[i].a[j] = (uint32_t)value.value.vector[j].aval;
+            mem->vals[i].b[j] = (uint32_t)value.value.vector[j].bval;
+        }
+    }
+}
+
+/**
+ * Drive the slave's signals that have changed.
+ */
+static void axi_update_values(axi_mem_t* mem)
+{
+    s_vpi_vecval vec[AXI_MEM_MAX_WORDS];
+    s_vpi_value value;
+
+    for (int i=0; i<AXI_NUM_SIGS; i++) {
+        if (!axi_sigs[i].slave || mem->sigs[i] == NULL ||
+            memcmp(&mem->vals[i], &mem->next[i], sizeof(axi_vec_t)) == 0) {
+            continue;
+        }
+
+        const uint32_t words = (mem->width[i] + 31) >> 5;
+        for (uint32_t j=0; j<words; j++) {
+            vec[j].aval = (PLI_INT32)mem->next[i].a[j];
+            vec[j].bval = (PLI_INT32)mem->next[i].b[j];
+        }
+        value.format = vpiVectorVal;
+        value.value.vector = vec;
+        vpi_put_value(mem->sigs[i], &value, NULL, vpiNoDelay);
+        memcpy(&mem->vals[i], &mem->next[i], sizeof(axi_vec_t));
+    }
+}
+
+
+// -- Channels -- //
+
+/**
+ * Store the bytes of a W beat, that are enabled by 'wstrb'.
+ */
+static void axi_write_beat(axi_mem_t* mem, axi_xact_t* x)
+{
+    const uint32_t addr = axi_beat_addr(mem, x);
+    const axi_vec_t* data = &mem->vals[AXI_WDATA];
+    const axi_vec_t* strb = &mem->vals[AXI_WSTRB];
+
+    for (uint32_t i=0; i<mem->nbytes; i++) {
+        if ((strb->a[i >> 5] >> (i & 31) & 1) != 0) {
+            const uint8_t byte = (uint8_t)(data->a[i >> 2] >> ((i & 3) << 3));
+            shadow_store(&mem->mem, addr + i, &byte, 1);
+        }
+    }
+    mem->wr.beats++;
+    mem->wr.bytes += mem->nbytes;
+}
+
+static void axi_read_beat(axi_mem_t* mem, const axi_xact_t* x)
+{
+    uint8_t data[AXI_MEM_MAX_BYTES];
+    uint8_t known[AXI_MEM_MAX_BYTES];
+    axi_vec_t* vec = &mem->next[AXI_RDATA];
+
+    shadow_read(&mem->mem, axi_beat_addr(mem, x), data, known, mem->nbytes);
+    memset(vec, 0, sizeof(axi_vec_t));
+    for (uint32_t i=0; i<mem->nbytes; i++) {
+        vec->a[i >> 2] |= (uint32_t)data[i] << ((i & 3) << 3);
+    }
+}
+
+/**
+ * Process the handshakes of the sampled values, then compute the outputs for
+ * the next cycle.
+ */
+static void axi_mem_step(axi_mem_t* mem)
+{
+    axi_xact_t* x;
+
+    // Write address, data, and response channels
+    if (axi_bit(mem, AXI_AWVALID) && axi_bit(mem, AXI_AWREADY)) {
+        axi_accept(mem, &mem->aw, AXI_AWADDR, AXI_AWID, AXI_AWLEN, AXI_AWBURST);
+    }
+    if (axi_bit(mem, AXI_WVALID) && axi_bit(mem, AXI_WREADY) && (x = axi_head(&mem->aw)) != NULL) {
+        axi_write_beat(mem, x);
+        if (++x->beat == x->len || axi_bit(mem, AXI_WLAST)) {
+            axi_xact_t* b = axi_push(&mem->b);
+            memcpy(b, x, sizeof(axi_xact_t));
+            b->due = mem->cycle + axi_latency(mem);
+            axi_pop(&mem->aw);
+        }
+    }
+    if (axi_bit(mem, AXI_BVALID)) {
+        if (axi_bit(mem, AXI_BREADY)) {
+            axi_stats_done(&mem->wr, axi_head(&mem->b), mem->cycle);
+            axi_pop(&mem->b);
+        } else {
+            mem->wr.stalls++;
+        }
+    }
+
+    // Read address, and data, channels
+    if (axi_bit(mem, AXI_ARVALID) && axi_bit(mem, AXI_ARREADY)) {
+        axi_accept(mem, &mem->ar, AXI_ARADDR, AXI_ARID, AXI_ARLEN, AXI_ARBURST);
+    }
+    if (axi_bit(mem, AXI_RVALID)) {
+        if (axi_bit(mem, AXI_RREADY)) {
+            x = axi_head(&mem->ar);
+            if (x->beat == 0) {
+                axi_stats_done(&mem->rd, x, mem->cycle);
+            }
+            mem->rd.beats++;
+            mem->rd.bytes += mem->nbytes;
+            if (++x->beat == x->len) {
+                axi_pop(&mem->ar);
+            }
+        } else {
+            mem->rd.stalls++;
+        }
+    }
+
+    // Outputs, for the next cycle
+    axi_vec_set(mem, AXI_AWREADY, mem->aw.count + mem->b.count < AXI_MEM_QUEUE - 1);
+    axi_vec_set(mem, AXI_WREADY, mem->aw.count > 0);
+
+    x = axi_head(&mem->b);
+    axi_vec_set(mem, AXI_BVALID, x != NULL && x->due <= mem->cycle);
+    axi_vec_set(mem, AXI_BID, x != NULL ? x->id : 0);
+    axi_vec_set(mem, AXI_BRESP, 0);
+
+    axi_vec_set(mem, AXI_ARREADY, mem->ar.count < AXI_MEM_QUEUE - 1);
+    x = axi_head(&mem->ar);
+    if (x != NULL && x->due <= mem->cycle) {
+        axi_vec_set(mem, AXI_RVALID, 1);
+        axi_vec_set(mem, AXI_RLAST, x->beat + 1 == x->len);
+        axi_vec_set(mem, AXI_RID, x->id);
+        axi_read_beat(mem, x);
+    } else {
+        axi_vec_set(mem, AXI_RVALID, 0);
+        axi_vec_set(mem, AXI_RLAST, 0);
+    }
+    axi_vec_set(mem, AXI_RRESP, 0);
+}
+
+static void axi_mem_idle(axi_mem_t* mem)
+{
+    memset(&mem->aw, 0, sizeof(axi_queue_t));
+    memset(&mem->b, 0, sizeof(axi_queue_t));
+    memset(&mem->ar, 0, sizeof(axi_queue_t));
+
+    for (int i=0; i<AXI_NUM_SIGS; i++) {
+        if (axi_sigs[i].slave && mem->sigs[i] != NULL) {
+            axi_vec_set(mem, (axi_sig_t)i, 0);
+        }
+    }
+}
+
+
+// -- Reporting -- //
+
+static void axi_report_stats(const char* name, const char* dir, const axi_mem_stats_t* st)
+{
+    vpi_printf("AXI\t%s: %-5s %8lu bursts %10lu beats %10lu bytes  latency: %u/%.1f/%u  stalls: %lu\n",
+               name, dir, st->bursts, st->beats, st->bytes, st->lat_min,
+               st->bursts > 0 ? (double)st->latency / (double)st->bursts : 0.0,
+               st->lat_max, st->stalls);
+}
+
+static int cb_axi_mem_end(p_cb_data cb_data)
+{
+    const char* dump = ulpi_plusarg(AXI_DUMP_PLUSARG, NULL);
+
+    for (int i=0; i<axi_num_mems; i++) {
+        axi_mem_t* mem = axi_mems[i];
+
+        vpi_printf("AXI\t%s: %lu cycles, latency: %u (+0..%u), %u pages (%lu bytes)\n",
+                   mem->name, mem->cycle, mem->latency, mem->jitter, mem->mem.pages,
+                   shadow_bytes(&mem->mem));
+        axi_report_stats(mem->name, "write", &mem->wr);
+        axi_report_stats(mem->name, "read", &mem->rd);
+
+        if (dump != NULL && i == 0) {
+            const long bytes = shadow_dump(&mem->mem, dump);
+            if (bytes < 0) {
+                vpi_printf("ERROR: $axi_mem (%s) failed to write '%s'\n", mem->name, dump);
+            } else {
+                vpi_printf("AXI\t%s: dumped %ld bytes to '%s'\n", mem->name, bytes, dump);
+            }
+        }
+        shadow_free(&mem->mem);
+        free(mem);
+    }
+    axi_num_mems = 0;
+
+    return 0;
+}
+
+
+//
+//  VPI Callbacks
+///
+
+static int cb_axi_mem_sync(p_cb_data cb_data)
+{
+    axi_mem_t* mem = (axi_mem_t*)cb_data->user_data;
+    s_vpi_value value;
+
+    value.format = vpiScalarVal;
+    vpi_get_value(mem->reset, &value);
+    memcpy(mem->next, mem->vals, sizeof(mem->next));
+
+    if (value.value.scalar != vpi0) {
+        axi_mem_idle(mem);
+    } else {
+        mem->cycle++;
+        axi_mem_step(mem);
+    }
+
+    axi_update_values(mem);
+
+    return 0;
+}
+
+/**
+ * Event-handler for every posedge-clock event.
+ */
+static int cb_axi_mem_clock(p_cb_data cb_data)
+{
+    axi_mem_t* mem = (axi_mem_t*)cb_data->user_data;
+    s_vpi_value x;
+
+    x.format = vpiIntVal;
+    vpi_get_value(mem->clock, &x);
+    if (x.value.integer != 1) {
+        return 0;
+    }
+
+    // Capture the AXI4 signals at the time of the clock-edge
+    axi_fetch_values(mem);
+
+    s_vpi_time t;
+    t.type       = vpiSimTime;
+    t.high       = 0;
+    t.low        = 0;
+
+    s_cb_data cb;
+    cb.reason    = cbReadWriteSynch;
+    cb.cb_rtn    = cb_axi_mem_sync;
+    cb.user_data = (PLI_BYTE8*)mem;
+    cb.time      = &t;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+static uint32_t axi_get_int(vpiHandle* iter, uint32_t def)
+{
+    vpiHandle arg;
+    s_vpi_value value;
+
+    if (*iter == NULL || (arg = vpi_scan(*iter)) == NULL) {
+        *iter = NULL;
+        return def;
+    }
+    value.format = vpiIntVal;
+    vpi_get_value(arg, &value);
+
+    return (uint32_t)value.value.integer;
+}
+
+static int axi_set_handles(axi_mem_t* mem, vpiHandle scope)
+{
+    for (int i=0; i<AXI_NUM_SIGS; i++) {
+        mem->sigs[i] = vpi_handle_by_name((PLI_BYTE8*)axi_sigs[i].name, scope);
+        if (mem->sigs[i] == NULL) {
+            if (axi_sigs[i].required) {
+                vpi_printf("ERROR: $axi_mem signal '%s.%s' not found\n", mem->name, axi_sigs[i].name);
+                return axi_mem_error("missing signal");
+            }
+            continue;
+        }
+        mem->width[i] = (uint32_t)vpi_get(vpiSize, mem->sigs[i]);
+        if (mem->width[i] > (i == AXI_WDATA || i == AXI_RDATA ? AXI_MEM_MAX_WIDTH : 32)) {
+            vpi_printf("ERROR: $axi_mem signal '%s.%s' is too wide\n", mem->name, axi_sigs[i].name);
+            return axi_mem_error("signal too wide");
+        }
+    }
+
+    mem->nbytes = mem->width[AXI_WDATA] / 8;
+    if (mem->width[AXI_RDATA] != mem->width[AXI_WDATA] || mem->nbytes == 0 ||
+        (mem->nbytes & (mem->nbytes - 1)) != 0) {
+        return axi_mem_error("'wdata' and 'rdata' must be the same (power of 2) bytes wide");
+    } else if (mem->width[AXI_WSTRB] != mem->nbytes) {
+        return axi_mem_error("'wstrb' must have one bit per byte of 'wdata'");
+    }
+
+    return 1;
+}
+
+/**
+ * Populates the memory data-structure before the Verilog simulation starts.
+ */
+static int axi_mem_compiletf(char* user_data)
+{
+    vpiHandle systf_handle, arg_iterator, scope;
+    const char* preload = ulpi_plusarg(AXI_PRELOAD_PLUSARG, NULL);
+    axi_mem_t* mem;
+
+    if (axi_num_mems >= AXI_MEM_MAX_PORTS) {
+        return axi_mem_error("too many AXI4 memories");
+    }
+
+    systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    if (systf_handle == NULL) {
+        return axi_mem_error("failed to obtain systf handle");
+    }
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    if (arg_iterator == NULL) {
+        return axi_mem_error("requires at least 2 arguments");
+    }
+
+    mem = (axi_mem_t*)malloc(sizeof(axi_mem_t));
+    memset(mem, 0, sizeof(axi_mem_t));
+
+    if ((mem->clock = vpi_scan(arg_iterator)) == NULL ||
+        (mem->reset = vpi_scan(arg_iterator)) == NULL) {
+        free(mem);
+        return axi_mem_error("requires at least 2 arguments");
+    }
+
+    mem->latency = axi_plusarg(AXI_LATENCY_PLUSARG, axi_get_int(&arg_iterator, 8));
+    mem->jitter = axi_plusarg(AXI_JITTER_PLUSARG, axi_get_int(&arg_iterator, 0));
+    mem->seed = axi_plusarg(AXI_SEED_PLUSARG, axi_get_int(&arg_iterator, 1 + axi_num_mems));
+    mem->latency = mem->latency > 0 ? mem->latency : 1;
+    mem->rng = mem->seed != 0 ? mem->seed : 1;
+
+    if (arg_iterator != NULL && vpi_scan(arg_iterator) != NULL) {
+        vpi_free_object(arg_iterator);
+        free(mem);
+        return axi_mem_error("too many arguments");
+    }
+
+    scope = vpi_handle(vpiScope, systf_handle);
+    snprintf(mem->name, AXI_MEM_MAX_NAME, "%s", vpi_get_str(vpiFullName, scope));
+    if (!axi_set_handles(mem, scope)) {
+        free(mem);
+        return 0;
+    }
+
+    shadow_init(&mem->mem);
+    if (preload != NULL && axi_num_mems == 0) {
+        const uint32_t base = axi_plusarg(AXI_BASE_PLUSARG, 0);
+        const long bytes = shadow_load(&mem->mem, preload, base);
+        if (bytes < 0) {
+            shadow_free(&mem->mem);
+            free(mem);
+            return axi_mem_error("preload failed");
+        }
+        vpi_printf("AXI\t%s: preloaded %ld bytes from '%s'\n", mem->name, bytes, preload);
+    }
+
+    axi_mems[axi_num_mems++] = mem;
+
+    if (axi_num_mems == 1) {
+        s_cb_data cb;
+        cb.reason    = cbEndOfSimulation;
+        cb.cb_rtn    = cb_axi_mem_end;
+        cb.user_data = NULL;
+        cb.time      = NULL;
+        cb.value     = NULL;
+        cb.obj       = NULL;
+
+        vpiHandle cb_handle = vpi_register_cb(&cb);
+        vpi_free_object(cb_handle);
+    }
+
+    vpi_put_userdata(systf_handle, (void*)mem);
+
+    return 0;
+}
+
+/**
+ * Start processing clock-events.
+ */
+static int axi_mem_calltf(char* user_data)
+{
+    vpiHandle systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    axi_mem_t* mem = (axi_mem_t*)vpi_get_userdata(systf_handle);
+    s_vpi_value x;
+    s_vpi_time t;
+    s_cb_data cb;
+
+    if (mem == NULL) {
+        return axi_mem_error("'*mem' problem");
+    }
+
+    vpi_printf("AXI\t%s: %u-bit, latency: %u (+0..%u) cycles\n", mem->name,
+               mem->width[AXI_WDATA], mem->latency, mem->jitter);
+
+    t.type       = vpiSuppressTime;
+    x.format     = vpiSuppressVal;
+    cb.reason    = cbValueChange;
+    cb.cb_rtn    = cb_axi_mem_clock;
+    cb.time      = &t;
+    cb.value     = &x;
+    cb.user_data = (PLI_BYTE8*)mem;
+    cb.obj       = mem->clock;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+void axi_mem_register(void)
+{
+    s_vpi_systf_data tf_data;
+    tf_data.type      = vpiSysTask;
+    tf_data.tfname    = "$axi_mem";
+    tf_data.calltf    = axi_mem_calltf;
+    tf_data.compiletf = axi_mem_compiletf;
+    tf_data.sizetf    = NULL;
+    tf_data.user_data = NULL;
+    vpi_register_systf(&tf_data);
+}
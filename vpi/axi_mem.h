@@ -0,0 +1,130 @@
+#ifndef __AXI_MEM_H__
+#define __AXI_MEM_H__
+
+
+#include "usb/ddr3shadow.h"
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Transaction-level AXI4 memory (slave), with C-side storage, and a fixed (or
+ * random) latency, so that testbenches can replace a memory controller, its
+ * PHY, and the SDRAM model, when the memory timing does not matter.
+ * The AXI4 signals are found (by name) in the scope of the calling module:
+ *  - 'awvalid', 'awready', 'awaddr', 'awid', 'awlen', 'awburst';
+ *  - 'wvalid', 'wready', 'wlast', 'wstrb', 'wdata';
+ *  - 'bvalid', 'bready', 'bresp', 'bid';
+ *  - 'arvalid', 'arready', 'araddr', 'arid', 'arlen', 'arburst';
+ *  - 'rvalid', 'rready', 'rlast', 'rresp', 'rid', 'rdata';
+ * where the slave drives the 'ready's of the AW, W, and AR channels, and the
+ * B and R channels, which must be 'reg's (see 'bench/axi_mem_shell.v').
+ *
+ * Usage:
+ *   $axi_mem(clock, reset, latency, jitter, seed);
+ *
+ * where each read-burst returns its first beat, and each write-burst its
+ * response, 'latency' cycles after its address was accepted (or after its last
+ * beat, for writes), plus a random 0..'jitter' cycles, and the trailing integer
+ * arguments are optional.
+ *
+ * Plusargs:
+ *   +axi_latency=<N>, +axi_jitter=<N>, +axi_seed=<N>  --  override the arguments;
+ *   +axi_preload=<file>, +axi_base=<address>, +axi_dump=<file>  --  as for the
+ *                                  '+ddr3_*' plusargs (see 'ddr3mem.h'), but
+ *                                  using AXI4 byte-addresses;
+ *
+ * NOTE:
+ *  - 'reset' is active-HIGH;
+ *  - bursts are processed in order (for each channel), and up to
+ *    'AXI_MEM_QUEUE' of them can be outstanding;
+ *  - memory that was never written reads as zero, as any X's would propagate
+ *    all the way to the USB CRCs;
+ *  - addresses are 28-bit (as for the memory-requests), and INCR, FIXED, and
+ *    WRAP bursts are supported;
+ */
+#define AXI_MEM_MAX_WIDTH  1024
+#define AXI_MEM_MAX_BYTES  (AXI_MEM_MAX_WIDTH / 8)
+#define AXI_MEM_MAX_WORDS  (AXI_MEM_MAX_WIDTH / 32)
+#define AXI_MEM_MAX_PORTS  4
+#define AXI_MEM_MAX_NAME   256
+#define AXI_MEM_QUEUE      16
+
+typedef enum {
+    AXI_AWVALID, AXI_AWREADY, AXI_AWADDR, AXI_AWID, AXI_AWLEN, AXI_AWBURST,
+    AXI_WVALID, AXI_WREADY, AXI_WLAST, AXI_WSTRB, AXI_WDATA,
+    AXI_BVALID, AXI_BREADY, AXI_BRESP, AXI_BID,
+    AXI_ARVALID, AXI_ARREADY, AXI_ARADDR, AXI_ARID, AXI_ARLEN, AXI_ARBURST,
+    AXI_RVALID, AXI_RREADY, AXI_RLAST, AXI_RRESP, AXI_RID, AXI_RDATA,
+    AXI_NUM_SIGS
+} axi_sig_t;
+
+typedef enum {
+    AxiFixed = 0,
+    AxiIncr  = 1,
+    AxiWrap  = 2,
+} axi_burst_t;
+
+/**
+ * Uses the same ('aval', 'bval') encoding as VPI vectors.
+ */
+typedef struct {
+    uint32_t a[AXI_MEM_MAX_WORDS];
+    uint32_t b[AXI_MEM_MAX_WORDS];
+} axi_vec_t;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t id;
+    uint16_t len;               // beats
+    uint16_t beat;
+    axi_burst_t burst;
+    uint64_t start;             // cycle that the address was accepted
+    uint64_t due;               // cycle of the first R beat, or of the B response
+} axi_xact_t;
+
+typedef struct {
+    axi_xact_t xacts[AXI_MEM_QUEUE];
+    uint8_t head;
+    uint8_t count;
+} axi_queue_t;
+
+typedef struct {
+    uint64_t bursts;
+    uint64_t beats;
+    uint64_t bytes;
+    uint64_t latency;           // sum of the latencies
+    uint32_t lat_min;
+    uint32_t lat_max;
+    uint64_t stalls;            // 'valid && !ready', of the R and B channels
+} axi_mem_stats_t;
+
+typedef struct {
+    char name[AXI_MEM_MAX_NAME];
+    vpiHandle clock;
+    vpiHandle reset;
+    vpiHandle sigs[AXI_NUM_SIGS];
+    uint32_t width[AXI_NUM_SIGS];
+    uint32_t nbytes;
+    axi_vec_t vals[AXI_NUM_SIGS];
+    axi_vec_t next[AXI_NUM_SIGS];
+    // Configuration
+    uint32_t latency;
+    uint32_t jitter;
+    uint32_t seed;
+    // State
+    uint64_t cycle;
+    uint32_t rng;
+    axi_queue_t aw;             // accepted write-addresses, awaiting data
+    axi_queue_t b;              // write-responses
+    axi_queue_t ar;             // accepted read-addresses
+    ddr3_shadow_t mem;
+    axi_mem_stats_t wr;
+    axi_mem_stats_t rd;
+} axi_mem_t;
+
+
+void axi_mem_register(void);
+
+
+#endif  /* __AXI_MEM_H__ */
@@ -0,0 +1,852 @@
+#include "axis_tb.h"
+
+#include <vpi_user.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define AXIS_MAX_ERRORS 8
+
+/**
+ * Table of AXI4-Stream signals, and which roles drive them.
+ */
+typedef struct {
+    const char* suffix;
+    bool required;
+    bool source;
+} axis_sig_info_t;
+
+static const axis_sig_info_t axis_sigs[AXIS_NUM_SIGS] = {
+    {"tvalid", true,  true },
+    {"tready", true,  false},
+    {"tdata",  true,  true },
+    {"tkeep",  false, true },
+    {"tlast",  false, true },
+    {"tuser",  false, true },
+    {"tid",    false, true },
+};
+
+static const char axis_role_strings[3][8] = {
+    {"source"}, {"sink"}, {"monitor"},
+};
+
+static const axis_role_t axis_roles[3] = {AxisSource, AxisSink, AxisMonitor};
+
+static axis_port_t* axis_ports[AXIS_MAX_PORTS];
+static int axis_num_ports = 0;
+static bool axis_reported = false;
+
+
+// -- Helpers -- //
+
+static int axis_error(const char* reason)
+{
+    vpi_printf("ERROR: $axis_tb %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+static uint32_t axis_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static bool axis_bit(const axis_vec_t* vec, uint32_t bit)
+{
+    return (vec->a[bit >> 5] >> (bit & 31) & 1) && !(vec->b[bit >> 5] >> (bit & 31) & 1);
+}
+
+static uint8_t axis_byte(const axis_vec_t* vec, uint32_t i)
+{
+    return (uint8_t)(vec->a[i >> 2] >> ((i & 3) << 3));
+}
+
+static void axis_vec_set(axis_vec_t* vec, uint32_t width, uint32_t value)
+{
+    memset(vec, 0, sizeof(axis_vec_t));
+    vec->a[0] = width < 32 ? value & ((1u << width) - 1) : value;
+}
+
+static bool axis_has(const axis_port_t* port, axis_sig_t sig)
+{
+    return port->sigs[sig] != NULL;
+}
+
+/**
+ * Count of the bytes of the current beat, using 'tkeep' if present.
+ */
+static uint32_t axis_keep_bytes(const axis_port_t* port)
+{
+    if (!axis_has(port, AXIS_TKEEP)) {
+        return port->nbytes;
+    }
+    uint32_t count = 0;
+    for (uint32_t i=0; i<port->width[AXIS_TKEEP]; i++) {
+        count += axis_bit(&port->vals[AXIS_TKEEP], i);
+    }
+    return count;
+}
+
+static bool axis_keep(const axis_port_t* port, uint32_t i)
+{
+    return !axis_has(port, AXIS_TKEEP) || axis_bit(&port->vals[AXIS_TKEEP], i);
+}
+
+static axis_port_t* axis_find(const char* name)
+{
+    for (int i=0; i<axis_num_ports; i++) {
+        if (strcmp(axis_ports[i]->name, name) == 0) {
+            return axis_ports[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Count of the sinks that check the named source.
+ */
+static int axis_sinks_of(const char* name)
+{
+    int count = 0;
+    for (int i=0; i<axis_num_ports; i++) {
+        for (int j=0; j<axis_ports[i]->num_refs; j++) {
+            count += strcmp(axis_ports[i]->ref_names[j], name) == 0;
+        }
+    }
+    return count;
+}
+
+
+// -- Signal Values -- //
+
+/**
+ * Extract the current values of each of the port's signals.
+ */
+static void axis_fetch_values(axis_port_t* port)
+{
+    s_vpi_value value;
+
+    for (int i=0; i<AXIS_NUM_SIGS; i++) {
+        if (port->sigs[i] == NULL) {
+            continue;
+        }
+        const uint32_t words = (port->width[i] + 31) >> 5;
+        value.format = vpiVectorVal;
+        vpi_get_value(port->sigs[i], &value);
+        for (uint32_t j=0; j<words; j++) {
+            port->vals[i].a[j] = (uint32_t)value.value.vector[j].aval;
+            port->vals[i].b[j] = (uint32_t)value.value.vector[j].bval;
+        }
+    }
+}
+
+/**
+ * Drive the signals that have changed, for the role of the port.
+ */
+static void axis_update_values(axis_port_t* port)
+{
+    s_vpi_vecval vec[AXIS_MAX_WORDS];
+    s_vpi_value value;
+
+    for (int i=0; i<AXIS_NUM_SIGS; i++) {
+        const bool drives = port->role == AxisSource ? axis_sigs[i].source :
+            port->role == AxisSink && i == AXIS_TREADY;
+        if (!drives || port->sigs[i] == NULL ||
+            memcmp(&port->vals[i], &port->next[i], sizeof(axis_vec_t)) == 0) {
+            continue;
+        }
+
+        const uint32_t words = (port->width[i] + 31) >> 5;
+        for (uint32_t j=0; j<words; j++) {
+            vec[j].aval = (PLI_INT32)port->next[i].a[j];
+            vec[j].bval = (PLI_INT32)port->next[i].b[j];
+        }
+        value.format = vpiVectorVal;
+        value.value.vector = vec;
+        vpi_put_value(port->sigs[i], &value, NULL, vpiNoDelay);
+        memcpy(&port->vals[i], &port->next[i], sizeof(axis_vec_t));
+    }
+}
+
+
+// -- Reporting -- //
+
+static void axis_report(void)
+{
+    uint64_t errors = 0;
+
+    if (axis_reported) {
+        return;
+    }
+    axis_reported = true;
+
+    vpi_printf("\nAXIS\tport%*s role      beats      bytes  packets     cycles  beats/cyc  bytes/cyc  stalled     idle\n",
+               20, "");
+    for (int i=0; i<axis_num_ports; i++) {
+        const axis_port_t* port = axis_ports[i];
+        const axis_stats_t* st = &port->stats;
+        const double cycles = st->cycles > 0 ? (double)st->cycles : 1.0;
+
+        vpi_printf("AXIS\t%-24s %-7s %8lu %10lu %8lu %10lu %10.3f %10.3f %7.1f%% %7.1f%%\n",
+                   port->name, axis_role_strings[port->role], st->beats, st->bytes,
+                   st->packets, st->cycles, (double)st->beats / cycles,
+                   (double)st->bytes / cycles, st->stalls * 100.0 / cycles,
+                   st->idles * 100.0 / cycles);
+        if (st->errors > 0) {
+            vpi_printf("AXIS\t%-24s %lu errors\n", port->name, st->errors);
+        }
+        errors += st->errors;
+    }
+    vpi_printf("AXIS\t%s\n", errors > 0 ? "FAILED" : "PASSED");
+}
+
+/**
+ * Finish once every checking sink has received all of its source's bytes.
+ */
+static void axis_check_done(void)
+{
+    int sinks = 0;
+
+    for (int i=0; i<axis_num_ports; i++) {
+        const axis_port_t* port = axis_ports[i];
+        if (port->role == AxisSink && port->num_refs > 0) {
+            if (!port->done) {
+                return;
+            }
+            sinks++;
+        }
+    }
+
+    if (sinks > 0) {
+        axis_report();
+        vpi_control(vpiFinish, 0);
+    }
+}
+
+static int cb_axis_end(p_cb_data cb_data)
+{
+    axis_report();
+    return 0;
+}
+
+
+// -- Sources, Sinks, and Monitors -- //
+
+/**
+ * Packet-length, in bytes, rounded up to whole beats if there is no 'tkeep'.
+ */
+static uint32_t axis_length(axis_port_t* port)
+{
+    if (!axis_has(port, AXIS_TLAST)) {
+        return port->nbytes;
+    }
+    uint32_t len = 1 + axis_rand(&port->rng) % port->max_len;
+    if (!axis_has(port, AXIS_TKEEP)) {
+        len = (len + port->nbytes - 1) / port->nbytes * port->nbytes;
+    }
+    return len;
+}
+
+static void axis_source_beat(axis_port_t* port)
+{
+    const uint32_t count = port->remain < port->nbytes ? port->remain : port->nbytes;
+    axis_vec_t* data = &port->next[AXIS_TDATA];
+
+    memset(data, 0, sizeof(axis_vec_t));
+    for (uint32_t i=0; i<count; i++) {
+        const uint32_t byte = axis_rand(&port->data_rng) & port->mask;
+        data->a[i >> 2] |= byte << ((i & 3) << 3);
+    }
+    port->remain -= count;
+
+    axis_vec_set(&port->next[AXIS_TVALID], 1, 1);
+    axis_vec_set(&port->next[AXIS_TLAST], 1, port->remain == 0);
+    axis_vec_set(&port->next[AXIS_TUSER], port->width[AXIS_TUSER], 0);
+    axis_vec_set(&port->next[AXIS_TID], port->width[AXIS_TID], (uint32_t)port->index);
+
+    axis_vec_t* keep = &port->next[AXIS_TKEEP];
+    memset(keep, 0, sizeof(axis_vec_t));
+    for (uint32_t i=0; i<count; i++) {
+        keep->a[i >> 5] |= 1u << (i & 31);
+    }
+}
+
+static void axis_source_step(axis_port_t* port)
+{
+    const bool valid = axis_bit(&port->vals[AXIS_TVALID], 0);
+    const bool ready = axis_bit(&port->vals[AXIS_TREADY], 0);
+
+    if (valid && ready) {
+        port->stats.beats++;
+        port->stats.bytes += axis_keep_bytes(port);
+        if (port->remain == 0) {
+            port->stats.packets++;
+        }
+    } else if (valid) {
+        // Hold the beat until it is accepted
+        port->stats.stalls++;
+        return;
+    } else {
+        port->stats.idles++;
+    }
+
+    if (port->remain == 0 && port->sent < port->packets &&
+        (!port->by_packet || port->sent - port->oldest < AXIS_MAX_PENDING)) {
+        port->remain = axis_length(port);
+        if (port->by_packet) {
+            axis_packet_t* pkt = &port->pending[port->sent % AXIS_MAX_PENDING];
+            pkt->rng = port->data_rng;
+            pkt->len = port->remain;
+            pkt->matched = false;
+        }
+        port->sent++;
+    }
+
+    if (port->remain > 0 && axis_rand(&port->rng) % 100 < port->duty) {
+        axis_source_beat(port);
+    } else {
+        axis_vec_set(&port->next[AXIS_TVALID], 1, 0);
+        if (port->remain == 0 && port->sent == port->packets) {
+            port->done = true;
+        }
+    }
+}
+
+/**
+ * Check each byte against the byte-stream of the source, if given.
+ */
+static void axis_sink_check(axis_port_t* port)
+{
+    axis_port_t* ref = port->refs[0];
+
+    for (uint32_t i=0; i<port->nbytes; i++) {
+        if (!axis_keep(port, i)) {
+            continue;
+        }
+        const uint8_t byte = axis_byte(&port->vals[AXIS_TDATA], i) & port->mask;
+        const uint8_t want = (uint8_t)axis_rand(&port->data_rng) & ref->mask;
+        const bool xz = (port->vals[AXIS_TDATA].b[i >> 2] >> ((i & 3) << 3) & port->mask) != 0;
+
+        if (byte != want || xz) {
+            if (port->stats.errors++ < AXIS_MAX_ERRORS) {
+                vpi_printf("AXIS\t%s: byte %lu is 0x%02x%s, expected 0x%02x\n",
+                           port->name, port->stats.bytes, byte, xz ? " (X/Z)" : "", want);
+            }
+        }
+        port->stats.bytes++;
+    }
+}
+
+/**
+ * Every packet of the sink's sources that has not yet been received is a
+ * candidate for the packet that is starting.
+ */
+static void axis_match_start(axis_port_t* port)
+{
+    port->num_matches = 0;
+    for (int i=0; i<port->num_refs; i++) {
+        axis_port_t* ref = port->refs[i];
+        for (uint32_t id=ref->oldest; id<ref->sent; id++) {
+            const axis_packet_t* pkt = &ref->pending[id % AXIS_MAX_PENDING];
+            if (!pkt->matched) {
+                axis_match_t* m = &port->matches[port->num_matches++];
+                m->ref = ref;
+                m->id = id;
+                m->rng = pkt->rng;
+                m->remain = pkt->len;
+            }
+        }
+    }
+    port->in_packet = true;
+    port->length = 0;
+    port->oldest_match = port->num_matches > 0 ? port->matches[0] : (axis_match_t){0};
+}
+
+/**
+ * Mark the source's packet as received, if it is still pending (and all of its
+ * bytes were matched, unless 'any_length'), and free the slots of the oldest
+ * received packets.
+ */
+static bool axis_match_claim(const axis_match_t* m, bool any_length)
+{
+    axis_port_t* ref = m->ref;
+
+    if (ref == NULL || (m->remain != 0 && !any_length) || m->id < ref->oldest ||
+        ref->pending[m->id % AXIS_MAX_PENDING].matched) {
+        return false;
+    }
+    ref->pending[m->id % AXIS_MAX_PENDING].matched = true;
+    while (ref->oldest < ref->sent && ref->pending[ref->oldest % AXIS_MAX_PENDING].matched) {
+        ref->oldest++;
+    }
+    return true;
+}
+
+/**
+ * Check each packet as a whole, as the packets of several sources can be
+ * interleaved (by a mux), or those of one source can be split between several
+ * sinks (by a demux). Candidates that differ are dropped, as each byte
+ * arrives, and at 'tlast', the first remaining candidate (of the same length)
+ * is the packet received.
+ */
+static void axis_sink_packet(axis_port_t* port)
+{
+    if (!port->in_packet) {
+        axis_match_start(port);
+    }
+
+    for (uint32_t i=0; i<port->nbytes; i++) {
+        if (!axis_keep(port, i)) {
+            continue;
+        }
+        const uint8_t byte = axis_byte(&port->vals[AXIS_TDATA], i) & port->mask;
+        const bool xz = (port->vals[AXIS_TDATA].b[i >> 2] >> ((i & 3) << 3) & port->mask) != 0;
+        int n = 0;
+
+        for (int j=0; j<port->num_matches; j++) {
+            axis_match_t* m = &port->matches[j];
+            if (m->remain == 0) {
+                continue;
+            }
+            m->remain--;
+            if (((uint8_t)axis_rand(&m->rng) & m->ref->mask) == byte && !xz) {
+                port->matches[n++] = *m;
+            }
+        }
+        port->num_matches = n;
+        port->length++;
+        port->stats.bytes++;
+    }
+
+    if (!axis_bit(&port->vals[AXIS_TLAST], 0)) {
+        return;
+    }
+    port->in_packet = false;
+    for (int j=0; j<port->num_matches; j++) {
+        if (axis_match_claim(&port->matches[j], false)) {
+            return;
+        }
+    }
+    if (port->stats.errors++ < AXIS_MAX_ERRORS) {
+        vpi_printf("AXIS\t%s: packet %lu (%u bytes) matches no packet of its sources\n",
+                   port->name, port->stats.packets, port->length);
+    }
+    // Assume that it was the oldest of the same length (else the oldest), so
+    // that its sources can still finish
+    for (int j=0; j<port->num_refs; j++) {
+        axis_port_t* ref = port->refs[j];
+        for (uint32_t id=ref->oldest; id<ref->sent; id++) {
+            const axis_packet_t* pkt = &ref->pending[id % AXIS_MAX_PENDING];
+            const axis_match_t m = {ref, id, pkt->rng, 0};
+            if (pkt->len == port->length && axis_match_claim(&m, false)) {
+                return;
+            }
+        }
+    }
+    axis_match_claim(&port->oldest_match, true);
+}
+
+/**
+ * Sinks that check whole packets are done once their sources are, and every
+ * packet that they sent has been received.
+ */
+static bool axis_sink_done(const axis_port_t* port)
+{
+    if (!port->by_packet) {
+        return port->refs[0]->done && port->stats.bytes >= port->refs[0]->stats.bytes;
+    }
+    if (port->in_packet) {
+        return false;
+    }
+    for (int i=0; i<port->num_refs; i++) {
+        const axis_port_t* ref = port->refs[i];
+        if (!ref->done || ref->oldest != ref->sent) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void axis_sink_step(axis_port_t* port)
+{
+    const bool valid = axis_bit(&port->vals[AXIS_TVALID], 0);
+    const bool ready = axis_bit(&port->vals[AXIS_TREADY], 0);
+
+    if (valid && ready) {
+        port->stats.beats++;
+        if (port->role == AxisSink && port->by_packet) {
+            axis_sink_packet(port);
+        } else if (port->role == AxisSink && port->num_refs > 0) {
+            axis_sink_check(port);
+        } else {
+            port->stats.bytes += axis_keep_bytes(port);
+        }
+        if (!axis_has(port, AXIS_TLAST) || axis_bit(&port->vals[AXIS_TLAST], 0)) {
+            port->stats.packets++;
+        }
+    } else if (valid) {
+        port->stats.stalls++;
+    } else if (ready || port->role == AxisMonitor) {
+        port->stats.idles++;
+    }
+
+    if (port->role == AxisSink) {
+        const bool rdy = axis_rand(&port->rng) % 100 < port->duty;
+        axis_vec_set(&port->next[AXIS_TREADY], 1, rdy);
+
+        if (port->num_refs > 0 && axis_sink_done(port)) {
+            port->done = true;
+            axis_check_done();
+        }
+    }
+}
+
+
+//
+//  VPI Callbacks
+///
+
+/**
+ * Process the sampled values, and drive the next values.
+ */
+static int cb_axis_sync(p_cb_data cb_data)
+{
+    axis_port_t* port = (axis_port_t*)cb_data->user_data;
+    s_vpi_value value;
+
+    value.format = vpiScalarVal;
+    vpi_get_value(port->reset, &value);
+    memcpy(port->next, port->vals, sizeof(port->next));
+
+    if (value.value.scalar != vpi0) {
+        // Idle while in reset
+        if (port->role == AxisSource) {
+            axis_vec_set(&port->next[AXIS_TVALID], 1, 0);
+            port->remain = 0;
+        } else if (port->role == AxisSink) {
+            axis_vec_set(&port->next[AXIS_TREADY], 1, 0);
+        }
+    } else if (!port->done) {
+        port->stats.cycles++;
+        if (port->role == AxisSource) {
+            axis_source_step(port);
+        } else {
+            axis_sink_step(port);
+        }
+    }
+
+    axis_update_values(port);
+
+    return 0;
+}
+
+/**
+ * Event-handler for every posedge-clock event.
+ */
+static int cb_axis_clock(p_cb_data cb_data)
+{
+    axis_port_t* port = (axis_port_t*)cb_data->user_data;
+    s_vpi_value x;
+
+    x.format = vpiIntVal;
+    vpi_get_value(port->clock, &x);
+    if (x.value.integer != 1) {
+        return 0;
+    }
+
+    // Capture the port signals at the time of the clock-edge
+    axis_fetch_values(port);
+
+    s_vpi_time t;
+    t.type       = vpiSimTime;
+    t.high       = 0;
+    t.low        = 0;
+
+    s_cb_data cb;
+    cb.reason    = cbReadWriteSynch;
+    cb.cb_rtn    = cb_axis_sync;
+    cb.user_data = (PLI_BYTE8*)port;
+    cb.time      = &t;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+// Helper for parsing the argument-list.
+static int axis_get_signal(vpiHandle* dst, vpiHandle iter)
+{
+    vpiHandle arg_handle = vpi_scan(iter);
+    int arg_type = arg_handle != NULL ? vpi_get(vpiType, arg_handle) : 0;
+
+    if (arg_type != vpiNet && arg_type != vpiReg) {
+        if (arg_handle != NULL) {
+            vpi_free_object(iter);
+        }
+        return axis_error("arg must be a net or reg");
+    }
+    *dst = arg_handle;
+    return 1;
+}
+
+/**
+ * String argument, which is empty if the (optional) argument is missing.
+ */
+static int axis_get_string(char* dst, vpiHandle* iter, bool required)
+{
+    vpiHandle arg_handle = *iter != NULL ? vpi_scan(*iter) : NULL;
+    s_vpi_value value;
+
+    dst[0] = '\0';
+    if (arg_handle == NULL) {
+        *iter = NULL;
+        return required ? axis_error("requires a port-prefix string") : 1;
+    }
+    value.format = vpiStringVal;
+    vpi_get_value(arg_handle, &value);
+    snprintf(dst, AXIS_MAX_NAME, "%s", value.value.str);
+    return 1;
+}
+
+/**
+ * Optional integer argument, else 'def' (and then the iterator is exhausted).
+ */
+static uint32_t axis_get_int(vpiHandle* iter, uint32_t def)
+{
+    vpiHandle arg_handle = *iter != NULL ? vpi_scan(*iter) : NULL;
+    s_vpi_value value;
+
+    if (arg_handle == NULL) {
+        *iter = NULL;
+        return def;
+    }
+    value.format = vpiIntVal;
+    vpi_get_value(arg_handle, &value);
+    return (uint32_t)value.value.integer;
+}
+
+/**
+ * Full name of the port with the given prefix, in the calling scope.
+ */
+static int axis_set_name(char* dst, vpiHandle scope, const char* prefix)
+{
+    const int len = snprintf(dst, AXIS_MAX_NAME, "%s.%s", vpi_get_str(vpiFullName, scope),
+                             prefix);
+
+    if (len < 0 || len >= AXIS_MAX_NAME) {
+        vpi_printf("ERROR: $axis_tb '%s' is longer than %d characters\n", dst,
+                   AXIS_MAX_NAME - 1);
+        return axis_error("port name is too long");
+    }
+    return 1;
+}
+
+/**
+ * Find the port's signals, in the calling scope, using the signal table.
+ */
+static int axis_set_handles(axis_port_t* port, vpiHandle scope, const char* prefix)
+{
+    char name[AXIS_MAX_NAME + 8];
+
+    for (int i=0; i<AXIS_NUM_SIGS; i++) {
+        snprintf(name, sizeof(name), "%s_%s", prefix, axis_sigs[i].suffix);
+        port->sigs[i] = vpi_handle_by_name(name, scope);
+
+        if (port->sigs[i] == NULL) {
+            if (axis_sigs[i].required) {
+                vpi_printf("ERROR: $axis_tb '%s.%s' not found\n", port->name, name);
+                return axis_error("missing AXI4-Stream signal");
+            }
+            continue;
+        }
+
+        port->width[i] = (uint32_t)vpi_get(vpiSize, port->sigs[i]);
+        if (port->width[i] > AXIS_MAX_WIDTH || (i != AXIS_TDATA && i != AXIS_TKEEP &&
+                                                port->width[i] > 32)) {
+            vpi_printf("ERROR: $axis_tb '%s' is %u bits\n", name, port->width[i]);
+            return axis_error("AXI4-Stream signal is too wide");
+        }
+    }
+
+    const uint32_t width = port->width[AXIS_TDATA];
+    if (width > 8 && (width & 7) != 0) {
+        return axis_error("'tdata' must be a multiple of 8 bits, or narrower than 8 bits");
+    }
+    port->nbytes = (width + 7) >> 3;
+    port->mask = width < 8 ? (uint8_t)((1u << width) - 1) : 0xff;
+
+    if (axis_has(port, AXIS_TKEEP) && port->width[AXIS_TKEEP] != port->nbytes) {
+        return axis_error("'tkeep' must have one bit per byte of 'tdata'");
+    }
+
+    return 1;
+}
+
+/**
+ * Populates the port data-structure before the Verilog simulation starts.
+ */
+static int axis_compiletf(char* user_data)
+{
+    vpiHandle systf_handle, arg_iterator, scope;
+    char prefix[AXIS_MAX_NAME];
+    axis_port_t* port;
+
+    if (axis_num_ports >= AXIS_MAX_PORTS) {
+        return axis_error("too many AXI4-Stream ports");
+    }
+
+    port = (axis_port_t*)malloc(sizeof(axis_port_t));
+    memset(port, 0, sizeof(axis_port_t));
+    port->role = *(const axis_role_t*)user_data;
+    port->index = axis_num_ports;
+
+    systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    if (systf_handle == NULL) {
+        return axis_error("failed to obtain systf handle");
+    }
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    if (arg_iterator == NULL) {
+        return axis_error("requires at least 3 arguments");
+    }
+
+    if (!axis_get_signal(&port->clock, arg_iterator) ||
+        !axis_get_signal(&port->reset, arg_iterator) ||
+        !axis_get_string(prefix, &arg_iterator, true)) {
+        return 0;
+    }
+
+    scope = vpi_handle(vpiScope, systf_handle);
+    if (!axis_set_name(port->name, scope, prefix) ||
+        !axis_set_handles(port, scope, prefix)) {
+        return 0;
+    }
+
+    if (port->role == AxisSource) {
+        port->packets = axis_get_int(&arg_iterator, 100);
+        port->duty = axis_get_int(&arg_iterator, 100);
+        port->max_len = axis_get_int(&arg_iterator, 64);
+        port->seed = axis_get_int(&arg_iterator, 1 + port->index);
+        port->max_len = port->max_len > 0 ? port->max_len : 1;
+        port->seed = port->seed != 0 ? port->seed : 1;
+    } else if (port->role == AxisSink) {
+        char refs[AXIS_MAX_NAME];
+        if (!axis_get_string(refs, &arg_iterator, false)) {
+            return 0;
+        }
+        for (char* ref = strtok(refs, ", "); ref != NULL; ref = strtok(NULL, ", ")) {
+            if (port->num_refs >= AXIS_MAX_REFS) {
+                return axis_error("too many sources for a sink");
+            }
+            if (!axis_set_name(port->ref_names[port->num_refs++], scope, ref)) {
+                return 0;
+            }
+        }
+        port->duty = axis_get_int(&arg_iterator, 100);
+        port->seed = 1 + port->index;
+    }
+
+    if (arg_iterator != NULL && vpi_scan(arg_iterator) != NULL) {
+        vpi_free_object(arg_iterator);
+        return axis_error("too many arguments");
+    }
+
+    port->rng = port->seed * 2654435761u | 1;
+    port->data_rng = port->seed;
+    axis_ports[axis_num_ports++] = port;
+
+    if (axis_num_ports == 1) {
+        s_cb_data cb;
+        cb.reason    = cbEndOfSimulation;
+        cb.cb_rtn    = cb_axis_end;
+        cb.user_data = NULL;
+        cb.time      = NULL;
+        cb.value     = NULL;
+        cb.obj       = NULL;
+
+        vpiHandle cb_handle = vpi_register_cb(&cb);
+        vpi_free_object(cb_handle);
+    }
+
+    vpi_put_userdata(systf_handle, (void*)port);
+
+    return 0;
+}
+
+/**
+ * Resolve the sink's sources (now that all ports exist), and then start
+ * processing clock-events.
+ */
+static int axis_calltf(char* user_data)
+{
+    vpiHandle systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    axis_port_t* port = (axis_port_t*)vpi_get_userdata(systf_handle);
+    s_vpi_value x;
+    s_vpi_time t;
+    s_cb_data cb;
+
+    if (port == NULL) {
+        return axis_error("'*port' problem");
+    }
+
+    for (int i=0; i<port->num_refs; i++) {
+        port->refs[i] = axis_find(port->ref_names[i]);
+        if (port->refs[i] == NULL || port->refs[i]->role != AxisSource) {
+            vpi_printf("ERROR: $axis_tb source '%s' not found\n", port->ref_names[i]);
+            return axis_error("missing source");
+        }
+        port->by_packet |= port->num_refs > 1 || axis_sinks_of(port->ref_names[i]) > 1;
+    }
+
+    if (port->by_packet) {
+        if (!axis_has(port, AXIS_TLAST)) {
+            return axis_error("sinks of several sources (or of shared sources) require 'tlast'");
+        }
+        for (int i=0; i<port->num_refs; i++) {
+            port->refs[i]->by_packet = true;
+        }
+    } else if (port->num_refs > 0) {
+        // Replay the source's byte-stream
+        port->data_rng = port->refs[0]->seed;
+    }
+
+    t.type       = vpiSuppressTime;
+    x.format     = vpiSuppressVal;
+    cb.reason    = cbValueChange;
+    cb.cb_rtn    = cb_axis_clock;
+    cb.time      = &t;
+    cb.value     = &x;
+    cb.user_data = (PLI_BYTE8*)port;
+    cb.obj       = port->clock;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+void axis_register(void)
+{
+    const char* names[3] = {"$axis_source", "$axis_sink", "$axis_monitor"};
+    s_vpi_systf_data tf_data;
+
+    for (int i=0; i<3; i++) {
+        tf_data.type      = vpiSysTask;
+        tf_data.tfname    = names[i];
+        tf_data.calltf    = axis_calltf;
+        tf_data.compiletf = axis_compiletf;
+        tf_data.sizetf    = NULL;
+        tf_data.user_data = (PLI_BYTE8*)&axis_roles[i];
+
+        vpi_register_systf(&tf_data);
+    }
+}
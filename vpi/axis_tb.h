@@ -0,0 +1,149 @@
+#ifndef __AXIS_TB_H__
+#define __AXIS_TB_H__
+
+
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Generic AXI4-Stream source, sink, and monitor system-tasks, where the ports
+ * are found (by name) in the scope of the calling module, using the table of
+ * AXI4-Stream signals. For the port prefix 's', these are:
+ *  - 's_tvalid', 's_tready', and 's_tdata'   --  required;
+ *  - 's_tkeep', 's_tlast', 's_tuser', 's_tid' --  optional;
+ * and 'tdata' can be any width (up to 'AXIS_MAX_WIDTH'), that is either a
+ * multiple of 8 bits, or narrower than a byte.
+ *
+ * Usage:
+ *   $axis_source(clock, reset, "s", packets, duty, max_len, seed);
+ *   $axis_sink(clock, reset, "m", "s", duty);
+ *   $axis_sink(clock, reset, "m", "s0,s1,s2", duty);
+ *   $axis_monitor(clock, reset, "x");
+ *
+ * where the trailing integer arguments are optional, 'duty' is the percentage
+ * of cycles that 'tvalid' (or 'tready') is asserted, and the (optional) second
+ * argument of '$axis_sink' names the source (or a comma-separated list of the
+ * sources) that the sink checks. A sink of just one source, that is the only
+ * sink of that source, checks its byte-stream (so the packet-framing can be
+ * changed). Otherwise, as for muxes and demuxes, each packet is checked as a
+ * whole, against the packets that its sources have sent, but that no sink has
+ * yet received. Once every checking sink has received all of its sources'
+ * bytes, the throughput of every port is reported, and the simulation
+ * finishes.
+ *
+ * NOTE:
+ *  - 'reset' is active-HIGH;
+ *  - packet-lengths are in bytes, and are rounded up to whole beats when
+ *    the source has no 'tkeep' (or, without 'tlast', every beat is a packet);
+ *  - sources drive 'tid' with their index (in order of elaboration), and
+ *    'tuser' LO;
+ *  - sinks that check by packet require 'tlast', and their sources wait for
+ *    a free slot before starting a packet, when 'AXIS_MAX_PENDING' packets
+ *    have not yet been received;
+ */
+#define AXIS_MAX_WIDTH  1024
+#define AXIS_MAX_BYTES  (AXIS_MAX_WIDTH / 8)
+#define AXIS_MAX_WORDS  (AXIS_MAX_WIDTH / 32)
+#define AXIS_MAX_PORTS  32
+#define AXIS_MAX_NAME   128
+#define AXIS_MAX_REFS   8           // sources, per sink
+#define AXIS_MAX_PENDING 32         // packets sent, but not yet received
+
+typedef enum {
+    AxisSource,
+    AxisSink,
+    AxisMonitor,
+} axis_role_t;
+
+typedef enum {
+    AXIS_TVALID = 0,
+    AXIS_TREADY = 1,
+    AXIS_TDATA  = 2,
+    AXIS_TKEEP  = 3,
+    AXIS_TLAST  = 4,
+    AXIS_TUSER  = 5,
+    AXIS_TID    = 6,
+    AXIS_NUM_SIGS = 7,
+} axis_sig_t;
+
+/**
+ * Uses the same ('aval', 'bval') encoding as VPI vectors.
+ */
+typedef struct {
+    uint32_t a[AXIS_MAX_WORDS];
+    uint32_t b[AXIS_MAX_WORDS];
+} axis_vec_t;
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t beats;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t stalls;            // 'tvalid && !tready'
+    uint64_t idles;             // '!tvalid' (and 'tready', for sinks)
+    uint64_t errors;
+} axis_stats_t;
+
+/**
+ * Packet sent by a source, for checking by packet.
+ */
+typedef struct {
+    uint32_t rng;               // 'data_rng' at the start of the packet
+    uint32_t len;               // bytes
+    bool matched;
+} axis_packet_t;
+
+/**
+ * Candidate for the packet that a sink is receiving.
+ */
+typedef struct {
+    struct __axis_port* ref;
+    uint32_t id;                // packet index, of the source
+    uint32_t rng;
+    uint32_t remain;
+} axis_match_t;
+
+typedef struct __axis_port {
+    char name[AXIS_MAX_NAME];
+    axis_role_t role;
+    int index;
+    vpiHandle clock;
+    vpiHandle reset;
+    vpiHandle sigs[AXIS_NUM_SIGS];
+    uint32_t width[AXIS_NUM_SIGS];
+    uint32_t nbytes;
+    uint8_t mask;
+    axis_vec_t vals[AXIS_NUM_SIGS];
+    axis_vec_t next[AXIS_NUM_SIGS];
+    // Configuration
+    uint32_t packets;
+    uint32_t duty;
+    uint32_t max_len;
+    uint32_t seed;
+    char ref_names[AXIS_MAX_REFS][AXIS_MAX_NAME];
+    struct __axis_port* refs[AXIS_MAX_REFS];
+    int num_refs;
+    bool by_packet;             // check whole packets (for muxes & demuxes)
+    // State
+    bool done;
+    uint32_t rng;
+    uint32_t data_rng;
+    uint32_t sent;
+    uint32_t remain;
+    axis_stats_t stats;
+    // Packets sent but not yet received (sources), or being matched (sinks)
+    axis_packet_t pending[AXIS_MAX_PENDING];
+    uint32_t oldest;
+    axis_match_t matches[AXIS_MAX_REFS * AXIS_MAX_PENDING];
+    int num_matches;
+    axis_match_t oldest_match;
+    bool in_packet;
+    uint32_t length;
+} axis_port_t;
+
+
+void axis_register(void);
+
+
+#endif  /* __AXIS_TB_H__ */
@@ -0,0 +1,347 @@
+#include "ddr3mem.h"
+#include "ulpivpi.h"
+
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define DDR3_PRELOAD_PLUSARG "+ddr3_preload="
+#define DDR3_BASE_PLUSARG    "+ddr3_base="
+#define DDR3_DUMP_PLUSARG    "+ddr3_dump="
+
+typedef enum {
+    DDR3MemWrite,
+    DDR3MemRead,
+    DDR3MemErase,
+} ddr3_mem_op_t;
+
+static const char ddr3_mem_names[3][16] = {
+    {"$ddr3_mem_write"}, {"$ddr3_mem_read"}, {"$ddr3_mem_erase"},
+};
+
+static const ddr3_mem_op_t ddr3_mem_ops[3] = {DDR3MemWrite, DDR3MemRead, DDR3MemErase};
+
+static ddr3_mem_t* ddr3_mems[DDR3_MEM_MAX_INSTS];
+static int ddr3_num_mems = 0;
+
+
+// -- Helpers -- //
+
+static int ddr3_mem_error(const char* reason)
+{
+    vpi_printf("ERROR: $ddr3_mem %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+/**
+ * File-name for the instance, where instances after the first have '.<N>'
+ * appended.
+ */
+static void ddr3_mem_path(char* dst, const char* path, const ddr3_mem_t* mem)
+{
+    if (mem->index == 0) {
+        snprintf(dst, DDR3_MEM_MAX_NAME, "%s", path);
+    } else {
+        snprintf(dst, DDR3_MEM_MAX_NAME, "%s.%d", path, mem->index);
+    }
+}
+
+/**
+ * The model instance that contains the task that invoked the system-task.
+ */
+static vpiHandle ddr3_mem_module(vpiHandle systf_handle)
+{
+    vpiHandle scope = vpi_handle(vpiScope, systf_handle);
+
+    while (scope != NULL && vpi_get(vpiType, scope) != vpiModule) {
+        scope = vpi_handle(vpiScope, scope);
+    }
+    return scope;
+}
+
+static ddr3_mem_t* ddr3_mem_find(const char* name)
+{
+    for (int i=0; i<ddr3_num_mems; i++) {
+        if (strcmp(ddr3_mems[i]->name, name) == 0) {
+            return ddr3_mems[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Convert the word-address argument to a byte-address, failing for X/Z, or
+ * out-of-range, addresses.
+ */
+static bool ddr3_mem_address(const ddr3_mem_t* mem, vpiHandle arg, uint32_t* addr)
+{
+    s_vpi_value val;
+    uint64_t byte;
+
+    val.format = vpiVectorVal;
+    vpi_get_value(arg, &val);
+    if (val.value.vector[0].bval != 0) {
+        vpi_printf("ERROR: $ddr3_mem (%s) X/Z address\n", mem->name);
+        return false;
+    }
+
+    byte = (uint64_t)(uint32_t)val.value.vector[0].aval * mem->width;
+    if (byte + mem->width > (uint64_t)SHADOW_ADDR_MASK + 1u) {
+        vpi_printf("ERROR: $ddr3_mem (%s) address 0x%lx is out of range\n", mem->name, byte);
+        return false;
+    }
+    *addr = (uint32_t)byte;
+
+    return true;
+}
+
+
+// -- Simulation Callbacks -- //
+
+static int cb_ddr3_mem_end(p_cb_data cb_data)
+{
+    const char* dump = ulpi_plusarg(DDR3_DUMP_PLUSARG, NULL);
+
+    for (int i=0; i<ddr3_num_mems; i++) {
+        ddr3_mem_t* mem = ddr3_mems[i];
+
+        vpi_printf("DDR3\t%s: %lu writes, %lu reads (%lu with unknown bytes), %lu erases\n",
+                   mem->name, mem->writes, mem->reads, mem->misses, mem->erases);
+        vpi_printf("DDR3\t%s: %u pages (%lu bytes) for a %u-byte word size\n",
+                   mem->name, mem->mem.pages, shadow_bytes(&mem->mem), mem->width);
+
+        if (dump != NULL) {
+            char path[DDR3_MEM_MAX_NAME];
+            long bytes;
+
+            ddr3_mem_path(path, dump, mem);
+            bytes = shadow_dump(&mem->mem, path);
+            if (bytes < 0) {
+                vpi_printf("ERROR: $ddr3_mem (%s) failed to write '%s'\n", mem->name, path);
+            } else {
+                vpi_printf("DDR3\t%s: dumped %ld bytes to '%s'\n", mem->name, bytes, path);
+            }
+        }
+        shadow_free(&mem->mem);
+        free(mem);
+    }
+    ddr3_num_mems = 0;
+
+    return 0;
+}
+
+/**
+ * Create the storage of a model instance, and preload it, if requested.
+ */
+static ddr3_mem_t* ddr3_mem_create(const char* name)
+{
+    const char* preload = ulpi_plusarg(DDR3_PRELOAD_PLUSARG, NULL);
+    ddr3_mem_t* mem;
+
+    if (ddr3_num_mems >= DDR3_MEM_MAX_INSTS) {
+        ddr3_mem_error("too many DDR3 model instances");
+        return NULL;
+    }
+
+    mem = (ddr3_mem_t*)malloc(sizeof(ddr3_mem_t));
+    memset(mem, 0, sizeof(ddr3_mem_t));
+    snprintf(mem->name, DDR3_MEM_MAX_NAME, "%s", name);
+    mem->index = ddr3_num_mems;
+    shadow_init(&mem->mem);
+
+    if (preload != NULL) {
+        const uint32_t base = strtoul(ulpi_plusarg(DDR3_BASE_PLUSARG, "0"), NULL, 0);
+        char path[DDR3_MEM_MAX_NAME];
+        long bytes;
+
+        ddr3_mem_path(path, preload, mem);
+        bytes = shadow_load(&mem->mem, path, base);
+        if (bytes < 0) {
+            shadow_free(&mem->mem);
+            free(mem);
+            ddr3_mem_error("preload failed");
+            return NULL;
+        }
+        vpi_printf("DDR3\t%s: preloaded %ld bytes from '%s'\n", name, bytes, path);
+    }
+
+    ddr3_mems[ddr3_num_mems++] = mem;
+
+    if (ddr3_num_mems == 1) {
+        s_cb_data cb;
+        cb.reason    = cbEndOfSimulation;
+        cb.cb_rtn    = cb_ddr3_mem_end;
+        cb.user_data = NULL;
+        cb.time      = NULL;
+        cb.value     = NULL;
+        cb.obj       = NULL;
+
+        vpiHandle cb_handle = vpi_register_cb(&cb);
+        vpi_free_object(cb_handle);
+    }
+
+    return mem;
+}
+
+
+// -- System Tasks -- //
+
+/**
+ * Checks the arguments, and binds each call-site to the storage of its model
+ * instance, before the Verilog simulation starts.
+ */
+static int ddr3_mem_compiletf(char* user_data)
+{
+    const ddr3_mem_op_t op = *(const ddr3_mem_op_t*)user_data;
+    vpiHandle systf_handle, arg_iterator, addr, data, module;
+    ddr3_mem_t* mem;
+
+    systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    if (systf_handle == NULL) {
+        return ddr3_mem_error("failed to obtain systf handle");
+    }
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    if (arg_iterator == NULL ||
+        (addr = vpi_scan(arg_iterator)) == NULL ||
+        (data = vpi_scan(arg_iterator)) == NULL) {
+        return ddr3_mem_error("requires 2 arguments");
+    }
+    if (vpi_scan(arg_iterator) != NULL) {
+        vpi_free_object(arg_iterator);
+        return ddr3_mem_error("too many arguments");
+    }
+
+    if (vpi_get(vpiSize, addr) > 32) {
+        return ddr3_mem_error("'addr' must be at most 32 bits");
+    }
+
+    module = ddr3_mem_module(systf_handle);
+    if (module == NULL) {
+        return ddr3_mem_error("must be called from within a module");
+    }
+
+    mem = ddr3_mem_find(vpi_get_str(vpiFullName, module));
+    if (mem == NULL && (mem = ddr3_mem_create(vpi_get_str(vpiFullName, module))) == NULL) {
+        return 0;
+    }
+
+    if (op != DDR3MemErase) {
+        const int bits = vpi_get(vpiSize, data);
+        if (bits % 8 != 0 || bits > DDR3_MEM_MAX_WIDTH) {
+            return ddr3_mem_error("'data' must be whole bytes, and at most 1024 bits");
+        } else if (mem->width != 0 && mem->width != (uint32_t)bits / 8) {
+            return ddr3_mem_error("'data' widths differ");
+        }
+        mem->width = bits / 8;
+    }
+
+    vpi_put_userdata(systf_handle, (void*)mem);
+
+    return 0;
+}
+
+static int ddr3_mem_calltf(char* user_data)
+{
+    const ddr3_mem_op_t op = *(const ddr3_mem_op_t*)user_data;
+    vpiHandle systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    ddr3_mem_t* mem = (ddr3_mem_t*)vpi_get_userdata(systf_handle);
+    vpiHandle arg_iterator, addr_h, data_h;
+    uint8_t data[DDR3_MEM_MAX_BYTES];
+    uint8_t known[DDR3_MEM_MAX_BYTES];
+    s_vpi_vecval vec[DDR3_MEM_MAX_WIDTH / 32];
+    s_vpi_value val;
+    uint32_t addr;
+
+    if (mem == NULL || mem->width == 0) {
+        return ddr3_mem_error("'*mem' problem");
+    }
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    addr_h = vpi_scan(arg_iterator);
+    data_h = vpi_scan(arg_iterator);
+    vpi_free_object(arg_iterator);
+
+    if (!ddr3_mem_address(mem, addr_h, &addr)) {
+        vpi_control(vpiFinish, 1);
+        return 0;
+    }
+
+    switch (op) {
+    case DDR3MemWrite: {
+        // Bytes with X/Z bits are stored as unknown
+        uint32_t i = 0;
+
+        val.format = vpiVectorVal;
+        vpi_get_value(data_h, &val);
+        while (i < mem->width) {
+            const uint32_t shift = (i & 3) * 8;
+            const bool valid = ((val.value.vector[i >> 2].bval >> shift) & 0xFF) == 0;
+            uint32_t n = 0;
+
+            while (i + n < mem->width) {
+                const uint32_t j = i + n, s = (j & 3) * 8;
+                if ((((val.value.vector[j >> 2].bval >> s) & 0xFF) == 0) != valid) {
+                    break;
+                }
+                data[n++] = (uint8_t)(val.value.vector[j >> 2].aval >> s);
+            }
+            if (valid) {
+                shadow_store(&mem->mem, addr + i, data, n);
+            } else {
+                shadow_erase(&mem->mem, addr + i, n);
+            }
+            i += n;
+        }
+        mem->writes++;
+        break;
+    }
+
+    case DDR3MemRead:
+        // Unknown bytes read as X
+        if (shadow_read(&mem->mem, addr, data, known, mem->width) < mem->width) {
+            mem->misses++;
+        }
+        memset(vec, 0, sizeof(vec));
+        for (uint32_t i=0; i<mem->width; i++) {
+            const uint32_t shift = (i & 3) * 8;
+            vec[i >> 2].aval |= (PLI_INT32)((uint32_t)(known[i] ? data[i] : 0xFF) << shift);
+            vec[i >> 2].bval |= (PLI_INT32)((uint32_t)(known[i] ? 0x00 : 0xFF) << shift);
+        }
+        val.format = vpiVectorVal;
+        val.value.vector = vec;
+        vpi_put_value(data_h, &val, NULL, vpiNoDelay);
+        mem->reads++;
+        break;
+
+    case DDR3MemErase:
+        // Erase 'data' words, from 'addr'
+        val.format = vpiIntVal;
+        vpi_get_value(data_h, &val);
+        shadow_erase(&mem->mem, addr, (size_t)(uint32_t)val.value.integer * mem->width);
+        mem->erases++;
+        break;
+    }
+
+    return 0;
+}
+
+void ddr3_mem_register(void)
+{
+    s_vpi_systf_data tf_data;
+
+    for (int i=0; i<3; i++) {
+        tf_data.type      = vpiSysTask;
+        tf_data.tfname    = (PLI_BYTE8*)ddr3_mem_names[i];
+        tf_data.calltf    = ddr3_mem_calltf;
+        tf_data.compiletf = ddr3_mem_compiletf;
+        tf_data.sizetf    = NULL;
+        tf_data.user_data = (PLI_BYTE8*)&ddr3_mem_ops[i];
+
+        vpi_register_systf(&tf_data);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef __DDR3MEM_H__
+#define __DDR3MEM_H__
+
+
+#include "usb/ddr3shadow.h"
+#include <vpi_user.h>
+#include <stdint.h>
+
+/**
+ * Sparse, paged storage for the DDR3 bench model ('bench/ddr3.v'), so that the
+ * contents of the (2 Gb) part are held in C, rather than in a Verilog memory-
+ * array (or in the per-bank files of 'MAX_MEM').
+ *
+ * Usage (by 'bench/ddr3.v', when built with '__ddr3_vpi_mem' defined):
+ *   $ddr3_mem_write(addr, data);
+ *   $ddr3_mem_read(addr, data);
+ *   $ddr3_mem_erase(addr, words);
+ *
+ * where 'addr' is the word-address ('{bank, row, col} / BL_MAX'), and 'data' is
+ * a whole burst ('BL_MAX * DQ_BITS' bits), and bytes of 'data' that contain any
+ * X/Z bits are stored as unknown, and read back as X.
+ *
+ * Plusargs:
+ *   +ddr3_preload=<file>  --  load a '.hex' file (of bytes, with '@<address>'
+ *                             records), else a raw binary image;
+ *   +ddr3_base=<address>  --  byte-address of a raw binary image (default: 0);
+ *   +ddr3_dump=<file>     --  write the known bytes, as a '.hex' file, at the
+ *                             end of the simulation;
+ *
+ * NOTE:
+ *  - byte-addresses are word-addresses times the bytes per word, with byte 0
+ *    being 'data[7:0]', so they are DDR3 (bank, row, column) addresses, and
+ *    not the AXI4 addresses of the memory controller;
+ *  - the storage is per model instance, and the files of instance N > 0 have
+ *    '.<N>' appended to their names;
+ */
+#define DDR3_MEM_MAX_INSTS  4
+#define DDR3_MEM_MAX_WIDTH  1024
+#define DDR3_MEM_MAX_BYTES  (DDR3_MEM_MAX_WIDTH / 8)
+#define DDR3_MEM_MAX_NAME   256
+
+typedef struct {
+    char name[DDR3_MEM_MAX_NAME];
+    int index;
+    uint32_t width;             // bytes per word
+    ddr3_shadow_t mem;
+    // Statistics
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t misses;            // reads of words with unknown bytes
+    uint64_t erases;
+} ddr3_mem_t;
+
+
+void ddr3_mem_register(void);
+
+
+#endif  /* __DDR3MEM_H__ */
@@ -1,10 +1,18 @@
 #include "ulpivpi.h"
+#include "usb/usbpcap.h"
 #include <vpi_user.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 
+#define ULPIM_PCAP_PLUSARG "+ulpi_pcap="
+#define ULPIM_UFRAME_PLUSARG "+ulpi_uframes="
+
+// 125 us microframes, of the 60 MHz ULPI clock
+#define ULPIM_UFRAME_CYCLES 7500
+
+
 /**
  * ULPI signals being monitored.
  */
@@ -19,11 +27,17 @@ typedef struct {
     int t_prec;
     uint64_t t_recip;
     ulpi_bus_t ulpi_prev;
+    usb_pcap_t pcap;
+    uint64_t cycle;
+    uint64_t uframes;
+    uint64_t uframe_base[ULPI_NUM_CLASSES];
+    double payload_min;
+    double payload_max;
+    FILE* uframe_log;
 } ulpim_handles_t;
 
 PLI_INT32 ulpim_StartOfSim(p_cb_data cb_data)
 {
-    vpiHandle systf_handle;
     return 0;
 }
 
@@ -53,6 +67,79 @@ static void ulpim_store_bus(ulpim_handles_t* ulpim_data, ulpi_bus_t* bus)
     bus->data.b = (uint8_t)curr_value.value.vector->bval;
 }
 
+/**
+ * At the end of each microframe, compute the share of each class of cycles,
+ * and log them (if '+ulpi_uframes=<file>' was given).
+ */
+static void ulpim_uframe(ulpim_handles_t* ulpim_data)
+{
+    const uint64_t* cycles = ulpim_data->pcap.cycles;
+    const double scale = 100.0 / ULPIM_UFRAME_CYCLES;
+    const double payload = (double)(cycles[UlpiPayload] -
+                                    ulpim_data->uframe_base[UlpiPayload]) * scale;
+
+    if (ulpim_data->uframes++ == 0 || payload < ulpim_data->payload_min) {
+        ulpim_data->payload_min = payload;
+    }
+    if (payload > ulpim_data->payload_max) {
+        ulpim_data->payload_max = payload;
+    }
+
+    if (ulpim_data->uframe_log != NULL) {
+        fprintf(ulpim_data->uframe_log, "%8lu", ulpim_data->uframes - 1);
+        for (int i=0; i<ULPI_NUM_CLASSES; i++) {
+            fprintf(ulpim_data->uframe_log, "\t%5.1f",
+                    (double)(cycles[i] - ulpim_data->uframe_base[i]) * scale);
+        }
+        fprintf(ulpim_data->uframe_log, "\n");
+    }
+    memcpy(ulpim_data->uframe_base, cycles, sizeof(ulpim_data->uframe_base));
+}
+
+/**
+ * Summarise how the ULPI bus cycles were used, over the whole run.
+ */
+static void ulpim_report(ulpim_handles_t* ulpim_data)
+{
+    const uint64_t* cycles = ulpim_data->pcap.cycles;
+    const double total = (double)ulpim_data->cycle;
+
+    if (ulpim_data->cycle == 0) {
+        return;
+    }
+
+    vpi_printf("$ulpi_monitor: ULPI bus utilisation over %lu cycles:\n", ulpim_data->cycle);
+    for (int i=0; i<ULPI_NUM_CLASSES; i++) {
+        vpi_printf("  %-12s %10lu  %5.1f%%\n", ulpi_class_string((ulpi_class_t)i),
+                   cycles[i], (double)cycles[i] * 100.0 / total);
+    }
+    if (ulpim_data->uframes > 0) {
+        vpi_printf("  payload per microframe: %.1f%% min, %.1f%% max (%lu microframes)\n",
+                   ulpim_data->payload_min, ulpim_data->payload_max, ulpim_data->uframes);
+    }
+}
+
+/**
+ * Flush & close the capture file, once the simulation has finished.
+ */
+static int ulpim_EndOfSim(p_cb_data cb_data)
+{
+    ulpim_handles_t* ulpim_data = (ulpim_handles_t*)cb_data->user_data;
+    usb_pcap_t* pcap = &ulpim_data->pcap;
+
+    vpi_printf("$ulpi_monitor: captured %u USB packets (%lu bytes, %u truncated)\n",
+               pcap->packets, pcap->bytes, pcap->truncated);
+    ulpim_report(ulpim_data);
+    usb_pcap_close(pcap);
+
+    if (ulpim_data->uframe_log != NULL) {
+        fclose(ulpim_data->uframe_log);
+        ulpim_data->uframe_log = NULL;
+    }
+
+    return 0;
+}
+
 static int ulpim_set_handles(ulpim_handles_t** data)
 {
     vpiHandle systf_handle, arg_iterator, arg_handle;
@@ -165,6 +252,45 @@ static int ulpim_set_handles(ulpim_handles_t** data)
 
     ulpim_store_bus(ulpim_data, &ulpim_data->ulpi_prev);
 
+    /* stream the decoded USB packets to a pcap file, if one is given */
+    const char* path = ulpi_plusarg(ULPIM_PCAP_PLUSARG, NULL);
+    if (usb_pcap_open(&ulpim_data->pcap, path) < 0) {
+        vpi_printf("ERROR: $ulpi_monitor cannot create '%s'\n", path);
+        vpi_control(vpiFinish, 1); /* abort simulation */
+        return 0;
+    }
+
+    /* per-microframe bus utilisation */
+    ulpim_data->cycle = 0;
+    ulpim_data->uframes = 0;
+    ulpim_data->payload_min = 0.0;
+    ulpim_data->payload_max = 0.0;
+    memset(ulpim_data->uframe_base, 0, sizeof(ulpim_data->uframe_base));
+    ulpim_data->uframe_log = NULL;
+
+    path = ulpi_plusarg(ULPIM_UFRAME_PLUSARG, NULL);
+    if (path != NULL) {
+        if ((ulpim_data->uframe_log = fopen(path, "w")) == NULL) {
+            vpi_printf("ERROR: $ulpi_monitor cannot create '%s'\n", path);
+            vpi_control(vpiFinish, 1); /* abort simulation */
+            return 0;
+        }
+        fprintf(ulpim_data->uframe_log, "uframe");
+        for (int i=0; i<ULPI_NUM_CLASSES; i++) {
+            fprintf(ulpim_data->uframe_log, "\t%s", ulpi_class_string((ulpi_class_t)i));
+        }
+        fprintf(ulpim_data->uframe_log, "\n");
+    }
+
+    s_cb_data cb;
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = ulpim_EndOfSim;
+    cb.user_data = (PLI_BYTE8*)ulpim_data;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+    vpi_free_object(vpi_register_cb(&cb));
+
     vpi_put_userdata(systf_handle, (void*)ulpim_data);
     *data = ulpim_data;
 
@@ -180,6 +306,11 @@ static int ulpim_set_handles(ulpim_handles_t** data)
  *  - nxt      --  PHY-to-link
  *  - stp      --  link-to-PHY
  *  - data[8]  --  bidirectional (and 0 idle)
+ * Call it at each positive clock-edge, and the decoded USB packets are written
+ * to the pcap file given by '+ulpi_pcap=<file>' (if any), and each cycle is
+ * classified, with the bus utilisation reported at the end (and per-microframe
+ * to '+ulpi_uframes=<file>', if given):
+ *   always @(posedge clock) $ulpi_monitor(clock, rst_n, dir, nxt, stp, data);
  */
 static int ulpim_compiletf(char* user_data)
 {
@@ -190,8 +321,7 @@ static int ulpim_compiletf(char* user_data)
 
 static int ulpim_calltf(char* user_data)
 {
-    vpiHandle systf_handle, arg_iterator, net_handle, time_handle;
-    s_vpi_value current_value;
+    vpiHandle systf_handle;
     ulpim_handles_t* ulpim_data;
     s_vpi_time curr_time;
     ulpi_bus_t ulpi_curr;
@@ -218,36 +348,14 @@ static int ulpim_calltf(char* user_data)
     tick_ns /= ulpim_data->t_recip;
 #endif /* !0 */
 
-#if 0
-    /* read current 'rst_n' value */
-    net_handle = ulpim_data->rst_n;
-    current_value.format = vpiBinStrVal; /* read value as a string */
-    vpi_get_value(net_handle, &current_value);
-    vpi_printf("At: %8lu ns => signal %s has the value %s\n",
-               tick_ns,
-               vpi_get_str(vpiFullName, net_handle),
-               current_value.value.str);
-
-    net_handle = ulpim_data->dir;
-    current_value.format = vpiScalarVal;
-    vpi_get_value(net_handle, &current_value);
-    vpi_printf("At: %8lu ns => signal %s has the value %x\n",
-               tick_ns,
-               vpi_get_str(vpiFullName, net_handle),
-               current_value.value.scalar);
-#endif /* 0 */
-
     ulpim_store_bus(ulpim_data, &ulpi_curr);
 
-    if (ulpi_curr.dir != ulpim_data->ulpi_prev.dir) {
-        net_handle = ulpim_data->data;
-        current_value.format = vpiVectorVal;
-        vpi_get_value(net_handle, &current_value);
-        vpi_printf("At: %8lu ns => signal %s has the value (a: %2x, b: %2x)\n",
-                   tick_ns,
-                   vpi_get_str(vpiFullName, net_handle),
-                   current_value.value.vector[0].aval,
-                   current_value.value.vector[0].bval);
+    if (usb_pcap_step(&ulpim_data->pcap, &ulpi_curr, tick_ns) < 0) {
+        vpi_printf("ERROR: $ulpi_monitor pcap write failed\n");
+        vpi_control(vpiFinish, 2); /* abort simulation */
+    }
+    if (++ulpim_data->cycle % ULPIM_UFRAME_CYCLES == 0) {
+        ulpim_uframe(ulpim_data);
     }
     memcpy(&ulpim_data->ulpi_prev, &ulpi_curr, sizeof(ulpi_bus_t));
 
@@ -263,7 +371,6 @@ void ulpim_register(void)
     tf_data.compiletf = ulpim_compiletf;
     tf_data.sizetf    = 0;
     tf_data.user_data = 0;
-    vpi_printf("goats are the best\n");
     vpi_register_systf(&tf_data);
 }
 
@@ -1,34 +1,29 @@
 #include "packet_tb.h"
+#include "ulpivpi.h"
+#include "pfmodel.h"
+#include "scoreboard.h"
 
 #include <vpi_user.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
 #define NUM_TESTCASES 64
 
-#define SIG0 vpi0
-#define SIG1 vpi1
-#define SIGZ vpiZ
-#define SIGX vpiX
+#define PT_STREAM_PLUSARG  "+pt_stream="
+#define PT_W_DUTY_PLUSARG  "+pt_w_duty="
+#define PT_R_DUTY_PLUSARG  "+pt_r_duty="
+#define PT_LENGTHS_PLUSARG "+pt_lengths="
+#define PT_DROP_PLUSARG    "+pt_drop="
+#define PT_REDO_PLUSARG    "+pt_redo="
+#define PT_SEED_PLUSARG    "+pt_seed="
+#define PT_MODEL_PLUSARG   "+pt_model="
 
 
-/**
- * VPI scalar value, 0-5.
- */
-typedef uint8_t bit_t;
-
-/**
- * Uses the same ('aval', 'bval') encoding as VPI vectors (but only 8b).
- */
-typedef struct {
-    uint8_t a;
-    uint8_t b;
-} byte_t;
-
 typedef struct __fifo_sigs {
     bit_t clock;
     bit_t reset;
@@ -57,6 +52,7 @@ typedef struct __fifo_sigs {
  */
 typedef struct {
     const char* name;
+    bool quiet;
     void* data;
     int (*init)(fifo_sigs_t* sigs, void* data);
     int (*step)(fifo_sigs_t* sigs, void* data);
@@ -88,6 +84,8 @@ typedef struct __pt_state {
     testcase_t** tests;
     fifo_sigs_t prev;
     fifo_sigs_t sigs;
+    pf_model_t* model;
+    uint64_t hazards;
 } pt_state_t;
 
 typedef struct __test {
@@ -106,6 +104,7 @@ static int pt_failed(const char* mesg, const int line, pt_state_t* state);
 static int pt_get_signal(vpiHandle* dst, vpiHandle iter);
 static void pt_fetch_values(pt_state_t* state);
 static void pt_update_values(pt_state_t* state, fifo_sigs_t* next);
+static int pt_model_step(pt_state_t* state);
 static int pt_step(pt_state_t* state, fifo_sigs_t* next);
 
 void show_pt_state(pt_state_t* state);
@@ -280,6 +279,73 @@ static void pt_update_values(pt_state_t* state, fifo_sigs_t* next)
     memcpy(&state->sigs, next, sizeof(fifo_sigs_t));
 }
 
+static const char pf_hazard_strings[4][64] = {
+    {"none"},
+    {"held transfer released, but not stored (SRAM full)"},
+    {"'redo' replays bytes that have been overwritten"},
+    {"'redo' replays from the wrong address"},
+};
+
+/**
+ * Compare the sampled 'packet_fifo' outputs against those of the model, and
+ * then clock the model using the sampled inputs.
+ *
+ * Note: the model starts once 'reset' has been sampled, and 'r_lst'/'r_dat'
+ *   are only compared when 'r_vld' is asserted.
+ */
+static int pt_model_step(pt_state_t* state)
+{
+    pf_model_t* model = state->model;
+    const fifo_sigs_t* curr = &state->sigs;
+    pf_outputs_t out;
+    pf_inputs_t in;
+
+    if (curr->reset != SIG1 && (curr->reset != SIG0 || !model->primed)) {
+        return 0;
+    }
+
+    if (curr->reset == SIG0) {
+        pf_outputs(model, &out);
+
+        const bool level = curr->level.b == 0x00 && curr->level.a == (uint8_t)out.level;
+        const bool w_rdy = curr->w_rdy == (out.s_tready ? SIG1 : SIG0);
+        const bool r_vld = curr->r_vld == (out.m_tvalid ? SIG1 : SIG0);
+        const bool r_dat = !out.m_tvalid || (curr->r_dat.b == 0x00 &&
+                                             curr->r_dat.a == out.m_tdata &&
+                                             curr->r_lst == (out.m_tlast ? SIG1 : SIG0));
+
+        if (!level || !w_rdy || !r_vld || !r_dat) {
+            vpi_printf("PF\t#%8lu cyc =>\tdiverged from the model, expected:\n", state->cycle);
+            vpi_printf("\tlevel: 0x%04x, r: {v: %u, l: %u, d: 0x%04x}, w_rdy: %u\n",
+                       out.level, out.m_tvalid, out.m_tlast, out.m_tdata, out.s_tready);
+            vpi_printf("\tsampled: ");
+            fifo_sigs_show(&state->sigs);
+            return pt_failed("MODEL", __LINE__, state);
+        }
+    }
+
+    in.reset = curr->reset == SIG1;
+    in.drop = curr->drop == SIG1;
+    in.save = curr->save == SIG1;
+    in.redo = curr->redo == SIG1;
+    in.next = curr->next == SIG1;
+    in.s_tvalid = curr->w_vld == SIG1;
+    in.s_tkeep = in.s_tvalid;
+    in.s_tlast = curr->w_lst == SIG1;
+    in.s_tdata = curr->w_dat.a;
+    in.m_tready = curr->r_rdy == SIG1;
+    pf_clock(model, &in);
+
+    const pf_hazard_t hazard = pf_hazard(model);
+    if (hazard != PF_NONE) {
+        // The RTL differs from the intended behaviour (see 'pfmodel.h')
+        vpi_printf("PF\t#%8lu cyc =>\tWARNING: %s\n", state->cycle, pf_hazard_strings[hazard]);
+        state->hazards++;
+    }
+
+    return 0;
+}
+
 //
 // Todo: keep progressing through the test-cases ...
 //
@@ -291,6 +357,10 @@ static int pt_step(pt_state_t* state, fifo_sigs_t* next)
     bool changed = memcmp(prev, curr, sizeof(fifo_sigs_t)) != 0;
     int result;
 
+    if (state->model != NULL && pt_model_step(state) < 0) {
+        return -1;
+    }
+
     if (state->test_curr < state->test_num) {
         testcase_t* test = state->tests[state->test_curr];
 
@@ -317,6 +387,10 @@ static int pt_step(pt_state_t* state, fifo_sigs_t* next)
         // No more tests remaining
         vpi_printf("PT\t#%8lu cyc =>\tAll testbenches completed [%s:%d]\n",
                    cycle, __FILE__, __LINE__);
+        if (state->hazards > 0) {
+            vpi_printf("PF\t%lu cycles hit known 'packet_fifo' hazards (see 'pfmodel.h')\n",
+                       state->hazards);
+        }
         result = 2;
     }
 
@@ -324,7 +398,8 @@ static int pt_step(pt_state_t* state, fifo_sigs_t* next)
         memcmp(curr, next, sizeof(fifo_sigs_t)) != 0 ||
         memcmp(prev, next, sizeof(fifo_sigs_t)) != 0;
 
-    if (changed) {
+    if (changed && (state->test_curr >= state->test_num ||
+                    !state->tests[state->test_curr]->quiet)) {
         vpi_printf("\t@%8lu ns  =>\t", state->tick_ns);
         fifo_sigs_show(next);
     }
@@ -359,17 +434,16 @@ typedef struct __tc_state {
 
 static void tc_state_show(tc_state_t* st)
 {
-    char str[2048];
-    int p = 0;
-    for (int i=0; i<st->size; i++) {
-        p += sprintf(&str[p], "0x%02x, ", st->buf[i]);
-    }
     vpi_printf("ST: {\n");
     vpi_printf("  step: %d,\n", st->step);
     vpi_printf("  size: %d,\n", st->size);
     vpi_printf("  head: %d,\n", st->head);
     vpi_printf("  tail: %d,\n", st->tail);
-    vpi_printf("  buf[256]: {\n    %s\n  }\n};\n", str);
+    vpi_printf("  buf[256]: {");
+    for (int i=0; i<st->size; i++) {
+        vpi_printf("%s0x%02x,", (i & 15) == 0 ? "\n    " : " ", st->buf[i]);
+    }
+    vpi_printf("\n  }\n};\n");
 }
 
 static int store_packet(fifo_sigs_t* curr, tc_state_t* st)
@@ -471,6 +545,7 @@ testcase_t* test_waitrst(void)
 
     st->step = 0;
     tc->name = tc_waitrst_name;
+    tc->quiet = false;
     tc->data = st;
     tc->init = tc_waitrst_init;
     tc->step = tc_waitrst_step;
@@ -557,6 +632,7 @@ testcase_t* test_wrdata1(uint8_t len)
     st->step = 0;
     st->size = (uint32_t)len;
     tc->name = tc_wrdata1_name;
+    tc->quiet = false;
     tc->data = st;
     tc->init = tc_wrdata1_init;
     tc->step = tc_wrdata1_step;
@@ -680,6 +756,7 @@ testcase_t* test_wr_redo(uint8_t len)
     st->step = 0;
     st->size = (uint32_t)len;
     tc->name = tc_wr_redo_name;
+    tc->quiet = false;
     tc->data = st;
     tc->init = tc_wr_redo_init;
     tc->step = tc_wr_redo_step;
@@ -788,6 +865,7 @@ testcase_t* test_wr_drop(uint8_t len)
     st->step = 0;
     st->size = (uint32_t)len;
     tc->name = tc_wr_drop_name;
+    tc->quiet = false;
     tc->data = st;
     tc->init = tc_wr_drop_init;
     tc->step = tc_wr_drop_step;
@@ -883,6 +961,7 @@ testcase_t* test_stop_go(void)
     st->step = 0;
     st->size = 32;
     tc->name = tc_stop_go_name;
+    tc->quiet = false;
     tc->data = st;
     tc->init = tc_stop_go_init;
     tc->step = tc_stop_go_step;
@@ -890,6 +969,419 @@ testcase_t* test_stop_go(void)
     return tc;
 }
 
+// -- STREAM PACKETS, BACK-TO-BACK -- //
+
+/**
+ * Sustained-throughput (and stress) test, that stores and fetches packets back
+ * to back, with random 'w_vld' and 'r_rdy' duty-cycles, and packet-lengths
+ * drawn from one of the following distributions:
+ *  - fixed   : every packet is 'len_max' bytes;
+ *  - uniform : lengths are uniform over 'len_min..len_max';
+ *  - bulk    : runs of 'len_max'-byte packets, each run terminated by a short
+ *              packet (like USB Bulk transfers);
+ * and 'drop' (or 'redo') replaces 'save' (or 'next') for the given percentage
+ * of packets. The expected packets are queued by a scoreboard.
+ *
+ * NOTE:
+ *  - 'save'/'drop' is asserted for the cycle after each 'w_lst', and 'next'/
+ *    'redo' for the cycle after each 'r_lst' (with 'r_rdy' LO), as per the
+ *    other tests;
+ *  - a packet-boundary stall is a cycle where the reader wants data, and at
+ *    least one saved packet is waiting, but 'r_vld' is LO;
+ *  - with 'LAST_ON_SAVE', the writer idles for the cycle after 'save', as
+ *    'packet_fifo' commits the packet a cycle later;
+ *  - the writer only starts a packet if the FIFO has room for it, counting
+ *    from the start of the packet being fetched, as 'w_rdy' ignores the bytes
+ *    that 'redo' would replay, and (with 'LAST_ON_SAVE') the last byte is
+ *    released, but not stored, if the FIFO is full when 'save_q' commits the
+ *    packet;
+ *  - with 'redo' enabled, packets need at least 2 bytes, as (with 'OUTREG = 2')
+ *    a 1-byte packet passes the output-register before 'next' is asserted for
+ *    the previous packet, so its 'rprev' (replay) address is skipped;
+ *  - packets left over from the previous tests (e.g., the remaining chunks of
+ *    packets longer than 'MAX_LENGTH') are drained first;
+ */
+#define TS_TIMEOUT  10000
+#define TS_DRAINED  8
+
+typedef enum {
+    LenFixed,
+    LenUniform,
+    LenBulk,
+} ts_dist_t;
+
+static const char ts_dist_strings[3][8] = {
+    {"fixed"}, {"uniform"}, {"bulk"},
+};
+
+typedef struct __ts_state {
+    int step;
+    uint32_t packets;
+    uint8_t w_duty;
+    uint8_t r_duty;
+    uint8_t drop;
+    uint8_t redo;
+    ts_dist_t dist;
+    uint32_t len_min;
+    uint32_t len_max;
+    uint32_t depth;
+    scoreboard_t* sb;
+    // Writer
+    uint32_t w_pkts;
+    uint32_t w_rem;
+    // Reader
+    uint32_t r_pkts;
+    uint32_t idle;
+    // Measurements
+    uint64_t cycles;
+    uint64_t bytes;
+    uint64_t level_sum;
+    uint32_t level_max;
+    uint32_t w_stalls;
+    uint32_t r_stalls;
+    uint32_t boundary;
+    char name[96];
+} ts_state_t;
+
+static uint32_t ts_length(ts_state_t* st)
+{
+    const uint32_t span = st->len_max - st->len_min + 1;
+
+    switch (st->dist) {
+    case LenUniform:
+        return st->len_min + (uint32_t)rand() % span;
+    case LenBulk:
+        if ((rand() & 0x03) != 0 || st->len_max == st->len_min) {
+            return st->len_max;
+        }
+        return st->len_min + (uint32_t)rand() % (span - 1);
+    case LenFixed:
+    default:
+        return st->len_max;
+    }
+}
+
+static void ts_state_report(ts_state_t* st)
+{
+    const double cycles = st->cycles > 0 ? (double)st->cycles : 1.0;
+    const scoreboard_t* sb = st->sb;
+
+    vpi_printf("\t%u packets, %lu bytes, in %lu cycles: %.3f bytes/cycle\n",
+               st->r_pkts, st->bytes, st->cycles, (double)st->bytes / cycles);
+    vpi_printf("\t%lu packets saved, %lu dropped, %lu redone\n",
+               sb->saved, sb->dropped, sb->redone);
+    vpi_printf("\tlevel: %.1f average, %u maximum\n",
+               (double)st->level_sum / cycles, st->level_max);
+    vpi_printf("\tstalls: %u write (%.1f%%), %u read (%.1f%%), %u packet-boundary (%.1f%%)\n",
+               st->w_stalls, st->w_stalls * 100.0 / cycles,
+               st->r_stalls, st->r_stalls * 100.0 / cycles,
+               st->boundary, st->boundary * 100.0 / cycles);
+}
+
+static int ts_store(fifo_sigs_t* curr, ts_state_t* st)
+{
+    const bool saved = curr->save == SIG1;
+    curr->save = SIG0;
+    curr->drop = SIG0;
+
+    if (curr->w_vld == SIG1) {
+        if (curr->w_rdy != SIG1) {
+            st->w_stalls++;
+            return 0;
+        }
+        st->idle = 0;
+        if (--st->w_rem == 0) {
+            // Packet stored, so 'save' (or 'drop') it, while idle for a cycle
+            curr->w_vld = SIG0;
+            curr->w_lst = SIG0;
+            curr->w_dat.a = 0x00;
+            curr->w_dat.b = 0xFF;
+            if (rand() % 100 < st->drop) {
+                curr->drop = SIG1;
+                sb_drop(st->sb);
+            } else {
+                curr->save = SIG1;
+                sb_save(st->sb);
+            }
+            return 0;
+        }
+    }
+
+    if (saved) {
+        // Idle while 'save_q' commits the packet, as the chunk-length (when
+        // 'USE_LENGTH') is counted from the previous packet until then
+        return 0;
+    }
+
+    if (st->w_rem == 0 && st->depth > st->len_max + 2 &&
+        sb_stored(st->sb) + st->len_max + 2 > st->depth) {
+        // Only start a packet if it fits (see NOTE)
+        curr->w_vld = SIG0;
+        return 0;
+    }
+
+    if (st->w_rem == 0 && st->w_pkts < st->packets) {
+        st->w_rem = ts_length(st);
+        st->w_pkts++;
+    }
+
+    if (st->w_rem > 0 && rand() % 100 < st->w_duty) {
+        uint8_t byte = (uint8_t)rand();
+        if (sb_push(st->sb, byte) < 0) {
+            pt_error("overflow, stream packet");
+            return -1;
+        }
+        curr->w_vld = SIG1;
+        curr->w_lst = st->w_rem == 1 ? SIG1 : SIG0;
+        curr->w_dat.a = byte;
+        curr->w_dat.b = 0x00;
+    } else {
+        curr->w_vld = SIG0;
+        curr->w_lst = SIG0;
+        curr->w_dat.a = 0x00;
+        curr->w_dat.b = 0xFF;
+    }
+
+    return 0;
+}
+
+static int ts_fetch(fifo_sigs_t* curr, ts_state_t* st, uint64_t queued)
+{
+    const bool wants = curr->r_rdy == SIG1 || curr->next == SIG1 || curr->redo == SIG1;
+    curr->next = SIG0;
+    curr->redo = SIG0;
+
+    if (curr->r_rdy == SIG1 && curr->r_vld == SIG1) {
+        if (sb_check(st->sb, curr->r_dat.a, curr->r_lst == SIG1) < 0 ||
+            curr->r_dat.b != 0x00) {
+            fifo_sigs_show(curr);
+            sb_show(st->sb);
+            pt_error("fetched-data check, stream");
+            return -1;
+        }
+
+        st->bytes++;
+        st->idle = 0;
+
+        if (curr->r_lst == SIG1) {
+            if (rand() % 100 < st->redo) {
+                curr->redo = SIG1;
+                sb_redo(st->sb);
+            } else {
+                curr->next = SIG1;
+                sb_next(st->sb);
+                st->r_pkts++;
+            }
+            curr->r_rdy = SIG0;
+            return 0;
+        }
+    } else if (wants) {
+        st->r_stalls += curr->r_rdy == SIG1;
+        if (queued > 0) {
+            st->boundary++;
+        }
+    }
+
+    curr->r_rdy = rand() % 100 < st->r_duty ? SIG1 : SIG0;
+
+    return 0;
+}
+
+static int tc_stream_init(fifo_sigs_t* curr, void* data)
+{
+    ts_state_t* st = (ts_state_t*)data;
+    if (st->sb != NULL) {
+        sb_free(st->sb);
+    }
+    st->sb = sb_create();
+    st->step = 0;
+    st->w_pkts = 0;
+    st->w_rem = 0;
+    st->r_pkts = 0;
+    st->idle = 0;
+    st->cycles = 0;
+    st->bytes = 0;
+    st->level_sum = 0;
+    st->level_max = 0;
+    st->w_stalls = 0;
+    st->r_stalls = 0;
+    st->boundary = 0;
+    return 0;
+}
+
+static int tc_stream_step(fifo_sigs_t* curr, void* data)
+{
+    ts_state_t* st = (ts_state_t*)data;
+    assert(curr->clock == SIG1 && curr->reset == SIG0 && st != NULL);
+
+    switch (st->step) {
+
+    case 0:
+        // Drain any packets (or chunks) left over from the previous tests
+        curr->next = SIG0;
+        if (curr->r_vld == SIG1 && curr->r_rdy == SIG1) {
+            st->idle = 0;
+            if (curr->r_lst == SIG1) {
+                curr->next = SIG1;
+                curr->r_rdy = SIG0;
+                break;
+            }
+        } else if (++st->idle > TS_DRAINED && curr->w_rdy == SIG1) {
+            curr->r_rdy = SIG0;
+            st->idle = 0;
+            st->step = 1;
+            break;
+        }
+        curr->r_rdy = SIG1;
+        break;
+
+    case 1: {
+        // Packets saved before this cycle, as 'ts_store()' may save another
+        const uint64_t queued = sb_packets(st->sb);
+
+        st->cycles++;
+        if (curr->level.b == 0x00) {
+            st->level_sum += curr->level.a;
+            st->level_max = curr->level.a > st->level_max ? curr->level.a : st->level_max;
+        }
+
+        if (ts_store(curr, st) < 0 || ts_fetch(curr, st, queued) < 0) {
+            return -1;
+        }
+
+        if (st->w_pkts == st->packets && st->w_rem == 0 && curr->save == SIG0 &&
+            curr->drop == SIG0 && sb_packets(st->sb) == 0) {
+            st->step = 2;
+        } else if (++st->idle > TS_TIMEOUT) {
+            ts_state_report(st);
+            sb_show(st->sb);
+            pt_error("stream timed out");
+            return -1;
+        }
+        break;
+    }
+
+    case 2:
+        curr->next = SIG0;
+        curr->redo = SIG0;
+        ts_state_report(st);
+        return 1;
+
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Stream 'packets' back to back, with 'w_vld' (and 'r_rdy') asserted for
+ * 'w_duty' (and 'r_duty') percent of the cycles (when the writer is not
+ * stalled), and with 'drop' (and 'redo') percent of the packets dropped (and
+ * redone).
+ */
+testcase_t* test_stream(uint32_t depth, uint32_t packets, uint8_t w_duty, uint8_t r_duty,
+                        ts_dist_t dist, uint32_t len_min, uint32_t len_max,
+                        uint8_t drop, uint8_t redo)
+{
+    testcase_t* tc = malloc(sizeof(testcase_t));
+    ts_state_t* st = malloc(sizeof(ts_state_t));
+    int n;
+
+    st->step = 0;
+    st->depth = depth;
+    st->packets = packets;
+    st->w_duty = w_duty;
+    st->r_duty = r_duty;
+    st->drop = drop;
+    st->redo = redo;
+    st->dist = dist;
+    st->len_min = len_min > 0 ? len_min : 1;
+    st->len_max = len_max > st->len_min ? len_max : st->len_min;
+    st->len_max = st->len_max < SB_MAX_PACKET ? st->len_max : SB_MAX_PACKET;
+    st->sb = NULL;
+
+    n = snprintf(st->name, sizeof(st->name), "STREAM (w: %u%%, r: %u%%, %s %u..%u",
+                 w_duty, r_duty, ts_dist_strings[dist], st->len_min, st->len_max);
+    if (drop > 0 || redo > 0) {
+        n += snprintf(&st->name[n], sizeof(st->name) - n, ", drop: %u%%, redo: %u%%",
+                      drop, redo);
+    }
+    snprintf(&st->name[n], sizeof(st->name) - n, ")");
+
+    tc->name = st->name;
+    tc->quiet = true;
+    tc->data = st;
+    tc->init = tc_stream_init;
+    tc->step = tc_stream_step;
+
+    return tc;
+}
+
+/**
+ * Parse the '+pt_lengths=<fixed|uniform|bulk>:<min>:<max>' plusarg.
+ */
+static void ts_parse_lengths(const char* arg, ts_dist_t* dist, uint32_t* len_min,
+                             uint32_t* len_max)
+{
+    unsigned lo = *len_min, hi = *len_max;
+
+    for (int i=0; i<3; i++) {
+        size_t n = strlen(ts_dist_strings[i]);
+        if (strncmp(arg, ts_dist_strings[i], n) == 0) {
+            *dist = (ts_dist_t)i;
+            arg += n;
+            break;
+        }
+    }
+
+    if (sscanf(arg, ":%u:%u", &lo, &hi) == 1) {
+        hi = lo;
+    }
+    *len_min = lo;
+    *len_max = hi;
+}
+
+/**
+ * Either a single stream test-case, configured using the plusargs, or a sweep
+ * of duty-cycles and length-distributions.
+ */
+static int tests_stream(testcase_t** tests, int i, uint32_t depth)
+{
+    const char* stream = ulpi_plusarg(PT_STREAM_PLUSARG, NULL);
+    const char* seed = ulpi_plusarg(PT_SEED_PLUSARG, NULL);
+
+    if (seed != NULL) {
+        srand((unsigned)strtoul(seed, NULL, 0));
+    }
+
+    if (stream != NULL) {
+        const char* w_duty = ulpi_plusarg(PT_W_DUTY_PLUSARG, "100");
+        const char* r_duty = ulpi_plusarg(PT_R_DUTY_PLUSARG, "100");
+        const char* lengths = ulpi_plusarg(PT_LENGTHS_PLUSARG, "uniform:1:8");
+        const char* drop = ulpi_plusarg(PT_DROP_PLUSARG, "0");
+        const char* redo = ulpi_plusarg(PT_REDO_PLUSARG, "0");
+        ts_dist_t dist = LenUniform;
+        uint32_t len_min = 1, len_max = 8;
+
+        ts_parse_lengths(lengths, &dist, &len_min, &len_max);
+        tests[i++] = test_stream(depth, (uint32_t)strtoul(stream, NULL, 0),
+                                 (uint8_t)atoi(w_duty), (uint8_t)atoi(r_duty),
+                                 dist, len_min, len_max,
+                                 (uint8_t)atoi(drop), (uint8_t)atoi(redo));
+        return i;
+    }
+
+    tests[i++] = test_stream(depth, 200, 100, 100, LenFixed, 8, 8, 0, 0);
+    tests[i++] = test_stream(depth, 200, 100, 100, LenUniform, 1, 8, 0, 0);
+    tests[i++] = test_stream(depth, 200, 50, 100, LenUniform, 1, 8, 0, 0);
+    tests[i++] = test_stream(depth, 200, 100, 50, LenUniform, 1, 8, 0, 0);
+    tests[i++] = test_stream(depth, 200, 70, 30, LenBulk, 1, 8, 0, 0);
+    tests[i++] = test_stream(depth, 200, 30, 70, LenBulk, 1, 8, 0, 0);
+    tests[i++] = test_stream(depth, 1000, 80, 60, LenUniform, 2, 8, 10, 10);
+
+    return i;
+}
 
 //
 //  VPI Callbacks
@@ -977,6 +1469,55 @@ static int cb_step_clock(p_cb_data cb_data)
     return 0;
 }
 
+/**
+ * Find the 'packet_fifo' instance (in the scope of the '$packet_tb' call), and
+ * read the parameters for the model.
+ */
+static int pt_model_params(vpiHandle systf_handle, pf_params_t* params)
+{
+    vpiHandle scope = vpi_handle(vpiScope, systf_handle);
+    vpiHandle iter = vpi_iterate(vpiModule, scope);
+    vpiHandle inst = NULL, param;
+    s_vpi_value x;
+
+    while (iter != NULL && (inst = vpi_scan(iter)) != NULL) {
+        if (strcmp(vpi_get_str(vpiDefName, inst), "packet_fifo") == 0) {
+            vpi_free_object(iter);
+            break;
+        }
+    }
+    if (inst == NULL) {
+        return -1;
+    }
+
+    iter = vpi_iterate(vpiParameter, inst);
+    while (iter != NULL && (param = vpi_scan(iter)) != NULL) {
+        const char* name = vpi_get_str(vpiName, param);
+        x.format = vpiIntVal;
+        vpi_get_value(param, &x);
+
+        if (strcmp(name, "DEPTH") == 0) {
+            params->depth = (uint32_t)x.value.integer;
+        } else if (strcmp(name, "OUTREG") == 0) {
+            params->outreg = (int)x.value.integer;
+        } else if (strcmp(name, "USE_LENGTH") == 0) {
+            params->use_length = x.value.integer != 0;
+        } else if (strcmp(name, "MAX_LENGTH") == 0) {
+            params->max_length = (uint32_t)x.value.integer;
+        } else if (strcmp(name, "SAVE_ON_LAST") == 0) {
+            params->save_on_last = x.value.integer != 0;
+        } else if (strcmp(name, "LAST_ON_SAVE") == 0) {
+            params->last_on_save = x.value.integer != 0;
+        } else if (strcmp(name, "NEXT_ON_LAST") == 0) {
+            params->next_on_last = x.value.integer != 0;
+        } else if (strcmp(name, "STORE_LASTS") == 0 && x.value.integer == 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 // Helper for parsing the argument-list.
 static int pt_get_signal(vpiHandle* dst, vpiHandle iter)
 {
@@ -1048,6 +1589,18 @@ static int pt_compiletf(char* user_data)
         return pt_error("FIFO 'r_dat' must be an 8-bit net");
     }
 
+    // Run the model in lock-step with 'packet_fifo', unless disabled
+    pf_params_t params = {16, 1, false, 8, true, false, true};
+    const char* model = ulpi_plusarg(PT_MODEL_PLUSARG, "on");
+
+    if (strcmp(model, "off") != 0) {
+        if (pt_model_params(systf_handle, &params) < 0) {
+            vpi_printf("PT\t'packet_fifo' not found (or unsupported), so not modelled\n");
+        } else {
+            state->model = pf_create(&params);
+        }
+    }
+
     state->cycle = 0;
     state->sync_flag = 0;
     state->test_curr = 0;
@@ -1062,6 +1615,7 @@ static int pt_compiletf(char* user_data)
     state->tests[i++] = test_wr_drop(8);
     state->tests[i++] = test_wr_drop(1);
     state->tests[i++] = test_stop_go();
+    i = tests_stream(state->tests, i, 1u << vpi_get(vpiSize, state->level));
     state->test_num = i;
 
     vpi_put_userdata(systf_handle, (void*)state);
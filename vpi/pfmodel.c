@@ -0,0 +1,302 @@
+#include "pfmodel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+pf_model_t* pf_create(const pf_params_t* params)
+{
+    pf_model_t* model = (pf_model_t*)malloc(sizeof(pf_model_t));
+    memset(model, 0, sizeof(pf_model_t));
+    memcpy(&model->p, params, sizeof(pf_params_t));
+
+    while ((1u << model->abits) < params->depth) {
+        model->abits++;
+    }
+    model->sram = (uint16_t*)malloc(params->depth * sizeof(uint16_t));
+    memset(model->sram, 0, params->depth * sizeof(uint16_t));
+
+    return model;
+}
+
+void pf_free(pf_model_t* model)
+{
+    free(model->sram);
+    free(model);
+}
+
+/**
+ * The outputs are all registered, for every 'OUTREG' setting.
+ */
+void pf_outputs(const pf_model_t* model, pf_outputs_t* out)
+{
+    const pf_model_t* m = model;
+    const uint16_t word = m->sram[m->raddr & (m->p.depth - 1)];
+
+    out->level = m->level_q;
+    out->s_tready = m->wready;
+
+    if (m->p.outreg == 0) {
+        out->m_tvalid = m->rvalid;
+        out->m_tlast = (word >> 8) & 1;
+        out->m_tdata = (uint8_t)word;
+    } else if (m->p.outreg == 1) {
+        out->m_tvalid = m->xvalid;
+        out->m_tlast = m->xlast;
+        out->m_tdata = m->xdata;
+    } else {
+        out->m_tvalid = m->mvalid;
+        out->m_tlast = m->mlast;
+        out->m_tdata = m->mdata;
+    }
+}
+
+pf_hazard_t pf_hazard(const pf_model_t* model)
+{
+    return model->hazard;
+}
+
+/**
+ * Tracks where 'redo' should replay from (the start of the oldest packet, at
+ * the output, that is not yet finished), and flags the cases where the RTL
+ * replays from elsewhere, or replays bytes that have since been overwritten.
+ */
+static void pf_clock_hazards(pf_model_t* m, const pf_inputs_t* in, const pf_outputs_t* out,
+                             bool finish_a, bool replay_a, bool release_a, bool store_w)
+{
+    const uint32_t amask = (m->p.depth << 1) - 1;
+    const bool take_w = out->m_tvalid && in->m_tready;
+    const bool stop_w = take_w && out->m_tlast;
+    const uint32_t rnext = (m->rtake + 1) & amask;
+
+    m->hazard = PF_NONE;
+    if (release_a && !store_w) {
+        m->hazard = PF_LOST_LAST;
+    } else if (replay_a && m->rplay != m->rtake_play) {
+        m->hazard = PF_WRONG_REPLAY;
+    } else if (replay_a && ((m->waddr - m->rplay) & amask) > m->p.depth) {
+        m->hazard = PF_OVERWRITTEN;
+    }
+
+    if (replay_a) {
+        // Follow the RTL, so that each hazard is only reported once
+        m->rtake = m->rplay;
+        m->rtake_play = m->rplay;
+        m->rtake_prev = m->rplay;
+        return;
+    }
+    if (finish_a) {
+        m->rtake_play = stop_w ? rnext : m->rtake_prev;
+    }
+    m->rtake_prev = stop_w ? rnext : m->rtake_prev;
+    m->rtake = take_w ? rnext : m->rtake;
+}
+
+/**
+ * Skid-buffer ('axis_skid', with 'BYPASS = 0') registers, for the output-
+ * register's (pre-edge) values.
+ */
+static void pf_clock_skid(pf_model_t* m, bool reset, bool m_tready)
+{
+    const bool s_tvalid = m->xvalid;
+    const bool s_tlast = m->xlast;
+    const uint8_t s_tdata = m->xdata;
+
+    const bool sready_next = m_tready || !(m->tvalid || (m->mvalid && s_tvalid));
+    const bool tvalid_next = !sready_next;
+    const bool mvalid_next = m->tvalid || s_tvalid || (m->mvalid && !m_tready);
+
+    // Datapath (not reset)
+    if (m->sready && (m_tready || !m->mvalid)) {
+        m->mdata = s_tdata;
+        m->mlast = s_tlast;
+    } else if (m->tvalid && m_tready) {
+        m->mdata = m->tdata;
+        m->mlast = m->tlast;
+    }
+    if (m->sready && !m_tready && m->mvalid) {
+        m->tdata = s_tdata;
+        m->tlast = s_tlast;
+    }
+
+    if (reset) {
+        m->sready = false;
+        m->mvalid = false;
+        m->tvalid = false;
+    } else {
+        m->sready = sready_next;
+        m->mvalid = mvalid_next;
+        m->tvalid = tvalid_next;
+    }
+}
+
+/**
+ * Evaluate the combinational signals, using the (pre-edge) register and input
+ * values, and then update all of the registers, at once.
+ */
+void pf_clock(pf_model_t* model, const pf_inputs_t* in)
+{
+    pf_model_t* m = model;
+    const pf_params_t* p = &m->p;
+    const uint32_t lmask = p->depth - 1;
+    const uint32_t amask = (p->depth << 1) - 1;
+    pf_outputs_t out;
+
+    pf_outputs(m, &out);
+
+    // -- Read-port control -- //
+
+    const bool xready = p->outreg == 1 ? in->m_tready : m->sready;
+    const uint16_t rword = m->sram[m->raddr & lmask];
+    bool fetch_w, rstop_w;
+
+    if (p->outreg == 0) {
+        fetch_w = m->rvalid && in->m_tready;
+        rstop_w = m->rvalid && ((rword >> 8) & 1) && in->m_tready;
+    } else {
+        fetch_w = m->rvalid && ((m->xvalid && xready) || !m->xvalid);
+        rstop_w = m->xvalid && m->xlast && xready;
+    }
+
+    // -- Packet commands -- //
+
+    const bool save_w = ((p->save_on_last && in->s_tvalid && m->wready && in->s_tlast) ||
+                         in->save) && !in->drop;
+    const bool accept_a = p->last_on_save ? m->save_q : save_w;
+    const bool reject_a = in->drop;
+    const bool finish_a = ((p->next_on_last && out.m_tvalid && in->m_tready && out.m_tlast) ||
+                           in->next) && !in->redo;
+    const bool replay_a = in->redo;
+
+    // -- Write-port control -- //
+
+    bool store_w, last_w, capture_a = false, release_a = false;
+    uint8_t data_w;
+
+    if (p->last_on_save) {
+        capture_a = in->s_tvalid && m->wready && in->s_tkeep;
+        release_a = m->xvld && ((m->xlst && p->save_on_last) || m->save_q);
+        store_w = m->xvld && m->wready &&
+            ((in->s_tvalid && in->s_tkeep) || (m->xlst && p->save_on_last) || m->save_q);
+        last_w = m->xlst || m->save_q || m->xmax;
+        data_w = m->xdat;
+    } else {
+        store_w = in->s_tvalid && m->wready && in->s_tkeep;
+        last_w = in->s_tlast;
+        data_w = in->s_tdata;
+    }
+
+    const uint32_t waddr_next = store_w ? (m->waddr + 1) & amask : m->waddr;
+    const uint32_t raddr_next = fetch_w ? (m->raddr + 1) & amask : m->raddr;
+    const bool chunk_w = p->use_length && ((waddr_next - m->paddr) & lmask) == p->max_length - 1;
+    uint32_t level_w;
+
+    if (p->last_on_save) {
+        level_w = (waddr_next & lmask) - (raddr_next & lmask) +
+            ((capture_a || m->xvld) && !release_a);
+    } else {
+        last_w = last_w || chunk_w;
+        level_w = waddr_next - raddr_next;
+    }
+
+    // -- FIFO status -- //
+
+    const bool match_w = (m->waddr & lmask) == (m->raddr & lmask);
+    const bool wrfull_next = (waddr_next & lmask) == (m->raddr & lmask) && store_w && !fetch_w;
+    const bool wrfull_curr = match_w && ((m->waddr ^ m->raddr) >> m->abits & 1) &&
+        fetch_w == store_w;
+    const bool rempty_next = (raddr_next & lmask) == (m->paddr & lmask) && fetch_w && !accept_a;
+    const bool rempty_curr = m->paddr == m->raddr && fetch_w == accept_a;
+
+    const bool wfull_w = wrfull_curr || wrfull_next;
+    const bool empty_w = rempty_curr || rempty_next;
+
+    // -- Registers -- //
+
+    const uint32_t waddr = m->waddr, raddr = m->raddr, paddr = m->paddr;
+    const uint32_t rplay = m->rplay, rprev = m->rprev;
+
+    if (!in->reset) {
+        pf_clock_hazards(m, in, &out, finish_a, replay_a, release_a, store_w);
+    }
+
+    // Output-register, and skid-buffer, use the pre-edge SRAM contents
+    if (p->outreg > 1) {
+        pf_clock_skid(m, in->reset || replay_a, in->m_tready);
+    }
+    if (p->outreg > 0) {
+        if (in->reset || replay_a) {
+            m->xvalid = false;
+        } else if (fetch_w) {
+            m->xvalid = true;
+            m->xlast = (rword >> 8) & 1;
+            m->xdata = (uint8_t)rword;
+        } else if (m->xvalid && xready) {
+            m->xvalid = false;
+        }
+    }
+
+    if (in->reset) {
+        m->save_q = false;
+        m->drop_q = false;
+        m->xvld = false;
+        m->xlst = false;
+        m->xmax = false;
+        m->waddr = 0;
+        m->wready = false;
+        m->paddr = 0;
+        m->rplay = 0;
+        m->raddr = 0;
+        m->rprev = 0;
+        m->rvalid = false;
+        m->level_q = 0;
+        m->rtake = 0;
+        m->rtake_prev = 0;
+        m->rtake_play = 0;
+        m->hazard = PF_NONE;
+        m->primed = true;
+        return;
+    }
+
+    if (p->last_on_save) {
+        m->save_q = save_w;
+        m->drop_q = in->drop;
+        if (capture_a) {
+            m->xvld = true;
+            m->xlst = in->s_tlast || in->save || (p->save_on_last && chunk_w);
+            m->xmax = chunk_w;
+            m->xdat = in->s_tdata;
+        } else if (release_a || in->drop) {
+            m->xvld = false;
+            m->xlst = false;
+            m->xmax = false;
+        }
+    }
+
+    m->wready = !wfull_w;
+    if (reject_a) {
+        m->waddr = paddr;
+    } else {
+        if (store_w) {
+            m->sram[waddr & lmask] = (uint16_t)last_w << 8 | data_w;
+        }
+        m->waddr = waddr_next;
+    }
+
+    if (accept_a) {
+        m->paddr = waddr_next;
+    }
+    if (finish_a) {
+        m->rplay = rprev;
+    }
+
+    m->rvalid = !empty_w;
+    if (replay_a) {
+        m->raddr = rplay;
+    } else {
+        m->raddr = raddr_next;
+        m->rprev = rstop_w ? raddr : rprev;
+    }
+
+    m->level_q = level_w & lmask;
+}
@@ -0,0 +1,116 @@
+#ifndef __PFMODEL_H__
+#define __PFMODEL_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Cycle-level model of 'rtl/fifo/packet_fifo.v' (with 'STORE_LASTS = 1', and
+ * up to 8-bit data), including its output-register and skid-buffer stages, so
+ * that '$packet_tb' can predict 'level', 'w_rdy', 'r_vld', and 'r_lst', each
+ * cycle, and flag the first cycle that the RTL diverges.
+ *
+ * Usage, at each rising clock-edge:
+ *  1. 'pf_outputs()' gives the outputs for the (pre-edge) register values;
+ *  2. 'pf_clock()' updates the registers, using the (pre-edge) inputs;
+ *  3. 'pf_hazard()' gives any known hazard of the RTL hit by that cycle;
+ *
+ * NOTE:
+ *  - the model follows the RTL, including where the RTL loses data, and those
+ *    cases are reported as hazards (instead of being modelled differently):
+ *     - with 'LAST_ON_SAVE', the held transfer is released, but not stored,
+ *       if the SRAM is full when 'save_q' accepts the packet;
+ *     - 'w_rdy' only counts from 'raddr', so the bytes that 'redo' would
+ *       replay can be overwritten;
+ *     - with 'OUTREG = 2', a 1-byte packet can pass the output-register
+ *       before 'next' for the previous packet, so its replay-address is
+ *       skipped;
+ *    and the last two are only reported when 'redo' replays the bytes;
+ */
+typedef enum {
+    PF_NONE,
+    PF_LOST_LAST,               // held transfer released, but not stored
+    PF_OVERWRITTEN,             // 'redo' replays bytes that were overwritten
+    PF_WRONG_REPLAY,            // 'redo' replays from the wrong address
+} pf_hazard_t;
+
+typedef struct {
+    uint32_t depth;             // must be a power of 2
+    int outreg;                 // 0, 1, or 2
+    bool use_length;
+    uint32_t max_length;
+    bool save_on_last;
+    bool last_on_save;
+    bool next_on_last;
+} pf_params_t;
+
+typedef struct {
+    bool reset;
+    bool drop;
+    bool save;
+    bool redo;
+    bool next;
+    bool s_tvalid;
+    bool s_tkeep;
+    bool s_tlast;
+    uint8_t s_tdata;
+    bool m_tready;
+} pf_inputs_t;
+
+typedef struct {
+    uint32_t level;
+    bool s_tready;
+    bool m_tvalid;
+    bool m_tlast;
+    uint8_t m_tdata;
+} pf_outputs_t;
+
+typedef struct {
+    pf_params_t p;
+    uint32_t abits;
+    bool primed;                // has been reset (so registers are known)
+    uint16_t* sram;             // {last, data}
+    // Write port, and packet pointers
+    uint32_t waddr;
+    uint32_t paddr;
+    bool wready;
+    bool save_q;
+    bool drop_q;
+    bool xvld;                  // 'LAST_ON_SAVE' input-register
+    bool xlst;
+    bool xmax;
+    uint8_t xdat;
+    // Read port
+    uint32_t raddr;
+    uint32_t rplay;
+    uint32_t rprev;
+    bool rvalid;
+    uint32_t level_q;
+    bool xvalid;                // 'OUTREG > 0' output-register
+    bool xlast;
+    uint8_t xdata;
+    bool sready;                // 'OUTREG > 1' skid-buffer
+    bool mvalid;
+    bool tvalid;
+    bool mlast;
+    bool tlast;
+    uint8_t mdata;
+    uint8_t tdata;
+    // Replay-address, from the transfers at the output, for the hazard check
+    uint32_t rtake;
+    uint32_t rtake_prev;
+    uint32_t rtake_play;
+    pf_hazard_t hazard;
+} pf_model_t;
+
+
+pf_model_t* pf_create(const pf_params_t* params);
+void pf_free(pf_model_t* model);
+
+void pf_outputs(const pf_model_t* model, pf_outputs_t* out);
+void pf_clock(pf_model_t* model, const pf_inputs_t* in);
+pf_hazard_t pf_hazard(const pf_model_t* model);
+
+
+#endif  /* __PFMODEL_H__ */
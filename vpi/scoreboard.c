@@ -0,0 +1,186 @@
+#include "scoreboard.h"
+
+#include <vpi_user.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SB_SHOW_BYTES 16
+
+
+scoreboard_t* sb_create(void)
+{
+    scoreboard_t* sb = (scoreboard_t*)malloc(sizeof(scoreboard_t));
+    memset(sb, 0, sizeof(scoreboard_t));
+    sb->size = SB_INIT_BYTES;
+    sb->num = SB_INIT_PACKETS;
+    sb->buf = (uint8_t*)malloc(sb->size);
+    sb->lens = (uint32_t*)malloc(sb->num * sizeof(uint32_t));
+    return sb;
+}
+
+void sb_free(scoreboard_t* sb)
+{
+    free(sb->buf);
+    free(sb->lens);
+    free(sb);
+}
+
+/**
+ * Double the capacity of the byte ring-buffer, preserving the (wrapped) order
+ * of the bytes, as their indices are absolute.
+ */
+static void sb_grow_bytes(scoreboard_t* sb)
+{
+    const uint32_t size = sb->size << 1;
+    uint8_t* buf = (uint8_t*)malloc(size);
+
+    for (uint64_t i=sb->base; i<sb->wr; i++) {
+        buf[i & (size - 1)] = sb->buf[i & (sb->size - 1)];
+    }
+    free(sb->buf);
+    sb->buf = buf;
+    sb->size = size;
+}
+
+static void sb_grow_packets(scoreboard_t* sb)
+{
+    const uint32_t num = sb->num << 1;
+    uint32_t* lens = (uint32_t*)malloc(num * sizeof(uint32_t));
+
+    for (uint64_t i=sb->ltail; i<sb->lhead; i++) {
+        lens[i & (num - 1)] = sb->lens[i & (sb->num - 1)];
+    }
+    free(sb->lens);
+    sb->lens = lens;
+    sb->num = num;
+}
+
+
+// -- Store Packets -- //
+
+/**
+ * Append a byte to the packet being stored.
+ */
+int sb_push(scoreboard_t* sb, uint8_t byte)
+{
+    if (sb->wr - sb->end >= SB_MAX_PACKET) {
+        vpi_printf("SB\tpacket exceeds %u bytes\n", SB_MAX_PACKET);
+        return -1;
+    }
+    if (sb->wr - sb->base >= sb->size) {
+        sb_grow_bytes(sb);
+    }
+    sb->buf[sb->wr++ & (sb->size - 1)] = byte;
+    return 0;
+}
+
+/**
+ * Commit the packet being stored, and returns its length.
+ */
+int sb_save(scoreboard_t* sb)
+{
+    const uint32_t len = (uint32_t)(sb->wr - sb->end);
+
+    if (sb->lhead - sb->ltail >= sb->num) {
+        sb_grow_packets(sb);
+    }
+    sb->lens[sb->lhead++ & (sb->num - 1)] = len;
+    sb->end = sb->wr;
+    sb->saved++;
+
+    return (int)len;
+}
+
+void sb_drop(scoreboard_t* sb)
+{
+    sb->wr = sb->end;
+    sb->dropped++;
+}
+
+uint32_t sb_pending(const scoreboard_t* sb)
+{
+    return (uint32_t)(sb->wr - sb->end);
+}
+
+
+// -- Fetch Packets -- //
+
+/**
+ * Compare the fetched byte (and its 'last' flag), against the packet being
+ * fetched.
+ */
+int sb_check(scoreboard_t* sb, uint8_t byte, bool last)
+{
+    if (sb->lhead == sb->ltail) {
+        vpi_printf("SB\tfetched 0x%02x, but no packets are queued\n", byte);
+        sb->errors++;
+        return -1;
+    }
+
+    const uint32_t len = sb->lens[sb->ltail & (sb->num - 1)];
+    const uint32_t pos = (uint32_t)(sb->rd - sb->base);
+
+    if (pos >= len) {
+        vpi_printf("SB\tfetched 0x%02x, beyond the end of the %u-byte packet\n", byte, len);
+        sb->errors++;
+        return -1;
+    }
+
+    const uint8_t want = sb->buf[sb->rd++ & (sb->size - 1)];
+    const bool end = pos + 1 == len;
+    sb->fetched++;
+
+    if (byte != want || last != end) {
+        vpi_printf("SB\tpacket %lu, byte %u/%u: fetched {0x%02x, last: %u}, expected {0x%02x, last: %u}\n",
+                   sb->ltail, pos, len, byte, last, want, end);
+        sb->errors++;
+        return -1;
+    }
+
+    return 0;
+}
+
+void sb_redo(scoreboard_t* sb)
+{
+    sb->rd = sb->base;
+    sb->redone++;
+}
+
+/**
+ * Discard the packet being fetched, and returns its length.
+ */
+int sb_next(scoreboard_t* sb)
+{
+    if (sb->lhead == sb->ltail) {
+        vpi_printf("SB\t'next' without any queued packets\n");
+        sb->errors++;
+        return -1;
+    }
+
+    const uint32_t len = sb->lens[sb->ltail++ & (sb->num - 1)];
+    sb->base += len;
+    sb->rd = sb->base;
+
+    return (int)len;
+}
+
+/**
+ * Summary, and the bytes around the next byte to fetch.
+ */
+void sb_show(const scoreboard_t* sb)
+{
+    const uint32_t len = sb->lhead != sb->ltail ? sb->lens[sb->ltail & (sb->num - 1)] : 0;
+    const uint64_t to = sb->rd + SB_SHOW_BYTES < sb->end ? sb->rd + SB_SHOW_BYTES : sb->end;
+
+    vpi_printf("SB: {\n");
+    vpi_printf("  packets: %lu (queued), %lu (saved), %lu (dropped), %lu (redone),\n",
+               sb_packets(sb), sb->saved, sb->dropped, sb->redone);
+    vpi_printf("  fetch: %lu/%u (packet %lu), pending: %u, errors: %lu,\n",
+               sb->rd - sb->base, len, sb->ltail, sb_pending(sb), sb->errors);
+    vpi_printf("  next: {");
+    for (uint64_t i=sb->rd; i<to; i++) {
+        vpi_printf(" 0x%02x,", sb->buf[i & (sb->size - 1)]);
+    }
+    vpi_printf(" }\n};\n");
+}
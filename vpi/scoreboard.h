@@ -0,0 +1,73 @@
+#ifndef __SCOREBOARD_H__
+#define __SCOREBOARD_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Scoreboard for packet FIFOs, that queues the expected packets (of up to
+ * 'SB_MAX_PACKET' bytes each), and models the packet FIFO's controls:
+ *  - 'save' commits the packet being stored, to the queue;
+ *  - 'drop' discards the packet being stored;
+ *  - 'redo' rewinds the packet being fetched, so it is expected again;
+ *  - 'next' discards the packet being fetched, and advances to the next;
+ *
+ * The bytes are stored in a single ring-buffer (that grows as required), in
+ * the order: fetched packet, committed packets, packet being stored; so that
+ * each byte is pushed, and checked, in O(1).
+ */
+#define SB_MAX_PACKET 65536
+#define SB_INIT_BYTES 4096
+#define SB_INIT_PACKETS 256
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t* lens;
+    uint32_t size;              // capacity of 'buf' (a power of 2)
+    uint32_t num;               // capacity of 'lens' (a power of 2)
+    uint64_t base;              // start of the packet being fetched
+    uint64_t rd;                // next byte to fetch
+    uint64_t end;               // end of the committed packets
+    uint64_t wr;                // end of the packet being stored
+    uint64_t lhead;
+    uint64_t ltail;
+    // Totals
+    uint64_t saved;
+    uint64_t dropped;
+    uint64_t redone;
+    uint64_t fetched;
+    uint64_t errors;
+} scoreboard_t;
+
+
+scoreboard_t* sb_create(void);
+void sb_free(scoreboard_t* sb);
+
+int sb_push(scoreboard_t* sb, uint8_t byte);
+int sb_save(scoreboard_t* sb);
+void sb_drop(scoreboard_t* sb);
+
+int sb_check(scoreboard_t* sb, uint8_t byte, bool last);
+void sb_redo(scoreboard_t* sb);
+int sb_next(scoreboard_t* sb);
+
+uint32_t sb_pending(const scoreboard_t* sb);
+void sb_show(const scoreboard_t* sb);
+
+static inline uint64_t sb_packets(const scoreboard_t* sb)
+{
+    return sb->lhead - sb->ltail;
+}
+
+/**
+ * Bytes from the start of the packet being fetched, to the end of the packet
+ * being stored.
+ */
+static inline uint32_t sb_stored(const scoreboard_t* sb)
+{
+    return (uint32_t)(sb->wr - sb->base);
+}
+
+
+#endif  /* __SCOREBOARD_H__ */
@@ -0,0 +1,589 @@
+#include "spi_host.h"
+#include "ulpivpi.h"
+
+#include <vpi_user.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SPI_MODE_PLUSARG  "+spi_mode="
+#define SPI_SEED_PLUSARG  "+spi_seed="
+#define SPI_RATIO_PLUSARG "+spi_ratio="
+
+#define SPI_CPOL(host) (((host)->mode >> 1) & 1)
+#define SPI_CPHA(host) ((host)->mode & 1)
+
+static const char spi_sig_names[SPI_NUM_SIGS][8] = {
+    {"SCK"}, {"SSEL"}, {"MOSI"}, {"MISO"},
+};
+
+/**
+ * Writes, then reads back, the same registers, at each clock ratio, and then
+ * single-register, and burst, accesses.
+ */
+static const spi_test_t spi_tests[] = {
+    {"write",   SpiWrite,  2, 4, 32,  4},
+    {"read",    SpiRead,   2, 4, 32,  4},
+    {"write",   SpiWrite,  4, 4, 32,  4},
+    {"read",    SpiRead,   4, 4, 32,  4},
+    {"write",   SpiWrite,  8, 4, 32,  4},
+    {"read",    SpiRead,   8, 4, 32,  4},
+    {"write",   SpiWrite, 16, 4, 32,  4},
+    {"read",    SpiRead,  16, 4, 32,  4},
+    {"write1",  SpiWrite,  4, 4, 64,  1},
+    {"read1",   SpiRead,   4, 4, 64,  1},
+    {"write32", SpiWrite,  4, 4,  8, 32},
+    {"read32",  SpiRead,   4, 4,  8, 32},
+};
+
+
+// -- Helpers -- //
+
+static int spi_host_error(const char* reason)
+{
+    vpi_printf("ERROR: $spi_host %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+static uint32_t spi_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t spi_plusarg(const char* name, uint32_t def)
+{
+    const char* arg = ulpi_plusarg(name, NULL);
+    return arg != NULL ? (uint32_t)strtoul(arg, NULL, 0) : def;
+}
+
+static const spi_test_t* spi_test(const spi_host_t* host)
+{
+    return &host->tests[host->test_curr];
+}
+
+static uint16_t spi_ratio(const spi_host_t* host)
+{
+    const uint16_t ratio = host->ratio > 0 ? host->ratio : spi_test(host)->ratio;
+    return ratio > 2 ? ratio : 2;
+}
+
+/**
+ * Clock cycles of the first, and second, half of each SCK period.
+ */
+static uint32_t spi_half(const spi_host_t* host, int second)
+{
+    const uint16_t ratio = spi_ratio(host);
+    return second ? ratio - ratio / 2 : ratio / 2;
+}
+
+
+// -- Frames -- //
+
+/**
+ * Build the next register access of the current test-case, where the accesses
+ * cover consecutive registers, so that the reads check the earlier writes.
+ */
+static void spi_frame_begin(spi_host_t* host)
+{
+    const spi_test_t* test = spi_test(host);
+    spi_frame_t* frame = &host->frame;
+
+    memset(frame, 0, sizeof(spi_frame_t));
+    frame->op = test->op;
+    frame->len = test->len;
+    frame->addr = (uint8_t)((host->test_step * test->len) % (SPI_HOST_REGS - 1));
+    frame->data = -1;
+    frame->start_ns = host->tick_ns;
+
+    frame->tx[0] = frame->addr | (test->op == SpiRead ? SPI_HOST_READ : 0);
+    frame->tx[1] = test->len - 1;
+    if (test->op == SpiWrite) {
+        for (int i=0; i<test->len; i++) {
+            frame->tx[i + 2] = (uint8_t)spi_rand(&host->rng);
+        }
+        frame->tx_len = test->len + 2;
+    } else {
+        memset(&frame->tx[2], SPI_HOST_IDLE, SPI_HOST_MAX_FRAME - 2);
+        frame->tx_len = 3;
+    }
+}
+
+/**
+ * Extend a read-frame until the marker, and then all of the read-data, have
+ * been received.
+ */
+static void spi_frame_byte(spi_host_t* host)
+{
+    spi_frame_t* frame = &host->frame;
+    const uint16_t i = frame->pos;
+
+    frame->rx[i] = frame->shift;
+    frame->xz[i] = frame->unknown;
+    frame->shift = 0;
+    frame->unknown = false;
+
+    if (frame->op != SpiRead || i < 2) {
+        return;
+    } else if (frame->data < 0 && !frame->xz[i] && frame->rx[i] == SPI_HOST_MARKER) {
+        frame->data = i + 1;
+        frame->tx_len = frame->data + frame->len;
+    } else if (frame->data < 0 && i - 2 >= SPI_HOST_MAX_WAIT) {
+        vpi_printf("SPI\t%s: read of 0x%02x timed out, after %u bytes\n",
+                   host->name, frame->addr, i + 1);
+        frame->tx_len = i + 1;
+        host->stats.errors++;
+    } else if (frame->data < 0) {
+        frame->tx_len = i + 2;
+    }
+}
+
+/**
+ * Check any read-data, and record the writes, once 'SSEL' is released.
+ */
+static void spi_frame_end(spi_host_t* host)
+{
+    spi_frame_t* frame = &host->frame;
+    spi_host_stats_t* st = &host->stats;
+    const uint64_t lat = host->tick_ns - frame->start_ns;
+
+    for (int i=0; i<frame->len; i++) {
+        const uint8_t reg = (frame->addr + i) % SPI_HOST_REGS;
+
+        if (frame->op == SpiWrite) {
+            host->regs[reg] = frame->tx[i + 2];
+            host->known[reg] = true;
+        } else if (frame->data < 0) {
+            break;
+        } else if (frame->xz[frame->data + i] ||
+                   (host->known[reg] && frame->rx[frame->data + i] != host->regs[reg])) {
+            vpi_printf("SPI\t%s: register 0x%02x read 0x%02x%s (expected 0x%02x)\n",
+                       host->name, reg, frame->rx[frame->data + i],
+                       frame->xz[frame->data + i] ? " (X/Z)" : "", host->regs[reg]);
+            st->errors++;
+        }
+    }
+
+    if (frame->data > 0) {
+        st->waits += frame->data - 3;
+    }
+    st->lat_min = st->frames == 0 || lat < st->lat_min ? lat : st->lat_min;
+    st->lat_max = lat > st->lat_max ? lat : st->lat_max;
+    st->latency += lat;
+    st->bytes += frame->len;
+    st->frames++;
+}
+
+
+// -- Reporting -- //
+
+static void spi_test_report(const spi_host_t* host)
+{
+    const spi_test_t* test = spi_test(host);
+    const spi_host_stats_t* st = &host->stats;
+    const uint64_t ns = host->tick_ns - host->test_ns;
+    const double secs = ns > 0 ? (double)ns * 1e-9 : 1e-9;
+    const double frames = st->frames > 0 ? (double)st->frames : 1.0;
+
+    vpi_printf("SPI\t%-8s mode %u  1:%-3u %4lu x %-3u %8lu ns %10.1f acc/s %9.1f kB/s"
+               "  latency: %lu/%.1f/%lu ns",
+               test->name, host->mode, spi_ratio(host), st->frames, test->len, ns,
+               st->frames / secs, st->bytes / secs * 1e-3, st->lat_min,
+               st->latency / frames, st->lat_max);
+    if (test->op == SpiRead) {
+        vpi_printf("  turnaround: %.1f bytes", st->waits / frames);
+    }
+    vpi_printf("%s\n", st->errors > 0 ? "  FAILED" : "");
+}
+
+static void spi_host_report(const spi_host_t* host)
+{
+    vpi_printf("SPI\t%s: %d of %d test-cases completed, %lu errors: %s\n", host->name,
+               host->test_curr, host->test_num, host->errors,
+               host->errors > 0 || host->test_curr < host->test_num ? "FAILED" : "PASSED");
+}
+
+
+// -- Step Function -- //
+
+static void spi_sample(spi_host_t* host)
+{
+    const uint8_t miso = host->vals[SPI_MISO];
+
+    host->frame.shift = (uint8_t)(host->frame.shift << 1) | (miso == vpi1);
+    host->frame.unknown |= miso != vpi0 && miso != vpi1;
+}
+
+static void spi_drive(spi_host_t* host)
+{
+    const spi_frame_t* frame = &host->frame;
+    host->next[SPI_MOSI] = (frame->tx[frame->pos] >> (7 - frame->bit)) & 1;
+}
+
+/**
+ * Start the next frame, or the next test-case, and return 'false' once all of
+ * the test-cases have completed.
+ */
+static bool spi_host_next(spi_host_t* host)
+{
+    if (host->test_curr < host->test_num && host->test_step >= spi_test(host)->count) {
+        spi_test_report(host);
+        host->errors += host->stats.errors;
+        host->test_curr++;
+        host->test_step = 0;
+    }
+    if (host->test_curr >= host->test_num) {
+        return false;
+    }
+
+    if (host->test_step == 0) {
+        memset(&host->stats, 0, sizeof(spi_host_stats_t));
+        host->test_ns = host->tick_ns;
+    }
+    spi_frame_begin(host);
+
+    return true;
+}
+
+/**
+ * Advance the SPI host by one clock-cycle, where SCK, SSEL, and MOSI change
+ * on clock-edges, every half-period of SCK.
+ */
+static void spi_host_step(spi_host_t* host)
+{
+    spi_frame_t* frame = &host->frame;
+
+    if (host->wait > 1) {
+        host->wait--;
+        return;
+    }
+
+    switch (host->op) {
+
+    case SpiIdle:
+        if (!spi_host_next(host)) {
+            spi_host_report(host);
+            host->op = SpiDone;
+            vpi_control(vpiFinish, 0);
+            break;
+        }
+        host->next[SPI_SSEL] = 0;
+        host->next[SPI_SCK] = SPI_CPOL(host);
+        if (!SPI_CPHA(host)) {
+            spi_drive(host);
+        }
+        host->op = SpiLead;
+        host->wait = spi_half(host, 1);
+        break;
+
+    case SpiLead:
+        host->next[SPI_SCK] = !SPI_CPOL(host);
+        if (SPI_CPHA(host)) {
+            spi_drive(host);
+        } else {
+            spi_sample(host);
+        }
+        host->op = SpiTrail;
+        host->wait = spi_half(host, 0);
+        break;
+
+    case SpiTrail:
+        host->next[SPI_SCK] = SPI_CPOL(host);
+        if (SPI_CPHA(host)) {
+            spi_sample(host);
+        }
+        if (++frame->bit == 8) {
+            spi_frame_byte(host);
+            frame->bit = 0;
+            frame->pos++;
+        }
+        if (frame->pos < frame->tx_len) {
+            if (!SPI_CPHA(host)) {
+                spi_drive(host);
+            }
+            host->op = SpiLead;
+        } else {
+            host->op = SpiDeselect;
+        }
+        host->wait = spi_half(host, 1);
+        break;
+
+    case SpiDeselect:
+        host->next[SPI_SSEL] = 1;
+        spi_frame_end(host);
+        host->test_step++;
+        host->op = SpiIdle;
+        host->wait = spi_test(host)->gap;
+        break;
+
+    case SpiDone:
+        break;
+    }
+}
+
+static void spi_host_idle(spi_host_t* host)
+{
+    host->next[SPI_SCK] = SPI_CPOL(host);
+    host->next[SPI_SSEL] = 1;
+    host->next[SPI_MOSI] = 0;
+    host->op = host->op == SpiDone ? SpiDone : SpiIdle;
+    host->wait = 1;
+    host->test_step = 0;
+}
+
+
+//
+//  VPI Callbacks
+///
+
+static void spi_update_values(spi_host_t* host)
+{
+    s_vpi_value value;
+    value.format = vpiScalarVal;
+
+    for (int i=0; i<SPI_MISO; i++) {
+        if (host->next[i] != host->vals[i]) {
+            value.value.scalar = host->next[i];
+            vpi_put_value(host->sigs[i], &value, NULL, vpiNoDelay);
+            host->vals[i] = host->next[i];
+        }
+    }
+}
+
+static int cb_spi_host_sync(p_cb_data cb_data)
+{
+    spi_host_t* host = (spi_host_t*)cb_data->user_data;
+    s_vpi_value value;
+
+    value.format = vpiScalarVal;
+    vpi_get_value(host->reset, &value);
+    memcpy(host->next, host->vals, sizeof(host->next));
+
+    if (value.value.scalar != vpi0) {
+        spi_host_idle(host);
+    } else {
+        host->cycle++;
+        spi_host_step(host);
+    }
+
+    spi_update_values(host);
+
+    return 0;
+}
+
+/**
+ * Event-handler for every posedge-clock event.
+ */
+static int cb_spi_host_clock(p_cb_data cb_data)
+{
+    spi_host_t* host = (spi_host_t*)cb_data->user_data;
+    s_vpi_value x;
+
+    x.format = vpiIntVal;
+    vpi_get_value(host->clock, &x);
+    if (x.value.integer != 1) {
+        return 0;
+    }
+
+    s_vpi_time t;
+    t.type = vpiSimTime;
+    vpi_get_time(NULL, &t);
+    host->tick_ns = (((uint64_t)t.high << 32) | (uint64_t)t.low) / host->t_recip;
+
+    // Capture MISO at the time of the clock-edge
+    x.format = vpiScalarVal;
+    vpi_get_value(host->sigs[SPI_MISO], &x);
+    host->vals[SPI_MISO] = (uint8_t)x.value.scalar;
+
+    t.type       = vpiSimTime;
+    t.high       = 0;
+    t.low        = 0;
+
+    s_cb_data cb;
+    cb.reason    = cbReadWriteSynch;
+    cb.cb_rtn    = cb_spi_host_sync;
+    cb.user_data = (PLI_BYTE8*)host;
+    cb.time      = &t;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+static int cb_spi_host_end(p_cb_data cb_data)
+{
+    spi_host_t* host = (spi_host_t*)cb_data->user_data;
+
+    if (host->op != SpiDone) {
+        vpi_printf("SPI\t%s: simulation ended during test-case %d\n", host->name,
+                   host->test_curr);
+        spi_host_report(host);
+    }
+    free(host);
+
+    return 0;
+}
+
+static uint32_t spi_get_int(vpiHandle* iter, uint32_t def)
+{
+    vpiHandle arg;
+    s_vpi_value value;
+
+    if (*iter == NULL || (arg = vpi_scan(*iter)) == NULL) {
+        *iter = NULL;
+        return def;
+    }
+    value.format = vpiIntVal;
+    vpi_get_value(arg, &value);
+
+    return (uint32_t)value.value.integer;
+}
+
+static int spi_set_handles(spi_host_t* host, vpiHandle scope)
+{
+    for (int i=0; i<SPI_NUM_SIGS; i++) {
+        host->sigs[i] = vpi_handle_by_name((PLI_BYTE8*)spi_sig_names[i], scope);
+        if (host->sigs[i] == NULL) {
+            vpi_printf("ERROR: $spi_host signal '%s.%s' not found\n", host->name,
+                       spi_sig_names[i]);
+            return spi_host_error("missing signal");
+        } else if (vpi_get(vpiSize, host->sigs[i]) != 1) {
+            vpi_printf("ERROR: $spi_host signal '%s.%s' must be 1-bit\n", host->name,
+                       spi_sig_names[i]);
+            return spi_host_error("signal width");
+        }
+    }
+    return 1;
+}
+
+/**
+ * Populates the host data-structure before the Verilog simulation starts.
+ */
+static int spi_host_compiletf(char* user_data)
+{
+    vpiHandle systf_handle, arg_iterator, scope;
+    spi_host_t* host;
+
+    systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    if (systf_handle == NULL) {
+        return spi_host_error("failed to obtain systf handle");
+    }
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    if (arg_iterator == NULL) {
+        return spi_host_error("requires at least 2 arguments");
+    }
+
+    host = (spi_host_t*)malloc(sizeof(spi_host_t));
+    memset(host, 0, sizeof(spi_host_t));
+
+    if ((host->clock = vpi_scan(arg_iterator)) == NULL ||
+        (host->reset = vpi_scan(arg_iterator)) == NULL) {
+        free(host);
+        return spi_host_error("requires at least 2 arguments");
+    }
+
+    host->mode = (uint8_t)spi_plusarg(SPI_MODE_PLUSARG, spi_get_int(&arg_iterator, 0));
+    host->seed = spi_plusarg(SPI_SEED_PLUSARG, spi_get_int(&arg_iterator, 1));
+    host->ratio = (uint16_t)spi_plusarg(SPI_RATIO_PLUSARG, 0);
+    host->rng = host->seed != 0 ? host->seed : 1;
+
+    if (arg_iterator != NULL && vpi_scan(arg_iterator) != NULL) {
+        vpi_free_object(arg_iterator);
+        free(host);
+        return spi_host_error("too many arguments");
+    } else if (host->mode > 3) {
+        free(host);
+        return spi_host_error("'mode' must be 0..3");
+    }
+
+    scope = vpi_handle(vpiScope, systf_handle);
+    snprintf(host->name, SPI_HOST_MAX_NAME, "%s", vpi_get_str(vpiFullName, scope));
+    if (!spi_set_handles(host, scope)) {
+        free(host);
+        return 0;
+    }
+
+    host->t_recip = 1;
+    for (int scale = -9 - vpi_get(vpiTimePrecision, NULL); scale > 0; scale--) {
+        host->t_recip *= 10;
+    }
+
+    host->tests = spi_tests;
+    host->test_num = sizeof(spi_tests) / sizeof(spi_test_t);
+    host->vals[SPI_SCK] = vpiX;
+    host->vals[SPI_SSEL] = vpiX;
+    host->vals[SPI_MOSI] = vpiX;
+    spi_host_idle(host);
+
+    s_cb_data cb;
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = cb_spi_host_end;
+    cb.user_data = (PLI_BYTE8*)host;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    vpi_put_userdata(systf_handle, (void*)host);
+
+    return 0;
+}
+
+/**
+ * Start processing clock-events.
+ */
+static int spi_host_calltf(char* user_data)
+{
+    vpiHandle systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    spi_host_t* host = (spi_host_t*)vpi_get_userdata(systf_handle);
+    s_vpi_value x;
+    s_vpi_time t;
+    s_cb_data cb;
+
+    if (host == NULL) {
+        return spi_host_error("'*host' problem");
+    }
+
+    vpi_printf("SPI\t%s: mode %u (CPOL = %u, CPHA = %u), %d test-cases\n", host->name,
+               host->mode, SPI_CPOL(host), SPI_CPHA(host), host->test_num);
+    vpi_printf("SPI\ttest     mode  ratio  accesses   elapsed   throughput"
+               "               latency (min/avg/max)\n");
+
+    t.type       = vpiSuppressTime;
+    x.format     = vpiSuppressVal;
+    cb.reason    = cbValueChange;
+    cb.cb_rtn    = cb_spi_host_clock;
+    cb.time      = &t;
+    cb.value     = &x;
+    cb.user_data = (PLI_BYTE8*)host;
+    cb.obj       = host->clock;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+void spi_host_register(void)
+{
+    s_vpi_systf_data tf_data;
+    tf_data.type      = vpiSysTask;
+    tf_data.tfname    = "$spi_host";
+    tf_data.calltf    = spi_host_calltf;
+    tf_data.compiletf = spi_host_compiletf;
+    tf_data.sizetf    = NULL;
+    tf_data.user_data = NULL;
+    vpi_register_systf(&tf_data);
+}
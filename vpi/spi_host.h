@@ -0,0 +1,146 @@
+#ifndef __SPI_HOST_H__
+#define __SPI_HOST_H__
+
+
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * SPI master (host) model, that issues register accesses to an SPI target,
+ * from a list of test-cases, and measures the achieved register-access
+ * throughput, and latency, for each SCK ratio. The SPI signals are found (by
+ * name) in the scope of the calling module:
+ *  - 'SCK', 'SSEL', 'MOSI'  --  driven by the host, so must be 'reg's;
+ *  - 'MISO'                 --  sampled by the host;
+ *
+ * Usage:
+ *   $spi_host(clock, reset, mode, seed);
+ *
+ * where 'mode' (0..3) sets the clock polarity ('mode[1]') and phase
+ * ('mode[0]'), and each test-case sets the clock ratio (system-clock cycles
+ * per SCK period), and the number of system-clock cycles between back-to-back
+ * frames. SCK edges are aligned to the rising edges of 'clock'.
+ *
+ * Each frame is a single register access, of the form:
+ *   MOSI:  {RnW, addr[6:0]}, {count - 1}, data[0], .., data[count - 1]
+ * for a write, and for a read:
+ *   MOSI:  {1, addr[6:0]}, {count - 1}, 0xFF, ..
+ *   MISO:  header, status, idle (0xFF), .., SPI_HOST_MARKER, data[0], ..
+ * where the frame is extended until 'count' bytes have followed the marker, so
+ * that the (target-dependent) turnaround is measured, rather than assumed. The
+ * addresses increment (modulo 128) for each byte, and the MOSI filler-bytes
+ * (0xFF) are no-op commands, so a read cannot start at register 0x7F.
+ *
+ * Plusargs:
+ *   +spi_mode=<N>, +spi_seed=<N>  --  override the arguments;
+ *   +spi_ratio=<N>                --  run every test-case at this clock ratio;
+ *
+ * NOTE:
+ *  - 'reset' is active-HIGH;
+ *  - read data is checked against the values written (by earlier test-cases),
+ *    and registers that have not been written are not checked;
+ *  - the SPI cores in 'rtl/spi' only support mode 0, as yet;
+ */
+#define SPI_HOST_MAX_NAME   128
+#define SPI_HOST_MAX_FRAME  256
+#define SPI_HOST_MAX_WAIT   32      // turnaround bytes, before a read fails
+#define SPI_HOST_REGS       128
+#define SPI_HOST_READ       0x80
+#define SPI_HOST_MARKER     0x5A
+#define SPI_HOST_IDLE       0xFF    // MISO filler, and the MOSI no-op command
+
+typedef enum {
+    SPI_SCK,
+    SPI_SSEL,
+    SPI_MOSI,
+    SPI_MISO,
+    SPI_NUM_SIGS
+} spi_sig_t;
+
+typedef enum {
+    SpiWrite,
+    SpiRead,
+} spi_op_t;
+
+typedef enum {
+    SpiIdle,                    // waiting between frames
+    SpiLead,                    // leading SCK edge, next
+    SpiTrail,                   // trailing SCK edge, next
+    SpiDeselect,                // last edge done, so release 'SSEL' next
+    SpiDone,
+} spi_host_op_t;
+
+/**
+ * Each test-case issues 'count' accesses, each of 'len' registers.
+ */
+typedef struct {
+    const char* name;
+    spi_op_t op;
+    uint16_t ratio;             // clock cycles per SCK period
+    uint16_t gap;               // clock cycles between frames
+    uint16_t count;
+    uint8_t len;
+} spi_test_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes;             // register bytes transferred
+    uint64_t latency;           // sum of the frame latencies (ns)
+    uint64_t lat_min;
+    uint64_t lat_max;
+    uint64_t waits;             // turnaround bytes, before the read markers
+    uint64_t errors;
+} spi_host_stats_t;
+
+typedef struct {
+    spi_op_t op;
+    uint8_t addr;
+    uint8_t len;
+    uint8_t tx[SPI_HOST_MAX_FRAME];
+    uint8_t rx[SPI_HOST_MAX_FRAME];
+    uint16_t tx_len;            // bytes to transfer (extended, for reads)
+    uint16_t pos;               // current byte
+    uint8_t bit;                // current bit (MSB first)
+    uint8_t shift;              // MISO bits, of the current byte
+    bool unknown;               // MISO was X/Z, for the current byte
+    bool xz[SPI_HOST_MAX_FRAME];
+    int16_t data;               // index of the first read-data byte, or -1
+    uint64_t start_ns;          // time that 'SSEL' was asserted
+} spi_frame_t;
+
+typedef struct {
+    char name[SPI_HOST_MAX_NAME];
+    vpiHandle clock;
+    vpiHandle reset;
+    vpiHandle sigs[SPI_NUM_SIGS];
+    uint8_t vals[SPI_NUM_SIGS];
+    uint8_t next[SPI_NUM_SIGS];
+    uint64_t t_recip;
+    uint64_t tick_ns;
+    // Configuration
+    uint8_t mode;
+    uint16_t ratio;             // overrides the test-case ratios, if non-zero
+    uint32_t seed;
+    // State
+    spi_host_op_t op;
+    uint64_t cycle;
+    uint32_t wait;              // clock cycles until the next event
+    uint32_t rng;
+    const spi_test_t* tests;
+    int test_num;
+    int test_curr;
+    int test_step;              // accesses issued, for the current test-case
+    uint64_t test_ns;           // time of the first frame, of the test-case
+    spi_frame_t frame;
+    uint8_t regs[SPI_HOST_REGS];
+    bool known[SPI_HOST_REGS];
+    spi_host_stats_t stats;     // for the current test-case
+    uint64_t errors;
+} spi_host_t;
+
+
+void spi_host_register(void);
+
+
+#endif  /* __SPI_HOST_H__ */
@@ -2,9 +2,23 @@
 
 void ut_register(void);
 void pt_register(void);
+void ulpim_register(void);
+void axis_register(void);
+void ddr3_mem_register(void);
+void axi_mem_register(void);
+void spi_host_register(void);
+void uart_peer_register(void);
+void tele_register(void);
 
 void (*vlog_startup_routines[])() = {
     ut_register,
     pt_register,
+    ulpim_register,
+    axis_register,
+    ddr3_mem_register,
+    axi_mem_register,
+    spi_host_register,
+    uart_peer_register,
+    tele_register,
     0,
 };
@@ -18,6 +18,7 @@ typedef struct {
     uint8_t step;
     uint8_t stage;
     uint8_t ep;
+    ep_role_t role;
 } bulkin_state_t;
 
 static const char tc_bulkin_name[] = "BULK IN";
@@ -49,12 +50,12 @@ static void tc_bulkin_xfer(usb_host_t* host, const uint8_t ep)
 static int tc_bulkin_init(usb_host_t* host, void* data)
 {
     bulkin_state_t* st = (bulkin_state_t*)data;
-    vpi_printf("\n[%s:%d] %s INIT (cycle = %lu)\n\n", __FILE__, __LINE__,
-               tc_bulkin_name, host->cycle);
+    ulpi_vpi_printf("\n[%s:%d] %s INIT (cycle = %lu)\n\n", __FILE__, __LINE__,
+                    tc_bulkin_name, host->cycle);
 
     st->step = BulkIN0;
     st->stage = 0;
-    // tc_bulkin_xfer(host, BULK_IN_EP);
+    st->ep = tc_endpoint(host, st->role);
     tc_bulkin_xfer(host, st->ep);
     host->step = 0;
 
@@ -70,18 +71,25 @@ static int tc_bulkin_step(usb_host_t* host, void* data)
     bulkin_state_t* st = (bulkin_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = bulkin_strings[st->step];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+
+    if (xfer->rx_len > (int)tc_max_packet(host, st->role)) {
+        ulpi_vpi_printf("[%s:%d] Bulk IN packet exceeds 'wMaxPacketSize' (%d bytes)\n",
+                        __FILE__, __LINE__, xfer->rx_len);
+        vpi_control(vpiFinish, 1);
+        return -1;
+    }
 
     switch (st->step) {
     case BulkIN0:
         // BulkIN0 completed, so move to BulkIN1
-        tc_bulkin_xfer(host, BULK_IN_EP);
+        tc_bulkin_xfer(host, st->ep);
         st->step = BulkIN1;
         return 0;
 
     case BulkIN1:
         // BulkIN1 completed, so move to BulkIN2
-        tc_bulkin_xfer(host, BULK_IN_EP);
+        tc_bulkin_xfer(host, st->ep);
         st->step = BulkIN2;
         return 0;
 
@@ -95,28 +103,27 @@ static int tc_bulkin_step(usb_host_t* host, void* data)
 
     case BINDone:
         // Bulk OUT transaction tests completed
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid BULK IN state: 0x%x\n",
-                   __FILE__, __LINE__, st->step);
+        ulpi_vpi_printf("[%s:%d] Invalid BULK IN state: 0x%x\n",
+                        __FILE__, __LINE__, st->step);
         vpi_control(vpiFinish, 1);
     }
 
     return -1;
 }
 
-testcase_t* test_bulkin(uint8_t ep)
+testcase_t* test_bulkin(ep_role_t role)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    bulkin_state_t* st = malloc(sizeof(bulkin_state_t));
+    testcase_t* tc = tc_create(tc_bulkin_name, sizeof(bulkin_state_t));
+    bulkin_state_t* st = (bulkin_state_t*)tc->data;
     st->step = BulkIN0;
     st->stage = 0;
-    st->ep = ep;
+    st->ep = 0;
+    st->role = role;
 
-    tc->name = tc_bulkin_name;
-    tc->data = (void*)st;
     tc->init = tc_bulkin_init;
     tc->step = tc_bulkin_step;
 
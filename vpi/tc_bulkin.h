@@ -4,7 +4,7 @@
 #include "testcase.h"
 
 
-testcase_t* test_bulkin(uint8_t ep);
+testcase_t* test_bulkin(ep_role_t role);
 
 
 #endif  /* __TC_BULKIN_H__ */
@@ -32,12 +32,16 @@ static const char bulkout_strings[8][16] = {
 
 
 /**
- * Bulk OUT transaction-initialisation routine.
+ * Bulk OUT transaction-initialisation routine, with the packet-size limited to
+ * the 'wMaxPacketSize' of the endpoint.
  */
-static void tc_bulkout_xfer(usb_host_t* host, int n, uint8_t ep)
+static void tc_bulkout_xfer(usb_host_t* host, int n, ep_role_t role)
 {
     transfer_t* xfer = &host->xfer;
+    const uint8_t ep = tc_endpoint(host, role);
+    const int max = (int)tc_max_packet(host, role);
     host->op = HostBulkOUT;
+    n = n > max ? max : n;
 
     xfer->type = OUT;
     xfer->stage = NoXfer;
@@ -66,7 +70,7 @@ static int tc_bulkout_init(usb_host_t* host, void* data)
     bulkout_state_t* st = (bulkout_state_t*)data;
     *st = BulkOUT0;
 
-    tc_bulkout_xfer(host, 16, BULK_OUT_EP);
+    tc_bulkout_xfer(host, 16, EpBulkOut);
     host->step = 0;
 
     return 0;
@@ -81,18 +85,18 @@ static int tc_bulkout_step(usb_host_t* host, void* data)
     bulkout_state_t* st = (bulkout_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = bulkout_strings[*st];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (*st) {
     case BulkOUT0:
         // BulkOUT0 completed, so move to BulkOUT1
-        tc_bulkout_xfer(host, 37, BULK_OUT_EP);
+        tc_bulkout_xfer(host, 37, EpBulkOut);
         *st = BulkOUT1;
         return 0;
 
     case BulkOUT1:
         // BulkOUT1 completed, so move to BulkOUT2
-        tc_bulkout_xfer(host, 0, BULK_OUT_EP);
+        tc_bulkout_xfer(host, 0, EpBulkOut);
         *st = BulkOUT2;
         return 0;
 
@@ -100,25 +104,25 @@ static int tc_bulkout_step(usb_host_t* host, void* data)
         // BulkOUT2 completed, so move to BulkOUT3
 	// Note: Bulk OUT transfer of size=1, because Bulk IN of this size used
 	//   to break the ULPI encoder.
-        tc_bulkout_xfer(host, 1, BULK_OUT_EP);
+        tc_bulkout_xfer(host, 1, EpBulkOut);
         *st = BulkOUT3;
         return 0;
 
     case BulkOUT3:
         // BulkOUT3 completed, so move to BulkOUT4
-        tc_bulkout_xfer(host, 2, BULK_OUT_EP);
+        tc_bulkout_xfer(host, 2, EpBulkOut);
         *st = BulkOUT4;
         return 0;
 
     case BulkOUT4:
         // BulkOUT4 completed, so move to BulkOUT5
-        tc_bulkout_xfer(host, 3, BULK_OUT_EP);
+        tc_bulkout_xfer(host, 3, EpBulkOut);
         *st = BulkOUT5;
         return 0;
 
     case BulkOUT5:
         // BulkOUT5 completed, so move to BulkOUT6
-        tc_bulkout_xfer(host, 4, BULK_OUT_EP);
+        tc_bulkout_xfer(host, 4, EpBulkOut);
         *st = BulkOUT6;
         return 0;
 
@@ -132,13 +136,13 @@ static int tc_bulkout_step(usb_host_t* host, void* data)
 
     case BulkDone:
         // Bulk OUT transaction tests completed
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n",
+                        __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid BULK OUT state: 0x%x\n",
-                   __FILE__, __LINE__, *st);
+        ulpi_vpi_printf("[%s:%d] Invalid BULK OUT state: 0x%x\n",
+                        __FILE__, __LINE__, *st);
         vpi_control(vpiFinish, 1);
     }
 
@@ -147,12 +151,10 @@ static int tc_bulkout_step(usb_host_t* host, void* data)
 
 testcase_t* test_bulkout(void)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    bulkout_state_t* st = malloc(sizeof(bulkout_state_t));
+    testcase_t* tc = tc_create(tc_bulkout_name, sizeof(bulkout_state_t));
+    bulkout_state_t* st = (bulkout_state_t*)tc->data;
     *st = BulkOUT0;
 
-    tc->name = tc_bulkout_name;
-    tc->data = (void*)st;
     tc->init = tc_bulkout_init;
     tc->step = tc_bulkout_step;
 
@@ -0,0 +1,123 @@
+#include "tc_ctlbw.h"
+#include "usb/stdreq.h"
+#include "usb/descriptor.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <vpi_user.h>
+
+
+/**
+ * Measures the throughput of the control pipe (via 'ctl_pipe0'), by issuing
+ * back-to-back 'GET DESCRIPTOR' requests, for all of the configuration
+ * descriptors, and stepping each through its (possibly multi-packet) DATA
+ * stage, and its STATUS stage, using 'stdreq_next()'.
+ */
+typedef struct {
+    uint16_t len;
+    int count;
+    int done;
+    uint32_t naks;
+    uint64_t bytes;
+    uint64_t start;
+} ctlbw_state_t;
+
+
+static const char tc_ctlbw_name[] = "CONTROL THROUGHPUT";
+
+
+static int tc_ctlbw_xfer(usb_host_t* host, ctlbw_state_t* st)
+{
+    if (stdreq_get_desc_config(host, st->len) < 0) {
+        ulpi_vpi_printf("[%s:%d] %s request failed (transfer %d)\n",
+                        __FILE__, __LINE__, tc_ctlbw_name, st->done);
+        show_host(host);
+        vpi_control(vpiFinish, 2);
+        return -1;
+    }
+    return 0;
+}
+
+static int tc_ctlbw_init(usb_host_t* host, void* data)
+{
+    ctlbw_state_t* st = (ctlbw_state_t*)data;
+
+    // All of the descriptors, unless a length was given
+    if (st->len == 0) {
+        st->len = host->eptab.total > 0 ? host->eptab.total : MAX_CONFIG_SIZE;
+    }
+    st->done = 0;
+    st->naks = 0;
+    st->bytes = 0;
+    st->start = host->cycle;
+
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT (%d x %u bytes)\n",
+                    host->cycle, tc_ctlbw_name, st->count, st->len);
+
+    return tc_ctlbw_xfer(host, st);
+}
+
+/**
+ * Step-function that is invoked as each packet of a control transfer has been
+ * sent/received.
+ */
+static int tc_ctlbw_step(usb_host_t* host, void* data)
+{
+    ctlbw_state_t* st = (ctlbw_state_t*)data;
+    transfer_t* xfer = &host->xfer;
+    int result;
+
+    if ((host->step == 4 || host->step == 8) && xfer->hsk == USBPID_NAK) {
+        st->naks++;
+    }
+
+    result = stdreq_next(host);
+    if (result < 0) {
+        ulpi_vpi_printf("[%s:%d] %s failed (transfer %d, step %u, result %d)\n",
+                        __FILE__, __LINE__, tc_ctlbw_name, st->done, host->step, result);
+        vpi_control(vpiFinish, 1);
+        return -1;
+    } else if (result == 0) {
+        return 0;
+    }
+
+    // Completed, so check the descriptor, and then issue the next request
+    if (host->ctl.ptr == 0 || host->ctl.ptr > st->len || host->buf[1] != DESC_CONFIGURATION) {
+        ulpi_vpi_printf("[%s:%d] %s invalid descriptor (%u bytes, type 0x%02x)\n",
+                        __FILE__, __LINE__, tc_ctlbw_name, host->ctl.ptr, host->buf[1]);
+        vpi_control(vpiFinish, 1);
+        return -1;
+    }
+    st->bytes += host->ctl.ptr;
+
+    if (++st->done < st->count) {
+        return tc_ctlbw_xfer(host, st);
+    }
+
+    const uint64_t cycles = host->cycle - st->start;
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s: %d transfers, %lu bytes in %lu cycles\n",
+                    host->cycle, tc_ctlbw_name, st->done, st->bytes, cycles);
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s: %.3f bytes/cycle (%.2f MB/s), %lu cycles/transfer, %u NAKs\n",
+                    host->cycle, tc_ctlbw_name, (double)st->bytes / (double)cycles,
+                    (double)st->bytes * 60.0 / (double)cycles, cycles / st->done, st->naks);
+
+    return 1;
+}
+
+/**
+ * Issue 'count' requests of 'len' bytes, or of 'wTotalLength' bytes, if zero.
+ */
+testcase_t* test_ctlbw(const uint16_t len, const int count)
+{
+    testcase_t* tc = tc_create(tc_ctlbw_name, sizeof(ctlbw_state_t));
+    ctlbw_state_t* st = (ctlbw_state_t*)tc->data;
+
+    st->len = len;
+    st->count = count > 0 ? count : 1;
+    st->done = 0;
+
+    tc->init = tc_ctlbw_init;
+    tc->step = tc_ctlbw_step;
+
+    return tc;
+}
@@ -0,0 +1,11 @@
+#ifndef __TC_CTLBW_H__
+#define __TC_CTLBW_H__
+
+#include "testcase.h"
+#include <stdint.h>
+
+
+testcase_t* test_ctlbw(const uint16_t len, const int count);
+
+
+#endif  /* __TC_CTLBW_H__ */
@@ -1,8 +1,10 @@
 #include "tc_ddr3in.h"
 #include "usb/usbcrc.h"
+#include "usb/usbfunc.h"
 #include "usb/usbhost.h"
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <vpi_user.h>
 
@@ -35,12 +37,20 @@ static const int ddr3in_lengths[6] = { 4, 8, 16, 20, 12, 24 };
 
 /**
  * DDR3 IN transaction-initialisation routine, that first sends a FETCH command,
- * followed by a USB Bulk IN request.
+ * followed by a USB Bulk IN request. The number of beats is limited so that the
+ * response fits within the 'wMaxPacketSize' of the endpoint.
  */
+static int tc_ddr3in_size(usb_host_t* host, int n)
+{
+    const int max = (int)tc_max_packet(host, EpDDR3In) / 4;
+    return n > max ? max : n;
+}
+
 static void tc_ddr3in_cmd(usb_host_t* host, int n, const ddr3in_state_t* st)
 {
     transfer_t* xfer = &host->xfer;
     host->op = HostBulkOUT;
+    n = tc_ddr3in_size(host, n);
 
     xfer->type = OUT;
     xfer->stage = NoXfer;
@@ -84,17 +94,58 @@ static void tc_ddr3in_dat(usb_host_t* host, const ddr3in_state_t* st)
     xfer->tok2 = (tok >> 8) & 0xFF;
 
     xfer->rx_ptr = 0;
+    xfer->rx_len = 0;
+}
+
+/**
+ * Check the data of a FETCH response against the DDR3 shadow (of the preceding
+ * STOREs), if the host has one, where bytes that were never stored are skipped.
+ * If any of the requested bytes are known, then the response must be an RDATA,
+ * with the request's ID, and all of the requested beats.
+ */
+static int tc_ddr3in_check(usb_host_t* host, const ddr3in_state_t* st)
+{
+    const transfer_t* xfer = &host->xfer;
+    const int beats = (tc_ddr3in_size(host, ddr3in_lengths[st->iter]) - 1) | 0x03;
+    const int len = DDR3_BEAT_SIZE * (beats + 1);
+    bool known = false;
+
+    if (host->shadow == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < len && !known; i++) {
+        known = shadow_known(host->shadow, st->addr + i);
+    }
+    if (!known) {
+        return 0;
+    }
+
+    if (xfer->rx_len != len + 2) {
+        ulpi_vpi_printf("[%s:%d] FETCH response of %d bytes, expected %d (at 0x%07x)\n",
+                        __FILE__, __LINE__, xfer->rx_len, len + 2, st->addr);
+        return -1;
+    } else if (xfer->rx[0] != DDR3_RES_RDATA || xfer->rx[1] != st->id) {
+        ulpi_vpi_printf("[%s:%d] FETCH response: 0x%02x (ID: %u), for request ID: %u\n",
+                        __FILE__, __LINE__, xfer->rx[0], xfer->rx[1], st->id);
+        return -1;
+    } else if (shadow_check(host->shadow, st->addr, &xfer->rx[2], len) > 0) {
+        ulpi_vpi_printf("[%s:%d] FETCH data mismatch, at 0x%07x (expected: 0x%02x, got: 0x%02x)\n",
+                        __FILE__, __LINE__, host->shadow->bad_addr, host->shadow->bad_exp,
+                        host->shadow->bad_got);
+        return -1;
+    }
+    return 0;
 }
 
 static int tc_ddr3in_init(usb_host_t* host, void* data)
 {
     ddr3in_state_t* st = (ddr3in_state_t*)data;
-    vpi_printf("\n[%s:%d] %s INIT (cycle = %lu)\n\n", __FILE__, __LINE__,
-               tc_ddr3in_name, host->cycle);
+    ulpi_vpi_printf("\n[%s:%d] %s INIT (cycle = %lu)\n\n", __FILE__, __LINE__,
+                    tc_ddr3in_name, host->cycle);
 
     st->step = DDR3Cmd;
-    st->out  = DDR3_OUT_EP;
-    st->in   = DDR3_IN_EP;
+    st->out  = tc_endpoint(host, EpDDR3Out);
+    st->in   = tc_endpoint(host, EpDDR3In);
     tc_ddr3in_cmd(host, ddr3in_lengths[st->iter], st);
     host->step = 0;
 
@@ -110,7 +161,7 @@ static int tc_ddr3in_step(usb_host_t* host, void* data)
     ddr3in_state_t* st = (ddr3in_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = ddr3in_strings[st->step];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (st->step) {
     case DDR3Cmd:
@@ -126,8 +177,12 @@ static int tc_ddr3in_step(usb_host_t* host, void* data)
         return 0;
 
     case DDR3Dat:
-        // DDR3Dat completed, so move to DDR3End
+        // DDR3Dat completed, so check its data, and then move to DDR3End
         xfer->stage = NoXfer;
+        if (tc_ddr3in_check(host, st) < 0) {
+            vpi_control(vpiFinish, 1);
+            return -1;
+        }
 	if (++st->iter >= NUM_ITER) {
 	    xfer->type = XferIdle;
 	    host->op = HostIdle;
@@ -140,12 +195,12 @@ static int tc_ddr3in_step(usb_host_t* host, void* data)
 
     case DDR3End:
         // DDR Bulk IN transaction tests completed
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid BULK IN state: 0x%x\n",
-                   __FILE__, __LINE__, st->step);
+        ulpi_vpi_printf("[%s:%d] Invalid BULK IN state: 0x%x\n",
+                        __FILE__, __LINE__, st->step);
         vpi_control(vpiFinish, 1);
     }
 
@@ -154,8 +209,8 @@ static int tc_ddr3in_step(usb_host_t* host, void* data)
 
 testcase_t* test_ddr3in(const uint32_t addr)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    ddr3in_state_t* st = malloc(sizeof(ddr3in_state_t));
+    testcase_t* tc = tc_create(tc_ddr3in_name, sizeof(ddr3in_state_t));
+    ddr3in_state_t* st = (ddr3in_state_t*)tc->data;
     st->step = DDR3Cmd;
     st->iter = 0;
     st->out  = DDR3_OUT_EP;
@@ -163,8 +218,6 @@ testcase_t* test_ddr3in(const uint32_t addr)
     st->id   = rand() & 0x0F;
     st->addr = addr;
 
-    tc->name = tc_ddr3in_name;
-    tc->data = (void*)st;
     tc->init = tc_ddr3in_init;
     tc->step = tc_ddr3in_step;
 
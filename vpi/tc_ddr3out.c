@@ -35,12 +35,15 @@ static const int ddr3out_lengths[8] = { 4, 4, 8, 16, 20, 12, 24, 0 };
 
 
 /**
- * DDR3 OUT transaction-initialisation routine.
+ * DDR3 OUT transaction-initialisation routine, with the number of beats limited
+ * so that the command and data fit within the 'wMaxPacketSize' of the endpoint.
  */
 static void tc_ddr3out_cmd(usb_host_t* host, int n, const ddr3out_state_t* st)
 {
     transfer_t* xfer = &host->xfer;
+    const int max = ((int)tc_max_packet(host, EpDDR3Out) - 6) / st->beat;
     host->op = HostBulkOUT;
+    n = n > max ? max : n;
 
     xfer->type = OUT;
     xfer->stage = NoXfer;
@@ -68,6 +71,9 @@ static void tc_ddr3out_cmd(usb_host_t* host, int n, const ddr3out_state_t* st)
     for (int i=n; i--;) {
         dst[i] = rand();
     }
+    if (host->shadow != NULL) {
+        shadow_store(host->shadow, st->addr, &xfer->tx[6], n*st->beat);
+    }
 
     uint16_t crc = crc16_calc(xfer->tx, len);
     xfer->crc1 = crc & 0xFF;
@@ -97,8 +103,8 @@ static int tc_ddr3out_init(usb_host_t* host, void* data)
     ddr3out_state_t* st = (ddr3out_state_t*)data;
     st->step = DDR3Out;
     st->beat = 4;
-    st->out  = DDR3_OUT_EP;
-    st->in   = DDR3_IN_EP;
+    st->out  = tc_endpoint(host, EpDDR3Out);
+    st->in   = tc_endpoint(host, EpDDR3In);
     st->id   = rand() & 0x0F;
 
     tc_ddr3out_cmd(host, ddr3out_lengths[st->iter], st);
@@ -116,7 +122,7 @@ static int tc_ddr3out_step(usb_host_t* host, void* data)
     ddr3out_state_t* st = (ddr3out_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = ddr3out_strings[st->step];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (st->step) {
     case DDR3Out:
@@ -151,13 +157,13 @@ static int tc_ddr3out_step(usb_host_t* host, void* data)
 
     case DDR3End:
         // DDR3 OUT transaction tests completed
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n",
+                        __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid DDR3 OUT state: 0x%x\n",
-                   __FILE__, __LINE__, st->step);
+        ulpi_vpi_printf("[%s:%d] Invalid DDR3 OUT state: 0x%x\n",
+                        __FILE__, __LINE__, st->step);
         vpi_control(vpiFinish, 1);
     }
 
@@ -166,8 +172,8 @@ static int tc_ddr3out_step(usb_host_t* host, void* data)
 
 testcase_t* test_ddr3out(const uint32_t addr)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    ddr3out_state_t* st = malloc(sizeof(ddr3out_state_t));
+    testcase_t* tc = tc_create(tc_ddr3out_name, sizeof(ddr3out_state_t));
+    ddr3out_state_t* st = (ddr3out_state_t*)tc->data;
     st->step = DDR3Out;
     st->iter = 0;
     st->addr = addr; // 16-byte-aligned address
@@ -176,8 +182,6 @@ testcase_t* test_ddr3out(const uint32_t addr)
     st->in   = DDR3_IN_EP;
     st->id   = 0x01; // Transaction ID
 
-    tc->name = tc_ddr3out_name;
-    tc->data = (void*)st;
     tc->init = tc_ddr3out_init;
     tc->step = tc_ddr3out_step;
 
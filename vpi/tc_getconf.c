@@ -43,6 +43,31 @@ static const char getconf_strings[10][16] = {
 };
 
 
+/**
+ * Parse the received descriptor, so that the endpoints are discovered, rather
+ * than assumed by the test-cases.
+ */
+static int tc_getconf_parse(usb_host_t* host, uint8_t stage)
+{
+    const transfer_t* xfer = &host->xfer;
+    int result;
+
+    if (stage == 0) {
+        result = desc_parse_device(&host->eptab, xfer->rx, xfer->rx_len);
+    } else {
+        result = desc_parse_config(&host->eptab, xfer->rx, xfer->rx_len);
+    }
+
+    if (result < 0) {
+        ulpi_vpi_printf("[%s:%d] %s parsing failed (stage = %u)\n",
+                        __FILE__, __LINE__, tc_getconf_name, stage);
+    } else if (stage == 2) {
+        show_eptab(&host->eptab);
+    }
+
+    return result;
+}
+
 static int tc_getconf_init(usb_host_t* host, void* data)
 {
     getconf_state_t* st = (getconf_state_t*)data;
@@ -61,18 +86,19 @@ static int tc_getconf_init(usb_host_t* host, void* data)
         result = stdreq_get_desc_config(host, 9);
         break;
     case 2:
-        result = stdreq_get_desc_config(host, 39);
+        // All of the descriptors, using the total length from stage 1
+        result = stdreq_get_desc_config(host, host->eptab.total);
         break;
     case 3:
         return 1;
     }
 
-    vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
-               host->cycle, tc_getconf_name, result);
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
+                    host->cycle, tc_getconf_name, result);
 
     if (result < 0) {
-        vpi_printf("[%s:%d] GET STATUS initialisation failed\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] GET STATUS initialisation failed\n",
+                        __FILE__, __LINE__);
         show_host(host);
         vpi_control(vpiFinish, 2);
         return result;
@@ -90,7 +116,7 @@ static int tc_getconf_step(usb_host_t* host, void* data)
     getconf_state_t* st = (getconf_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = getconf_strings[st->step];
-    vpi_printf("[%s:%d] %s\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("[%s:%d] %s\n", __FILE__, __LINE__, str);
 
     switch (st->step) {
     case SendSETUP:
@@ -143,6 +169,10 @@ static int tc_getconf_step(usb_host_t* host, void* data)
         host->step++;
         host->op = HostIdle;
         show_desc(xfer);
+        if (tc_getconf_parse(host, st->stage) < 0) {
+            vpi_control(vpiFinish, 1);
+            return -1;
+        }
         if (++st->stage < 3) {
             tc_getconf_init(host, data);
             return 0;
@@ -152,12 +182,12 @@ static int tc_getconf_step(usb_host_t* host, void* data)
         }
 
     case DoneSETUP:
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid GET STATUS state: 0x%x\n",
-                   __FILE__, __LINE__, st->step);
+        ulpi_vpi_printf("[%s:%d] Invalid GET STATUS state: 0x%x\n",
+                        __FILE__, __LINE__, st->step);
         vpi_control(vpiFinish, 1);
     }
 
@@ -166,16 +196,13 @@ static int tc_getconf_step(usb_host_t* host, void* data)
 
 testcase_t* test_getconf(void)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    getconf_state_t* st = malloc(sizeof(getconf_state_t));
+    testcase_t* tc = tc_create(tc_getconf_name, sizeof(getconf_state_t));
+    getconf_state_t* st = (getconf_state_t*)tc->data;
 
     st->step = SendSETUP;
     st->stage = 0;
     st->len = 0;
-    st->buf = malloc(512);
 
-    tc->name = tc_getconf_name;
-    tc->data = (void*)st;
     tc->init = tc_getconf_init;
     tc->step = tc_getconf_step;
 
@@ -41,11 +41,11 @@ static int tc_getdesc_init(usb_host_t* host, void* data)
     transfer_t* xfer = &host->xfer;
     *st = SendSETUP;
     int result = stdreq_get_descriptor(host, 0x0301);
-    vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
-               host->cycle, tc_getdesc_name, result);
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
+                    host->cycle, tc_getdesc_name, result);
     if (result < 0) {
-        vpi_printf("[%s:%d] GET DESCRIPTOR initialisation failed\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] GET DESCRIPTOR initialisation failed\n",
+                        __FILE__, __LINE__);
         show_host(host);
         vpi_control(vpiFinish, 2);
         return -1;
@@ -62,13 +62,13 @@ static int tc_getdesc_step(usb_host_t* host, void* data)
     getdesc_state_t* st = (getdesc_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = getdesc_strings[*st];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (*st) {
     case SendSETUP:
         // SendSETUP completed, so now send DATA0
         host->step++;
-        vpi_printf("[%s:%d] WARN -- DATA0 not setup correctly\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN -- DATA0 not setup correctly\n", __FILE__, __LINE__);
         *st = SendDATA0;
         return 0;
 
@@ -120,12 +120,12 @@ static int tc_getdesc_step(usb_host_t* host, void* data)
         return 1;
 
     case DescDone:
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid GET DESCRIPTOR state: 0x%x\n",
-                   __FILE__, __LINE__, *st);
+        ulpi_vpi_printf("[%s:%d] Invalid GET DESCRIPTOR state: 0x%x\n",
+                        __FILE__, __LINE__, *st);
         vpi_control(vpiFinish, 1);
     }
 
@@ -134,12 +134,10 @@ static int tc_getdesc_step(usb_host_t* host, void* data)
 
 testcase_t* test_getdesc(void)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    getdesc_state_t* st = malloc(sizeof(getdesc_state_t));
+    testcase_t* tc = tc_create(tc_getdesc_name, sizeof(getdesc_state_t));
+    getdesc_state_t* st = (getdesc_state_t*)tc->data;
     *st = SendSETUP;
 
-    tc->name = tc_getdesc_name;
-    tc->data = (void*)st;
     tc->init = tc_getdesc_init;
     tc->step = tc_getdesc_step;
 
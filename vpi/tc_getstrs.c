@@ -73,12 +73,12 @@ static int tc_getstrs_init(usb_host_t* host, void* data)
 	return 1;
     }
 
-    vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
-               host->cycle, tc_getstrs_name, result);
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
+                    host->cycle, tc_getstrs_name, result);
 
     if (result < 0) {
-        vpi_printf("[%s:%d] GET STRINGS initialisation failed\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] GET STRINGS initialisation failed\n",
+                        __FILE__, __LINE__);
         show_host(host);
         vpi_control(vpiFinish, 2);
 	return result;
@@ -96,7 +96,7 @@ static int tc_getstrs_step(usb_host_t* host, void* data)
     getstrs_state_t* st = (getstrs_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = getstrs_strings[st->step];
-    vpi_printf("[%s:%d] %s\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("[%s:%d] %s\n", __FILE__, __LINE__, str);
 
     switch (st->step) {
     case SendSETUP:
@@ -158,12 +158,12 @@ static int tc_getstrs_step(usb_host_t* host, void* data)
 	}
 
     case DoneSETUP:
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid GET STRINGS state: 0x%x\n",
-                   __FILE__, __LINE__, st->step);
+        ulpi_vpi_printf("[%s:%d] Invalid GET STRINGS state: 0x%x\n",
+                        __FILE__, __LINE__, st->step);
         vpi_control(vpiFinish, 1);
     }
 
@@ -172,16 +172,13 @@ static int tc_getstrs_step(usb_host_t* host, void* data)
 
 testcase_t* test_getstrs(void)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    getstrs_state_t* st = malloc(sizeof(getstrs_state_t));
+    testcase_t* tc = tc_create(tc_getstrs_name, sizeof(getstrs_state_t));
+    getstrs_state_t* st = (getstrs_state_t*)tc->data;
 
     st->step = SendSETUP;
     st->stage = 0;
     st->len = 0;
-    st->buf = malloc(512);
 
-    tc->name = tc_getstrs_name;
-    tc->data = (void*)st;
     tc->init = tc_getstrs_init;
     tc->step = tc_getstrs_step;
 
@@ -48,7 +48,7 @@ static void adjust_seq(transfer_t* xfer)
  */
 static void adjust_crc(transfer_t* xfer)
 {
-    if (xfer->endpoint == BULK_IN_EP) {
+    if (xfer->type == IN) {
         // Corrupted token, so the request must be ignored
         xfer->tok2 ^= 0x80;
     } else {
@@ -71,11 +71,12 @@ static void adjust_ept(transfer_t* xfer)
 /**
  * Construct a Bulk IN transfer, with correct or inverted parity-bit.
  */
-static void tc_parity_xfer(usb_host_t* host, const uint8_t ep)
+static void tc_parity_xfer(usb_host_t* host, ep_role_t role)
 {
     transfer_t* xfer = &host->xfer;
+    const uint8_t ep = tc_endpoint(host, role);
 
-    if (ep == BULK_IN_EP) {
+    if (role == EpBulkIn) {
         host->op = HostBulkIN;
         xfer->type = IN;
         xfer->rx_len = 0;
@@ -127,13 +128,13 @@ static int tc_parity_init(usb_host_t* host, void* data)
         return 1;
     }
 
-    tc_parity_xfer(host, BULK_IN_EP);
+    tc_parity_xfer(host, EpBulkIn);
     st->step = BulkIN0;
     st->adjust(&host->xfer);
 
-    vpi_printf("[%s:%d] %s INIT (cycle = %lu, stage = %u, step = %u, EP = %u)\n",
-               __FILE__, __LINE__, tc_parity_name, host->cycle, st->stage,
-               st->step, host->xfer.endpoint);
+    ulpi_vpi_printf("[%s:%d] %s INIT (cycle = %lu, stage = %u, step = %u, EP = %u)\n",
+                    __FILE__, __LINE__, tc_parity_name, host->cycle, st->stage,
+                    st->step, host->xfer.endpoint);
 
     return 0;
 }
@@ -147,19 +148,19 @@ static int tc_parity_step(usb_host_t* host, void* data)
     parity_state_t* st = (parity_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = parity_strings[st->step];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (st->step) {
     case BulkIN0:
         // BulkIN0 should have failed parity-checking, so move to BulkIN1
         st->adjust(&host->xfer);
-        tc_parity_xfer(host, BULK_IN_EP);
+        tc_parity_xfer(host, EpBulkIn);
         st->step = BulkIN1;
         return 0;
 
     case BulkIN1:
         // BulkIN1 completed, so move to BulkIN2
-        tc_parity_xfer(host, BULK_OUT_EP);
+        tc_parity_xfer(host, EpBulkOut);
         st->adjust(&host->xfer);
         st->step = BulkOUT0;
         return 0;
@@ -167,7 +168,7 @@ static int tc_parity_step(usb_host_t* host, void* data)
     case BulkOUT0:
         // BulkOUT0 should have failed parity-checking, so move to BulkOUT1
         st->adjust(&host->xfer);
-        tc_parity_xfer(host, BULK_OUT_EP);
+        tc_parity_xfer(host, EpBulkOut);
         st->step = BulkOUT1;
         return 0;
 
@@ -185,12 +186,12 @@ static int tc_parity_step(usb_host_t* host, void* data)
 
     case DonePar:
         // Bulk IN/OUT parity tests completed
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid BULK IN/OUT parity state: { 0x%02x, 0x%02x }\n",
-                   __FILE__, __LINE__, st->step, st->stage);
+        ulpi_vpi_printf("[%s:%d] Invalid BULK IN/OUT parity state: { 0x%02x, 0x%02x }\n",
+                        __FILE__, __LINE__, st->step, st->stage);
         vpi_control(vpiFinish, 1);
     }
 
@@ -199,15 +200,13 @@ static int tc_parity_step(usb_host_t* host, void* data)
 
 testcase_t* test_parity(void)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    parity_state_t* st = malloc(sizeof(parity_state_t));
+    testcase_t* tc = tc_create(tc_parity_name, sizeof(parity_state_t));
+    parity_state_t* st = (parity_state_t*)tc->data;
 
     st->stage = 0;
     st->step = BulkIN0;
     st->adjust = adjust_seq;
 
-    tc->name = tc_parity_name;
-    tc->data = (void*)st;
     tc->init = tc_parity_init;
     tc->step = tc_parity_step;
 
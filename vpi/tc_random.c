@@ -0,0 +1,100 @@
+#include "tc_random.h"
+#include "usb/usbgen.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <vpi_user.h>
+
+
+/**
+ * Issues a seeded, constrained-random, mix of control, Bulk OUT/IN, and DDR3
+ * STORE/FETCH transactions, using the same generator (and scoreboard) as the
+ * loopback model, and then reports the bandwidth and latency of each kind.
+ *
+ * Note: the RTL core has no vendor register requests, and its Bulk IN data is
+ *   not a loop-back of the Bulk OUT packets, so only the protocol, and the DDR3
+ *   responses, are checked.
+ */
+typedef struct {
+    gen_config_t cfg;
+    usb_gen_t gen;
+} random_state_t;
+
+
+static const char tc_random_name[] = "RANDOM TRAFFIC";
+
+
+static int tc_random_failed(usb_host_t* host, random_state_t* st)
+{
+    ulpi_vpi_printf("[%s:%d] %s failed (transaction %u): %s\n", __FILE__, __LINE__,
+                    tc_random_name, st->gen.issued, st->gen.fail);
+    show_host(host);
+    vpi_control(vpiFinish, 1);
+    return -1;
+}
+
+static int tc_random_init(usb_host_t* host, void* data)
+{
+    random_state_t* st = (random_state_t*)data;
+
+    usbgen_init(&st->gen, &st->cfg);
+    usbgen_bind(&st->gen, host);
+
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT (%u transactions, seed: 0x%x)\n",
+                    host->cycle, tc_random_name, st->cfg.count, st->cfg.seed);
+
+    if (usbgen_start(&st->gen, host) < 0) {
+        return tc_random_failed(host, st);
+    }
+    return 0;
+}
+
+/**
+ * Step-function that is invoked as each packet of a transaction has been
+ * sent/received.
+ */
+static int tc_random_step(usb_host_t* host, void* data)
+{
+    random_state_t* st = (random_state_t*)data;
+    const int result = usbgen_next(&st->gen, host);
+
+    if (result < 0) {
+        return tc_random_failed(host, st);
+    } else if (result == 0) {
+        return 0;
+    } else if (!usbgen_done(&st->gen)) {
+        return usbgen_start(&st->gen, host) < 0 ? tc_random_failed(host, st) : 0;
+    }
+
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s completed\n", host->cycle, tc_random_name);
+    usbgen_report(&st->gen);
+
+    return 1;
+}
+
+/**
+ * Issue 'count' random transactions, using the DDR3 address window that starts
+ * at 128 kB, which overlaps the scripted DDR3 test-cases, so the host's shadow
+ * (shared by all of the test-cases) tracks which of them stored the data last.
+ * Without 'ddr3', no STOREs or FETCHes are issued.
+ */
+testcase_t* test_random(const uint32_t seed, const int count, const bool ddr3)
+{
+    testcase_t* tc = tc_create(tc_random_name, sizeof(random_state_t));
+    random_state_t* st = (random_state_t*)tc->data;
+
+    usbgen_defaults(&st->cfg, seed, count > 0 ? count : 1);
+    st->cfg.addr_base = 0x020000;
+    st->cfg.addr_size = 0x010000;
+    st->cfg.loopback = false;
+    st->cfg.vendor_regs = false;
+    if (!ddr3) {
+        st->cfg.weights[GenStore] = 0;
+        st->cfg.weights[GenFetch] = 0;
+    }
+
+    tc->init = tc_random_init;
+    tc->step = tc_random_step;
+
+    return tc;
+}
@@ -0,0 +1,12 @@
+#ifndef __TC_RANDOM_H__
+#define __TC_RANDOM_H__
+
+#include "testcase.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+testcase_t* test_random(const uint32_t seed, const int count, const bool ddr3);
+
+
+#endif  /* __TC_RANDOM_H__ */
@@ -96,7 +96,7 @@ static int tc_restarts_step(usb_host_t* host, void* data)
             bus->data.a = 0x00;
             bus->data.b = 0x00;
         } else if (bus->rst_n != vpi0) {
-            vpi_printf("ERROR: RESETB != 0 or 1\n");
+            ulpi_vpi_printf("ERROR: RESETB != 0 or 1\n");
             vpi_control(vpiFinish, 3);
             por->stage = ErrReset;
             return -1;
@@ -113,7 +113,7 @@ static int tc_restarts_step(usb_host_t* host, void* data)
                 phy_bus_release(bus);
             }
         } else {
-            vpi_printf("ERROR: Bad TStart bus state\n");
+            ulpi_vpi_printf("ERROR: Bad TStart bus state\n");
             vpi_control(vpiFinish, 3);
             return -1;
         }
@@ -160,8 +160,7 @@ static int tc_restarts_step(usb_host_t* host, void* data)
  */
 testcase_t* test_restarts(void)
 {
-    restart_t* data = (restart_t*)malloc(sizeof(restart_t));
-    testcase_t* test = tc_create(tc_restarts, data);
+    testcase_t* test = tc_create(tc_restarts, sizeof(restart_t));
 
     test->init = tc_restarts_init;
     test->step = tc_restarts_step;
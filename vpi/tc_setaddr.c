@@ -41,12 +41,12 @@ static int tc_setaddr_init(usb_host_t* host, void* data)
     st->stage = SendSETUP;
     int result = stdreq_set_address(host, st->addr);
 
-    vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
-               host->cycle, tc_setaddr_name, result);
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
+                    host->cycle, tc_setaddr_name, result);
 
     if (result < 0) {
-        vpi_printf("[%s:%d] SET ADDRESS initialisation failed\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] SET ADDRESS initialisation failed\n",
+                        __FILE__, __LINE__);
         show_host(host);
         vpi_control(vpiFinish, 2);
         return -1;
@@ -63,7 +63,7 @@ static int tc_setaddr_step(usb_host_t* host, void* data)
     setaddr_state_t* st = (setaddr_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = setaddr_strings[st->stage];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (st->stage) {
 
@@ -106,12 +106,12 @@ static int tc_setaddr_step(usb_host_t* host, void* data)
 
     // Finished
     case AddrDone:
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid SET ADDRESS state: 0x%x\n",
-                   __FILE__, __LINE__, st->stage);
+        ulpi_vpi_printf("[%s:%d] Invalid SET ADDRESS state: 0x%x\n",
+                        __FILE__, __LINE__, st->stage);
         vpi_control(vpiFinish, 1);
     }
 
@@ -124,13 +124,11 @@ testcase_t* test_setaddr(const uint8_t addr)
         return NULL;
     }
 
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    setaddr_state_t* st = malloc(sizeof(setaddr_state_t));
+    testcase_t* tc = tc_create(tc_setaddr_name, sizeof(setaddr_state_t));
+    setaddr_state_t* st = (setaddr_state_t*)tc->data;
     st->stage = SendSETUP;
     st->addr = addr;
 
-    tc->name = tc_setaddr_name;
-    tc->data = (void*)st;
     tc->init = tc_setaddr_init;
     tc->step = tc_setaddr_step;
 
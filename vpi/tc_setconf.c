@@ -41,12 +41,12 @@ static int tc_setconf_init(usb_host_t* host, void* data)
     st->stage = SendSETUP;
     int result = stdreq_set_config(host, st->conf);
 
-    vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
-               host->cycle, tc_setconf_name, result);
+    ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s INIT result = %d\n",
+                    host->cycle, tc_setconf_name, result);
 
     if (result < 0) {
-        vpi_printf("[%s:%d] SET CONFIGURATION initialisation failed\n",
-                   __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] SET CONFIGURATION initialisation failed\n",
+                        __FILE__, __LINE__);
         show_host(host);
         vpi_control(vpiFinish, 2);
         return -1;
@@ -63,7 +63,7 @@ static int tc_setconf_step(usb_host_t* host, void* data)
     setconf_t* st = (setconf_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = setconf_strings[st->stage];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (st->stage) {
 
@@ -104,12 +104,12 @@ static int tc_setconf_step(usb_host_t* host, void* data)
 
     // Finished
     case SetDone:
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid SET CONFIGURATION state: 0x%x\n",
-                   __FILE__, __LINE__, st->stage);
+        ulpi_vpi_printf("[%s:%d] Invalid SET CONFIGURATION state: 0x%x\n",
+                        __FILE__, __LINE__, st->stage);
         vpi_control(vpiFinish, 1);
     }
 
@@ -122,13 +122,11 @@ testcase_t* test_setconf(const uint8_t conf)
         return NULL;
     }
 
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    setconf_t* st = malloc(sizeof(setconf_t));
+    testcase_t* tc = tc_create(tc_setconf_name, sizeof(setconf_t));
+    setconf_t* st = (setconf_t*)tc->data;
     st->stage = SendSETUP;
     st->conf = conf;
 
-    tc->name = tc_setconf_name;
-    tc->data = (void*)st;
     tc->init = tc_setconf_init;
     tc->step = tc_setconf_step;
 
@@ -27,8 +27,8 @@ static int tc_waitsof_init(usb_host_t* host, void* data)
     waitsof_state_t* st = (waitsof_state_t*)data;
     *st = WaitIdle;
     host->step = 0;
-    vpi_printf("\n[%s:%d] %s INIT (cycle = %lu)\n\n", __FILE__, __LINE__,
-               tc_waitsof_name, host->cycle);
+    ulpi_vpi_printf("\n[%s:%d] %s INIT (cycle = %lu)\n\n", __FILE__, __LINE__,
+                    tc_waitsof_name, host->cycle);
 
     return 0;
 }
@@ -42,7 +42,7 @@ static int tc_waitsof_step(usb_host_t* host, void* data)
     waitsof_state_t* st = (waitsof_state_t*)data;
     transfer_t* xfer = &host->xfer;
     const char* str = waitsof_strings[*st];
-    vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
+    ulpi_vpi_printf("\n[%s:%d] %s\n\n", __FILE__, __LINE__, str);
 
     switch (*st) {
     case WaitIdle:
@@ -51,12 +51,12 @@ static int tc_waitsof_step(usb_host_t* host, void* data)
 
     case WaitDone:
         // Waiting for SOF test has completed
-        vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
+        ulpi_vpi_printf("[%s:%d] WARN => Invoked post-completion\n", __FILE__, __LINE__);
         return 1;
 
     default:
-        vpi_printf("[%s:%d] Invalid Wait-for-SOF state: 0x%x\n",
-                   __FILE__, __LINE__, *st);
+        ulpi_vpi_printf("[%s:%d] Invalid Wait-for-SOF state: 0x%x\n",
+                        __FILE__, __LINE__, *st);
         vpi_control(vpiFinish, 1);
     }
 
@@ -65,12 +65,10 @@ static int tc_waitsof_step(usb_host_t* host, void* data)
 
 testcase_t* test_waitsof(void)
 {
-    testcase_t* tc = malloc(sizeof(testcase_t));
-    waitsof_state_t* st = malloc(sizeof(waitsof_state_t));
+    testcase_t* tc = tc_create(tc_waitsof_name, sizeof(waitsof_state_t));
+    waitsof_state_t* st = (waitsof_state_t*)tc->data;
     *st = WaitIdle;
 
-    tc->name = tc_waitsof_name;
-    tc->data = (void*)st;
     tc->init = tc_waitsof_init;
     tc->step = tc_waitsof_step;
 
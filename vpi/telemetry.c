@@ -0,0 +1,491 @@
+#include "telemetry.h"
+#include "ulpivpi.h"
+
+#include <vpi_user.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define TELE_TIMELINE_PLUSARG "+telemetry_timeline"
+#define TELE_OUT_PLUSARG      "+telemetry_out="
+
+typedef struct {
+    const char* name;
+    bool required;
+} tele_sig_info_t;
+
+static const tele_sig_info_t tele_sigs[TELE_NUM_SIGS] = {
+    {"clock",    true },
+    {"c_tvalid", true },
+    {"c_tdata",  true },
+    {"reset",    false},
+    {"enable_i", false},
+    {"change_i", false},
+    {"curr_q",   false},
+    {"c_tready", false},
+    {"m_tvalid", false},
+    {"m_tready", false},
+    {"m_tdata",  false},
+};
+
+
+// -- Record Formats -- //
+
+static const char* const tele_logger_states[] = {
+    "ST_IDLE", "ST_RECV", "ST_RESP", "ST_DROP", "ST_SEND", "ST_WAIT",
+};
+
+static const char* const tele_logger_pids[] = {
+    " n/a ", " OUT ", " ACK ", "DATA0", "PING ", " SOF ", "NYET ", "DATA2",
+    "SPLIT", " IN  ", " NAK ", "DATA1", " ERR ", "SETUP", "STALL", "MDATA",
+};
+
+static const char* const tele_states[] = {
+    "ST_IDLE", "ST_CTRL", "ST_BULK", "ST_DUMP",
+};
+
+static const char* const tele_xctrls[] = {
+    "CTL_DONE",      "CTL_SETUP_RX",  "CTL_SETUP_ACK", "CTL_DATA_TOK",
+    "CTL_DATO_RX",   "CTL_DATO_ACK",  "CTL_DATI_TX",   "CTL_DATI_ACK",
+    "CTL_STATUS_TOK", "CTL_STATUS_RX", "CTL_STATUS_TX", "CTL_STATUS_ACK",
+};
+
+static const char* const tele_xbulks[] = {
+    "BLK_IDLE",     "BLK_DATI_TX",  "BLK_DATI_ZDP", "BLK_DATI_ACK",
+    "BLK_DATO_RX",  "BLK_DATO_ACK", "BLK_DATO_ERR", "BLK_DONE",
+};
+
+/**
+ * 'usb_ulpi_core' records are '{crc_error, sof[10:0], ep3, ep2, ep1, pid, rx,
+ * state[2:0]}', and only the protocol FSM state has a residency.
+ */
+static const tele_field_t tele_logger_fields[] = {
+    {"state", 0, 3, false, 6, tele_logger_states, "- XXX -"},
+};
+
+/**
+ * 16-bit records are '{state (one-hot), xctrl, xbulk (one-hot)}'.
+ */
+static const tele_field_t tele_telemetry_fields[] = {
+    {"state", 12, 4, true,  4, tele_states, "- XXX -"},
+    {"xctrl",  8, 4, false, 12, tele_xctrls, "- UNKNOWN -"},
+    {"xbulk",  0, 8, true,  8, tele_xbulks, "- UNKNOWN -"},
+};
+
+
+// -- Helpers -- //
+
+static int tele_error(const char* reason)
+{
+    vpi_printf("ERROR: $telemetry %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+static uint32_t tele_get(tele_state_t* state, tele_sig_t sig)
+{
+    s_vpi_value value;
+    value.format = vpiIntVal;
+    vpi_get_value(state->sigs[sig], &value);
+    return (uint32_t)value.value.integer;
+}
+
+static bool tele_has(const tele_state_t* state, tele_sig_t sig)
+{
+    return state->sigs[sig] != NULL;
+}
+
+/**
+ * Index of the field's state, within its names, or 'num_names' if unknown.
+ */
+static int tele_index(const tele_field_t* field, uint32_t record)
+{
+    const uint32_t value = (record >> field->shift) & ((1u << field->bits) - 1);
+    int index = (int)value;
+
+    if (field->onehot) {
+        index = __builtin_popcount(value) == 1 ? __builtin_ctz(value) : field->num_names;
+    }
+    return index < field->num_names ? index : field->num_names;
+}
+
+static const char* tele_name(const tele_field_t* field, int index)
+{
+    return index < field->num_names ? field->names[index] : field->unknown;
+}
+
+/**
+ * Decode a record, exactly as the driver does, for comparison with an
+ * on-board capture.
+ */
+static void tele_decode(const tele_state_t* state, uint64_t seq, uint32_t record,
+                        uint32_t prev, char* dst, size_t len)
+{
+    if (state->format == TeleLogger) {
+        const tele_field_t* fst = &tele_logger_fields[0];
+        const bool same = (record & 0x07) == (prev & 0x07);
+
+        snprintf(dst, len, "@%5lu  -> 0x%08X { SOF = %4u : %s : %s : %s : %X : %X : %X }",
+                 seq, record, (record >> 20) & 0x07ff,
+                 same ? "       " : tele_name(fst, tele_index(fst, record)),
+                 tele_logger_pids[(record >> 4) & 0x0f], (record >> 3) & 1 ? "RX" : "  ",
+                 (record >> 8) & 0x0f, (record >> 12) & 0x0f, (record >> 16) & 0x0f);
+    } else {
+        const tele_field_t* f = tele_telemetry_fields;
+
+        snprintf(dst, len, "%5lu  ->  { %s : %-14s : %-12s }", seq,
+                 tele_name(&f[0], tele_index(&f[0], record)),
+                 tele_name(&f[1], tele_index(&f[1], record)),
+                 tele_name(&f[2], tele_index(&f[2], record)));
+    }
+}
+
+
+// -- Residency -- //
+
+static void tele_residency_close(tele_residency_t* res, uint64_t ns)
+{
+    if (res->curr >= 0) {
+        const uint64_t dt = ns - res->since_ns;
+        res->ns[res->curr] += dt;
+        res->max_ns[res->curr] = dt > res->max_ns[res->curr] ? dt : res->max_ns[res->curr];
+    }
+    res->since_ns = ns;
+}
+
+static void tele_residency_update(tele_state_t* state, uint32_t record)
+{
+    for (int i=0; i<state->num_fields; i++) {
+        tele_residency_t* res = &state->res[i];
+        const int index = tele_index(&state->fields[i], record);
+
+        if (index != res->curr) {
+            tele_residency_close(res, state->tick_ns);
+            res->curr = index;
+            res->entries[index]++;
+        }
+    }
+}
+
+static void tele_report(tele_state_t* state)
+{
+    const uint64_t total = state->tick_ns - state->first_ns;
+
+    vpi_printf("TELE\t%s: %lu records, %lu missed (FIFO full), %lu read back, "
+               "%lu mismatches\n", state->name, state->records, state->missed,
+               state->read, state->mismatches);
+    if (state->records == 0 || total == 0) {
+        return;
+    }
+
+    for (int i=0; i<state->num_fields; i++) {
+        const tele_field_t* field = &state->fields[i];
+        tele_residency_t* res = &state->res[i];
+
+        tele_residency_close(res, state->tick_ns);
+        vpi_printf("TELE\t%-16s %12s %7s %8s %11s %11s\n", field->name, "time (ns)", "%",
+                   "entries", "mean (ns)", "max (ns)");
+        for (int j=0; j<=field->num_names; j++) {
+            if (res->entries[j] == 0) {
+                continue;
+            }
+            vpi_printf("TELE\t  %-14s %12lu %6.2f%% %8lu %11.1f %11lu\n",
+                       tele_name(field, j), res->ns[j],
+                       res->ns[j] * 100.0 / total, res->entries[j],
+                       (double)res->ns[j] / res->entries[j], res->max_ns[j]);
+        }
+    }
+}
+
+
+// -- Records -- //
+
+static void tele_capture(tele_state_t* state, uint32_t record)
+{
+    if (state->records == 0) {
+        state->first_ns = state->tick_ns;
+    }
+    tele_residency_update(state, record);
+
+    if (state->timeline || state->out != NULL) {
+        char line[128];
+        tele_decode(state, state->records, record, state->prev, line, sizeof(line));
+        if (state->timeline) {
+            vpi_printf("TELE\t@%10lu ns  %s\n", state->tick_ns, line);
+        }
+        if (state->out != NULL) {
+            fprintf(state->out, "%s\n", line);
+        }
+    }
+    state->prev = record;
+    state->records++;
+
+    if (state->count < TELE_QUEUE) {
+        state->queue[(state->head + state->count++) % TELE_QUEUE] = record;
+    } else {
+        state->overflows++;     // so the read-back can no longer be checked
+    }
+}
+
+/**
+ * Reassemble the records from the (little-endian) bytes read from the logger,
+ * and check them against those captured.
+ */
+static void tele_read_byte(tele_state_t* state, uint8_t byte)
+{
+    const uint8_t nbytes = (uint8_t)(state->width >> 3);
+
+    state->rx_word |= (uint32_t)byte << (state->rx_bytes << 3);
+    if (++state->rx_bytes < nbytes) {
+        return;
+    }
+
+    if (state->count > 0 && state->overflows == 0) {
+        const uint32_t expect = state->queue[state->head];
+        if (state->rx_word != expect && state->mismatches++ < 8) {
+            vpi_printf("TELE\t%s: record %lu read back as 0x%08X (captured 0x%08X)\n",
+                       state->name, state->read, state->rx_word, expect);
+        }
+        state->head = (state->head + 1) % TELE_QUEUE;
+        state->count--;
+    }
+    state->read++;
+    state->rx_word = 0;
+    state->rx_bytes = 0;
+}
+
+
+//
+//  VPI Callbacks
+///
+
+/**
+ * Sample the logger at each rising clock-edge, so the values are those that
+ * the edge registers.
+ */
+static int cb_tele_clock(p_cb_data cb_data)
+{
+    tele_state_t* state = (tele_state_t*)cb_data->user_data;
+    s_vpi_time t;
+
+    if (tele_get(state, TELE_CLOCK) != 1) {
+        return 0;
+    }
+
+    t.type = vpiSimTime;
+    vpi_get_time(NULL, &t);
+    state->tick_ns = (((uint64_t)t.high << 32) | (uint64_t)t.low) / state->t_recip;
+
+    if (tele_get(state, TELE_C_TVALID) == 1) {
+        tele_capture(state, tele_get(state, TELE_C_TDATA));
+    }
+
+    if (tele_has(state, TELE_C_TREADY) && tele_has(state, TELE_CHANGE) &&
+        tele_has(state, TELE_CURR) && tele_get(state, TELE_C_TREADY) == 0 &&
+        tele_get(state, TELE_CHANGE) != tele_get(state, TELE_CURR) &&
+        (!tele_has(state, TELE_RESET) || tele_get(state, TELE_RESET) == 0) &&
+        (!tele_has(state, TELE_ENABLE) || tele_get(state, TELE_ENABLE) == 1)) {
+        state->missed++;
+    }
+
+    if (tele_has(state, TELE_M_TVALID) && tele_has(state, TELE_M_TREADY) &&
+        tele_has(state, TELE_M_TDATA) && tele_get(state, TELE_M_TVALID) == 1 &&
+        tele_get(state, TELE_M_TREADY) == 1) {
+        tele_read_byte(state, (uint8_t)tele_get(state, TELE_M_TDATA));
+    }
+
+    return 0;
+}
+
+static int cb_tele_end(p_cb_data cb_data)
+{
+    tele_state_t* state = (tele_state_t*)cb_data->user_data;
+
+    tele_report(state);
+    if (state->out != NULL) {
+        fclose(state->out);
+    }
+    free(state);
+
+    return 0;
+}
+
+static int tele_set_handles(tele_state_t* state, vpiHandle scope, const char* path)
+{
+    char name[TELE_MAX_NAME + 16];
+
+    for (int i=0; i<TELE_NUM_SIGS; i++) {
+        snprintf(name, sizeof(name), "%s.%s", path, tele_sigs[i].name);
+        state->sigs[i] = vpi_handle_by_name(name, scope);
+
+        if (state->sigs[i] == NULL && tele_sigs[i].required) {
+            vpi_printf("ERROR: $telemetry '%s.%s' not found\n", state->name,
+                       tele_sigs[i].name);
+            return tele_error("missing 'axis_logger' signal");
+        }
+    }
+
+    state->width = (uint32_t)vpi_get(vpiSize, state->sigs[TELE_C_TDATA]);
+    if (state->width != 16 && state->width != 32) {
+        return tele_error("records must be 16, or 32, bits");
+    } else if (tele_has(state, TELE_CHANGE) && vpi_get(vpiSize, state->sigs[TELE_CHANGE]) > 32) {
+        return tele_error("'change_i' is too wide");
+    }
+
+    return 1;
+}
+
+static int tele_get_string(char* dst, vpiHandle* iter, bool required)
+{
+    vpiHandle arg_handle = *iter != NULL ? vpi_scan(*iter) : NULL;
+    s_vpi_value value;
+
+    dst[0] = '\0';
+    if (arg_handle == NULL) {
+        *iter = NULL;
+        return required ? tele_error("requires an 'axis_logger' instance-path") : 1;
+    }
+    value.format = vpiStringVal;
+    vpi_get_value(arg_handle, &value);
+    snprintf(dst, TELE_MAX_NAME, "%s", value.value.str);
+    return 1;
+}
+
+/**
+ * Populates the decoder data-structure before the Verilog simulation starts.
+ */
+static int tele_compiletf(char* user_data)
+{
+    vpiHandle systf_handle, arg_iterator, scope;
+    char path[TELE_MAX_NAME], format[TELE_MAX_NAME];
+    tele_state_t* state;
+
+    systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    if (systf_handle == NULL) {
+        return tele_error("failed to obtain systf handle");
+    }
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    if (arg_iterator == NULL) {
+        return tele_error("requires an 'axis_logger' instance-path");
+    } else if (!tele_get_string(path, &arg_iterator, true) ||
+               !tele_get_string(format, &arg_iterator, false)) {
+        return 0;
+    } else if (arg_iterator != NULL && vpi_scan(arg_iterator) != NULL) {
+        vpi_free_object(arg_iterator);
+        return tele_error("too many arguments");
+    }
+
+    state = (tele_state_t*)malloc(sizeof(tele_state_t));
+    memset(state, 0, sizeof(tele_state_t));
+
+    scope = vpi_handle(vpiScope, systf_handle);
+    const int len = snprintf(state->name, TELE_MAX_NAME, "%s.%s",
+                             vpi_get_str(vpiFullName, scope), path);
+    if (len < 0 || len >= TELE_MAX_NAME) {
+        vpi_printf("ERROR: $telemetry '%s' is longer than %d characters\n", state->name,
+                   TELE_MAX_NAME - 1);
+        free(state);
+        return tele_error("instance-path is too long");
+    } else if (!tele_set_handles(state, scope, path)) {
+        free(state);
+        return 0;
+    }
+
+    if (format[0] == '\0') {
+        state->format = state->width == 32 ? TeleLogger : TeleTelemetry;
+    } else if (strcmp(format, "logger") == 0) {
+        state->format = TeleLogger;
+    } else if (strcmp(format, "telemetry") == 0) {
+        state->format = TeleTelemetry;
+    } else {
+        free(state);
+        return tele_error("'format' must be \"logger\", or \"telemetry\"");
+    }
+
+    if (state->format == TeleLogger) {
+        state->fields = tele_logger_fields;
+        state->num_fields = sizeof(tele_logger_fields) / sizeof(tele_field_t);
+    } else {
+        state->fields = tele_telemetry_fields;
+        state->num_fields = sizeof(tele_telemetry_fields) / sizeof(tele_field_t);
+    }
+    for (int i=0; i<TELE_MAX_FIELDS; i++) {
+        state->res[i].curr = -1;
+    }
+    state->prev = 0xFFFFFFFF;
+
+    state->timeline = ulpi_plusarg(TELE_TIMELINE_PLUSARG, NULL) != NULL;
+    const char* out = ulpi_plusarg(TELE_OUT_PLUSARG, NULL);
+    if (out != NULL && (state->out = fopen(out, "w")) == NULL) {
+        vpi_printf("ERROR: $telemetry cannot open '%s'\n", out);
+        free(state);
+        return tele_error("failed to open the output file");
+    }
+
+    state->t_recip = 1;
+    for (int scale = -9 - vpi_get(vpiTimePrecision, NULL); scale > 0; scale--) {
+        state->t_recip *= 10;
+    }
+
+    s_cb_data cb;
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = cb_tele_end;
+    cb.user_data = (PLI_BYTE8*)state;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    vpi_put_userdata(systf_handle, (void*)state);
+
+    return 0;
+}
+
+/**
+ * Start sampling the logger at each clock-edge.
+ */
+static int tele_calltf(char* user_data)
+{
+    vpiHandle systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    tele_state_t* state = (tele_state_t*)vpi_get_userdata(systf_handle);
+    s_vpi_value x;
+    s_vpi_time t;
+    s_cb_data cb;
+
+    if (state == NULL) {
+        return tele_error("'*state' problem");
+    }
+
+    vpi_printf("TELE\t%s: %u-bit \"%s\" records\n", state->name, state->width,
+               state->format == TeleLogger ? "logger" : "telemetry");
+
+    t.type       = vpiSuppressTime;
+    x.format     = vpiSuppressVal;
+    cb.reason    = cbValueChange;
+    cb.cb_rtn    = cb_tele_clock;
+    cb.time      = &t;
+    cb.value     = &x;
+    cb.user_data = (PLI_BYTE8*)state;
+    cb.obj       = state->sigs[TELE_CLOCK];
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    return 0;
+}
+
+void tele_register(void)
+{
+    s_vpi_systf_data tf_data;
+    tf_data.type      = vpiSysTask;
+    tf_data.tfname    = "$telemetry";
+    tf_data.calltf    = tele_calltf;
+    tf_data.compiletf = tele_compiletf;
+    tf_data.sizetf    = NULL;
+    tf_data.user_data = NULL;
+    vpi_register_systf(&tf_data);
+}
@@ -0,0 +1,121 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Decoder for the telemetry records of an 'axis_logger' instance, using the
+ * same decoding as the driver ('driver/src/read_logger.rs' for 32-bit records,
+ * and 'driver/src/telemetry.rs' for 16-bit records), so that the FSM timeline
+ * of a simulation can be compared with one read back from the hardware. Each
+ * record is timestamped when the logger captures it, and the time spent in
+ * each FSM state is accumulated. The signals are found (by name) in the given
+ * 'axis_logger' instance:
+ *  - 'clock', 'c_tvalid', 'c_tdata'  --  captured records;
+ *  - 'reset', 'enable_i', 'change_i', 'curr_q', 'c_tready'  --  (optional)
+ *    count the changes that were lost, as the FIFO was full;
+ *  - 'm_tvalid', 'm_tready', 'm_tdata'  --  (optional) the bytes read back
+ *    from the logger are checked against the captured records;
+ *
+ * Usage:
+ *   $telemetry("U_USB1.g_debug.U_LOG1", format);
+ *
+ * where the instance-path is relative to the calling module, and the optional
+ * 'format' is "logger" (32-bit records of the USB protocol FSM), or
+ * "telemetry" (16-bit records of the control- and bulk-transfer FSMs), which
+ * defaults to that of the record width.
+ *
+ * Plusargs:
+ *   +telemetry_timeline   --  print the (timestamped) decoded records;
+ *   +telemetry_out=<file> --  write the decoded records, in the format of the
+ *                             driver, for comparison with an on-board capture;
+ *
+ * NOTE:
+ *  - times are from the clock-edge that each record is written to the FIFO,
+ *    and the residency of the final states is up to the end of simulation;
+ */
+#define TELE_MAX_NAME   128
+#define TELE_MAX_VALUES 17          // named values, plus "unknown"
+#define TELE_MAX_FIELDS 3
+#define TELE_QUEUE      4096        // records, captured but not yet read back
+
+typedef enum {
+    TeleLogger,                 // 32-bit, from 'usb_ulpi_core'
+    TeleTelemetry,              // 16-bit, control & bulk FSMs
+} tele_format_t;
+
+typedef enum {
+    TELE_CLOCK,
+    TELE_C_TVALID,
+    TELE_C_TDATA,
+    TELE_RESET,
+    TELE_ENABLE,
+    TELE_CHANGE,
+    TELE_CURR,
+    TELE_C_TREADY,
+    TELE_M_TVALID,
+    TELE_M_TREADY,
+    TELE_M_TDATA,
+    TELE_NUM_SIGS
+} tele_sig_t;
+
+/**
+ * FSM-state field of a record, with the names of its states, indexed by value
+ * (or by bit-position, for one-hot fields).
+ */
+typedef struct {
+    const char* name;
+    uint8_t shift;
+    uint8_t bits;
+    bool onehot;
+    uint8_t num_names;
+    const char* const* names;
+    const char* unknown;
+} tele_field_t;
+
+typedef struct {
+    uint64_t ns[TELE_MAX_VALUES];       // time-in-state
+    uint64_t max_ns[TELE_MAX_VALUES];   // longest stay
+    uint64_t entries[TELE_MAX_VALUES];
+    int curr;                           // current state, or -1
+    uint64_t since_ns;
+} tele_residency_t;
+
+typedef struct {
+    char name[TELE_MAX_NAME];
+    vpiHandle sigs[TELE_NUM_SIGS];
+    uint64_t t_recip;
+    uint64_t tick_ns;
+    // Configuration
+    tele_format_t format;
+    uint32_t width;                     // record bits
+    const tele_field_t* fields;
+    int num_fields;
+    bool timeline;
+    FILE* out;
+    // Captured records
+    uint64_t records;
+    uint64_t missed;                    // changes lost, as the FIFO was full
+    uint32_t prev;
+    uint64_t first_ns;
+    tele_residency_t res[TELE_MAX_FIELDS];
+    // Read-back check
+    uint32_t queue[TELE_QUEUE];
+    uint32_t head;
+    uint32_t count;
+    uint64_t overflows;                 // records not checked, as the queue was full
+    uint32_t rx_word;
+    uint8_t rx_bytes;
+    uint64_t read;                      // records read back
+    uint64_t mismatches;
+} tele_state_t;
+
+
+void tele_register(void);
+
+
+#endif  /* __TELEMETRY_H__ */
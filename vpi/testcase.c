@@ -1,26 +1,102 @@
 #include "testcase.h"
 #include <vpi_user.h>
 #include <stdlib.h>
+#include <string.h>
 
 
-testcase_t* tc_create(const char* name, void* data)
+static const uint8_t tc_default_eps[4] = {
+    BULK_IN_EP, BULK_OUT_EP, DDR3_IN_EP, DDR3_OUT_EP
+};
+
+
+/**
+ * Arena that test-cases, and their transactions, are allocated from; i.e., the
+ * harness sets this to its per-test arena, which is reset by 'tc_finish()', so
+ * that long runs of generated test-cases don't accumulate memory.
+ */
+static ulpi_arena_t* tc_curr_arena = NULL;
+
+
+void tc_arena_set(ulpi_arena_t* arena)
+{
+    tc_curr_arena = arena;
+}
+
+ulpi_arena_t* tc_arena(void)
+{
+    return tc_curr_arena;
+}
+
+/**
+ * Allocate (zeroed) memory that is released when the current test completes,
+ * or from the heap if no arena has been set.
+ */
+void* tc_alloc(size_t size)
+{
+    if (tc_curr_arena == NULL) {
+        void* ptr = malloc(size);
+        memset(ptr, 0, size);
+        return ptr;
+    }
+    return ulpi_arena_alloc(tc_curr_arena, size);
+}
+
+/**
+ * Allocate a test-case, along with 'size' bytes of (zeroed) test-state.
+ */
+testcase_t* tc_create(const char* name, size_t size)
 {
-    testcase_t* test = malloc(sizeof(testcase_t));
+    testcase_t* test = (testcase_t*)tc_alloc(sizeof(testcase_t));
 
     test->name = name;
-    test->data = data;
+    test->data = size > 0 ? tc_alloc(size) : NULL;
     test->init = NULL;
     test->step = NULL;
 
     return test;
 }
 
+/**
+ * The test has completed, so release everything allocated since it started
+ * (including the test itself, if it was generated after the harness set the
+ * arena).
+ */
 void tc_finish(testcase_t* test)
 {
-    if (test != NULL) {
-        if (test->data != NULL) {
-            free(test->data);
-        }
-        free(test);
+    if (test != NULL && tc_curr_arena != NULL) {
+        ulpi_arena_reset(tc_curr_arena);
+    }
+}
+
+
+// -- Endpoint Look-ups -- //
+
+static const usb_endpoint_t* tc_find_endpoint(const usb_host_t* host, ep_role_t role)
+{
+    const uint8_t dir = role == EpBulkIn || role == EpDDR3In ? EP_DIR_IN : 0x00;
+    const int nth = role == EpDDR3In || role == EpDDR3Out ? 1 : 0;
+    return desc_endpoint(&host->eptab, dir, EP_TYPE_BULK, nth);
+}
+
+/**
+ * Endpoint number for the role, as discovered by 'GET CONFIG DESCRIPTOR', or
+ * the default, if not (yet) discovered.
+ */
+uint8_t tc_endpoint(const usb_host_t* host, ep_role_t role)
+{
+    const usb_endpoint_t* ep = tc_find_endpoint(host, role);
+    return ep != NULL ? ep->address & 0x0F : tc_default_eps[role];
+}
+
+/**
+ * Maximum packet-size for the role's endpoint, from its 'wMaxPacketSize' (and
+ * limited by the size of the host's transfer buffers).
+ */
+uint16_t tc_max_packet(const usb_host_t* host, ep_role_t role)
+{
+    const usb_endpoint_t* ep = tc_find_endpoint(host, role);
+    if (ep == NULL || ep->max_packet == 0 || ep->max_packet > MAX_PACKET_SIZE) {
+        return MAX_PACKET_SIZE;
     }
+    return ep->max_packet;
 }
@@ -4,9 +4,11 @@
 
 #include "ulpivpi.h"
 #include "usb/usbhost.h"
+#include "usb/ulpiarena.h"
 #include <stdint.h>
 
 
+// Default endpoints, until discovered from the configuration descriptor
 #define BULK_IN_EP 1
 #define DDR3_IN_EP 3
 
@@ -14,6 +16,18 @@
 #define DDR3_OUT_EP 5
 
 
+/**
+ * Endpoint roles, that are assigned (in descriptor order) to the Bulk IN, and
+ * Bulk OUT, endpoints; i.e., the second Bulk IN endpoint is for DDR3 reads.
+ */
+typedef enum {
+    EpBulkIn,
+    EpBulkOut,
+    EpDDR3In,
+    EpDDR3Out,
+} ep_role_t;
+
+
 /**
  * Represents a single test-case, where a sequence of packets is sent to the
  * USB (ULPI, peripheral) device.
@@ -34,7 +48,11 @@ typedef struct {
 //  Test Setup-/Stop- Phase Routines
 ///
 
-testcase_t* tc_create(const char* name, void* data);
+void tc_arena_set(ulpi_arena_t* arena);
+ulpi_arena_t* tc_arena(void);
+void* tc_alloc(size_t size);
+
+testcase_t* tc_create(const char* name, size_t size);
 void tc_finish(testcase_t* test);
 
 
@@ -49,4 +67,12 @@ int tc_step(testcase_t* test);
 void tc_run(testcase_t* tests[], int num);
 
 
+//
+//  Endpoint Look-ups
+///
+
+uint8_t tc_endpoint(const usb_host_t* host, ep_role_t role);
+uint16_t tc_max_packet(const usb_host_t* host, ep_role_t role);
+
+
 #endif  /* __TESTCASE_H__ */
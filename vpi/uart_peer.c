@@ -0,0 +1,610 @@
+#include "uart_peer.h"
+#include "ulpivpi.h"
+
+#include <vpi_user.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define UART_SEED_PLUSARG "+uart_seed="
+#define UART_BAUD_PLUSARG "+uart_baud="
+
+typedef struct {
+    const char* name;
+    bool required;
+} uart_sig_info_t;
+
+static const uart_sig_info_t uart_sigs[UART_NUM_SIGS] = {
+    {"rxd",              true },
+    {"txd",              true },
+    {"prescale",         false},
+    {"rx_frame_error",   false},
+    {"rx_overrun_error", false},
+};
+
+static const char uart_parity_strings[3][8] = {
+    {"8N1"}, {"8E1"}, {"8O1"},
+};
+
+/**
+ * From console rates to the fastest that 'rtl/uart' supports at 100 MHz, then
+ * back-to-back frames, and error-injection and -recovery.
+ */
+static const uart_test_t uart_tests[] = {
+    {"console",   115200,  32, 1, UartClean,   0},
+    {"1M",       1000000, 128, 1, UartClean,   0},
+    {"3.125M",   3125000, 256, 1, UartClean,   0},
+    {"12.5M",   12500000, 256, 1, UartClean,   0},
+    {"b2b",      3125000,  64, 0, UartClean,   0},
+    {"framing",  3125000, 128, 1, UartFraming, 8},
+    {"parity",   3125000, 128, 1, UartParity,  8},
+};
+
+
+// -- Helpers -- //
+
+static int uart_peer_error(const char* reason)
+{
+    vpi_printf("ERROR: $uart_peer %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+static uint32_t uart_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t uart_plusarg(const char* name, uint32_t def)
+{
+    const char* arg = ulpi_plusarg(name, NULL);
+    return arg != NULL ? (uint32_t)strtoul(arg, NULL, 0) : def;
+}
+
+static const uart_test_t* uart_test(const uart_peer_t* peer)
+{
+    return &peer->tests[peer->test_curr];
+}
+
+static uint16_t uart_frame_bits(const uart_peer_t* peer)
+{
+    return peer->parity != UartNone ? 11 : 10;
+}
+
+static uint16_t uart_parity_bit(const uart_peer_t* peer, uint8_t data)
+{
+    const uint16_t odd = (uint16_t)__builtin_parity(data);
+    return peer->parity == UartOdd ? !odd : odd;
+}
+
+static uint64_t uart_now(void)
+{
+    s_vpi_time t;
+    t.type = vpiSimTime;
+    vpi_get_time(NULL, &t);
+    return ((uint64_t)t.high << 32) | (uint64_t)t.low;
+}
+
+/**
+ * Simulation tick of the given (fractional) bit-time, since 'base'.
+ */
+static uint64_t uart_tick(const uart_peer_t* peer, uint64_t base, double bits)
+{
+    return base + (uint64_t)(bits * peer->bit_ticks + 0.5);
+}
+
+static void uart_schedule(uint64_t tick, int (*cb_rtn)(p_cb_data), uart_peer_t* peer)
+{
+    const uint64_t now = uart_now();
+    const uint64_t delay = tick > now ? tick - now : 0;
+    s_vpi_time t;
+    s_cb_data cb;
+
+    t.type       = vpiSimTime;
+    t.high       = (PLI_UINT32)(delay >> 32);
+    t.low        = (PLI_UINT32)delay;
+    cb.reason    = cbAfterDelay;
+    cb.cb_rtn    = cb_rtn;
+    cb.user_data = (PLI_BYTE8*)peer;
+    cb.time      = &t;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+}
+
+static void uart_put_scalar(uart_peer_t* peer, uart_sig_t sig, uint8_t level)
+{
+    s_vpi_value value;
+    value.format = vpiScalarVal;
+    value.value.scalar = level;
+    vpi_put_value(peer->sigs[sig], &value, NULL, vpiNoDelay);
+}
+
+
+// -- Reporting -- //
+
+static void uart_test_report(const uart_peer_t* peer)
+{
+    const uart_test_t* test = uart_test(peer);
+    const uart_peer_stats_t* st = &peer->stats;
+    const uint32_t baud = peer->baud > 0 ? peer->baud : test->baud;
+    const double secs = st->end > st->start ? (st->end - st->start) / peer->tick_hz : 1.0;
+    const double rate = st->echoed / secs;
+    const double bytes = st->echoed > 0 ? (double)st->echoed : 1.0;
+
+    vpi_printf("UART\t%-8s %8u baud %s  %4lu/%-4lu bytes %11.1f B/s (%5.1f%% of line)"
+               "  %4.1f events/byte%s\n",
+               test->name, baud, uart_parity_strings[peer->parity], st->echoed, st->sent,
+               rate, rate * uart_frame_bits(peer) * 100.0 / baud,
+               (st->tx_events + st->rx_events) / bytes, st->errors > 0 ? "  FAILED" : "");
+    if (st->injected > 0 || st->frame_errors > 0 || st->overruns > 0 || st->spurious > 0) {
+        vpi_printf("UART\t%-8s injected: %lu, frame-errors: %lu, parity-errors: %lu, "
+                   "spurious: %lu, recovered: %lu, overruns: %lu\n",
+                   test->name, st->injected, st->frame_errors, st->parity_errors,
+                   st->spurious, st->recovered, st->overruns);
+    }
+}
+
+static void uart_peer_report(const uart_peer_t* peer)
+{
+    vpi_printf("UART\t%s: %d of %d test-cases completed, %lu errors: %s\n", peer->name,
+               peer->test_curr, peer->test_num, peer->errors,
+               peer->errors > 0 || peer->test_curr < peer->test_num ? "FAILED" : "PASSED");
+}
+
+
+// -- Test-Cases -- //
+
+static int cb_uart_tx(p_cb_data cb_data);
+static int cb_uart_timeout(p_cb_data cb_data);
+
+/**
+ * Queue the bits of the next frame, and the expected echo (unless the frame
+ * has a framing error).
+ */
+static void uart_tx_build(uart_peer_t* peer)
+{
+    const uart_test_t* test = uart_test(peer);
+    const uint8_t data = (uint8_t)uart_rand(&peer->rng);
+    const uint16_t bits = uart_frame_bits(peer);
+    const bool inject = test->inject != UartClean && test->every > 0 &&
+        peer->tx_frame % test->every == test->every / 2u;
+    const bool framing = inject && test->inject == UartFraming;
+    const bool parity = inject && test->inject == UartParity;
+    uint16_t par = 0;
+
+    if (peer->parity != UartNone) {
+        par = uart_parity_bit(peer, data) ^ (uint16_t)parity;
+    }
+
+    peer->tx_bits = (uint32_t)data << 1 | (uint32_t)par << 9;
+    peer->tx_bits |= (uint32_t)!framing << (bits - 1);
+    peer->tx_len = bits + test->gap + (framing ? UART_PEER_RECOVERY : 0);
+    peer->tx_pos = 0;
+    peer->stats.sent++;
+    peer->stats.injected += inject;
+
+    if (framing) {
+        peer->error_pending = true;
+    } else if (peer->count < UART_PEER_QUEUE) {
+        uart_expect_t* x = &peer->queue[(peer->head + peer->count++) % UART_PEER_QUEUE];
+        x->data = data | par << 8;
+        x->parity_bad = parity;
+        x->after_error = peer->error_pending;
+        peer->error_pending = false;
+    } else {
+        vpi_printf("UART\t%s: scoreboard overflow\n", peer->name);
+        peer->stats.errors++;
+    }
+}
+
+static uint8_t uart_tx_level(const uart_peer_t* peer)
+{
+    return peer->tx_pos < uart_frame_bits(peer) ? (peer->tx_bits >> peer->tx_pos) & 1 : 1;
+}
+
+/**
+ * Skip to the next bit that changes the line-level, and schedule its edge.
+ */
+static void uart_tx_advance(uart_peer_t* peer)
+{
+    const uint8_t level = uart_tx_level(peer);
+
+    do {
+        peer->tx_bit++;
+        if (++peer->tx_pos < peer->tx_len) {
+            continue;
+        } else if (++peer->tx_frame >= uart_test(peer)->count) {
+            peer->tx_done = true;
+            break;
+        }
+        uart_tx_build(peer);
+    } while (uart_tx_level(peer) == level);
+
+    if (!peer->tx_done) {
+        uart_schedule(uart_tick(peer, peer->tx_t0, peer->tx_bit), cb_uart_tx, peer);
+    } else {
+        const double bits = peer->tx_bit + UART_PEER_TIMEOUT * uart_frame_bits(peer);
+        peer->waiting = true;
+        peer->timeout = uart_tick(peer, peer->tx_t0, bits);
+        uart_schedule(peer->timeout, cb_uart_timeout, peer);
+    }
+}
+
+/**
+ * Start the next test-case, after a few bit-times of idle, else finish.
+ */
+static void uart_test_begin(uart_peer_t* peer)
+{
+    const uart_test_t* test;
+    uint32_t baud;
+
+    while (peer->test_curr < peer->test_num &&
+           uart_test(peer)->inject == UartParity && peer->parity == UartNone) {
+        vpi_printf("UART\t%-8s skipped (no parity)\n", uart_test(peer)->name);
+        peer->test_curr++;
+    }
+    if (peer->test_curr >= peer->test_num) {
+        uart_peer_report(peer);
+        vpi_control(vpiFinish, 0);
+        return;
+    }
+
+    test = uart_test(peer);
+    baud = peer->baud > 0 ? peer->baud : test->baud;
+    peer->bit_ticks = peer->tick_hz / baud;
+
+    if (peer->sigs[UART_PRESCALE] != NULL && peer->clock_hz > 0) {
+        s_vpi_value value;
+        value.format = vpiIntVal;
+        value.value.integer = (PLI_INT32)((peer->clock_hz + 4 * baud) / (8 * baud));
+        vpi_put_value(peer->sigs[UART_PRESCALE], &value, NULL, vpiNoDelay);
+    }
+
+    memset(&peer->stats, 0, sizeof(uart_peer_stats_t));
+    peer->head = 0;
+    peer->count = 0;
+    peer->rx_busy = false;
+    peer->error_pending = false;
+    peer->waiting = false;
+    peer->tx_done = false;
+    peer->tx_frame = 0;
+    peer->tx_bit = 0;
+    peer->tx_t0 = uart_tick(peer, uart_now(), UART_PEER_LEAD);
+    peer->stats.start = peer->tx_t0;
+
+    uart_tx_build(peer);
+    uart_schedule(peer->tx_t0, cb_uart_tx, peer);
+}
+
+static void uart_test_end(uart_peer_t* peer)
+{
+    uart_test_report(peer);
+    peer->errors += peer->stats.errors;
+    peer->waiting = false;
+    peer->test_curr++;
+    uart_test_begin(peer);
+}
+
+
+// -- Receiver -- //
+
+/**
+ * Check a received frame against the scoreboard, where bytes that were not
+ * sent are allowed (as spurious) after an injected framing error.
+ */
+static void uart_rx_frame(uart_peer_t* peer, uint16_t data, bool stop)
+{
+    uart_peer_stats_t* st = &peer->stats;
+    uart_expect_t* x = peer->count > 0 ? &peer->queue[peer->head] : NULL;
+    const uint16_t mask = peer->parity != UartNone ? 0x1FF : 0xFF;
+
+    if (!stop) {
+        vpi_printf("UART\t%s: echoed frame (0x%03x) has a framing error\n", peer->name, data);
+        st->errors++;
+    }
+
+    if (x != NULL && (data & mask) == (x->data & mask)) {
+        if (x->parity_bad) {
+            st->parity_errors++;
+        }
+        st->recovered += x->after_error;
+        st->echoed++;
+        st->end = uart_now();
+        peer->head = (peer->head + 1) % UART_PEER_QUEUE;
+        peer->count--;
+    } else if (x != NULL ? x->after_error : peer->error_pending) {
+        st->spurious++;
+    } else {
+        vpi_printf("UART\t%s: received 0x%03x (expected 0x%03x)\n", peer->name, data & mask,
+                   x != NULL ? x->data & mask : 0);
+        st->errors++;
+        if (x != NULL) {
+            peer->head = (peer->head + 1) % UART_PEER_QUEUE;
+            peer->count--;
+        }
+    }
+
+    if (peer->waiting && peer->count == 0) {
+        uart_test_end(peer);
+    }
+}
+
+/**
+ * Sample the (constant) line-level at each bit-centre before 'tick'.
+ */
+static void uart_rx_until(uart_peer_t* peer, uint64_t tick)
+{
+    const uint16_t bits = uart_frame_bits(peer);
+
+    while (peer->rx_busy) {
+        if (uart_tick(peer, peer->rx_start, peer->rx_pos + 0.5) >= tick) {
+            break;
+        }
+
+        if (peer->rx_pos == 0 && peer->rx_level != 0) {
+            peer->rx_busy = false;      // glitch, so not a start bit
+        } else if (peer->rx_pos == bits - 1) {
+            peer->rx_busy = false;
+            uart_rx_frame(peer, peer->rx_data, peer->rx_level != 0);
+        } else if (peer->rx_pos > 0) {
+            peer->rx_data |= (uint16_t)peer->rx_level << (peer->rx_pos - 1);
+        }
+        peer->rx_pos++;
+    }
+}
+
+
+//
+//  VPI Callbacks
+///
+
+static int cb_uart_tx(p_cb_data cb_data)
+{
+    uart_peer_t* peer = (uart_peer_t*)cb_data->user_data;
+
+    peer->stats.tx_events++;
+    uart_put_scalar(peer, UART_RXD, uart_tx_level(peer));
+    uart_tx_advance(peer);
+
+    return 0;
+}
+
+static int cb_uart_timeout(p_cb_data cb_data)
+{
+    uart_peer_t* peer = (uart_peer_t*)cb_data->user_data;
+
+    if (!peer->waiting || uart_now() < peer->timeout) {
+        return 0;
+    } else if (peer->count > 0) {
+        vpi_printf("UART\t%s: %u bytes were not echoed\n", peer->name, peer->count);
+        peer->stats.errors += peer->count;
+    }
+    uart_test_end(peer);
+
+    return 0;
+}
+
+/**
+ * Finish decoding the frame, at the centre of its stop bit, if the line has
+ * not changed since.
+ */
+static int cb_uart_rx_stop(p_cb_data cb_data)
+{
+    uart_peer_t* peer = (uart_peer_t*)cb_data->user_data;
+
+    peer->stats.rx_events++;
+    uart_rx_until(peer, uart_now() + 1);
+
+    return 0;
+}
+
+static int cb_uart_txd(p_cb_data cb_data)
+{
+    uart_peer_t* peer = (uart_peer_t*)cb_data->user_data;
+    const uint64_t tick = ((uint64_t)cb_data->time->high << 32) | cb_data->time->low;
+    const uint8_t level = cb_data->value->value.scalar != vpi0;
+
+    peer->stats.rx_events++;
+    uart_rx_until(peer, tick);
+
+    if (!peer->rx_busy && peer->rx_level != 0 && level == 0) {
+        peer->rx_busy = true;
+        peer->rx_start = tick;
+        peer->rx_pos = 0;
+        peer->rx_data = 0;
+        uart_schedule(uart_tick(peer, tick, uart_frame_bits(peer) - 0.5) + 1,
+                      cb_uart_rx_stop, peer);
+    }
+    peer->rx_level = level;
+
+    return 0;
+}
+
+static int cb_uart_flag(p_cb_data cb_data)
+{
+    uart_peer_t* peer = (uart_peer_t*)cb_data->user_data;
+
+    if (cb_data->value->value.scalar != vpi1) {
+        return 0;
+    } else if (cb_data->obj == peer->sigs[UART_FRAME_ERROR]) {
+        peer->stats.frame_errors++;
+    } else {
+        peer->stats.overruns++;
+    }
+
+    return 0;
+}
+
+static void uart_watch(uart_peer_t* peer, uart_sig_t sig, int (*cb_rtn)(p_cb_data))
+{
+    s_vpi_time t;
+    s_vpi_value x;
+    s_cb_data cb;
+
+    if (peer->sigs[sig] == NULL) {
+        return;
+    }
+
+    t.type       = vpiSimTime;
+    x.format     = vpiScalarVal;
+    cb.reason    = cbValueChange;
+    cb.cb_rtn    = cb_rtn;
+    cb.time      = &t;
+    cb.value     = &x;
+    cb.user_data = (PLI_BYTE8*)peer;
+    cb.obj       = peer->sigs[sig];
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+}
+
+static int cb_uart_peer_end(p_cb_data cb_data)
+{
+    uart_peer_t* peer = (uart_peer_t*)cb_data->user_data;
+
+    if (peer->test_curr < peer->test_num) {
+        vpi_printf("UART\t%s: simulation ended during test-case %d\n", peer->name,
+                   peer->test_curr);
+        uart_peer_report(peer);
+    }
+    free(peer);
+
+    return 0;
+}
+
+static uint32_t uart_get_int(vpiHandle* iter, uint32_t def)
+{
+    vpiHandle arg;
+    s_vpi_value value;
+
+    if (*iter == NULL || (arg = vpi_scan(*iter)) == NULL) {
+        *iter = NULL;
+        return def;
+    }
+    value.format = vpiIntVal;
+    vpi_get_value(arg, &value);
+
+    return (uint32_t)value.value.integer;
+}
+
+static int uart_set_handles(uart_peer_t* peer, vpiHandle scope)
+{
+    for (int i=0; i<UART_NUM_SIGS; i++) {
+        peer->sigs[i] = vpi_handle_by_name((PLI_BYTE8*)uart_sigs[i].name, scope);
+        if (peer->sigs[i] == NULL && uart_sigs[i].required) {
+            vpi_printf("ERROR: $uart_peer signal '%s.%s' not found\n", peer->name,
+                       uart_sigs[i].name);
+            return uart_peer_error("missing signal");
+        }
+    }
+    return 1;
+}
+
+/**
+ * Populates the peer data-structure before the Verilog simulation starts.
+ */
+static int uart_peer_compiletf(char* user_data)
+{
+    vpiHandle systf_handle, arg_iterator, scope;
+    uart_peer_t* peer;
+
+    systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    if (systf_handle == NULL) {
+        return uart_peer_error("failed to obtain systf handle");
+    }
+
+    peer = (uart_peer_t*)malloc(sizeof(uart_peer_t));
+    memset(peer, 0, sizeof(uart_peer_t));
+
+    arg_iterator = vpi_iterate(vpiArgument, systf_handle);
+    peer->clock_hz = uart_get_int(&arg_iterator, 0);
+    peer->parity = (uart_parity_t)uart_get_int(&arg_iterator, UartNone);
+    peer->seed = uart_plusarg(UART_SEED_PLUSARG, uart_get_int(&arg_iterator, 1));
+    peer->baud = uart_plusarg(UART_BAUD_PLUSARG, 0);
+    peer->rng = peer->seed != 0 ? peer->seed : 1;
+
+    if (arg_iterator != NULL && vpi_scan(arg_iterator) != NULL) {
+        vpi_free_object(arg_iterator);
+        free(peer);
+        return uart_peer_error("too many arguments");
+    } else if (peer->parity > UartOdd) {
+        free(peer);
+        return uart_peer_error("'parity' must be 0..2");
+    }
+
+    scope = vpi_handle(vpiScope, systf_handle);
+    snprintf(peer->name, UART_PEER_MAX_NAME, "%s", vpi_get_str(vpiFullName, scope));
+    if (!uart_set_handles(peer, scope)) {
+        free(peer);
+        return 0;
+    }
+
+    peer->tick_hz = 1.0;
+    for (int scale = -vpi_get(vpiTimePrecision, NULL); scale > 0; scale--) {
+        peer->tick_hz *= 10.0;
+    }
+
+    peer->tests = uart_tests;
+    peer->test_num = sizeof(uart_tests) / sizeof(uart_test_t);
+    peer->rx_level = 1;
+
+    s_cb_data cb;
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = cb_uart_peer_end;
+    cb.user_data = (PLI_BYTE8*)peer;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+
+    vpi_put_userdata(systf_handle, (void*)peer);
+
+    return 0;
+}
+
+/**
+ * Idle the line, watch the UART's outputs, and start the first test-case.
+ */
+static int uart_peer_calltf(char* user_data)
+{
+    vpiHandle systf_handle = vpi_handle(vpiSysTfCall, NULL);
+    uart_peer_t* peer = (uart_peer_t*)vpi_get_userdata(systf_handle);
+
+    if (peer == NULL) {
+        return uart_peer_error("'*peer' problem");
+    }
+
+    vpi_printf("UART\t%s: %s, %d test-cases, clock: %u Hz\n", peer->name,
+               uart_parity_strings[peer->parity], peer->test_num, peer->clock_hz);
+
+    uart_put_scalar(peer, UART_RXD, vpi1);
+    uart_watch(peer, UART_TXD, cb_uart_txd);
+    uart_watch(peer, UART_FRAME_ERROR, cb_uart_flag);
+    uart_watch(peer, UART_OVERRUN_ERROR, cb_uart_flag);
+    uart_test_begin(peer);
+
+    return 0;
+}
+
+void uart_peer_register(void)
+{
+    s_vpi_systf_data tf_data;
+    tf_data.type      = vpiSysTask;
+    tf_data.tfname    = "$uart_peer";
+    tf_data.calltf    = uart_peer_calltf;
+    tf_data.compiletf = uart_peer_compiletf;
+    tf_data.sizetf    = NULL;
+    tf_data.user_data = NULL;
+    vpi_register_systf(&tf_data);
+}
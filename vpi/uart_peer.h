@@ -0,0 +1,146 @@
+#ifndef __UART_PEER_H__
+#define __UART_PEER_H__
+
+
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * UART peer model, that transmits framed bytes to a UART, at the baud rate of
+ * each test-case, and checks that they are echoed back. Bit edges are
+ * scheduled using 'cbAfterDelay' callbacks, at just the times that the line
+ * changes, and the echoed frames are decoded from the value-changes of the
+ * line (plus one callback per frame), so the simulation cost is a few VPI
+ * events per byte, independent of the clock-rate. The UART signals are found
+ * (by name) in the scope of the calling module:
+ *  - 'rxd'       --  driven by the peer (so must be a 'reg');
+ *  - 'txd'       --  echoed frames, from the UART;
+ *  - 'prescale'  --  (optional) set by the peer, for each baud rate, to
+ *                    'clock_hz / (8 * baud)' (as for 'rtl/uart');
+ *  - 'rx_frame_error', 'rx_overrun_error'  --  (optional) counted;
+ *
+ * Usage:
+ *   $uart_peer(clock_hz, parity, seed);
+ *
+ * where 'parity' is 0 (none), 1 (even), or 2 (odd), and the parity bit follows
+ * the 8 data bits (so a UART without parity support is configured with 9 data
+ * bits, and echoes the parity bit as data).
+ *
+ * Test-cases can inject framing errors (a LO stop bit, followed by a frame-time
+ * of idle, for the UART to recover), or parity errors, every N frames. A frame
+ * with a framing error should not be echoed, and any bytes that were not sent,
+ * but are received before the next good frame, are counted as spurious.
+ *
+ * Plusargs:
+ *   +uart_seed=<N>  --  override the argument;
+ *   +uart_baud=<N>  --  run every test-case at this baud rate;
+ *
+ * NOTE:
+ *  - the peer starts once '$uart_peer' is called, so call it after reset;
+ *  - frames are 1 start bit, 8 data bits (LSB first), an optional parity bit,
+ *    and 1 stop bit;
+ */
+#define UART_PEER_MAX_NAME  128
+#define UART_PEER_QUEUE     64
+#define UART_PEER_RECOVERY  10      // idle bits, after an injected framing error
+#define UART_PEER_LEAD      4       // idle bits, before each test-case
+#define UART_PEER_TIMEOUT   4       // frame-times to wait, for the last echo
+
+typedef enum {
+    UartNone = 0,
+    UartEven = 1,
+    UartOdd  = 2,
+} uart_parity_t;
+
+typedef enum {
+    UartClean,
+    UartFraming,
+    UartParity,
+} uart_inject_t;
+
+typedef enum {
+    UART_RXD,
+    UART_TXD,
+    UART_PRESCALE,
+    UART_FRAME_ERROR,
+    UART_OVERRUN_ERROR,
+    UART_NUM_SIGS
+} uart_sig_t;
+
+typedef struct {
+    const char* name;
+    uint32_t baud;
+    uint16_t count;             // frames to send
+    uint16_t gap;               // idle bits between frames
+    uart_inject_t inject;
+    uint16_t every;             // inject an error every N frames
+} uart_test_t;
+
+typedef struct {
+    uint16_t data;              // data bits, and then the parity bit
+    bool parity_bad;            // injected parity error
+    bool after_error;           // first good frame after an injected error
+} uart_expect_t;
+
+typedef struct {
+    uint64_t sent;
+    uint64_t echoed;
+    uint64_t injected;
+    uint64_t frame_errors;      // 'rx_frame_error' pulses, of the UART
+    uint64_t overruns;          // 'rx_overrun_error' pulses, of the UART
+    uint64_t parity_errors;     // echoed with the injected parity error
+    uint64_t spurious;          // bytes received, that were not sent
+    uint64_t recovered;         // good frames echoed, directly after an error
+    uint64_t errors;
+    uint64_t tx_events;
+    uint64_t rx_events;
+    uint64_t start;             // (simulation ticks)
+    uint64_t end;
+} uart_peer_stats_t;
+
+typedef struct {
+    char name[UART_PEER_MAX_NAME];
+    vpiHandle sigs[UART_NUM_SIGS];
+    double tick_hz;             // simulation ticks per second
+    // Configuration
+    uint32_t clock_hz;
+    uart_parity_t parity;
+    uint32_t baud;              // overrides the test-case baud rates, if non-zero
+    uint32_t seed;
+    uint32_t rng;
+    // Test-cases
+    const uart_test_t* tests;
+    int test_num;
+    int test_curr;
+    bool waiting;               // all frames sent, waiting for the echoes
+    uint64_t timeout;
+    double bit_ticks;
+    // Transmitter (peer -> UART)
+    uint64_t tx_t0;
+    uint64_t tx_bit;            // bits since 'tx_t0'
+    uint32_t tx_frame;
+    uint32_t tx_bits;           // frame bits, LSB first
+    uint16_t tx_len;            // frame bits, plus idle bits
+    uint16_t tx_pos;
+    bool tx_done;
+    bool error_pending;         // an injected framing error, not yet recovered
+    // Receiver (UART -> peer)
+    bool rx_busy;
+    uint64_t rx_start;
+    uint16_t rx_pos;
+    uint16_t rx_data;
+    uint8_t rx_level;
+    // Scoreboard
+    uart_expect_t queue[UART_PEER_QUEUE];
+    uint16_t head;
+    uint16_t count;
+    uart_peer_stats_t stats;    // for the current test-case
+    uint64_t errors;
+} uart_peer_t;
+
+
+void uart_peer_register(void);
+
+
+#endif  /* __UART_PEER_H__ */
@@ -0,0 +1,350 @@
+#include "ulpisim.h"
+#include "testcase.h"
+
+#include "tc_bulkin.h"
+#include "tc_bulkout.h"
+#include "tc_ctlbw.h"
+#include "tc_ddr3out.h"
+#include "tc_ddr3in.h"
+#include "tc_getdesc.h"
+#include "tc_getconf.h"
+#include "tc_getstrs.h"
+#include "tc_parity.h"
+#include "tc_random.h"
+#include "tc_setaddr.h"
+#include "tc_setconf.h"
+#include "tc_waitsof.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Simulator-independent parts of the ULPI test harness. Every routine here
+// works only on 'ulpi_bus_t' values, so that the same PHY model, USB host model,
+// and test-cases can be driven by the '$ulpi_step' VPI callbacks, or directly
+// from a compiled (Verilator) model.
+//
+
+
+#define NUM_TESTCASES 64
+
+#define UT_RANDOM_SEED  0x5EED1234u
+#define UT_RANDOM_XACTS 200
+
+
+static const char op_strings[5][16] = {
+    {"UT_PowerOn"},
+    {"UT_StartUp"},
+    {"UT_Idle"},
+    {"UT_Test"},
+    {"UT_Done"}
+};
+
+static char err_mesg[2048] = {0};
+
+
+/**
+ * Abort simulation and emit the error-reason.
+ */
+int ut_error(const char* reason)
+{
+    ulpi_vpi_printf("ERROR: $ulpi_step %s\n", reason);
+    vpi_control(vpiFinish, 1);
+    return 0;
+}
+
+int ut_failed(const char* mesg, const int line, ut_state_t* state)
+{
+    ulpi_vpi_printf("\t@%8lu ns  =>\tTest-case: %s failed [%s:%d]\n",
+                    state->tick_ns, mesg, __FILE__, __LINE__);
+    show_ut_state(state);
+    ut_ring_show(state->ring, 0);
+    sprintf(err_mesg, "[%s:%d] Test-case: %s failed\n", __FILE__, line, mesg);
+    ut_error(err_mesg);
+
+    return -1;
+}
+
+//
+// Todo:
+//  1. ~~handle reset~~
+//  2. TX CMDs & line-speed negotiation
+//  3. idle line-state
+//  4. start-of-frame & end-of-frame
+//  5. scheduling transactions
+//  6. stepping current transaction to completion
+//
+static int stim_step(ulpi_phy_t* phy, usb_host_t* host, const ulpi_bus_t* curr, ulpi_bus_t* next)
+{
+    int result;
+    if (phy->state.speed < HighSpeed || phy->state.op != PhyIdle) {
+        // Step-function for the ULPI PHY of the USB device/peripheral
+        result = uphy_step(phy, curr, next);
+        host->cycle++;
+        if (result < 0) {
+            return ut_error("ULPI PHY step failed\n");
+        } else if (result > 0) {
+            host->op = HostIdle;
+        }
+    } else {
+        // Step-function for the USB host, if the PHY 
+        ulpi_vpi_printf(".");
+        result = usbh_step(host, curr, next);
+        if (result < 0) {
+            ulpi_vpi_printf("[%s:%d] USB host-step failed: host->op = %x\n\n",
+                            __FILE__, __LINE__, host->op);
+        }
+    }
+
+    return result;
+}
+
+//
+// Todo: keep progressing through the test-cases ...
+//
+static int test_step(ut_state_t* state)
+{
+    uint64_t cycle = state->cycle;
+
+    if (state->test_curr < state->test_num) {
+        testcase_t* test = state->tests[state->test_curr];
+        usb_host_t* host = &state->host;
+        int result;
+
+        if (state->test_step++ == 0) {
+            // show_host(host);
+            ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s (test %d) started [%s:%d]\n", cycle,
+                            test->name, state->test_curr, __FILE__, __LINE__);
+            result = test->init(host, test->data);
+            if (result < 0) {
+                return ut_failed("INIT", __LINE__, state);
+            }
+        } else {
+            result = test->step(host, test->data);
+            if (result < 0) {
+                return ut_failed("STEP", __LINE__, state);
+            }
+        }
+
+        if (result > 0) {
+            // Test finished, advance to the next, if possible
+            ulpi_vpi_printf("HOST\t#%8lu cyc =>\t%s completed [%s:%d]\n", cycle,
+                            test->name, __FILE__, __LINE__);
+            tc_finish(test);
+            state->test_step = 0;
+            state->test_curr++;
+            return result;
+        }
+    } else {
+        // No more tests remaining
+        ulpi_vpi_printf("HOST\t#%8lu cyc =>\tAll testbenches completed [%s:%d]\n",
+                        cycle, __FILE__, __LINE__);
+        ulpi_arena_show(state->suite, "suite");
+        ulpi_arena_show(state->arena, "per-test");
+        shadow_show(&state->shadow, "DDR3");
+        return 2;
+    }
+
+    return 0;
+}
+
+void show_ut_state(ut_state_t* state)
+{
+    char hstr[4096];
+    char str[ULPI_STRING_LEN];
+    int len = host_string(&state->host, hstr, 4);
+    assert(len < 4096);
+
+    ulpi_vpi_printf("UT_STATE = {\n");
+    ulpi_vpi_printf("  tick_ns: %lu,\n", state->tick_ns);
+    ulpi_vpi_printf("  t_recip: %lu,\n", state->t_recip);
+    ulpi_vpi_printf("  cycle: %lu,\n", state->cycle);
+    ulpi_vpi_printf("  bus: {\n   %s\n  },\n", ulpi_bus_string(&state->bus, str));
+    ulpi_vpi_printf("  phy: {\n   xfer: %s,\n", transfer_string(&state->phy.xfer, str));
+    ulpi_vpi_printf("  },\n  host: {\n%s\n  },\n", hstr);
+    ulpi_vpi_printf("  sync_flag: %d,\n", state->sync_flag);
+    ulpi_vpi_printf("  test_curr: %d,\n", state->test_curr);
+    ulpi_vpi_printf("  test_step: %d,\n", state->test_step);
+    ulpi_vpi_printf("  tests[%d]: <%p>,\n", state->test_num, state->tests);
+    ulpi_vpi_printf("  op: %u (%s)\n};\n", state->op, op_strings[state->op]);
+}
+
+/**
+ * Advance the PHY, USB host, and test-cases by one ULPI clock-cycle, using the
+ * bus values that were sampled at the clock-edge, and compute the next values
+ * for the PHY-driven signals.
+ */
+int ut_step(ut_state_t* state, ulpi_bus_t* next)
+{
+    ulpi_phy_t* phy;
+    usb_host_t* host;
+
+    state->cycle++;
+    phy = &state->phy;
+    host = &state->host;
+
+    const ulpi_bus_t* curr = &state->bus;
+    int result;
+#ifdef  __show_all_ulpi_signal_changes
+    const ulpi_bus_t* prev = &phy->bus;
+    bool changed = memcmp(prev, curr, sizeof(ulpi_bus_t)) != 0;
+#endif  /* __show_all_ulpi_signal_changes */
+    memcpy(next, curr, sizeof(ulpi_bus_t));
+    ut_ring_record(state->ring, curr, host, phy);
+
+    switch (state->op) {
+
+    case UT_PowerOn:
+        // Wait for the power-on time to elapse
+        ulpi_vpi_printf("[%s:%d] Todo: implement power-on steps\n",
+                        __FILE__, __LINE__);
+        host->cycle++;
+        state->op = UT_StartUp;
+        break;
+
+    case UT_StartUp:
+        // Negotiate high-speed (bus) mode
+        result = stim_step(phy, host, curr, next);
+        if (result < 0) {
+            char err[80] = {0};
+            sprintf(err, "in state: speed = %x, phy->op = %x, host->op = %x,",
+                    phy->state.speed, phy->state.op, host->op);
+            return ut_failed(err, __LINE__, state);
+        } else if (result > 0) {
+            ulpi_vpi_printf(
+                "\t@%8lu ns  =>\tPHY/Host high-speed negotiation completed [%s:%d]\n",
+                state->tick_ns, __FILE__, __LINE__);
+            state->op = UT_Idle;
+        }
+        break;
+
+    case UT_Idle:
+        if (!ulpi_bus_is_idle(curr)) {
+            // Wait for the ULPI bus to become idle, first ...
+            result = usbh_step(host, curr, next);
+            if (result < 0) {
+                return ut_failed("USB host-step", __LINE__, state);
+            }
+        } else {
+            // Initiate each of the various test-cases
+            host->cycle++;
+            result = test_step(state);
+            if (result < 0) {
+                return ut_failed("test-step", __LINE__, state);
+            } else if (result > 0) {
+                if (result > 1) {
+                    state->op = UT_Done;
+                }
+            } else {
+                state->op = UT_Test;
+            }
+        }
+        break;
+
+    case UT_Test:
+        // Step each test-case to resolution
+        result = usbh_step(host, curr, next);
+        if (result < 0) {
+            return ut_failed("USB host-step", __LINE__, state);
+        } else if (result > 0) {
+            // Proceed to the next test (sub-)step
+            ulpi_vpi_printf("\t@%8lu ns  =>\tTest-case USB host-step completed [%s:%d]\n",
+                            state->tick_ns, __FILE__, __LINE__);
+            state->op = UT_Idle;
+        }
+        break;
+
+    case UT_Done:
+        // Indicate that the test-cases completed successfully
+        ulpi_vpi_printf("\t@%8lu ns  =>\tAll test-cases completed [%s:%d]\n",
+                        state->tick_ns, __FILE__, __LINE__);
+        return 1;
+
+    default:
+        return ut_failed("test-operation invalid,", __LINE__, state);
+    }
+
+// #define __show_all_ulpi_signal_changes
+#ifdef  __show_all_ulpi_signal_changes
+    changed |=
+        memcmp(curr, next, sizeof(ulpi_bus_t)) != 0 ||
+        memcmp(prev, next, sizeof(ulpi_bus_t)) != 0;
+
+    if (changed) {
+        ulpi_vpi_printf("\t@%8lu ns  =>\t", state->tick_ns);
+        ulpi_bus_show(next);
+    }
+#endif  /* __show_all_ulpi_signal_changes */
+
+    return 0;
+}
+
+/**
+ * Initialise the harness state, and queue up all of the test-cases.
+ */
+int ut_init(ut_state_t* state)
+{
+    int i = 0;
+
+    state->cycle = 0;
+    state->sync_flag = 0;
+    state->ring = ut_ring_create(UT_RING_SIZE);
+    usbh_init(&state->host);
+    shadow_init(&state->shadow);
+    state->host.shadow = &state->shadow;
+    state->test_curr = 0;
+    state->test_step = 0;
+
+    // Scripted test-cases live for the whole run, whereas anything allocated
+    // while a test is running is released when that test completes
+    state->suite = ulpi_arena_create();
+    state->arena = ulpi_arena_create();
+    tc_arena_set(state->suite);
+    state->tests = (testcase_t**)tc_alloc(sizeof(testcase_t*) * NUM_TESTCASES);
+
+    // -- USB device start-up and enumeration -- //
+    state->tests[i++] = test_getdesc();
+    state->tests[i++] = test_setaddr(0x23);
+    state->tests[i++] = test_getconf();
+    state->tests[i++] = test_setconf(0x01);
+    state->tests[i++] = test_getstrs();
+    state->tests[i++] = test_waitsof(); // 615 us
+
+    // -- Read out all of the string descriptors, then OUT some data -- //
+    state->tests[i++] = test_bulkout();
+    if (state->ddr3) {
+        state->tests[i++] = test_ddr3out(0x02A8F0);
+    }
+    state->tests[i++] = test_waitsof(); // 630 us
+
+    // -- Bidirectional transfers & queries -- //
+    if (state->ddr3) {
+        state->tests[i++] = test_ddr3in(0x02A8F0);
+    }
+    state->tests[i++] = test_bulkout();
+    state->tests[i++] = test_bulkin(EpBulkIn);
+    // state->tests[i++] = test_bulkout();
+    state->tests[i++] = test_waitsof(); // 645 us
+
+    // -- Control-pipe throughput, of back-to-back descriptor requests -- //
+    state->tests[i++] = test_ctlbw(0, 16);
+    state->tests[i++] = test_waitsof();
+
+    // -- Constrained-random mix of control, bulk, and DDR3 transactions -- //
+    state->tests[i++] = test_random(state->seed != 0 ? state->seed : UT_RANDOM_SEED,
+                                    state->randoms > 0 ? state->randoms : UT_RANDOM_XACTS,
+                                    state->ddr3);
+    state->tests[i++] = test_waitsof();
+
+    // -- Error-handling tests -- //
+    state->tests[i++] = test_getconf();
+    state->tests[i++] = test_parity();
+    state->tests[i++] = test_waitsof(); // 660 us
+
+    state->test_num = i;
+    tc_arena_set(state->arena);
+
+    return i;
+}
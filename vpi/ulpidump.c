@@ -0,0 +1,121 @@
+#include "ulpidump.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define UT_DUMP_PLUSARG      "+ulpi_dump="
+#define UT_DUMP_TEST_PLUSARG "+ulpi_dump_test="
+#define UT_DUMP_PRE_PLUSARG  "+ulpi_dump_pre="
+#define UT_DUMP_POST_PLUSARG "+ulpi_dump_post="
+
+#define UT_DUMP_NEVER UINT64_MAX
+
+
+static void ut_dump_set(ut_state_t* state, bool on)
+{
+    ut_dump_t* dump = state->dump;
+    s_vpi_value sig;
+
+    if (dump->on == on) {
+        return;
+    }
+    dump->on = on;
+
+    sig.format = vpiScalarVal;
+    sig.value.scalar = on ? vpi1 : vpi0;
+    vpi_put_value(state->dump_en, &sig, NULL, vpiNoDelay);
+
+    vpi_printf("HOST\t#%8lu cyc =>\tWaveform dump %s [%s:%d]\n", state->cycle,
+               on ? "on" : "off", __FILE__, __LINE__);
+}
+
+static void ut_dump_rerun(ut_state_t* state, uint64_t first, uint64_t last)
+{
+    const ut_dump_t* dump = state->dump;
+    const uint64_t from = first > dump->pre ? first - dump->pre : 0;
+
+    vpi_printf("HOST\t#%8lu cyc =>\tRe-run with '" UT_DUMP_PLUSARG "%lu:%lu' to dump "
+               "cycles %lu..%lu [%s:%d]\n", state->cycle, from, last + dump->post,
+               from, last + dump->post, __FILE__, __LINE__);
+}
+
+
+//
+//  Public API Routines
+///
+
+/**
+ * Parse the plusargs, for the waveform capture-window. Without the 'dump'
+ * argument, the window is still computed, so that failures still print the
+ * plusargs for re-running with waveforms.
+ */
+int ut_dump_init(ut_state_t* state)
+{
+    const char* window = ulpi_plusarg(UT_DUMP_PLUSARG, NULL);
+    const char* test = ulpi_plusarg(UT_DUMP_TEST_PLUSARG, NULL);
+    const char* pre = ulpi_plusarg(UT_DUMP_PRE_PLUSARG, NULL);
+    const char* post = ulpi_plusarg(UT_DUMP_POST_PLUSARG, NULL);
+    ut_dump_t* dump = (ut_dump_t*)malloc(sizeof(ut_dump_t));
+
+    memset(dump, 0, sizeof(ut_dump_t));
+    dump->from = UT_DUMP_NEVER;
+    dump->to = UT_DUMP_NEVER;
+    dump->pre = pre != NULL ? (uint32_t)atoi(pre) : UT_DUMP_PRE;
+    dump->post = post != NULL ? (uint32_t)atoi(post) : UT_DUMP_POST;
+    dump->test = test != NULL ? atoi(test) : -1;
+    state->dump = dump;
+
+    if (window == NULL) {
+        // No explicit window
+    } else if (strcmp(window, "all") == 0) {
+        dump->from = 0;
+    } else if (sscanf(window, "%lu:%lu", &dump->from, &dump->to) != 2 ||
+               dump->to < dump->from) {
+        return ut_error("'+ulpi_dump=<from>:<to>' is not a valid window");
+    }
+
+    if (dump->test >= state->test_num) {
+        return ut_error("'+ulpi_dump_test=<N>' is not a valid test-case");
+    }
+
+    return 0;
+}
+
+/**
+ * Called after each 'ut_step()', to update the waveform-dump state, using the
+ * cycle that was just processed.
+ */
+void ut_dump_step(ut_state_t* state, int result)
+{
+    ut_dump_t* dump = state->dump;
+    const uint64_t cycle = state->cycle - 1;
+
+    if (dump == NULL) {
+        return;
+    }
+
+    if (result < 0) {
+        ut_dump_rerun(state, cycle, cycle);
+        return;
+    }
+
+    if (dump->test >= 0) {
+        if (state->test_curr == dump->test && state->test_step > 0 &&
+            dump->from == UT_DUMP_NEVER) {
+            // The test-case has started, so dump from now on
+            dump->start = cycle;
+            dump->from = cycle;
+        } else if (state->test_curr > dump->test && dump->from != UT_DUMP_NEVER &&
+                   dump->to == UT_DUMP_NEVER) {
+            // ... and has finished, so stop after the post-roll
+            dump->to = cycle + dump->post;
+            ut_dump_rerun(state, dump->start, cycle);
+        }
+    }
+
+    if (state->dump_en != NULL) {
+        ut_dump_set(state, cycle >= dump->from && cycle <= dump->to);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef __ULPIDUMP_H__
+#define __ULPIDUMP_H__
+
+
+#include "ulpisim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Harness-controlled waveform capture windows, where '$ulpi_step' drives its
+ * (optional) 'dump' argument, and the testbench calls '$dumpon'/'$dumpoff'
+ * whenever it changes. Windows are given (in ULPI clock-cycles) by:
+ *  - '+ulpi_dump=<from>:<to>'  --  explicit window (or '+ulpi_dump=all');
+ *  - '+ulpi_dump_test=<N>'     --  around the N-th test-case (from 0);
+ * and '+ulpi_dump_pre=<N>' & '+ulpi_dump_post=<N>' set how many cycles before
+ * (and after) the test-case, or a failure, to include. As the simulation can't
+ * go back in time, the '+ulpi_dump=<from>:<to>' for re-running the (pre-rolled)
+ * window is printed once the test-case finishes, or fails.
+ */
+#define UT_DUMP_PRE  1000
+#define UT_DUMP_POST 200
+
+struct __ut_dump {
+    uint64_t from;
+    uint64_t to;
+    uint32_t pre;
+    uint32_t post;
+    int test;
+    uint64_t start;
+    bool on;
+};
+
+
+int ut_dump_init(ut_state_t* state);
+void ut_dump_step(ut_state_t* state, int result);
+
+
+#endif  /* __ULPIDUMP_H__ */
@@ -0,0 +1,31 @@
+#include "ulpivpi.h"
+
+#include <vpi_user.h>
+#include <stdarg.h>
+#include <time.h>
+
+
+/**
+ * Kept apart from 'ulpisim.c', so that the core and test-cases also link
+ * with the Verilator harness (which has no '$ulpi_step').
+ */
+int ulpi_vpi_printf(const char* fmt, ...)
+{
+    va_list args;
+    int len;
+
+#ifdef __profile
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+#endif
+    va_start(args, fmt);
+    len = vpi_vprintf((PLI_BYTE8*)fmt, args);
+    va_end(args);
+#ifdef __profile
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ulpi_log_add((uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ull +
+                 (uint64_t)(t1.tv_nsec - t0.tv_nsec));
+#endif
+
+    return len;
+}
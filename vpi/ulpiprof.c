@@ -0,0 +1,103 @@
+#include "ulpiprof.h"
+
+#ifdef __profile
+
+#include "usb/ulpi.h"
+
+#include <vpi_user.h>
+#include <time.h>
+
+
+uint64_t prof_phase_ticks[PROF_NUM];
+
+static uint64_t prof_edges = 0;
+static uint64_t prof_tick0 = 0;
+static uint64_t prof_ns0 = 0;
+
+
+static uint64_t prof_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Count the clock-edges, and start the wall-clock (and the tick-counter
+ * calibration) at the first edge.
+ */
+void prof_edge(void)
+{
+    if (prof_edges++ == 0) {
+        prof_tick0 = prof_ticks();
+        prof_ns0 = prof_ns();
+    }
+}
+
+static void prof_line(const char* name, double ns, double edges, double wall)
+{
+    vpi_printf("  %-22s %10.1f ns/edge  %5.1f%%\n", name, ns / edges,
+               wall > 0.0 ? ns * 100.0 / wall : 0.0);
+}
+
+/**
+ * Breakdown of the time spent in each phase, excluding the time spent in any
+ * nested phases, and with the remainder of the wall-time attributed to the
+ * simulator itself.
+ */
+static int prof_report(p_cb_data cb_data)
+{
+    if (prof_edges == 0) {
+        vpi_printf("\n$ulpi_step profile: no clock-edges\n");
+        return 0;
+    }
+
+    const double wall = (double)(prof_ns() - prof_ns0);
+    const uint64_t ticks = prof_ticks() - prof_tick0;
+    const double scale = ticks > 0 ? wall / (double)ticks : 1.0;
+    const double edges = (double)prof_edges;
+    double ns[PROF_NUM];
+
+    for (int i=0; i<PROF_NUM; i++) {
+        ns[i] = (double)prof_phase_ticks[i] * scale;
+    }
+
+    // Logging mostly happens within 'ut_step()', and the phases nest
+    const double log = (double)ulpi_log_ns();
+    const double step = ns[PROF_Step] > log ? ns[PROF_Step] - log : 0.0;
+    const double clock = ns[PROF_Clock] - ns[PROF_Fetch];
+    const double sync = ns[PROF_Sync] - ns[PROF_Step] - ns[PROF_Update];
+    const double sim = wall - ns[PROF_Clock] - ns[PROF_Sync];
+
+    vpi_printf("\n$ulpi_step profile: %lu clock-edges, %.3f ms wall-time\n",
+               prof_edges, wall * 1e-6);
+    prof_line("cb_step_clock (self)", clock, edges, wall);
+    prof_line("ut_fetch_bus", ns[PROF_Fetch], edges, wall);
+    prof_line("cb_step_sync (self)", sync, edges, wall);
+    prof_line("ut_step (models)", step, edges, wall);
+    prof_line("ut_step (logging)", log, edges, wall);
+    prof_line("ut_update_bus_state", ns[PROF_Update], edges, wall);
+    prof_line("simulator", sim > 0.0 ? sim : 0.0, edges, wall);
+
+    return 0;
+}
+
+/**
+ * Print the profile once the simulation finishes.
+ */
+void prof_register(void)
+{
+    s_cb_data cb;
+
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = prof_report;
+    cb.user_data = NULL;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+
+    vpiHandle cb_handle = vpi_register_cb(&cb);
+    vpi_free_object(cb_handle);
+}
+
+#endif  /* __profile */
@@ -0,0 +1,66 @@
+#ifndef __ULPIPROF_H__
+#define __ULPIPROF_H__
+
+
+#include <stdint.h>
+
+/**
+ * Self-profiler for the '$ulpi_step' callback path, that accumulates the
+ * time spent in each phase, per clock-edge. Everything compiles out unless
+ * built with '-D__profile' (or 'make PROFILE=1').
+ */
+typedef enum {
+    PROF_Clock  = 0,            // 'cb_step_clock()'
+    PROF_Fetch  = 1,            // 'ut_fetch_bus()'
+    PROF_Sync   = 2,            // 'cb_step_sync()'
+    PROF_Step   = 3,            // 'ut_step()'
+    PROF_Update = 4,            // 'ut_update_bus_state()'
+    PROF_NUM    = 5,
+} prof_phase_t;
+
+
+#ifdef __profile
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline uint64_t prof_ticks(void)
+{
+    return __rdtsc();
+}
+#else  /* !__x86_64__ */
+#include <time.h>
+
+static inline uint64_t prof_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif  /* !__x86_64__ */
+
+extern uint64_t prof_phase_ticks[PROF_NUM];
+
+static inline void prof_add(prof_phase_t phase, uint64_t t0)
+{
+    prof_phase_ticks[phase] += prof_ticks() - t0;
+}
+
+#define PROF_BEGIN(phase)   const uint64_t __prof_##phase = prof_ticks()
+#define PROF_END(phase)     prof_add(phase, __prof_##phase)
+
+void prof_edge(void);
+void prof_register(void);
+
+#else  /* !__profile */
+
+#define PROF_BEGIN(phase)
+#define PROF_END(phase)
+
+#define prof_edge()
+#define prof_register()
+
+#endif  /* !__profile */
+
+
+#endif  /* __ULPIPROF_H__ */
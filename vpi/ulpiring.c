@@ -0,0 +1,97 @@
+#include "ulpiring.h"
+
+#include <vpi_user.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char sig_chars[8] = {'0', '1', 'Z', 'X', 'H', 'L', '?', '?'};
+
+
+static bool ut_ring_same(const ut_ring_entry_t* a, const ut_ring_entry_t* b)
+{
+    return a->sigs == b->sigs && a->data_a == b->data_a && a->data_b == b->data_b &&
+        a->host_op == b->host_op && a->stage == b->stage && a->phy_op == b->phy_op;
+}
+
+static void ut_ring_line(const ut_ring_entry_t* entry, uint64_t cycle, uint64_t reps)
+{
+    char data[8];
+    const uint16_t s = entry->sigs;
+
+    if (entry->data_b == 0x00) {
+        snprintf(data, sizeof(data), "0x%02x", entry->data_a);
+    } else if (entry->data_b == 0xff && entry->data_a == 0x00) {
+        snprintf(data, sizeof(data), "ZZ");
+    } else {
+        snprintf(data, sizeof(data), "XX");
+    }
+
+    vpi_printf("  #%8lu  %c %c %c %c  %-4s  %-11s %-9s  %-12s", cycle,
+               sig_chars[s & 7], sig_chars[(s >> 3) & 7], sig_chars[(s >> 6) & 7],
+               sig_chars[(s >> 9) & 7], data, host_op_string(entry->host_op),
+               transfer_stage_string(entry->stage), phy_op_string(entry->phy_op));
+    if (reps > 1) {
+        vpi_printf("  (x%lu)\n", reps);
+    } else {
+        vpi_printf("\n");
+    }
+}
+
+
+//
+//  Public API Routines
+///
+
+ut_ring_t* ut_ring_create(uint32_t size)
+{
+    ut_ring_t* ring = (ut_ring_t*)malloc(sizeof(ut_ring_t));
+
+    ring->cycle = 0;
+    ring->show_at = UINT64_MAX;
+    ring->mask = size - 1;
+    ring->entries = (ut_ring_entry_t*)calloc(size, sizeof(ut_ring_entry_t));
+
+    return ring;
+}
+
+void ut_ring_free(ut_ring_t* ring)
+{
+    if (ring != NULL) {
+        free(ring->entries);
+        free(ring);
+    }
+}
+
+/**
+ * Show the most recent 'num' cycles (or all of them, if 0), oldest first, and
+ * with runs of identical cycles shown just once.
+ */
+void ut_ring_show(const ut_ring_t* ring, uint32_t num)
+{
+    const uint64_t size = (uint64_t)ring->mask + 1;
+    uint64_t count = ring->cycle < size ? ring->cycle : size;
+
+    if (num > 0 && num < count) {
+        count = num;
+    }
+
+    vpi_printf("Flight-recorder, last %lu cycles:\n", count);
+    vpi_printf("  %9s  R D N S  %-4s  %-11s %-9s  %-12s\n", "cycle", "data", "host",
+               "stage", "PHY");
+
+    uint64_t first = ring->cycle - count;
+    const ut_ring_entry_t* prev = &ring->entries[first & ring->mask];
+    uint64_t start = first;
+
+    for (uint64_t c = first + 1; c <= ring->cycle; c++) {
+        const ut_ring_entry_t* entry = &ring->entries[c & ring->mask];
+
+        if (c == ring->cycle || !ut_ring_same(prev, entry)) {
+            ut_ring_line(prev, start, c - start);
+            prev = entry;
+            start = c;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef __ULPIRING_H__
+#define __ULPIRING_H__
+
+
+#include "usb/ulpi.h"
+#include "usb/ulpiphy.h"
+#include "usb/usbhost.h"
+#include <stdint.h>
+
+/**
+ * Flight-recorder of the most recent ULPI bus cycles, along with the host op
+ * & transfer-stage, and the PHY op, at each cycle. It costs 8 bytes/cycle, so
+ * that it can always be on, and it is shown (decoded) when a test-case fails,
+ * so that failures can be debugged without dumping waveforms. It can also be
+ * shown on demand, once cycle 'show_at' has been recorded.
+ */
+#define UT_RING_SIZE 4096       // Must be a power of 2
+
+
+typedef struct {
+    uint16_t sigs;              // 3 bits each: 'rst_n', 'dir', 'nxt', 'stp'
+    uint8_t data_a;
+    uint8_t data_b;
+    int8_t host_op;
+    uint8_t stage;
+    int8_t phy_op;
+} ut_ring_entry_t;
+
+typedef struct {
+    uint64_t cycle;             // Cycle of the next entry
+    uint64_t show_at;
+    uint32_t mask;
+    ut_ring_entry_t* entries;
+} ut_ring_t;
+
+
+static inline void ut_ring_record(ut_ring_t* ring, const ulpi_bus_t* bus,
+                                  const usb_host_t* host, const ulpi_phy_t* phy)
+{
+    ut_ring_entry_t* entry = &ring->entries[ring->cycle++ & ring->mask];
+
+    entry->sigs = (uint16_t)(bus->rst_n & 7u) | (uint16_t)(bus->dir & 7u) << 3 |
+        (uint16_t)(bus->nxt & 7u) << 6 | (uint16_t)(bus->stp & 7u) << 9;
+    entry->data_a = bus->data.a;
+    entry->data_b = bus->data.b;
+    entry->host_op = (int8_t)host->op;
+    entry->stage = host->xfer.stage;
+    entry->phy_op = phy->state.op;
+}
+
+ut_ring_t* ut_ring_create(uint32_t size);
+void ut_ring_free(ut_ring_t* ring);
+void ut_ring_show(const ut_ring_t* ring, uint32_t num);
+
+
+#endif  /* __ULPIRING_H__ */
@@ -1,18 +1,8 @@
 #include "ulpisim.h"
+#include "ulpidump.h"
+#include "ulpiprof.h"
 #include "testcase.h"
 
-#include "tc_bulkin.h"
-#include "tc_bulkout.h"
-#include "tc_ddr3out.h"
-#include "tc_ddr3in.h"
-#include "tc_getdesc.h"
-#include "tc_getconf.h"
-#include "tc_getstrs.h"
-#include "tc_parity.h"
-#include "tc_setaddr.h"
-#include "tc_setconf.h"
-#include "tc_waitsof.h"
-
 // Todo: create a top-level registry of simulation system-tasks
 #include "packet_tb.h"
 
@@ -21,39 +11,30 @@
 #include <string.h>
 
 
-#define NUM_TESTCASES 64
-
-
-static const char op_strings[5][16] = {
-    {"UT_PowerOn"},
-    {"UT_StartUp"},
-    {"UT_Idle"},
-    {"UT_Test"},
-    {"UT_Done"}
-};
-
-static char err_mesg[2048] = {0};
+#define UT_TRACE_PLUSARG  "+ulpi_trace="
+#define UT_GOLDEN_PLUSARG "+ulpi_golden="
+#define UT_WINDOW_PLUSARG "+ulpi_window="
+#define UT_RING_PLUSARG   "+ulpi_ring="
+#define UT_SEED_PLUSARG   "+ulpi_seed="
+#define UT_RANDOM_PLUSARG "+ulpi_random="
 
 
 /**
- * Abort simulation and emit the error-reason.
+ * Find the value of a '+name=<value>' plusarg, else return 'def'.
  */
-static int ut_error(const char* reason)
-{
-    vpi_printf("ERROR: $ulpi_step %s\n", reason);
-    vpi_control(vpiFinish, 1);
-    return 0;
-}
-
-static int ut_failed(const char* mesg, const int line, ut_state_t* state)
+const char* ulpi_plusarg(const char* name, const char* def)
 {
-    vpi_printf("\t@%8lu ns  =>\tTest-case: %s failed [%s:%d]\n",
-               state->tick_ns, mesg, __FILE__, __LINE__);
-    show_ut_state(state);
-    sprintf(err_mesg, "[%s:%d] Test-case: %s failed\n", __FILE__, line, mesg);
-    ut_error(err_mesg);
+    s_vpi_vlog_info info;
+    const size_t len = strlen(name);
 
-    return -1;
+    if (vpi_get_vlog_info(&info)) {
+        for (int i=0; i<info.argc; i++) {
+            if (strncmp(info.argv[i], name, len) == 0) {
+                return info.argv[i] + len;
+            }
+        }
+    }
+    return def;
 }
 
 /**
@@ -61,6 +42,7 @@ static int ut_failed(const char* mesg, const int line, ut_state_t* state)
  */
 static void ut_fetch_bus(ut_state_t* state)
 {
+    PROF_BEGIN(PROF_Fetch);
     s_vpi_value curr_value;
     curr_value.format = vpiScalarVal;
 
@@ -83,21 +65,12 @@ static void ut_fetch_bus(ut_state_t* state)
     vpi_get_value(state->dati, &curr_value);
     state->bus.data.a = (uint8_t)curr_value.value.vector->aval;
     state->bus.data.b = (uint8_t)curr_value.value.vector->bval;
-}
-
-static void ut_set_phy_idle(ut_state_t* state)
-{
-    s_vpi_value sig;
-
-    sig.format = vpiScalarVal;
-    sig.value.scalar = vpi0;
-
-    vpi_put_value(state->dir, &sig, NULL, vpiNoDelay);
-    vpi_put_value(state->nxt, &sig, NULL, vpiNoDelay);
+    PROF_END(PROF_Fetch);
 }
 
 static void ut_update_bus_state(ut_state_t* state, ulpi_bus_t* next)
 {
+    PROF_BEGIN(PROF_Update);
     s_vpi_value sig;
     s_vpi_time now;
     const ulpi_bus_t* curr = &state->bus;
@@ -124,212 +97,7 @@ static void ut_update_bus_state(ut_state_t* state, ulpi_bus_t* next)
     }
 
     memcpy(&state->phy.bus, next, sizeof(ulpi_bus_t));
-}
-
-static int ut_step_xfer(ut_state_t* state)
-{
-    return 0;
-}
-
-//
-// Todo:
-//  1. ~~handle reset~~
-//  2. TX CMDs & line-speed negotiation
-//  3. idle line-state
-//  4. start-of-frame & end-of-frame
-//  5. scheduling transactions
-//  6. stepping current transaction to completion
-//
-static int stim_step(ulpi_phy_t* phy, usb_host_t* host, const ulpi_bus_t* curr, ulpi_bus_t* next)
-{
-    int result;
-    if (phy->state.speed < HighSpeed || phy->state.op != PhyIdle) {
-        // Step-function for the ULPI PHY of the USB device/peripheral
-        result = uphy_step(phy, curr, next);
-        host->cycle++;
-        if (result < 0) {
-            return ut_error("ULPI PHY step failed\n");
-        } else if (result > 0) {
-            host->op = HostIdle;
-        }
-    } else {
-        // Step-function for the USB host, if the PHY 
-        vpi_printf(".");
-        result = usbh_step(host, curr, next);
-        if (result < 0) {
-            vpi_printf("[%s:%d] USB host-step failed: host->op = %x\n\n",
-                       __FILE__, __LINE__, host->op);
-        }
-    }
-
-    return result;
-}
-
-//
-// Todo: keep progressing through the test-cases ...
-//
-static int test_step(ut_state_t* state)
-{
-    uint64_t cycle = state->cycle;
-
-    if (state->test_curr < state->test_num) {
-        testcase_t* test = state->tests[state->test_curr];
-        usb_host_t* host = &state->host;
-        int result;
-
-        if (state->test_step++ == 0) {
-            // show_host(host);
-            result = test->init(host, test->data);
-            if (result < 0) {
-                return ut_failed("INIT", __LINE__, state);
-            }
-        } else {
-            result = test->step(host, test->data);
-            if (result < 0) {
-                return ut_failed("STEP", __LINE__, state);
-            }
-        }
-
-        if (result > 0) {
-            // Test finished, advance to the next, if possible
-            vpi_printf("HOST\t#%8lu cyc =>\t%s completed [%s:%d]\n", cycle,
-                       test->name, __FILE__, __LINE__);
-            state->test_step = 0;
-            state->test_curr++;
-            return result;
-        }
-    } else {
-        // No more tests remaining
-        vpi_printf("HOST\t#%8lu cyc =>\tAll testbenches completed [%s:%d]\n",
-                   cycle, __FILE__, __LINE__);
-        return 2;
-    }
-
-    return 0;
-}
-
-void show_ut_state(ut_state_t* state)
-{
-    char* hstr = malloc(4096);
-    int len = host_string(&state->host, hstr, 4);
-    assert(len < 4096);
-
-    vpi_printf("UT_STATE = {\n");
-    vpi_printf("  tick_ns: %lu,\n", state->tick_ns);
-    vpi_printf("  t_recip: %lu,\n", state->t_recip);
-    vpi_printf("  cycle: %lu,\n", state->cycle);
-    vpi_printf("  bus: {\n   %s\n  },\n", ulpi_bus_string(&state->bus));
-    vpi_printf("  phy: {\n   xfer: %s,\n", transfer_string(&state->phy.xfer));
-    vpi_printf("  },\n  host: {\n%s\n  },\n", hstr);
-    vpi_printf("  sync_flag: %d,\n", state->sync_flag);
-    vpi_printf("  test_curr: %d,\n", state->test_curr);
-    vpi_printf("  test_step: %d,\n", state->test_step);
-    vpi_printf("  tests[%d]: <%p>,\n", state->test_num, state->tests);
-    vpi_printf("  op: %u (%s)\n};\n", state->op, op_strings[state->op]);
-
-    free(hstr);
-}
-
-static int ut_step(ut_state_t* state, ulpi_bus_t* next)
-{
-    ulpi_phy_t* phy;
-    usb_host_t* host;
-    uint64_t cycle = state->cycle++;
-
-    phy = &state->phy;
-    host = &state->host;
-
-    const ulpi_bus_t* prev = &phy->bus;
-    const ulpi_bus_t* curr = &state->bus;
-    bool changed = memcmp(prev, curr, sizeof(ulpi_bus_t)) != 0;
-    int result;
-    memcpy(next, curr, sizeof(ulpi_bus_t));
-
-    switch (state->op) {
-
-    case UT_PowerOn:
-        // Wait for the power-on time to elapse
-        vpi_printf("[%s:%d] Todo: implement power-on steps\n",
-                   __FILE__, __LINE__);
-        host->cycle++;
-        state->op = UT_StartUp;
-        break;
-
-    case UT_StartUp:
-        // Negotiate high-speed (bus) mode
-        result = stim_step(phy, host, curr, next);
-        if (result < 0) {
-            char err[80] = {0};
-            sprintf(err, "in state: speed = %x, phy->op = %x, host->op = %x,",
-                    phy->state.speed, phy->state.op, host->op);
-            return ut_failed(err, __LINE__, state);
-        } else if (result > 0) {
-            vpi_printf(
-                "\t@%8lu ns  =>\tPHY/Host high-speed negotiation completed [%s:%d]\n",
-                state->tick_ns, __FILE__, __LINE__);
-            state->op = UT_Idle;
-        }
-        break;
-
-    case UT_Idle:
-        if (!ulpi_bus_is_idle(curr)) {
-            // Wait for the ULPI bus to become idle, first ...
-            result = usbh_step(host, curr, next);
-            if (result < 0) {
-                return ut_failed("USB host-step", __LINE__, state);
-            }
-        } else {
-            // Initiate each of the various test-cases
-            host->cycle++;
-            result = test_step(state);
-            if (result < 0) {
-                return ut_failed("test-step", __LINE__, state);
-            } else if (result > 0) {
-                if (result > 1) {
-                    state->op = UT_Done;
-                }
-            } else {
-                state->op = UT_Test;
-            }
-        }
-        break;
-
-    case UT_Test:
-        // Step each test-case to resolution
-        result = usbh_step(host, curr, next);
-        if (result < 0) {
-            return ut_failed("USB host-step", __LINE__, state);
-        } else if (result > 0) {
-            // Proceed to the next test (sub-)step
-            vpi_printf("\t@%8lu ns  =>\tTest-case USB host-step completed [%s:%d]\n",
-                       state->tick_ns, __FILE__, __LINE__);
-            state->op = UT_Idle;
-        }
-        break;
-
-    case UT_Done:
-        // Indicate that the test-cases completed successfully
-        vpi_printf("\t@%8lu ns  =>\tAll test-cases completed [%s:%d]\n",
-                   state->tick_ns, __FILE__, __LINE__);
-        return 1;
-
-    default:
-        return ut_failed("test-operation invalid,", __LINE__, state);
-    }
-
-// #define __show_all_ulpi_signal_changes
-#ifdef  __show_all_ulpi_signal_changes
-    changed |=
-        memcmp(curr, next, sizeof(ulpi_bus_t)) != 0 ||
-        memcmp(prev, next, sizeof(ulpi_bus_t)) != 0;
-
-    if (changed) {
-        vpi_printf("\t@%8lu ns  =>\t", state->tick_ns);
-        ulpi_bus_show(next);
-    }
-#endif  /* __show_all_ulpi_signal_changes */
-
-    return 0;
+    PROF_END(PROF_Update);
 }
 
 /**
@@ -337,6 +105,7 @@ static int ut_step(ut_state_t* state, ulpi_bus_t* next)
  */
 static int cb_step_sync(p_cb_data cb_data)
 {
+    PROF_BEGIN(PROF_Sync);
     ulpi_bus_t next;
     ut_state_t* state = (ut_state_t*)cb_data->user_data;
 
@@ -350,7 +119,13 @@ static int cb_step_sync(p_cb_data cb_data)
         return 0;
     }
 
+    PROF_BEGIN(PROF_Step);
     int result = ut_step(state, &next);
+    PROF_END(PROF_Step);
+    ut_dump_step(state, result);
+    if (state->ring->cycle == state->ring->show_at + 1) {
+        ut_ring_show(state->ring, 0);
+    }
     if (result < 0) {
         vpi_printf("Oh noes [%s:%d]\n", __FILE__, __LINE__);
     } else if (result > 0) {
@@ -359,6 +134,7 @@ static int cb_step_sync(p_cb_data cb_data)
 
     ut_update_bus_state(state, &next);
     state->sync_flag = 0;
+    PROF_END(PROF_Sync);
 
     return 0;
 }
@@ -368,6 +144,7 @@ static int cb_step_sync(p_cb_data cb_data)
  */
 static int cb_step_clock(p_cb_data cb_data)
 {
+    PROF_BEGIN(PROF_Clock);
     ut_state_t* state = (ut_state_t*)cb_data->user_data;
     if (state == NULL) {
         ut_error("'*state' missing");
@@ -380,8 +157,10 @@ static int cb_step_clock(p_cb_data cb_data)
 
     int clock = (int)x.value.integer;
     if (clock != 1) {
+        PROF_END(PROF_Clock);
         return 0;
     }
+    prof_edge();
 
     s_vpi_time t;
     t.type = vpiSimTime;
@@ -394,6 +173,10 @@ static int cb_step_clock(p_cb_data cb_data)
     // Capture the bus signals at the time of the clock-edge
     ut_fetch_bus(state);
 
+    if (state->trace != NULL && ulpi_trace_step(state->trace, &state->bus) < 0) {
+        vpi_control(vpiFinish, 1);
+    }
+
     // Setup a read/write synchronisation callback, to process the current bus
     // values, and update signals & state.
     t.type       = vpiSimTime;
@@ -411,6 +194,76 @@ static int cb_step_clock(p_cb_data cb_data)
     vpiHandle cb_handle = vpi_register_cb(&cb);
     vpi_free_object(cb_handle);
     state->sync_flag = 1;
+    PROF_END(PROF_Clock);
+
+    return 0;
+}
+
+/**
+ * Emit the final checkpoint, and check the length against the golden trace.
+ */
+static int cb_trace_end(p_cb_data cb_data)
+{
+    ut_state_t* state = (ut_state_t*)cb_data->user_data;
+    int result = 0;
+
+    if (state->trace != NULL) {
+        result = ulpi_trace_close(state->trace);
+        free(state->trace);
+        state->trace = NULL;
+    }
+    if (result < 0) {
+        return ut_error("ULPI trace failed (diverged, or not written)");
+    }
+    return 0;
+}
+
+/**
+ * Hash the ULPI bus each cycle, and record the checkpoints to the file given
+ * by '+ulpi_trace=<file>', or compare them against '+ulpi_golden=<file>', and
+ * stop at the first divergent window (of '+ulpi_window=<N>' cycles).
+ */
+static int ut_trace_init(ut_state_t* state)
+{
+    const char* record = ulpi_plusarg(UT_TRACE_PLUSARG, NULL);
+    const char* golden = ulpi_plusarg(UT_GOLDEN_PLUSARG, NULL);
+    const char* window = ulpi_plusarg(UT_WINDOW_PLUSARG, NULL);
+    s_cb_data cb;
+
+    if (record == NULL && golden == NULL) {
+        return 0;
+    } else if (record != NULL && golden != NULL) {
+        return ut_error("can either record, or compare against, a golden trace");
+    }
+
+    state->trace = (ulpi_trace_t*)malloc(sizeof(ulpi_trace_t));
+    if (ulpi_trace_open(state->trace, golden != NULL ? golden : record, golden != NULL,
+                        window != NULL ? (uint32_t)atoi(window) : ULPI_TRACE_WINDOW) < 0) {
+        free(state->trace);
+        state->trace = NULL;
+        return ut_error("failed to open the ULPI trace");
+    }
+
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = cb_trace_end;
+    cb.user_data = (PLI_BYTE8*)state;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+    vpi_free_object(vpi_register_cb(&cb));
+
+    return 0;
+}
+
+/**
+ * Release the flight-recorder, as no more cycles will be recorded.
+ */
+static int cb_ring_end(p_cb_data cb_data)
+{
+    ut_state_t* state = (ut_state_t*)cb_data->user_data;
+
+    ut_ring_free(state->ring);
+    state->ring = NULL;
 
     return 0;
 }
@@ -440,6 +293,9 @@ static int get_signal(vpiHandle* dst, vpiHandle iter)
  *  - nxt      --  PHY-to-link
  *  - stp      --  link-to-PHY
  *  - data[8]  --  bidirectional (and 0 idle)
+ *  - dato[8]  --  PHY-to-link data
+ *  - dump     --  (optional) 1-bit reg, set while waveforms are wanted
+ *  - ddr3     --  (optional) 0 if the DDR3 end-points do not reach a memory
  */
 static int ut_compiletf(char* user_data)
 {
@@ -470,11 +326,30 @@ static int ut_compiletf(char* user_data)
         return 0;
     }
 
-    /* check that there are no more system task arguments */
+    /* optional waveform-dump control */
     arg_handle = vpi_scan(arg_iterator);
     if (arg_handle != NULL) {
-        vpi_free_object(arg_iterator); /* free iterator memory */
-        return ut_error("can only have 6 arguments");
+        if (vpi_get(vpiType, arg_handle) != vpiReg || vpi_get(vpiSize, arg_handle) != 1) {
+            vpi_free_object(arg_iterator); /* free iterator memory */
+            return ut_error("'dump' must be a 1-bit reg");
+        }
+        state->dump_en = arg_handle;
+        arg_handle = vpi_scan(arg_iterator);
+    }
+
+    /* optional DDR3 flag, as the DDR3 test-cases need a memory */
+    state->ddr3 = true;
+    if (arg_handle != NULL) {
+        s_vpi_value value;
+        value.format = vpiIntVal;
+        vpi_get_value(arg_handle, &value);
+        state->ddr3 = value.value.integer != 0;
+
+        /* check that there are no more system task arguments */
+        if (vpi_scan(arg_iterator) != NULL) {
+            vpi_free_object(arg_iterator); /* free iterator memory */
+            return ut_error("can only have 9 arguments");
+        }
     }
 
     if (vpi_get(vpiType, state->dir) != vpiReg ||
@@ -497,40 +372,10 @@ static int ut_compiletf(char* user_data)
         return ut_error("ULPI 'dato' must be an 8-bit reg");
     }
 
-    state->cycle = 0;
-    state->sync_flag = 0;
-    usbh_init(&state->host);
-    state->test_curr = 0;
-    state->test_step = 0;
-    int i = 0;
-    state->tests = (testcase_t**)malloc(sizeof(testcase_t*) * NUM_TESTCASES);
-
-    // -- USB device start-up and enumeration -- //
-    state->tests[i++] = test_getdesc();
-    state->tests[i++] = test_setaddr(0x23);
-    state->tests[i++] = test_getconf();
-    state->tests[i++] = test_setconf(0x01);
-    state->tests[i++] = test_getstrs();
-    state->tests[i++] = test_waitsof(); // 615 us
-
-    // -- Read out all of the string descriptors, then OUT some data -- //
-    state->tests[i++] = test_bulkout();
-    state->tests[i++] = test_ddr3out(0x02A8F0);
-    state->tests[i++] = test_waitsof(); // 630 us
-
-    // -- Bidirectional transfers & queries -- //
-    state->tests[i++] = test_ddr3in(0x02A8F0);
-    state->tests[i++] = test_bulkout();
-    state->tests[i++] = test_bulkin(1);
-    // state->tests[i++] = test_bulkout();
-    state->tests[i++] = test_waitsof(); // 645 us
-
-    // -- Error-handling tests -- //
-    state->tests[i++] = test_getconf();
-    state->tests[i++] = test_parity();
-    state->tests[i++] = test_waitsof(); // 660 us
-
-    state->test_num = i;
+    /* seed, and number of transactions, of the random test-case */
+    state->seed = (uint32_t)strtoul(ulpi_plusarg(UT_SEED_PLUSARG, "0"), NULL, 0);
+    state->randoms = atoi(ulpi_plusarg(UT_RANDOM_PLUSARG, "0"));
+    ut_init(state);
 
     vpi_put_userdata(systf_handle, (void*)state);
 
@@ -580,6 +425,29 @@ static int ut_calltf(char* user_data)
     cb_handle    = vpi_register_cb(&cb);
     vpi_free_object(cb_handle);
 
+    /* report the time spent in each callback phase, at the end */
+    prof_register();
+
+    /* golden-trace recording, or regression-checking */
+    ut_trace_init(state);
+
+    /* waveform capture-windows */
+    ut_dump_init(state);
+
+    /* show the flight-recorder at the '+ulpi_ring=<cycle>' (on demand) */
+    const char* ring_at = ulpi_plusarg(UT_RING_PLUSARG, NULL);
+    if (ring_at != NULL) {
+        state->ring->show_at = strtoull(ring_at, NULL, 0);
+    }
+
+    cb.reason    = cbEndOfSimulation;
+    cb.cb_rtn    = cb_ring_end;
+    cb.user_data = (PLI_BYTE8*)state;
+    cb.time      = NULL;
+    cb.value     = NULL;
+    cb.obj       = NULL;
+    vpi_free_object(vpi_register_cb(&cb));
+
     return 0;
 }
 
@@ -2,9 +2,12 @@
 #define __ULPISIM_H__
 
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "usb/usbhost.h"
+#include "usb/ulpitrace.h"
+#include "ulpiring.h"
 #include "ulpivpi.h"
 #include "testcase.h"
 
@@ -23,6 +26,8 @@ typedef enum __ulpi_op {
     ULPI_LinkToPHY, // REGR/REGW/SPECIAL
 } ulpi_op_t;
 
+typedef struct __ut_dump ut_dump_t;
+
 typedef enum __ut_step {
     UT_PowerOn,
     UT_StartUp,
@@ -42,18 +47,28 @@ typedef struct {
     vpiHandle stp;
     vpiHandle dati;
     vpiHandle dato;
+    vpiHandle dump_en;
     uint64_t tick_ns;
     uint64_t t_recip;
     uint64_t cycle;
     ulpi_bus_t bus;
     ulpi_phy_t phy;
     usb_host_t host;
+    ddr3_shadow_t shadow;       // DDR3 scoreboard, of the STOREs and FETCHes
     int sync_flag;
     int test_num;
     int test_curr;
     int test_step;
     testcase_t** tests;
+    ulpi_arena_t* suite;        // scripted test-cases, and the 'tests' array
+    ulpi_arena_t* arena;        // per-test allocations, reset on completion
+    uint32_t seed;              // for the random test-case (0: default)
+    int randoms;                // random transactions (0: default)
+    bool ddr3;                  // the DDR3 end-points reach a memory
     int8_t op;
+    ulpi_trace_t* trace;
+    ut_dump_t* dump;
+    ut_ring_t* ring;
 } ut_state_t;
 
 
@@ -62,6 +77,10 @@ static inline int phy_is_driving(ut_state_t* state)
     return state->phy.bus.dir == SIG1;
 }
 
+int ut_init(ut_state_t* state);
+int ut_step(ut_state_t* state, ulpi_bus_t* next);
+int ut_error(const char* reason);
+int ut_failed(const char* mesg, const int line, ut_state_t* state);
 void show_ut_state(ut_state_t* state);
 
 
@@ -16,5 +16,13 @@ ulpi_phy_t* phy_init(void);
 int phy_set_reg(uint8_t reg, uint8_t val);
 int phy_get_reg(uint8_t reg, uint8_t* val);
 
+const char* ulpi_plusarg(const char* name, const char* def);
+
+/**
+ * As 'vpi_printf()', but billed to the logging time of the '$ulpi_step'
+ * profile (as for 'ulpi_printf()'), for messages from the test-cases.
+ */
+int ulpi_vpi_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
 
 #endif  /* __ULPIVPI_H__ */
@@ -0,0 +1,457 @@
+/**
+ * Microbenchmarks for the USB model kernels, so that the cost of the harness
+ * (per ULPI cycle) can be tracked as the models grow.
+ * NOTE:
+ *  - each kernel is repeated until it has run for at least '-T' seconds, and
+ *    the reported time is per operation, where an operation is a call, or a
+ *    complete packet (for the step-functions);
+ *  - results can be saved as a baseline ('-o'), and later runs compared with
+ *    it ('-c'), which fails if any kernel is slower by more than '-t' percent;
+ */
+#include "../loopback.h"
+#include "../ulpiphy.h"
+#include "../usbcrc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define BENCH_MAX_KERNELS 16
+#define BENCH_NAME_LEN    32
+
+
+typedef struct {
+    char name[BENCH_NAME_LEN];
+    double ns_per_op;
+    double bytes_per_op;
+    uint64_t cycles_per_op;
+    uint64_t ops;
+} bench_result_t;
+
+typedef uint64_t (*bench_fn_t)(uint64_t ops);
+
+static bench_result_t results[BENCH_MAX_KERNELS];
+static int num_results = 0;
+static double min_secs = 0.25;
+
+// Stops the compiler from optimising away the work
+static volatile uint32_t sink;
+
+
+//
+//  Timing Helpers
+///
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Run the kernel for an increasing number of operations, until it takes at
+ * least 'min_secs', and record the time per operation. Each kernel returns
+ * the number of ULPI cycles that it stepped (or zero).
+ */
+static void bench(const char* name, bench_fn_t fn, double bytes_per_op)
+{
+    bench_result_t* res = &results[num_results++];
+    uint64_t ops = 1;
+    uint64_t cycles;
+    double secs;
+
+    fn(1);
+    for (;;) {
+        double t0 = now();
+        cycles = fn(ops);
+        secs = now() - t0;
+        if (secs >= min_secs || ops >= (1ull << 40)) {
+            break;
+        }
+        ops = secs > 1e-3 ? (uint64_t)((double)ops * min_secs * 1.2 / secs) : ops * 10;
+    }
+
+    snprintf(res->name, BENCH_NAME_LEN, "%s", name);
+    res->ns_per_op = secs * 1e9 / (double)ops;
+    res->bytes_per_op = bytes_per_op;
+    res->cycles_per_op = cycles / ops;
+    res->ops = ops;
+}
+
+
+//
+//  Kernels
+///
+
+static uint64_t bench_crc5(uint64_t ops)
+{
+    uint32_t acc = 0;
+    for (uint64_t i=0; i<ops; i++) {
+        acc += crc5_calc((uint16_t)(i & 0x7FF));
+    }
+    sink = acc;
+    return 0;
+}
+
+static uint8_t payload[MAX_PACKET_SIZE];
+
+static uint64_t bench_crc16(uint64_t ops)
+{
+    uint32_t acc = 0;
+    for (uint64_t i=0; i<ops; i++) {
+        payload[0] = (uint8_t)i;
+        acc += crc16_calc(payload, MAX_PACKET_SIZE);
+    }
+    sink = acc;
+    return 0;
+}
+
+/**
+ * Steps a PHY-side transmission to completion, with its outputs fed back as
+ * its inputs (as there is no link to respond).
+ */
+static uint64_t run_send(step_fn_t fn, transfer_t* xfer, ulpi_bus_t* bus)
+{
+    ulpi_bus_t out;
+    uint64_t cycles = 0;
+    int result;
+
+    ulpi_bus_idle(bus);
+    xfer->stage = NoXfer;
+    xfer->tx_ptr = 0;
+    do {
+        result = fn(xfer, bus, &out);
+        *bus = out;
+        cycles++;
+    } while (result == 0);
+
+    if (result < 0) {
+        printf("ERROR: step-function failed\n");
+        exit(1);
+    }
+    return cycles;
+}
+
+static uint64_t bench_token_send(uint64_t ops)
+{
+    transfer_t xfer = {0};
+    ulpi_bus_t bus;
+    uint64_t cycles = 0;
+
+    transfer_out(&xfer, 0x01, 2);
+    for (uint64_t i=0; i<ops; i++) {
+        xfer.type = OUT;
+        cycles += run_send(token_send_step, &xfer, &bus);
+    }
+    return cycles;
+}
+
+static uint64_t bench_datax_send(uint64_t ops)
+{
+    static transfer_t xfer;
+    ulpi_bus_t bus;
+    uint64_t cycles = 0;
+
+    memset(&xfer, 0, sizeof(transfer_t));
+    memcpy(xfer.tx, payload, MAX_PACKET_SIZE);
+    xfer.tx_len = MAX_PACKET_SIZE;
+    for (uint64_t i=0; i<ops; i++) {
+        xfer.type = DnDATA0;
+        cycles += run_send(datax_send_step, &xfer, &bus);
+    }
+    return cycles;
+}
+
+/**
+ * Bus trace of a link sending a max-sized DATA0 packet, followed by the PHY's
+ * end-of-packet RX CMDs, for replaying into 'datax_recv_step()'.
+ */
+static ulpi_bus_t recv_trace[MAX_PACKET_SIZE + 16];
+static int recv_len = 0;
+
+static void recv_cycle(bit_t dir, bit_t nxt, bit_t stp, uint8_t a, uint8_t b)
+{
+    ulpi_bus_t* bus = &recv_trace[recv_len++];
+    bus->clock = SIG1;
+    bus->rst_n = SIG1;
+    bus->dir = dir;
+    bus->nxt = nxt;
+    bus->stp = stp;
+    bus->data.a = a;
+    bus->data.b = b;
+}
+
+static void recv_trace_init(void)
+{
+    const uint16_t crc = crc16_calc(payload, MAX_PACKET_SIZE);
+
+    recv_len = 0;
+    recv_cycle(SIG0, SIG0, SIG0, ULPITX_DATA0, 0x00);
+    recv_cycle(SIG0, SIG1, SIG0, ULPITX_DATA0, 0x00);
+    for (int i=0; i<MAX_PACKET_SIZE; i++) {
+        recv_cycle(SIG0, SIG1, SIG0, payload[i], 0x00);
+    }
+    recv_cycle(SIG0, SIG1, SIG0, crc & 0xFF, 0x00);
+    recv_cycle(SIG0, SIG1, SIG0, crc >> 8, 0x00);
+    recv_cycle(SIG0, SIG0, SIG1, 0x00, 0x00);
+    recv_cycle(SIG1, SIG0, SIG0, 0x00, 0xFF);
+    recv_cycle(SIG1, SIG0, SIG0, 0x4C, 0x00);
+    recv_cycle(SIG1, SIG0, SIG0, 0x4D, 0x00);
+    recv_cycle(SIG0, SIG0, SIG0, 0x00, 0x00);
+}
+
+static uint64_t bench_datax_recv(uint64_t ops)
+{
+    static transfer_t xfer;
+    ulpi_bus_t out;
+    uint64_t cycles = 0;
+    int result = 0;
+
+    memset(&xfer, 0, sizeof(transfer_t));
+    for (uint64_t i=0; i<ops; i++) {
+        xfer.type = UpDATA0;
+        xfer.stage = NoXfer;
+        for (int j=0; j<recv_len; j++) {
+            result = datax_recv_step(&xfer, &recv_trace[j], &out);
+            if (result != 0) {
+                cycles += j + 1;
+                break;
+            }
+        }
+        if (result != 1 || xfer.rx_len != MAX_PACKET_SIZE) {
+            printf("ERROR: DATAx receive failed (%d)\n", result);
+            exit(1);
+        }
+    }
+    return cycles;
+}
+
+static uint64_t bench_host_idle(uint64_t ops)
+{
+    usb_host_t host;
+    ulpi_bus_t bus, out;
+
+    usbh_init(&host);
+    host.op = HostIdle;
+    ulpi_bus_idle(&bus);
+    for (uint64_t i=0; i<ops; i++) {
+        if (usbh_step(&host, &bus, &out) < 0) {
+            printf("ERROR: host-step failed\n");
+            exit(1);
+        }
+        bus = out;
+    }
+    return ops;
+}
+
+/**
+ * Back-to-back Bulk OUT transactions, each of a max-sized packet, and with an
+ * idle link, so each one waits for the 'ACK' to time-out.
+ */
+static uint64_t bench_host_active(uint64_t ops)
+{
+    usb_host_t host;
+    ulpi_bus_t bus, out, link;
+    uint64_t cycles = 0;
+
+    usbh_init(&host);
+    host.op = HostIdle;
+    host.addr = 1;
+    ulpi_bus_idle(&bus);
+    ulpi_bus_idle(&link);
+    for (uint64_t i=0; i<ops; i++) {
+        int result;
+        usbh_bulk_out(&host, 2, payload, MAX_PACKET_SIZE);
+        do {
+            result = usbh_step(&host, &bus, &out);
+            ulpi_bus_merge(&bus, &out, &link);
+            cycles++;
+        } while (result == 0);
+        if (result < 0) {
+            printf("ERROR: host-step failed\n");
+            exit(1);
+        }
+        host.op = HostIdle;
+    }
+    return cycles;
+}
+
+static uint64_t bench_phy(uint64_t ops)
+{
+    ulpi_phy_t* phy = phy_init();
+    ulpi_bus_t bus, out;
+
+    ulpi_bus_idle(&bus);
+    bus.rst_n = SIG0;
+    uphy_step(phy, &bus, &out);
+    bus.rst_n = SIG1;
+    for (uint64_t i=0; i<ops; i++) {
+        uphy_step(phy, &bus, &out);
+    }
+    sink = phy->state.op;
+    phy_free(phy);
+    return ops;
+}
+
+/**
+ * Full host <-> function loopback, of Bulk OUT -> IN bursts, so the cost per
+ * cycle includes the host, the function, and the bus-merging.
+ */
+static uint64_t bench_loopback(uint64_t ops)
+{
+    usb_loopback_t* lb = (usb_loopback_t*)malloc(sizeof(usb_loopback_t));
+    uint64_t cycles;
+
+    loopback_init(lb, 1);
+    if (loopback_enumerate(lb, 1) < 0) {
+        printf("ERROR: loopback enumeration failed\n");
+        exit(1);
+    }
+    cycles = lb->host.cycle;
+    if (loopback_bulk(lb, (int)ops) < 0) {
+        printf("ERROR: loopback failed\n");
+        exit(1);
+    }
+    cycles = lb->host.cycle - cycles;
+    loopback_free(lb);
+    free(lb);
+
+    return cycles;
+}
+
+
+//
+//  Baselines
+///
+
+static int save_baseline(const char* name)
+{
+    FILE* fp = fopen(name, "w");
+    if (fp == NULL) {
+        printf("ERROR: cannot write '%s'\n", name);
+        return -1;
+    }
+    fprintf(fp, "# kernel ns/op\n");
+    for (int i=0; i<num_results; i++) {
+        fprintf(fp, "%s %.3f\n", results[i].name, results[i].ns_per_op);
+    }
+    fclose(fp);
+    printf("\nBaseline written to '%s'\n", name);
+    return 0;
+}
+
+/**
+ * Returns the number of kernels that are slower than the baseline, by more
+ * than 'threshold' percent (or -1 if the baseline cannot be read).
+ */
+static int compare_baseline(const char* name, double threshold)
+{
+    FILE* fp = fopen(name, "r");
+    char line[128], kern[BENCH_NAME_LEN];
+    double base;
+    int slower = 0;
+
+    if (fp == NULL) {
+        printf("ERROR: cannot read '%s'\n", name);
+        return -1;
+    }
+
+    printf("\n%-20s %12s %12s %9s\n", "kernel", "base ns/op", "ns/op", "change");
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%31s %lf", kern, &base) != 2) {
+            continue;
+        }
+        for (int i=0; i<num_results; i++) {
+            if (strcmp(kern, results[i].name) != 0) {
+                continue;
+            }
+            const double pct = (results[i].ns_per_op - base) * 100.0 / base;
+            const int worse = pct > threshold;
+            printf("%-20s %12.2f %12.2f %+8.1f%%%s\n", kern, base,
+                   results[i].ns_per_op, pct, worse ? "  SLOWER" : "");
+            slower += worse;
+        }
+    }
+    fclose(fp);
+
+    return slower;
+}
+
+
+static void usage(const char* name)
+{
+    printf("Usage: %s [-T SECS] [-o BASELINE] [-c BASELINE] [-t PERCENT]\n", name);
+    printf("  -T SECS      minimum run-time of each kernel (default: 0.25)\n");
+    printf("  -o BASELINE  save the results as a baseline\n");
+    printf("  -c BASELINE  compare the results with a baseline\n");
+    printf("  -t PERCENT   slow-down that fails the comparison (default: 10)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* save = NULL;
+    const char* base = NULL;
+    double threshold = 10.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "T:o:c:t:h")) != -1) {
+        switch (opt) {
+        case 'T': min_secs = atof(optarg); break;
+        case 'o': save = optarg; break;
+        case 'c': base = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    ulpi_log_set(NULL);
+    for (int i=0; i<MAX_PACKET_SIZE; i++) {
+        payload[i] = (uint8_t)(i * 7 + 3);
+    }
+    recv_trace_init();
+
+    bench("crc5_calc", bench_crc5, 0.0);
+    bench("crc16_calc", bench_crc16, MAX_PACKET_SIZE);
+    bench("token_send_step", bench_token_send, 0.0);
+    bench("datax_send_step", bench_datax_send, MAX_PACKET_SIZE);
+    bench("datax_recv_step", bench_datax_recv, MAX_PACKET_SIZE);
+    bench("usbh_step_idle", bench_host_idle, 0.0);
+    bench("usbh_step_active", bench_host_active, MAX_PACKET_SIZE);
+    bench("uphy_step", bench_phy, 0.0);
+    bench("loopback_burst", bench_loopback, 0.0);
+
+    printf("%-20s %12s %12s %10s %12s\n", "kernel", "ns/op", "cycles/op",
+           "ns/cycle", "MB/s");
+    for (int i=0; i<num_results; i++) {
+        const bench_result_t* r = &results[i];
+        char cyc[16] = "-", per[16] = "-", mbs[16] = "-";
+
+        if (r->cycles_per_op > 0) {
+            snprintf(cyc, sizeof(cyc), "%lu", r->cycles_per_op);
+            snprintf(per, sizeof(per), "%.2f", r->ns_per_op / r->cycles_per_op);
+        }
+        if (r->bytes_per_op > 0.0) {
+            snprintf(mbs, sizeof(mbs), "%.1f", r->bytes_per_op * 1e3 / r->ns_per_op);
+        }
+        printf("%-20s %12.2f %12s %10s %12s\n", r->name, r->ns_per_op, cyc, per, mbs);
+    }
+
+    if (save != NULL && save_baseline(save) < 0) {
+        return 1;
+    }
+    if (base != NULL) {
+        int slower = compare_baseline(base, threshold);
+        if (slower != 0) {
+            printf("\n%s\n", slower < 0 ? "FAILED" : "Slower than the baseline");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,459 @@
+#include "ddr3shadow.h"
+#include "ulpi.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define PAGE_INDEX(a)  (((a) & SHADOW_ADDR_MASK) >> SHADOW_PAGE_BITS)
+#define PAGE_OFFSET(a) ((a) & (SHADOW_PAGE_SIZE - 1))
+#define PAGE_KNOWN(p, i) (((p)->known[(i) >> 3] & (1u << ((i) & 7))) != 0)
+
+#define DUMP_LINE      16
+
+
+/**
+ * Fibonacci hashing of the page-index, so that pages that are adjacent (the
+ * common case, for bursts) are spread across the table.
+ */
+static inline uint32_t shadow_hash(const ddr3_shadow_t* shadow, uint32_t index)
+{
+    return (index * 0x9E3779B1u) & (shadow->size - 1);
+}
+
+static shadow_page_t* shadow_find(const ddr3_shadow_t* shadow, uint32_t index)
+{
+    uint32_t slot = shadow_hash(shadow, index);
+    shadow_page_t* page;
+
+    while ((page = shadow->slots[slot]) != NULL) {
+        if (page->index == index) {
+            return page;
+        }
+        slot = (slot + 1) & (shadow->size - 1);
+    }
+    return NULL;
+}
+
+static void shadow_insert(ddr3_shadow_t* shadow, shadow_page_t* page)
+{
+    uint32_t slot = shadow_hash(shadow, page->index);
+
+    while (shadow->slots[slot] != NULL) {
+        slot = (slot + 1) & (shadow->size - 1);
+    }
+    shadow->slots[slot] = page;
+}
+
+static void shadow_grow(ddr3_shadow_t* shadow)
+{
+    shadow_page_t** slots = shadow->slots;
+    const uint32_t size = shadow->size;
+
+    shadow->size = size << 1;
+    shadow->slots = (shadow_page_t**)calloc(shadow->size, sizeof(shadow_page_t*));
+    for (uint32_t i=0; i<size; i++) {
+        if (slots[i] != NULL) {
+            shadow_insert(shadow, slots[i]);
+        }
+    }
+    free(slots);
+}
+
+/**
+ * Find the page containing 'addr', and (optionally) allocate it, if it has not
+ * been stored to yet.
+ */
+static shadow_page_t* shadow_page(ddr3_shadow_t* shadow, uint32_t addr, bool alloc)
+{
+    const uint32_t index = PAGE_INDEX(addr);
+    shadow_page_t* page = shadow->last;
+
+    if (page != NULL && page->index == index) {
+        return page;
+    }
+    page = shadow_find(shadow, index);
+
+    if (page == NULL && alloc) {
+        if ((shadow->pages + 1) * 4 > shadow->size * 3) {
+            shadow_grow(shadow);
+        }
+        page = (shadow_page_t*)calloc(1, sizeof(shadow_page_t));
+        page->index = index;
+        shadow_insert(shadow, page);
+        shadow->pages++;
+    }
+    if (page != NULL) {
+        shadow->last = page;
+    }
+
+    return page;
+}
+
+
+// -- Shadow Memory -- //
+
+void shadow_init(ddr3_shadow_t* shadow)
+{
+    memset(shadow, 0, sizeof(ddr3_shadow_t));
+    shadow->size = SHADOW_INIT_SLOTS;
+    shadow->slots = (shadow_page_t**)calloc(shadow->size, sizeof(shadow_page_t*));
+}
+
+void shadow_free(ddr3_shadow_t* shadow)
+{
+    if (shadow->slots == NULL) {
+        return;
+    }
+    for (uint32_t i=0; i<shadow->size; i++) {
+        free(shadow->slots[i]);
+    }
+    free(shadow->slots);
+    memset(shadow, 0, sizeof(ddr3_shadow_t));
+}
+
+/**
+ * Record the data of a STORE, which may span pages, and wraps at the top of the
+ * (28-bit) address space, as the memory-request addresses do.
+ */
+void shadow_store(ddr3_shadow_t* shadow, uint32_t addr, const uint8_t* data, size_t len)
+{
+    while (len > 0) {
+        shadow_page_t* page = shadow_page(shadow, addr, true);
+        const uint32_t off = PAGE_OFFSET(addr);
+        size_t num = SHADOW_PAGE_SIZE - off;
+
+        num = num < len ? num : len;
+        memcpy(&page->data[off], data, num);
+        for (uint32_t i=off; i<off+num; i++) {
+            page->known[i >> 3] |= 1u << (i & 7);
+        }
+
+        shadow->stored += num;
+        data += num;
+        len  -= num;
+        addr  = (addr + num) & SHADOW_ADDR_MASK;
+    }
+}
+
+/**
+ * Compare the data of a FETCH against the known bytes, and return the number
+ * of mismatches (with the first mismatch recorded, for the report).
+ */
+uint32_t shadow_check(ddr3_shadow_t* shadow, uint32_t addr, const uint8_t* data, size_t len)
+{
+    uint32_t errors = 0;
+
+    while (len > 0) {
+        shadow_page_t* page = shadow_page(shadow, addr, false);
+        const uint32_t off = PAGE_OFFSET(addr);
+        size_t num = SHADOW_PAGE_SIZE - off;
+
+        num = num < len ? num : len;
+        if (page == NULL) {
+            shadow->unknown += num;
+        } else {
+            for (uint32_t i=0; i<num; i++) {
+                const uint32_t j = off + i;
+
+                if (!PAGE_KNOWN(page, j)) {
+                    shadow->unknown++;
+                    continue;
+                }
+                shadow->checked++;
+                if (page->data[j] != data[i]) {
+                    if (shadow->errors == 0 && errors == 0) {
+                        shadow->bad_addr = (addr + i) & SHADOW_ADDR_MASK;
+                        shadow->bad_exp = page->data[j];
+                        shadow->bad_got = data[i];
+                    }
+                    errors++;
+                }
+            }
+        }
+
+        data += num;
+        len  -= num;
+        addr  = (addr + num) & SHADOW_ADDR_MASK;
+    }
+    shadow->errors += errors;
+
+    return errors;
+}
+
+bool shadow_known(const ddr3_shadow_t* shadow, uint32_t addr)
+{
+    const shadow_page_t* page = shadow_find(shadow, PAGE_INDEX(addr));
+    const uint32_t off = PAGE_OFFSET(addr);
+
+    return page != NULL && PAGE_KNOWN(page, off);
+}
+
+/**
+ * Copy out the stored data, with a 'known' flag per byte (where the unknown
+ * bytes read as zero), and return the number of known bytes.
+ */
+size_t shadow_read(ddr3_shadow_t* shadow, uint32_t addr, uint8_t* data, uint8_t* known, size_t len)
+{
+    size_t count = 0;
+
+    while (len > 0) {
+        const shadow_page_t* page = shadow_page(shadow, addr, false);
+        const uint32_t off = PAGE_OFFSET(addr);
+        size_t num = SHADOW_PAGE_SIZE - off;
+
+        num = num < len ? num : len;
+        for (uint32_t i=0; i<num; i++) {
+            const bool valid = page != NULL && PAGE_KNOWN(page, off + i);
+            data[i] = valid ? page->data[off + i] : 0;
+            known[i] = valid;
+            count += valid;
+        }
+
+        data  += num;
+        known += num;
+        len   -= num;
+        addr   = (addr + num) & SHADOW_ADDR_MASK;
+    }
+
+    return count;
+}
+
+/**
+ * Forget the data of a range of addresses (that remain allocated), so that it
+ * reads back as unknown; e.g., for banks that lose their contents.
+ */
+void shadow_erase(ddr3_shadow_t* shadow, uint32_t addr, size_t len)
+{
+    while (len > 0) {
+        shadow_page_t* page = shadow_page(shadow, addr, false);
+        const uint32_t off = PAGE_OFFSET(addr);
+        size_t num = SHADOW_PAGE_SIZE - off;
+
+        num = num < len ? num : len;
+        if (page != NULL && num == SHADOW_PAGE_SIZE) {
+            memset(page->known, 0, sizeof(page->known));
+        } else if (page != NULL) {
+            for (uint32_t i=off; i<off+num; i++) {
+                page->known[i >> 3] &= ~(1u << (i & 7));
+            }
+        }
+
+        len  -= num;
+        addr  = (addr + num) & SHADOW_ADDR_MASK;
+    }
+}
+
+static bool shadow_is_hex(const char* path)
+{
+    const char* ext = strrchr(path, '.');
+    return ext != NULL && strcmp(ext, ".hex") == 0;
+}
+
+/**
+ * Load a '$readmemh'-style file of bytes, with '@<address>' records, as written
+ * by 'shadow_dump()', else a raw binary image (stored at 'base').
+ * Returns the number of bytes loaded, or -1 on error.
+ */
+long shadow_load(ddr3_shadow_t* shadow, const char* path, uint32_t base)
+{
+    FILE* fp = fopen(path, "rb");
+    uint8_t buf[SHADOW_PAGE_SIZE];
+    uint32_t addr = base;
+    long total = 0;
+
+    if (fp == NULL) {
+        ulpi_printf("SHADOW\tcannot open '%s'\n", path);
+        return -1;
+    }
+
+    if (shadow_is_hex(path)) {
+        char tok[32];
+        char* end;
+
+        while (fscanf(fp, "%31s", tok) == 1) {
+            if (tok[0] == '/' && tok[1] == '/') {
+                int c;
+                while ((c = fgetc(fp)) != EOF && c != '\n') {}
+                continue;
+            }
+
+            const unsigned long val = strtoul(tok[0] == '@' ? &tok[1] : tok, &end, 16);
+            if (*end != '\0') {
+                ulpi_printf("SHADOW\tinvalid token '%s' in '%s'\n", tok, path);
+                fclose(fp);
+                return -1;
+            } else if (tok[0] == '@') {
+                addr = (uint32_t)val & SHADOW_ADDR_MASK;
+            } else {
+                buf[0] = (uint8_t)val;
+                shadow_store(shadow, addr, buf, 1);
+                addr = (addr + 1) & SHADOW_ADDR_MASK;
+                total++;
+            }
+        }
+    } else {
+        size_t num;
+        while ((num = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            shadow_store(shadow, addr, buf, num);
+            addr = (addr + num) & SHADOW_ADDR_MASK;
+            total += (long)num;
+        }
+    }
+
+    fclose(fp);
+    return total;
+}
+
+static int page_compare(const void* a, const void* b)
+{
+    const uint32_t x = (*(shadow_page_t* const*)a)->index;
+    const uint32_t y = (*(shadow_page_t* const*)b)->index;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Write the known bytes, in address order, as a '$readmemh'-style file, with an
+ * '@<address>' record at the start of each run of known bytes.
+ * Returns the number of bytes written, or -1 on error.
+ */
+long shadow_dump(const ddr3_shadow_t* shadow, const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    shadow_page_t** pages;
+    uint32_t num = 0;
+    uint32_t next = ~0u;
+    long total = 0;
+    int col = 0;
+
+    if (fp == NULL) {
+        ulpi_printf("SHADOW\tcannot create '%s'\n", path);
+        return -1;
+    }
+
+    pages = (shadow_page_t**)malloc((shadow->pages + 1) * sizeof(shadow_page_t*));
+    for (uint32_t i=0; i<shadow->size; i++) {
+        if (shadow->slots[i] != NULL) {
+            pages[num++] = shadow->slots[i];
+        }
+    }
+    qsort(pages, num, sizeof(shadow_page_t*), page_compare);
+
+    for (uint32_t p=0; p<num; p++) {
+        const shadow_page_t* page = pages[p];
+        const uint32_t base = page->index << SHADOW_PAGE_BITS;
+
+        for (uint32_t i=0; i<SHADOW_PAGE_SIZE; i++) {
+            if (!PAGE_KNOWN(page, i)) {
+                continue;
+            }
+            if (base + i != next || col == DUMP_LINE) {
+                fprintf(fp, "%s", col > 0 ? "\n" : "");
+                if (base + i != next) {
+                    fprintf(fp, "@%07x\n", base + i);
+                }
+                col = 0;
+            }
+            fprintf(fp, "%s%02x", col > 0 ? " " : "", page->data[i]);
+            next = base + i + 1;
+            col++;
+            total++;
+        }
+    }
+    if (col > 0) {
+        fprintf(fp, "\n");
+    }
+
+    free(pages);
+    return fclose(fp) == 0 ? total : -1;
+}
+
+/**
+ * Memory used by the shadow, which is proportional to the pages touched.
+ */
+size_t shadow_bytes(const ddr3_shadow_t* shadow)
+{
+    return (size_t)shadow->pages * sizeof(shadow_page_t) +
+        (size_t)shadow->size * sizeof(shadow_page_t*);
+}
+
+void shadow_show(const ddr3_shadow_t* shadow, const char* name)
+{
+    ulpi_printf("SHADOW\t%s: %lu bytes stored, %lu checked, %lu unknown, %lu errors"
+                " (%u pages, %lu bytes)\n", name, shadow->stored, shadow->checked,
+                shadow->unknown, shadow->errors, shadow->pages, shadow_bytes(shadow));
+    if (shadow->errors > 0) {
+        ulpi_printf("SHADOW\t%s: first mismatch at 0x%07x (expected: 0x%02x, got: 0x%02x)\n",
+                    name, shadow->bad_addr, shadow->bad_exp, shadow->bad_got);
+    }
+}
+
+
+// -- Unit Tests -- //
+
+/**
+ * Random STOREs (some crossing pages, and the top of the address space) across
+ * the whole address space, checked against a flat model of the same pages.
+ */
+void test_shadow(void)
+{
+    ddr3_shadow_t shadow;
+    uint8_t buf[1024];
+    uint8_t got[1024];
+    uint8_t known[8];
+    uint32_t bases[16];
+    uint32_t seed = 0x5EED0045u;
+
+    ulpi_printf("Testing DDR3 shadow-memory");
+
+    shadow_init(&shadow);
+    for (int i=0; i<16; i++) {
+        bases[i] = ulpi_rand(&seed) & SHADOW_ADDR_MASK & ~(SHADOW_PAGE_SIZE - 1);
+    }
+    bases[15] = SHADOW_ADDR_MASK & ~(SHADOW_PAGE_SIZE - 1);
+
+    // Nothing is known, so nothing mismatches
+    memset(got, 0xA5, sizeof(got));
+    assert(shadow_check(&shadow, bases[0], got, sizeof(got)) == 0);
+    assert(shadow.unknown == sizeof(got) && shadow.pages == 0);
+
+    // Each burst ends at most 1 KiB into the next page
+    for (int i=0; i<4096; i++) {
+        const uint32_t base = bases[ulpi_rand(&seed) & 15];
+        const uint32_t addr = base + ulpi_rand(&seed) % SHADOW_PAGE_SIZE;
+        const size_t len = 1 + (size_t)ulpi_rand(&seed) % sizeof(buf);
+
+        for (size_t j=0; j<len; j++) {
+            buf[j] = (uint8_t)ulpi_rand(&seed);
+        }
+        shadow_store(&shadow, addr, buf, len);
+        memcpy(got, buf, len);
+        assert(shadow_check(&shadow, addr, got, len) == 0);
+    }
+    assert(shadow.pages <= 32 && shadow.stored > 0 && shadow.errors == 0);
+    assert(shadow_bytes(&shadow) < 33 * sizeof(shadow_page_t) + 64 * sizeof(void*));
+
+    // Wrapping at the top of the address space
+    memset(buf, 0x3C, 8);
+    shadow_store(&shadow, SHADOW_ADDR_MASK - 3, buf, 8);
+    assert(shadow_known(&shadow, SHADOW_ADDR_MASK) && shadow_known(&shadow, 3));
+
+    // Corrupt a byte, and find it
+    memcpy(got, buf, 8);
+    got[5] ^= 0x10;
+    assert(shadow_check(&shadow, SHADOW_ADDR_MASK - 3, got, 8) == 1);
+    assert(shadow.errors == 1 && shadow.bad_addr == 1);
+    assert(shadow.bad_exp == 0x3C && shadow.bad_got == 0x2C);
+
+    // Read back, then erase across the top of the address space
+    assert(shadow_read(&shadow, SHADOW_ADDR_MASK - 3, got, known, 8) == 8);
+    assert(memcmp(got, buf, 8) == 0);
+    shadow_erase(&shadow, SHADOW_ADDR_MASK - 1, 4);
+    assert(shadow_read(&shadow, SHADOW_ADDR_MASK - 3, got, known, 8) == 4);
+    assert(known[1] && !known[2] && !known[5] && known[6] && got[2] == 0x00);
+
+    shadow_free(&shadow);
+    ulpi_printf("\t\tSUCCESS\n");
+}
@@ -0,0 +1,69 @@
+#ifndef __DDR3SHADOW_H__
+#define __DDR3SHADOW_H__
+/**
+ * Sparse shadow-memory, of the DDR3 contents, that records the data of every
+ * STORE, and checks the data of every FETCH, across the whole (28-bit) address
+ * space of the memory-requests.
+ * NOTE:
+ *  - 4 KiB pages are allocated as they are first stored to, and are found via
+ *    an open-addressed hash-table (that doubles when 3/4 full), so look-ups are
+ *    O(1), and the memory used is proportional to the pages touched;
+ *  - each byte has a 'known' bit, and only known bytes are checked, so FETCHes
+ *    of memory that was never stored to (in this run) are not errors;
+ *  - the same paged storage also backs the DDR3 bench model ('ddr3mem.c'),
+ *    which is why the shadow can be read back, erased, loaded, and dumped;
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define SHADOW_PAGE_BITS  12
+#define SHADOW_PAGE_SIZE  (1u << SHADOW_PAGE_BITS)
+#define SHADOW_ADDR_MASK  0x0FFFFFFFu
+#define SHADOW_INIT_SLOTS 64
+
+
+typedef struct {
+    uint32_t index;             // address >> SHADOW_PAGE_BITS
+    uint8_t known[SHADOW_PAGE_SIZE / 8];
+    uint8_t data[SHADOW_PAGE_SIZE];
+} shadow_page_t;
+
+typedef struct {
+    shadow_page_t** slots;
+    uint32_t size;              // number of slots (a power of 2)
+    uint32_t pages;
+    shadow_page_t* last;        // most-recently used page
+    // Totals
+    uint64_t stored;
+    uint64_t checked;           // known bytes that were compared
+    uint64_t unknown;           // bytes fetched that were never stored
+    uint64_t errors;
+    // First mismatch
+    uint32_t bad_addr;
+    uint8_t bad_exp;
+    uint8_t bad_got;
+} ddr3_shadow_t;
+
+
+void shadow_init(ddr3_shadow_t* shadow);
+void shadow_free(ddr3_shadow_t* shadow);
+
+void shadow_store(ddr3_shadow_t* shadow, uint32_t addr, const uint8_t* data, size_t len);
+uint32_t shadow_check(ddr3_shadow_t* shadow, uint32_t addr, const uint8_t* data, size_t len);
+bool shadow_known(const ddr3_shadow_t* shadow, uint32_t addr);
+size_t shadow_read(ddr3_shadow_t* shadow, uint32_t addr, uint8_t* data, uint8_t* known, size_t len);
+void shadow_erase(ddr3_shadow_t* shadow, uint32_t addr, size_t len);
+
+long shadow_load(ddr3_shadow_t* shadow, const char* path, uint32_t base);
+long shadow_dump(const ddr3_shadow_t* shadow, const char* path);
+
+size_t shadow_bytes(const ddr3_shadow_t* shadow);
+void shadow_show(const ddr3_shadow_t* shadow, const char* name);
+
+void test_shadow(void);
+
+
+#endif  /* __DDR3SHADOW_H__ */
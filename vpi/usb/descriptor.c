@@ -1,6 +1,10 @@
 #include "descriptor.h"
+#include "stdreq.h"
+
+#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 
 void show_desc(transfer_t* xfer)
@@ -8,11 +12,11 @@ void show_desc(transfer_t* xfer)
     if (xfer->rx_len < 0 || xfer->rx_len > MAX_CONFIG_SIZE) {
         return;
     }
-    printf("USB_DESCRIPTOR[%d] = {\n", xfer->rx_len);
+    ulpi_printf("USB_DESCRIPTOR[%d] = {\n", xfer->rx_len);
     for (int i=0; i<xfer->rx_len; i++) {
-        printf(" 0x%X, ", xfer->rx[i]);
+        ulpi_printf(" 0x%X, ", xfer->rx[i]);
     }
-    printf("\n};\n");
+    ulpi_printf("\n};\n");
 }
 
 
@@ -22,18 +26,18 @@ void show_desc(transfer_t* xfer)
 int desc_recv(transfer_t* xfer, const ulpi_bus_t* in)
 {
     if (xfer->type < UpDATA0 || in->dir != SIG0 || in->nxt > SIG1 || in->stp > SIG1) {
-        printf("ERROR: Bus not in recieve-mode\n");
+        ulpi_printf("ERROR: Bus not in recieve-mode\n");
         return -1;
     } else if (in->nxt != SIG1) {
         // Wait-state ignore
-        // printf(".");
+        // ulpi_printf(".");
         return 0;
     }
 
     switch ((xfer_stage_t)xfer->stage) {
     case DATAxPID:
         if (!check_pid(in) || !check_seq(xfer, in->data.a & 0x0F)) {
-            printf("[%s:%d] Invalid PID value\n", __FILE__, __LINE__);
+            ulpi_printf("[%s:%d] Invalid PID value\n", __FILE__, __LINE__);
             return -1;
         }
         xfer->stage = DATAxBody;
@@ -44,9 +48,17 @@ int desc_recv(transfer_t* xfer, const ulpi_bus_t* in)
     case DATAxCRC1:
     case DATAxCRC2:
         if (in->nxt == SIG1) {
+            if (xfer->rx_ptr >= MAX_PACKET_SIZE + 2) {
+                ulpi_printf("[%s:%d] Descriptor too long\n", __FILE__, __LINE__);
+                return -1;
+            }
             xfer->rx[xfer->rx_ptr++] = in->data.a;
         }
         if (in->stp == SIG1) {
+            if (xfer->rx_ptr < 2) {
+                ulpi_printf("[%s:%d] Descriptor too short\n", __FILE__, __LINE__);
+                return -1;
+            }
             xfer->stage = DATAxStop;
             xfer->rx_len = xfer->rx_ptr - 2;
             return 1;
@@ -55,7 +67,7 @@ int desc_recv(transfer_t* xfer, const ulpi_bus_t* in)
 
     case DATAxStop:
         if (in->nxt != SIG0) {
-            printf("Unexpected assertion of STP\n");
+            ulpi_printf("Unexpected assertion of STP\n");
             return -1;
         }
         xfer->stage = EndRXCMD;
@@ -63,11 +75,11 @@ int desc_recv(transfer_t* xfer, const ulpi_bus_t* in)
 
     case EndRXCMD:
     case EOP:
-        printf("WARN: transfer has already finished\n");
+        ulpi_printf("WARN: transfer has already finished\n");
         return 1;
 
     default:
-        printf("Unexpected command-stage: %u\n", xfer->stage);
+        ulpi_printf("Unexpected command-stage: %u\n", xfer->stage);
         return -1;
     }
 
@@ -75,6 +87,117 @@ int desc_recv(transfer_t* xfer, const ulpi_bus_t* in)
 }
 
 
+// -- Descriptor Parsing -- //
+
+/**
+ * Parse the device descriptor, for the EP0 packet-size, and the vendor and
+ * product IDs.
+ */
+int desc_parse_device(usb_eptab_t* tab, const uint8_t* buf, int len)
+{
+    if (len < 8 || buf[0] < 8 || buf[1] != DESC_DEVICE) {
+        ulpi_printf("[%s:%d] Invalid device descriptor\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    tab->max_packet0 = buf[7];
+    if (len >= 12 && buf[0] >= 12) {
+        tab->vendor = (uint16_t)buf[9] << 8 | buf[8];
+        tab->product = (uint16_t)buf[11] << 8 | buf[10];
+    }
+
+    return 0;
+}
+
+/**
+ * Parse the configuration descriptor, and the interface and endpoint
+ * descriptors that follow it, into the endpoint table, and returns the number
+ * of endpoints found.
+ *
+ * Note: for a partial read (e.g., just the first 9 bytes, to get the total
+ *   length), only the complete endpoint descriptors are added.
+ */
+int desc_parse_config(usb_eptab_t* tab, const uint8_t* buf, int len)
+{
+    uint8_t iface = 0;
+
+    if (len < 9 || buf[0] < 9 || buf[1] != DESC_CONFIGURATION) {
+        ulpi_printf("[%s:%d] Invalid configuration descriptor\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    tab->total = (uint16_t)buf[3] << 8 | buf[2];
+    tab->num_ifaces = buf[4];
+    tab->config = buf[5];
+    tab->num_eps = 0;
+
+    if (tab->total < len) {
+        len = tab->total;
+    }
+
+    for (int i=buf[0]; i+2<=len; i+=buf[i]) {
+        const uint8_t* desc = &buf[i];
+
+        if (desc[0] >= 2 && i + desc[0] > len && len < tab->total) {
+            break;
+        } else if (desc[0] < 2 || i + desc[0] > len) {
+            ulpi_printf("[%s:%d] Invalid descriptor length: %u (at %d)\n",
+                        __FILE__, __LINE__, desc[0], i);
+            return -1;
+        }
+
+        if (desc[1] == DESC_INTERFACE && desc[0] >= 9) {
+            iface = desc[2];
+        } else if (desc[1] == DESC_ENDPOINT && desc[0] >= 7) {
+            if (tab->num_eps >= USB_MAX_ENDPOINTS) {
+                ulpi_printf("[%s:%d] Too many endpoints\n", __FILE__, __LINE__);
+                return -1;
+            }
+            usb_endpoint_t* ep = &tab->eps[tab->num_eps++];
+            ep->address = desc[2];
+            ep->type = desc[3] & 0x03;
+            ep->max_packet = ((uint16_t)desc[5] << 8 | desc[4]) & 0x07FF;
+            ep->interface = iface;
+            ep->interval = desc[6];
+        }
+    }
+
+    return tab->num_eps;
+}
+
+/**
+ * Find the 'nth' endpoint (counting from 0) with the given direction and type,
+ * in descriptor order.
+ */
+const usb_endpoint_t* desc_endpoint(const usb_eptab_t* tab, uint8_t dir, uint8_t type, int nth)
+{
+    for (int i=0; i<tab->num_eps; i++) {
+        const usb_endpoint_t* ep = &tab->eps[i];
+        if ((ep->address & EP_DIR_IN) == dir && ep->type == type && nth-- == 0) {
+            return ep;
+        }
+    }
+    return NULL;
+}
+
+void show_eptab(const usb_eptab_t* tab)
+{
+    static const char types[4][8] = {"Control", "Isoch", "Bulk", "Intr"};
+
+    ulpi_printf("USB_ENDPOINTS = {\n");
+    ulpi_printf("  device: %04x:%04x, EP0: %u, config: %u, interfaces: %u,\n",
+                tab->vendor, tab->product, tab->max_packet0, tab->config,
+                tab->num_ifaces);
+    for (int i=0; i<tab->num_eps; i++) {
+        const usb_endpoint_t* ep = &tab->eps[i];
+        ulpi_printf("  EP%u %s: { type: %s, max_packet: %u, interface: %u },\n",
+                    ep->address & 0x0F, ep->address & EP_DIR_IN ? "IN " : "OUT",
+                    types[ep->type], ep->max_packet, ep->interface);
+    }
+    ulpi_printf("};\n");
+}
+
+
 void test_desc_recv(void)
 {
     transfer_t xfer = {0};
@@ -99,12 +222,12 @@ void test_desc_recv(void)
     xfer.ep_seq[0] = 1;
     xfer.rx_len = 64;
 
-    printf("Testing 'GET DESCRIPTOR'");
+    ulpi_printf("Testing 'GET DESCRIPTOR'");
     do {
         result = desc_recv(&xfer, &bus);
 
         if (xfer.stage == DATAxBody) {
-            printf(".");
+            ulpi_printf(".");
             bus.data.a = packet[index++];
             if (index >= length) {
                 bus.stp = SIG1;
@@ -115,10 +238,51 @@ void test_desc_recv(void)
     } while (result == 0);
 
     if (result < 0) {
-        printf("\t\tERROR\n");
+        ulpi_printf("\t\tERROR\n");
     } else if (result > 0) {
-        printf("\t\tSUCCESS\n");
+        ulpi_printf("\t\tSUCCESS\n");
     } else {
-        printf("\t\tHAIL SEITAN\n");
+        ulpi_printf("\t\tHAIL SEITAN\n");
     }
 }
+
+void test_desc_parse(void)
+{
+    usb_eptab_t tab = {0};
+    const usb_endpoint_t* ep;
+    const uint8_t device[18] = {
+        0x12, 0x01, 0x00, 0x02, 0xFF, 0x00, 0x00, 0x40,
+        0xCE, 0xFA, 0xDE, 0x0B, 0x00, 0x00, 0x01, 0x02,
+        0x03, 0x01,
+    };
+    uint8_t config[46] = {
+        0x09, 0x02, 0x2E, 0x00, 0x01, 0x01, 0x00, 0xC0, 0x32,
+        0x09, 0x04, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+        0x07, 0x05, 0x02, 0x02, 0x00, 0x02, 0x00,
+        0x07, 0x05, 0x81, 0x02, 0x00, 0x02, 0x00,
+        0x07, 0x05, 0x83, 0x02, 0x40, 0x00, 0x00,
+        0x07, 0x05, 0x05, 0x02, 0x00, 0x02, 0x00,
+    };
+
+    ulpi_printf("Testing descriptor parsing");
+    assert(desc_parse_device(&tab, device, sizeof(device)) == 0);
+    assert(tab.max_packet0 == 64 && tab.vendor == 0xFACE && tab.product == 0x0BDE);
+
+    // Just the configuration descriptor, for its total length
+    assert(desc_parse_config(&tab, config, 9) == 0);
+    assert(tab.total == sizeof(config) && tab.config == 1);
+
+    assert(desc_parse_config(&tab, config, sizeof(config)) == 4);
+    ep = desc_endpoint(&tab, EP_DIR_IN, EP_TYPE_BULK, 1);
+    assert(ep != NULL && ep->address == 0x83 && ep->max_packet == 64);
+    ep = desc_endpoint(&tab, 0x00, EP_TYPE_BULK, 0);
+    assert(ep != NULL && ep->address == 0x02 && ep->max_packet == 512);
+    assert(desc_endpoint(&tab, 0x00, EP_TYPE_BULK, 2) == NULL);
+    assert(desc_endpoint(&tab, EP_DIR_IN, EP_TYPE_INTERRUPT, 0) == NULL);
+
+    // Partial read, and then an invalid descriptor length
+    assert(desc_parse_config(&tab, config, 38) == 2);
+    config[32] = 0x00;
+    assert(desc_parse_config(&tab, config, sizeof(config)) < 0);
+    ulpi_printf("\t\tSUCCESS\n");
+}
@@ -5,9 +5,54 @@
 #include "ulpi.h"
 
 
+#define USB_MAX_ENDPOINTS 30
+
+#define EP_TYPE_CONTROL   0
+#define EP_TYPE_ISOCH     1
+#define EP_TYPE_BULK      2
+#define EP_TYPE_INTERRUPT 3
+
+#define EP_DIR_IN         0x80
+
+
+/**
+ * Endpoint, as given by its USB endpoint descriptor.
+ */
+typedef struct {
+    uint8_t address;            // 'bEndpointAddress', bit 7 set for IN
+    uint8_t type;               // 'bmAttributes[1:0]'
+    uint16_t max_packet;        // 'wMaxPacketSize[10:0]'
+    uint8_t interface;
+    uint8_t interval;
+} usb_endpoint_t;
+
+/**
+ * Endpoint table, and the device properties, parsed from the device and
+ * configuration descriptors; e.g., so that the host can discover the endpoints
+ * of the core, instead of assuming them.
+ */
+typedef struct {
+    uint16_t vendor;
+    uint16_t product;
+    uint8_t max_packet0;
+    uint8_t config;             // 'bConfigurationValue'
+    uint16_t total;             // 'wTotalLength'
+    uint8_t num_ifaces;
+    uint8_t num_eps;
+    usb_endpoint_t eps[USB_MAX_ENDPOINTS];
+} usb_eptab_t;
+
+
 void show_desc(transfer_t* xfer);
 int desc_recv(transfer_t* xfer, const ulpi_bus_t* in);
+
+int desc_parse_device(usb_eptab_t* tab, const uint8_t* buf, int len);
+int desc_parse_config(usb_eptab_t* tab, const uint8_t* buf, int len);
+const usb_endpoint_t* desc_endpoint(const usb_eptab_t* tab, uint8_t dir, uint8_t type, int nth);
+void show_eptab(const usb_eptab_t* tab);
+
 void test_desc_recv(void);
+void test_desc_parse(void);
 
 
 #endif  /* __DESCRIPTOR_H__ */
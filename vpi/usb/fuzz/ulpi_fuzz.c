@@ -0,0 +1,660 @@
+/**
+ * In-process fuzz-target for the ULPI step-functions, which decodes a byte-
+ * stream into ULPI bus cycles, and feeds these straight into the receive (and
+ * token) state-machines, the function (link) model, and the PHY model.
+ *
+ * Input format:
+ *   byte 0   --  selects the target step-function;
+ *   byte 1   --  target flags (sequence bit, and token-type);
+ *   then each cycle is two bytes:
+ *     [0]    --  {3'bx, data.b is Z, rst_n, stp, nxt, dir}; and
+ *     [1]    --  data.a
+ *
+ * NOTE:
+ *  - when built with clang's libFuzzer, only 'LLVMFuzzerTestOneInput()' is
+ *    provided, and libFuzzer handles the corpus, crashes, and minimisation;
+ *  - otherwise, a stand-alone driver is built, that uses GCC's 'trace-pc'
+ *    coverage to guide its mutations, writes 'crash-<hash>' reproducers, and
+ *    minimises these (with '-m'), by re-running candidates in child processes;
+ *  - each step-function is O(1) per cycle, and the number of cycles is capped,
+ *    so an input cannot hang the harness;
+ */
+#include "../descriptor.h"
+#include "../usbcrc.h"
+#include "../ulpiphy.h"
+#include "../usbfunc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define FUZZ_MAX_CYCLES 4096
+#define FUZZ_MAX_LEN    (2 + 2 * FUZZ_MAX_CYCLES)
+
+typedef enum {
+    FuzzDescRecv,
+    FuzzDataxRecv,
+    FuzzAckRecv,
+    FuzzTokenSend,
+    FuzzAckSend,
+    FuzzFuncStep,
+    FuzzPhyStep,
+    FuzzNumTargets,
+} fuzz_target_t;
+
+
+//
+//  Fuzz-Target
+///
+
+static void fuzz_invariant(int cond, const char* mesg)
+{
+    if (!cond) {
+        fprintf(stderr, "FUZZ: invariant failed: %s\n", mesg);
+        abort();
+    }
+}
+
+static void check_xfer(const transfer_t* xfer)
+{
+    fuzz_invariant(xfer->type <= TimeOut, "transfer-type in range");
+    fuzz_invariant(xfer->stage <= LineIdle, "transfer-stage in range");
+    fuzz_invariant(xfer->rx_ptr >= 0 && xfer->rx_ptr <= (int)MAX_PACKET_SIZE + 2,
+                   "receive-pointer within the buffer");
+    fuzz_invariant(xfer->rx_len >= -1 && xfer->rx_len <= (int)MAX_PACKET_SIZE,
+                   "received length within the buffer");
+}
+
+/**
+ * Arm the transfer for the selected step-function, as if the host/PHY had
+ * just issued the corresponding token.
+ */
+static void fuzz_arm(transfer_t* xfer, fuzz_target_t target, uint8_t flags)
+{
+    static const uint8_t tokens[4] = {SETUP, OUT, IN, SOF};
+
+    memset(xfer, 0, sizeof(transfer_t));
+    xfer->ep_seq[0] = flags & 0x01;
+    xfer->cycle = 40;
+
+    switch (target) {
+    case FuzzDescRecv:
+        xfer->type = (flags & 0x01) ? UpDATA1 : UpDATA0;
+        xfer->stage = DATAxPID;
+        break;
+    case FuzzDataxRecv:
+        xfer->type = (flags & 0x01) ? UpDATA1 : UpDATA0;
+        break;
+    case FuzzAckRecv:
+        xfer->type = UpACK;
+        break;
+    case FuzzTokenSend:
+        xfer->type = tokens[(flags >> 1) & 0x03];
+        transfer_tok(xfer);
+        break;
+    case FuzzAckSend:
+        xfer->type = DnACK;
+        break;
+    default:
+        break;
+    }
+}
+
+static void fuzz_bus(ulpi_bus_t* bus, const uint8_t* cyc)
+{
+    bus->clock = SIG1;
+    bus->dir = cyc[0] & 0x01;
+    bus->nxt = (cyc[0] >> 1) & 0x01;
+    bus->stp = (cyc[0] >> 2) & 0x01;
+    bus->rst_n = (cyc[0] & 0x08) ? SIG0 : SIG1;
+    bus->data.a = cyc[1];
+    bus->data.b = (cyc[0] & 0x10) ? 0xFF : 0x00;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    static usb_func_t func;
+    static transfer_t xfer;
+    ulpi_phy_t* phy = NULL;
+    ulpi_bus_t bus, out;
+    int result;
+
+    if (size < 2) {
+        return 0;
+    }
+    ulpi_log_set(NULL);
+
+    const fuzz_target_t target = data[0] % FuzzNumTargets;
+    const uint8_t flags = data[1];
+    size_t cycles = (size - 2) / 2;
+    if (cycles > FUZZ_MAX_CYCLES) {
+        cycles = FUZZ_MAX_CYCLES;
+    }
+
+    fuzz_arm(&xfer, target, flags);
+    if (target == FuzzFuncStep) {
+        usbf_init(&func);
+        usbf_policy(&func, flags >> 4, flags & 0x08);
+    } else if (target == FuzzPhyStep) {
+        phy = phy_init();
+    }
+
+    for (size_t i=0; i<cycles; i++) {
+        fuzz_bus(&bus, &data[2 + 2*i]);
+        memset(&out, 0, sizeof(ulpi_bus_t));
+
+        switch (target) {
+        case FuzzDescRecv:
+            result = desc_recv(&xfer, &bus);
+            break;
+        case FuzzDataxRecv:
+            result = datax_recv_step(&xfer, &bus, &out);
+            break;
+        case FuzzAckRecv:
+            result = ack_recv_step(&xfer, &bus, &out);
+            break;
+        case FuzzTokenSend:
+            result = token_send_step(&xfer, &bus, &out);
+            break;
+        case FuzzAckSend:
+            result = ack_send_step(&xfer, &bus, &out);
+            break;
+        case FuzzFuncStep:
+            result = usbf_step(&func, &bus, &out);
+            fuzz_invariant(func.fifo.count <= FUNC_FIFO_DEPTH, "FIFO depth");
+            fuzz_invariant(func.fifo.level <= FUNC_FIFO_SIZE, "FIFO level");
+            fuzz_invariant(func.ctl_ptr <= func.ctl_len &&
+                           func.ctl_len <= MAX_CONFIG_SIZE, "control buffer");
+            check_xfer(&func.xfer);
+            break;
+        default:
+            result = uphy_step(phy, &bus, &out);
+            fuzz_invariant(phy->state.regnum < UPHY_NUM_REGS, "PHY register");
+            break;
+        }
+
+        if (target < FuzzFuncStep) {
+            check_xfer(&xfer);
+            if (result != 0) {
+                // Completed, or failed, so re-arm and keep going
+                fuzz_arm(&xfer, target, flags);
+            }
+        }
+    }
+
+    if (phy != NULL) {
+        phy_free(phy);
+    }
+
+    return 0;
+}
+
+
+#ifndef __libfuzzer
+//
+//  Stand-Alone Driver
+///
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define COV_MAP_SIZE  (1 << 16)
+#define CORPUS_SIZE   4096
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+} fuzz_input_t;
+
+static uint8_t cov_map[COV_MAP_SIZE];
+static uint8_t cov_seen[COV_MAP_SIZE];
+
+static fuzz_input_t corpus[CORPUS_SIZE];
+static int corpus_num = 0;
+
+static const uint8_t* curr_data = NULL;
+static size_t curr_size = 0;
+static const char* out_dir = ".";
+static uint32_t rng = 1u;
+
+
+/**
+ * Called, by GCC's '-fsanitize-coverage=trace-pc' instrumentation, at the
+ * start of every basic-block of the models.
+ */
+void __sanitizer_cov_trace_pc(void)
+{
+    uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+    cov_map[(pc ^ (pc >> 16)) & (COV_MAP_SIZE - 1)]++;
+}
+
+/**
+ * Bucket the hit-counts (like AFL), so that loop-iteration counts don't all
+ * look like new coverage.
+ */
+static uint8_t cov_bucket(uint8_t n)
+{
+    return n == 0 ? 0 : n < 2 ? 1 : n < 3 ? 2 : n < 4 ? 4 : n < 8 ? 8 :
+        n < 16 ? 16 : n < 32 ? 32 : n < 128 ? 64 : 128;
+}
+
+static int run_input(const uint8_t* data, size_t size)
+{
+    int fresh = 0;
+
+    memset(cov_map, 0, sizeof(cov_map));
+    curr_data = data;
+    curr_size = size;
+    LLVMFuzzerTestOneInput(data, size);
+    curr_data = NULL;
+
+    for (int i=0; i<COV_MAP_SIZE; i++) {
+        uint8_t b = cov_bucket(cov_map[i]);
+        if ((b & ~cov_seen[i]) != 0) {
+            cov_seen[i] |= b;
+            fresh = 1;
+        }
+    }
+
+    return fresh;
+}
+
+static uint32_t fnv1a(const uint8_t* data, size_t size)
+{
+    uint32_t h = 0x811C9DC5u;
+    for (size_t i=0; i<size; i++) {
+        h = (h ^ data[i]) * 0x01000193u;
+    }
+    return h;
+}
+
+static int write_file(const char* name, const uint8_t* data, size_t size)
+{
+    FILE* fp = fopen(name, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+    return 0;
+}
+
+static uint8_t* read_file(const char* name, size_t* size)
+{
+    FILE* fp = fopen(name, "rb");
+    uint8_t* data = (uint8_t*)malloc(FUZZ_MAX_LEN);
+
+    if (fp == NULL) {
+        free(data);
+        return NULL;
+    }
+    *size = fread(data, 1, FUZZ_MAX_LEN, fp);
+    fclose(fp);
+
+    return data;
+}
+
+/**
+ * Save the current input, as a reproducer, and then let the signal terminate
+ * the process.
+ */
+static void crash_handler(int sig)
+{
+    char name[512];
+
+    if (curr_data != NULL) {
+        snprintf(name, sizeof(name), "%s/crash-%08x", out_dir,
+                 fnv1a(curr_data, curr_size));
+        write_file(name, curr_data, curr_size);
+        fprintf(stderr, "FUZZ: signal %d, reproducer written to '%s'\n", sig, name);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void corpus_add(const uint8_t* data, size_t size)
+{
+    if (corpus_num >= CORPUS_SIZE) {
+        return;
+    }
+    corpus[corpus_num].data = (uint8_t*)malloc(size);
+    corpus[corpus_num].size = size;
+    memcpy(corpus[corpus_num].data, data, size);
+    corpus_num++;
+}
+
+
+//
+//  Seed Inputs
+///
+
+static size_t seed_cycle(uint8_t* buf, size_t len, uint8_t ctl, uint8_t dat)
+{
+    buf[len++] = ctl;
+    buf[len++] = dat;
+    return len;
+}
+
+/**
+ * Well-formed traces, for each target, so that the mutations start from
+ * somewhere deep within the state-machines.
+ */
+static void corpus_seed(void)
+{
+    static const uint8_t body[4] = {0x12, 0x34, 0x56, 0x78};
+    uint8_t buf[128];
+    uint16_t crc = crc16_calc(body, sizeof(body));
+    size_t len;
+
+    // DATA0 packet, from the link
+    for (int target=FuzzDescRecv; target<=FuzzDataxRecv; target++) {
+        len = 0;
+        buf[len++] = target;
+        buf[len++] = 0x00;
+        len = seed_cycle(buf, len, 0x00, ULPITX_DATA0);
+        len = seed_cycle(buf, len, 0x02, ULPITX_DATA0);
+        for (int i=0; i<4; i++) {
+            len = seed_cycle(buf, len, 0x02, body[i]);
+        }
+        len = seed_cycle(buf, len, 0x02, crc & 0xFF);
+        len = seed_cycle(buf, len, 0x02, crc >> 8);
+        len = seed_cycle(buf, len, 0x04, 0x00);
+        len = seed_cycle(buf, len, 0x11, 0x00);
+        len = seed_cycle(buf, len, 0x01, 0x4C);
+        len = seed_cycle(buf, len, 0x01, 0x4D);
+        len = seed_cycle(buf, len, 0x00, 0x00);
+        corpus_add(buf, len);
+    }
+
+    // ACK, from the link
+    len = 0;
+    buf[len++] = FuzzAckRecv;
+    buf[len++] = 0x00;
+    len = seed_cycle(buf, len, 0x00, ULPITX_ACK);
+    len = seed_cycle(buf, len, 0x00, ULPITX_ACK);
+    len = seed_cycle(buf, len, 0x04, 0x00);
+    len = seed_cycle(buf, len, 0x00, 0x00);
+    corpus_add(buf, len);
+
+    // Tokens, and the downstream ACK, with the PHY driving the bus
+    for (int target=FuzzTokenSend; target<=FuzzAckSend; target++) {
+        len = 0;
+        buf[len++] = target;
+        buf[len++] = 0x04;
+        len = seed_cycle(buf, len, 0x00, 0x00);
+        len = seed_cycle(buf, len, 0x13, 0x00);
+        len = seed_cycle(buf, len, 0x01, 0x5D);
+        for (int i=0; i<4; i++) {
+            len = seed_cycle(buf, len, 0x03, 0x00);
+        }
+        len = seed_cycle(buf, len, 0x01, 0x4C);
+        len = seed_cycle(buf, len, 0x01, 0x4D);
+        len = seed_cycle(buf, len, 0x10, 0x00);
+        len = seed_cycle(buf, len, 0x00, 0x00);
+        corpus_add(buf, len);
+    }
+
+    // SETUP token, then the function's idle bus, and PHY start-up
+    for (int target=FuzzFuncStep; target<=FuzzPhyStep; target++) {
+        len = 0;
+        buf[len++] = target;
+        buf[len++] = 0x00;
+        len = seed_cycle(buf, len, 0x00, 0x00);
+        len = seed_cycle(buf, len, 0x03, 0x00);
+        len = seed_cycle(buf, len, 0x01, 0x5D);
+        len = seed_cycle(buf, len, 0x03, 0x2D);
+        len = seed_cycle(buf, len, 0x03, 0x00);
+        len = seed_cycle(buf, len, 0x03, 0x10);
+        len = seed_cycle(buf, len, 0x01, 0x4C);
+        len = seed_cycle(buf, len, 0x00, 0x00);
+        len = seed_cycle(buf, len, 0x00, 0x84);
+        len = seed_cycle(buf, len, 0x00, 0x00);
+        corpus_add(buf, len);
+    }
+}
+
+
+//
+//  Mutations
+///
+
+static size_t mutate(uint8_t* buf, size_t size)
+{
+    const uint32_t r = ulpi_rand(&rng);
+    const size_t pos = size > 2 ? 2 + ulpi_rand(&rng) % (size - 2) : 2;
+
+    switch (r % 8) {
+    case 0:
+        // Flip a bit
+        if (size > 0) {
+            buf[ulpi_rand(&rng) % size] ^= 1 << (ulpi_rand(&rng) & 7);
+        }
+        break;
+    case 1:
+        // Random byte
+        if (size > 0) {
+            buf[ulpi_rand(&rng) % size] = ulpi_rand(&rng);
+        }
+        break;
+    case 2:
+        // Insert a random cycle
+        if (size + 2 <= FUZZ_MAX_LEN && pos <= size) {
+            memmove(&buf[pos + 2], &buf[pos], size - pos);
+            buf[pos] = ulpi_rand(&rng) & 0x1F;
+            buf[pos + 1] = ulpi_rand(&rng);
+            size += 2;
+        }
+        break;
+    case 3:
+        // Delete a cycle
+        if (size >= pos + 2 && size > 4) {
+            memmove(&buf[pos], &buf[pos + 2], size - pos - 2);
+            size -= 2;
+        }
+        break;
+    case 4:
+        // Repeat a cycle, 1-1024 times (wait-states, and longer packets)
+        if (pos + 2 <= size) {
+            size_t n = 2 << (ulpi_rand(&rng) % 11);
+            if (size + n > FUZZ_MAX_LEN) {
+                n = (FUZZ_MAX_LEN - size) & ~(size_t)1;
+            }
+            memmove(&buf[pos + n], &buf[pos], size - pos);
+            for (size_t i=2; i<n; i+=2) {
+                buf[pos + i] = buf[pos];
+                buf[pos + i + 1] = buf[pos + 1];
+            }
+            size += n;
+        }
+        break;
+    case 5:
+        // Splice with another input
+        if (corpus_num > 0) {
+            const fuzz_input_t* in = &corpus[ulpi_rand(&rng) % corpus_num];
+            if (in->size > 2 && pos <= size) {
+                size_t n = in->size - 2;
+                if (pos + n > FUZZ_MAX_LEN) {
+                    n = FUZZ_MAX_LEN - pos;
+                }
+                memcpy(&buf[pos], &in->data[2], n);
+                size = pos + n;
+            }
+        }
+        break;
+    case 6:
+        // Change the target flags
+        buf[1] = ulpi_rand(&rng);
+        break;
+    default:
+        // Interesting values for the data-bus
+        if (size > 3) {
+            static const uint8_t vals[8] = {
+                0x00, 0x4C, 0x4D, 0x5D, ULPITX_DATA0, ULPITX_DATA1, ULPITX_ACK, 0xFF
+            };
+            buf[(pos | 1) < size ? (pos | 1) : size - 1] = vals[ulpi_rand(&rng) & 7];
+        }
+        break;
+    }
+
+    return size;
+}
+
+
+//
+//  Minimisation
+///
+
+/**
+ * Returns non-zero if the input crashes, when run within a child process.
+ */
+static int crashes(const uint8_t* data, size_t size)
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        signal(SIGABRT, SIG_DFL);
+        signal(SIGSEGV, SIG_DFL);
+        freopen("/dev/null", "w", stderr);
+        LLVMFuzzerTestOneInput(data, size);
+        _exit(0);
+    } else if (pid < 0) {
+        return 0;
+    }
+    waitpid(pid, &status, 0);
+
+    return WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+}
+
+/**
+ * Remove chunks of cycles (halving the chunk-size each pass), and keep each
+ * removal that still crashes.
+ */
+static int minimise(const char* name)
+{
+    size_t size;
+    uint8_t* data = read_file(name, &size);
+    char path[512];
+
+    if (data == NULL || !crashes(data, size)) {
+        printf("'%s' does not crash\n", name);
+        free(data);
+        return 1;
+    }
+
+    for (size_t chunk = (size - 2) & ~(size_t)1; chunk >= 2; chunk /= 2) {
+        chunk &= ~(size_t)1;
+        for (size_t pos = 2; pos + chunk <= size; ) {
+            uint8_t* cand = (uint8_t*)malloc(size);
+            memcpy(cand, data, pos);
+            memcpy(&cand[pos], &data[pos + chunk], size - pos - chunk);
+            if (crashes(cand, size - chunk)) {
+                free(data);
+                data = cand;
+                size -= chunk;
+            } else {
+                free(cand);
+                pos += chunk;
+            }
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s.min", name);
+    write_file(path, data, size);
+    printf("Minimised '%s' to %zu bytes (%zu cycles): '%s'\n", name, size,
+           (size - 2) / 2, path);
+    free(data);
+
+    return 0;
+}
+
+
+static void usage(const char* name)
+{
+    printf("Usage: %s [-n ITERS] [-s SEED] [-o DIR] [FILE ...]\n", name);
+    printf("       %s -m CRASH\n", name);
+    printf("  -n ITERS  number of fuzzing iterations (default: 1000000)\n");
+    printf("  -s SEED   seed for the mutations\n");
+    printf("  -o DIR    directory for the crash reproducers (default: '.')\n");
+    printf("  -m CRASH  minimise the given crash reproducer\n");
+    printf("  FILE      inputs to add to the corpus (or to replay, with '-n 0')\n");
+}
+
+int main(int argc, char* argv[])
+{
+    uint8_t* buf = (uint8_t*)malloc(FUZZ_MAX_LEN);
+    struct timespec t0, t1;
+    long iters = 1000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:o:m:h")) != -1) {
+        switch (opt) {
+        case 'n': iters = atol(optarg); break;
+        case 's': rng = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'o': out_dir = optarg; break;
+        case 'm':
+            free(buf);
+            return minimise(optarg);
+        default:
+            usage(argv[0]);
+            free(buf);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    signal(SIGABRT, crash_handler);
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGFPE, crash_handler);
+
+    corpus_seed();
+    for (int i=optind; i<argc; i++) {
+        size_t size;
+        uint8_t* data = read_file(argv[i], &size);
+        if (data == NULL) {
+            printf("Cannot read '%s'\n", argv[i]);
+            return 1;
+        }
+        corpus_add(data, size);
+        free(data);
+    }
+
+    for (int i=0; i<corpus_num; i++) {
+        run_input(corpus[i].data, corpus[i].size);
+    }
+    printf("Replayed %d inputs\n", corpus_num);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long n=0; n<iters; n++) {
+        const fuzz_input_t* in = &corpus[ulpi_rand(&rng) % corpus_num];
+        size_t size = in->size;
+
+        memcpy(buf, in->data, size);
+        for (int m = 1 + (ulpi_rand(&rng) & 3); m--;) {
+            size = mutate(buf, size);
+        }
+        if (run_input(buf, size)) {
+            corpus_add(buf, size);
+        }
+
+        if ((n & 0xFFFF) == 0xFFFF) {
+            printf("#%ld\tcorpus: %d\n", n + 1, corpus_num);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    const double secs = (double)(t1.tv_sec - t0.tv_sec) +
+        (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("Done: %ld iterations, corpus: %d, %.0f execs/s\n", iters, corpus_num,
+           secs > 0.0 ? (double)iters / secs : 0.0);
+
+    free(buf);
+    return 0;
+}
+
+#endif  /* !__libfuzzer */
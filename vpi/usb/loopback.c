@@ -0,0 +1,436 @@
+#include "loopback.h"
+#include "stdreq.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//
+//  Helper Routines
+///
+
+static int lb_failed(usb_loopback_t* lb, const char* mesg, const int line)
+{
+    ulpi_printf("\nLOOP\t#%8lu cyc =>\tFAILED: %s [%s:%d]\n",
+                lb->host.cycle, mesg, __FILE__, line);
+    show_host(&lb->host);
+    if (lb->fail == NULL) {
+        lb->fail = mesg;
+    }
+    return -1;
+}
+
+/**
+ * Step until the host, bus, and function are all idle, so that the next
+ * transaction can be queued-up.
+ */
+static int lb_wait_idle(usb_loopback_t* lb)
+{
+    const uint64_t end = lb->host.cycle + LB_TIMEOUT;
+
+    while (lb->host.op != HostIdle || lb->func.state != FuncIdle ||
+           !ulpi_bus_is_idle(&lb->bus)) {
+        if (loopback_step(lb) < 0) {
+            return lb_failed(lb, "waiting for idle", __LINE__);
+        } else if (lb->host.cycle > end) {
+            return lb_failed(lb, "timed out waiting for idle", __LINE__);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Step until the current transaction completes, or fails, or the watchdog
+ * expires (so that a misbehaving model cannot hang the loopback).
+ */
+static int lb_xact(usb_loopback_t* lb)
+{
+    const uint64_t end = lb->host.cycle + LB_TIMEOUT;
+    int result;
+
+    while ((result = loopback_step(lb)) == 0) {
+        if (lb->host.cycle > end) {
+            return lb_failed(lb, "transaction timed out", __LINE__);
+        }
+    }
+    return result;
+}
+
+/**
+ * Run the queued-up control request to completion, by advancing the host
+ * through each packet of the SETUP, DATA, and STATUS stages (see
+ * 'stdreq_next()'), where the DATA stage may span many packets.
+ * Returns:
+ *  -2  --  the request was STALLed;
+ *  -1  --  failure/error; OR
+ *  n   --  number of bytes received during the DATA stage.
+ */
+static int lb_control(usb_loopback_t* lb, uint8_t* buf, uint16_t size)
+{
+    usb_host_t* host = &lb->host;
+    transfer_t* xfer = &host->xfer;
+    int len;
+    int result;
+
+    while (host->op == HostSETUP) {
+        result = lb_xact(lb);
+        if (result < 0) {
+            return lb_failed(lb, "SETUP step", __LINE__);
+        } else if ((host->step == 4 || host->step == 8) && xfer->hsk == USBPID_NAK) {
+            lb->retries++;
+        }
+
+        result = stdreq_next(host);
+        if (result == -2) {
+            return -2;
+        } else if (result < 0) {
+            return lb_failed(lb, "control transfer", __LINE__);
+        }
+    }
+
+    lb->xacts++;
+    if (!host->ctl.in) {
+        return 0;
+    }
+    len = host->ctl.ptr < size ? host->ctl.ptr : size;
+    memcpy(buf, host->buf, len);
+    return len;
+}
+
+static int lb_bulk_out(usb_loopback_t* lb, const uint8_t* data, uint16_t len)
+{
+    usb_host_t* host = &lb->host;
+    int result;
+
+    for (int i=0; i<LB_MAX_RETRIES; i++) {
+        if (lb_wait_idle(lb) < 0 ||
+            usbh_bulk_out(host, lb->ep_out->address & 0x0F, data, len) < 0) {
+            return lb_failed(lb, "Bulk OUT set-up", __LINE__);
+        }
+
+        result = lb_xact(lb);
+        host->op = HostIdle;
+
+        if (result < 0) {
+            return lb_failed(lb, "Bulk OUT step", __LINE__);
+        } else if (host->xfer.hsk == USBPID_ACK || host->xfer.hsk == USBPID_NYET) {
+            lb->xacts++;
+            lb->bytes_out += len;
+            return 0;
+        } else if (host->xfer.hsk != USBPID_NAK) {
+            return lb_failed(lb, "Bulk OUT not ACK'd", __LINE__);
+        }
+        lb->retries++;
+    }
+
+    return lb_failed(lb, "Bulk OUT retries exceeded", __LINE__);
+}
+
+static int lb_bulk_in(usb_loopback_t* lb, uint8_t* data)
+{
+    usb_host_t* host = &lb->host;
+    int result;
+
+    for (int i=0; i<LB_MAX_RETRIES; i++) {
+        if (lb_wait_idle(lb) < 0 || usbh_bulk_in(host, lb->ep_in->address & 0x0F) < 0) {
+            return lb_failed(lb, "Bulk IN set-up", __LINE__);
+        }
+
+        result = lb_xact(lb);
+        host->op = HostIdle;
+
+        if (result < 0) {
+            return lb_failed(lb, "Bulk IN step", __LINE__);
+        } else if (host->xfer.hsk == USBPID_ACK) {
+            lb->xacts++;
+            lb->bytes_in += host->xfer.rx_len;
+            memcpy(data, host->xfer.rx, host->xfer.rx_len);
+            return host->xfer.rx_len;
+        } else if (host->xfer.hsk != USBPID_NAK) {
+            return lb_failed(lb, "Bulk IN not completed", __LINE__);
+        }
+        lb->retries++;
+    }
+
+    return lb_failed(lb, "Bulk IN retries exceeded", __LINE__);
+}
+
+
+//
+//  Public API Routines
+///
+
+void loopback_init(usb_loopback_t* lb, uint32_t seed)
+{
+    usbh_init(&lb->host);
+    usbf_init(&lb->func);
+    ulpi_bus_idle(&lb->bus);
+    lb->rng = seed;
+    lb->host.rng = ulpi_rand(&lb->rng);
+    lb->pcap = NULL;
+    lb->trace = NULL;
+    lb->fail = NULL;
+    lb->ep_out = NULL;
+    lb->ep_in = NULL;
+    lb->xacts = 0;
+    lb->retries = 0;
+    lb->bytes_out = 0;
+    lb->bytes_in = 0;
+    lb->ctl_bytes = 0;
+    lb->ctl_cycles = 0;
+    shadow_init(&lb->shadow);
+    lb->host.shadow = &lb->shadow;
+}
+
+void loopback_free(usb_loopback_t* lb)
+{
+    lb->host.shadow = NULL;
+    shadow_free(&lb->shadow);
+}
+
+/**
+ * Step both the host and the function, using the same bus values, and then
+ * combine their outputs to give the bus values for the next cycle (which are
+ * also captured, and hashed, if a pcap file, or a trace, is attached).
+ */
+int loopback_step(usb_loopback_t* lb)
+{
+    ulpi_bus_t phy, link;
+    int result = usbh_step(&lb->host, &lb->bus, &phy);
+
+    if (usbf_step(&lb->func, &lb->bus, &link) < 0) {
+        return -1;
+    }
+    ulpi_bus_merge(&lb->bus, &phy, &link);
+
+    if (lb->pcap != NULL &&
+        usb_pcap_step(lb->pcap, &lb->bus, LB_CYCLE_NS(lb->host.cycle)) < 0) {
+        return -1;
+    }
+    if (lb->trace != NULL && ulpi_trace_step(lb->trace, &lb->bus) < 0) {
+        lb->fail = "diverged from the golden trace";
+        return -1;
+    }
+
+    return result;
+}
+
+/**
+ * Issue the standard requests for enumerating, and then configuring, the
+ * function.
+ */
+int loopback_enumerate(usb_loopback_t* lb, uint8_t addr)
+{
+    usb_host_t* host = &lb->host;
+    uint8_t buf[MAX_CONFIG_SIZE];
+    int len;
+
+    if (lb_wait_idle(lb) < 0 || stdreq_get_desc_device(host) < 0 ||
+        (len = lb_control(lb, buf, sizeof(buf))) != 18 ||
+        desc_parse_device(&host->eptab, buf, len) < 0) {
+        return lb_failed(lb, "GET DESCRIPTOR (device)", __LINE__);
+    }
+
+    if (lb_wait_idle(lb) < 0 || stdreq_set_address(host, addr) < 0 ||
+        lb_control(lb, buf, sizeof(buf)) != 0) {
+        return lb_failed(lb, "SET ADDRESS", __LINE__);
+    }
+    host->addr = addr;
+
+    // Fetch just the configuration descriptor, and then all of them
+    if (lb_wait_idle(lb) < 0 || stdreq_get_desc_config(host, 9) < 0 ||
+        lb_control(lb, buf, sizeof(buf)) != 9) {
+        return lb_failed(lb, "GET DESCRIPTOR (config)", __LINE__);
+    }
+
+    const uint16_t total = (uint16_t)buf[3] << 8 | buf[2];
+    if (lb_wait_idle(lb) < 0 || stdreq_get_desc_config(host, total) < 0 ||
+        lb_control(lb, buf, sizeof(buf)) != total || buf[4] != 1 ||
+        desc_parse_config(&host->eptab, buf, total) < 0) {
+        return lb_failed(lb, "GET DESCRIPTOR (all)", __LINE__);
+    }
+
+    // Loop back via the first Bulk OUT, and the first Bulk IN, endpoints
+    lb->ep_out = desc_endpoint(&host->eptab, 0x00, EP_TYPE_BULK, 0);
+    lb->ep_in = desc_endpoint(&host->eptab, EP_DIR_IN, EP_TYPE_BULK, 0);
+    if (lb->ep_out == NULL || lb->ep_in == NULL) {
+        return lb_failed(lb, "no Bulk OUT and Bulk IN endpoints", __LINE__);
+    }
+
+    for (int i=0; i<4; i++) {
+        if (lb_wait_idle(lb) < 0 ||
+            stdreq_get_descriptor(host, DESC_STRING << 8 | i) < 0 ||
+            (len = lb_control(lb, buf, sizeof(buf))) < 4 || buf[0] != len ||
+            buf[1] != DESC_STRING) {
+            return lb_failed(lb, "GET DESCRIPTOR (string)", __LINE__);
+        }
+    }
+
+    // Unsupported descriptors have to be STALLed
+    if (lb_wait_idle(lb) < 0 ||
+        stdreq_get_descriptor(host, DESC_DEVICE_QUALIFIER << 8) < 0 ||
+        lb_control(lb, buf, sizeof(buf)) != -2) {
+        return lb_failed(lb, "GET DESCRIPTOR (qualifier) not STALLed", __LINE__);
+    }
+
+    if (lb_wait_idle(lb) < 0 || stdreq_set_config(host, 1) < 0 ||
+        lb_control(lb, buf, sizeof(buf)) != 0) {
+        return lb_failed(lb, "SET CONFIGURATION", __LINE__);
+    }
+
+    if (lb_wait_idle(lb) < 0 || stdreq_get_status(host) < 0 ||
+        lb_control(lb, buf, sizeof(buf)) != 2) {
+        return lb_failed(lb, "GET STATUS", __LINE__);
+    }
+
+    return 0;
+}
+
+/**
+ * Each burst sends upto 'LB_MAX_BURST' random-sized packets, via Bulk OUT, and
+ * then reads them back, via Bulk IN, and checks that they match.
+ *
+ * Note: packets are sized using the 'wMaxPacketSize' of the endpoints.
+ */
+int loopback_bulk(usb_loopback_t* lb, int bursts)
+{
+    uint8_t sent[LB_MAX_BURST][MAX_PACKET_SIZE];
+    uint16_t lens[LB_MAX_BURST];
+    uint8_t recv[MAX_PACKET_SIZE + 2];
+    uint16_t size = MAX_PACKET_SIZE;
+
+    if (lb->ep_out == NULL || lb->ep_in == NULL) {
+        return lb_failed(lb, "Bulk endpoints unknown, so enumerate first", __LINE__);
+    }
+    size = lb->ep_out->max_packet < size ? lb->ep_out->max_packet : size;
+    size = lb->ep_in->max_packet < size ? lb->ep_in->max_packet : size;
+
+    for (int b=0; b<bursts; b++) {
+        const int num = 1 + ulpi_rand(&lb->rng) % LB_MAX_BURST;
+
+        for (int i=0; i<num; i++) {
+            lens[i] = ulpi_rand(&lb->rng) % (size + 1);
+            for (int j=0; j<lens[i]; j++) {
+                sent[i][j] = ulpi_rand(&lb->rng);
+            }
+            if (lb_bulk_out(lb, sent[i], lens[i]) < 0) {
+                return -1;
+            }
+        }
+
+        for (int i=0; i<num; i++) {
+            int len = lb_bulk_in(lb, recv);
+            if (len < 0) {
+                return -1;
+            } else if (len != lens[i] || memcmp(recv, sent[i], len) != 0) {
+                ulpi_printf("LOOP\t#%8lu cyc =>\tExpected %u bytes, received %d\n",
+                            lb->host.cycle, lens[i], len);
+                return lb_failed(lb, "Bulk IN data mismatch", __LINE__);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Each blob is written to a random offset of the function's register block,
+ * using a vendor control-write, and then read back, using a vendor control-
+ * read, where both span many packets of the control pipe; i.e., like a bulk
+ * register dump. The cycles, and bytes, of both transfers are accumulated for
+ * measuring the throughput of the control pipe.
+ */
+int loopback_control(usb_loopback_t* lb, int blobs)
+{
+    usb_host_t* host = &lb->host;
+    uint8_t sent[FUNC_REGS_SIZE];
+    uint8_t recv[FUNC_REGS_SIZE];
+    usb_stdreq_t req;
+
+    for (int b=0; b<blobs; b++) {
+        const uint16_t addr = ulpi_rand(&lb->rng) % FUNC_REGS_SIZE;
+        const uint16_t len = 1 + ulpi_rand(&lb->rng) % (FUNC_REGS_SIZE - addr);
+        uint64_t start;
+        int result;
+
+        for (int i=0; i<len; i++) {
+            sent[i] = ulpi_rand(&lb->rng);
+        }
+
+        req.bmRequestType = 0x40;
+        req.bRequest = FUNC_VENDOR_WRITE;
+        req.wValue = addr;
+        req.wIndex = 0;
+        req.wLength = len;
+        req.data = sent;
+
+        if (lb_wait_idle(lb) < 0 || stdreq_control(host, &req) < 0) {
+            return lb_failed(lb, "vendor control-write set-up", __LINE__);
+        }
+        start = host->cycle;
+        if (lb_control(lb, recv, sizeof(recv)) != 0) {
+            return lb_failed(lb, "vendor control-write", __LINE__);
+        }
+        lb->ctl_cycles += host->cycle - start;
+
+        req.bmRequestType = 0xC0;
+        req.bRequest = FUNC_VENDOR_READ;
+        req.data = NULL;
+
+        if (lb_wait_idle(lb) < 0 || stdreq_control(host, &req) < 0) {
+            return lb_failed(lb, "vendor control-read set-up", __LINE__);
+        }
+        start = host->cycle;
+        result = lb_control(lb, recv, sizeof(recv));
+        lb->ctl_cycles += host->cycle - start;
+
+        if (result != len || memcmp(recv, sent, len) != 0) {
+            ulpi_printf("LOOP\t#%8lu cyc =>\tExpected %u bytes (at 0x%03x), received %d\n",
+                        host->cycle, len, addr, result);
+            return lb_failed(lb, "vendor control-read mismatch", __LINE__);
+        }
+        lb->ctl_bytes += 2 * len;
+    }
+
+    return 0;
+}
+
+/**
+ * Issue the constrained-random transactions of the generator, where each packet
+ * is stepped to completion, and then checked by the generator, which queues-up
+ * the next packet; i.e., the same as for the '$ulpi_step' test-case.
+ */
+int loopback_random(usb_loopback_t* lb, usb_gen_t* gen)
+{
+    usb_host_t* host = &lb->host;
+    int result;
+
+    usbgen_bind(gen, host);
+
+    while (!usbgen_done(gen)) {
+        if (lb_wait_idle(lb) < 0 || usbgen_start(gen, host) < 0) {
+            return lb_failed(lb, "random transaction set-up", __LINE__);
+        }
+
+        do {
+            if (lb_xact(lb) < 0) {
+                return lb_failed(lb, "random transaction step", __LINE__);
+            } else if (host->op == HostBulkOUT || host->op == HostBulkIN) {
+                // Bulk packets are followed by an idle bus, as for the harness
+                host->op = HostIdle;
+                if (lb_wait_idle(lb) < 0) {
+                    return -1;
+                }
+            }
+            result = usbgen_next(gen, host);
+        } while (result == 0);
+
+        if (result < 0) {
+            return lb_failed(lb, gen->fail, __LINE__);
+        }
+        lb->xacts++;
+    }
+
+    return 0;
+}
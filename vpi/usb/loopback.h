@@ -0,0 +1,60 @@
+#ifndef __LOOPBACK_H__
+#define __LOOPBACK_H__
+/**
+ * Connects the USB host (and PHY) model to the USB function (link) model, and
+ * exchanges their ULPI bus values every clock-cycle, so that the host model
+ * can be exercised without a Verilog simulator.
+ * NOTE:
+ *  - each instance has its own random-number state, so that instances can be
+ *    run concurrently, one per thread;
+ *  - the DDR3 STOREs and FETCHes are checked against a (sparse) shadow of the
+ *    memory, that is released by 'loopback_free()';
+ */
+
+#include "ddr3shadow.h"
+#include "usbfunc.h"
+#include "usbgen.h"
+#include "usbhost.h"
+#include "usbpcap.h"
+#include "ulpitrace.h"
+
+
+#define LB_MAX_RETRIES 16
+#define LB_MAX_BURST   4
+#define LB_TIMEOUT     100000
+
+// ULPI clock-period is 16.667 ns (60 MHz), for timestamping captures
+#define LB_CYCLE_NS(c) ((c) * 50u / 3u)
+
+
+typedef struct {
+    usb_host_t host;
+    usb_func_t func;
+    ulpi_bus_t bus;
+    uint32_t xacts;
+    uint32_t retries;
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+    uint64_t ctl_bytes;             // DATA-stage bytes of the control transfers
+    uint64_t ctl_cycles;
+    uint32_t rng;
+    usb_pcap_t* pcap;
+    ulpi_trace_t* trace;
+    const char* fail;
+    const usb_endpoint_t* ep_out;   // discovered by 'loopback_enumerate()'
+    const usb_endpoint_t* ep_in;
+    ddr3_shadow_t shadow;
+} usb_loopback_t;
+
+
+void loopback_init(usb_loopback_t* lb, uint32_t seed);
+void loopback_free(usb_loopback_t* lb);
+int loopback_step(usb_loopback_t* lb);
+
+int loopback_enumerate(usb_loopback_t* lb, uint8_t addr);
+int loopback_bulk(usb_loopback_t* lb, int bursts);
+int loopback_control(usb_loopback_t* lb, int blobs);
+int loopback_random(usb_loopback_t* lb, usb_gen_t* gen);
+
+
+#endif  /* __LOOPBACK_H__ */
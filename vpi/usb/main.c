@@ -1,13 +1,17 @@
+#include "ddr3shadow.h"
 #include "descriptor.h"
-#include "usbfunc.h"
-#include "usbhost.h"
-#include "stdreq.h"
+#include "loopback.h"
+#include "ulpiarena.h"
+#include "usbgen.h"
 #include "usbcrc.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 
 static void check_crc16(void)
@@ -50,65 +54,323 @@ void usb_unit_tests(void)
     check_crc5();
     check_crc16();
     test_desc_recv();
+    test_desc_parse();
+    test_stdreq_next();
+    test_arena();
+    test_shadow();
+    test_usbgen();
     test_func_recv();
     printf("Done\n\n");
 }
 
 
+/**
+ * Flow-control policies that each runner-thread cycles through, with '-p'.
+ */
+static const struct {
+    uint16_t nak_rate;
+    bool nyet;
+} policies[] = {
+    {0, false},
+    {0, true},
+    {3, false},
+    {2, true},
+};
+
+#define NUM_POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+/**
+ * Each runner-thread owns a host/function pair, its seed, and its log.
+ */
+typedef struct {
+    pthread_t thread;
+    int index;
+    uint32_t seed;
+    int bursts;
+    int blobs;
+    int xacts;
+    uint16_t nak_rate;
+    bool nyet;
+    FILE* log;
+    bool decode;
+    const char* capture;
+    usb_pcap_t pcap;
+    const char* golden;
+    bool compare;
+    ulpi_trace_t trace;
+    usb_loopback_t lb;
+    usb_gen_t gen;
+    int result;
+} lb_runner_t;
+
+
+static double elapsed(const struct timespec* t0, const struct timespec* t1)
+{
+    return (double)(t1->tv_sec - t0->tv_sec) +
+        (double)(t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void usage(const char* name)
+{
+    printf("Usage: %s [-n BURSTS] [-c BLOBS] [-r XACTS] [-k NAK_RATE] [-y] [-s SEED] [-j THREADS]\n"
+           "          [-p] [-o PREFIX] [-w PCAP] [-u] [-g TRACE | -G TRACE]\n", name);
+    printf("  -n BURSTS   number of Bulk OUT/IN loopback bursts (default: 1000)\n");
+    printf("  -c BLOBS    number of multi-packet control write/read-backs (default: 10)\n");
+    printf("  -r XACTS    number of constrained-random transactions (default: 200)\n");
+    printf("  -k NAK_RATE function NAKs 1-in-N transactions (0: never, N >= 2)\n");
+    printf("  -y          function responds NYET when its FIFO is nearly full\n");
+    printf("  -s SEED     seed for the random packet-sizes and -data\n");
+    printf("  -j THREADS  number of concurrent host/function pairs (default: 1)\n");
+    printf("  -p          each thread cycles through the NAK/NYET policies\n");
+    printf("  -o PREFIX   write each thread's log to 'PREFIX.<N>.log'\n");
+    printf("  -w PCAP     capture the USB packets of thread 0 to a pcap file\n");
+    printf("  -u          report the ULPI bus utilisation of thread 0\n");
+    printf("  -g TRACE    record a golden trace (of ULPI bus hashes) of thread 0\n");
+    printf("  -G TRACE    compare thread 0 against a golden trace\n");
+    printf("NOTE: thread N uses the seed 'SEED + N', and multi-threaded runs are\n"
+           "      silent unless '-o' is given.\n");
+}
+
+static void* lb_run(void* arg)
+{
+    lb_runner_t* run = (lb_runner_t*)arg;
+    usb_loopback_t* lb = &run->lb;
+
+    ulpi_log_set(run->log);
+    loopback_init(lb, run->seed);
+    usbf_policy(&lb->func, run->nak_rate, run->nyet);
+
+    if (run->decode) {
+        if (usb_pcap_open(&run->pcap, run->capture) < 0) {
+            run->result = -1;
+            lb->fail = "cannot create pcap file";
+            return NULL;
+        }
+        lb->pcap = &run->pcap;
+    }
+    if (run->golden != NULL) {
+        if (ulpi_trace_open(&run->trace, run->golden, run->compare, ULPI_TRACE_WINDOW) < 0) {
+            run->result = -1;
+            lb->fail = "cannot open the golden trace";
+            return NULL;
+        }
+        lb->trace = &run->trace;
+    }
+
+    run->result = loopback_enumerate(lb, 1);
+    if (run->result == 0) {
+        ulpi_printf("\nEnumerated, starting %d control-pipe blobs\n", run->blobs);
+        run->result = loopback_control(lb, run->blobs);
+    }
+    if (run->result == 0) {
+        ulpi_printf("\nStarting %d loopback bursts\n", run->bursts);
+        run->result = loopback_bulk(lb, run->bursts);
+    }
+    if (run->result == 0 && run->xacts > 0) {
+        gen_config_t cfg;
+        usbgen_defaults(&cfg, run->seed, run->xacts);
+        usbgen_init(&run->gen, &cfg);
+        ulpi_printf("\nStarting %d random transactions\n", run->xacts);
+        run->result = loopback_random(lb, &run->gen);
+    }
+    if (run->result == 0 && lb->func.errors > 0) {
+        run->result = -1;
+        lb->fail = "function errors";
+    }
+
+    if (lb->trace != NULL && ulpi_trace_close(lb->trace) < 0 && run->result == 0) {
+        run->result = -1;
+        lb->fail = "diverged from the golden trace";
+    }
+    if (lb->pcap != NULL && usb_pcap_close(lb->pcap) < 0 && run->result == 0) {
+        run->result = -1;
+        lb->fail = "pcap write failed";
+    }
+    return NULL;
+}
+
+
 /**
  * Main entry-point for the USB simulator/model.
+ * Runs the host model against the function model, without a simulator, by
+ * exchanging the ULPI bus values each cycle. Independent host/function pairs
+ * can be run concurrently, with their results merged at the end.
  */
 int main(int argc, char* argv[])
 {
-    usb_host_t* host = (usb_host_t*)malloc(sizeof(usb_host_t));
-    ulpi_bus_t bus, upd;
-    int result;
-    uint8_t buf[64];
-    uint16_t len = 64;
+    lb_runner_t* runs;
+    struct timespec t0, t1;
+    int bursts = 1000;
+    int blobs = 10;
+    int randoms = 200;
+    int nak_rate = 0;
+    bool nyet = false;
+    bool cycle_policies = false;
+    unsigned seed = 1;
+    int threads = 1;
+    const char* prefix = NULL;
+    const char* capture = NULL;
+    bool util = false;
+    const char* golden = NULL;
+    bool compare = false;
+    int opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "n:c:r:k:ys:j:po:w:ug:G:h")) != -1) {
+        switch (opt) {
+        case 'n': bursts = atoi(optarg); break;
+        case 'c': blobs = atoi(optarg); break;
+        case 'r': randoms = atoi(optarg); break;
+        case 'k': nak_rate = atoi(optarg); break;
+        case 'y': nyet = true; break;
+        case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'j': threads = atoi(optarg); break;
+        case 'p': cycle_policies = true; break;
+        case 'o': prefix = optarg; break;
+        case 'w': capture = optarg; break;
+        case 'u': util = true; break;
+        case 'g': golden = optarg; compare = false; break;
+        case 'G': golden = optarg; compare = true; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (nak_rate == 1) {
+        printf("ERROR: a NAK-rate of 1 would NAK every transaction\n");
+        return 1;
+    } else if (threads < 1) {
+        printf("ERROR: need at least one thread\n");
+        return 1;
+    }
 
     usb_unit_tests();
 
-    printf("Simulating ULPI\n");
-
-    // Issue host-reset
-    printf("Initialising ...\n");
-    ulpi_bus_idle(&bus);
-    usbh_init(host);
-
-    // Wait > 1 ms, for RESET period
-    // bus.rst_n = SIG0;
-    // host->op = HostReset;
-    while (host->op == HostReset) {
-        result = usbh_step(host, &bus, &upd);
-        if (result < 0) {
-            printf("ERROR: %d\n", result);
-            break;
+    runs = (lb_runner_t*)calloc(threads, sizeof(lb_runner_t));
+    for (int i=0; i<threads; i++) {
+        lb_runner_t* run = &runs[i];
+        run->index = i;
+        run->seed = seed + i;
+        run->bursts = bursts;
+        run->blobs = blobs;
+        run->xacts = randoms;
+        run->nak_rate = cycle_policies ? policies[i % NUM_POLICIES].nak_rate : nak_rate;
+        run->nyet = cycle_policies ? policies[i % NUM_POLICIES].nyet : nyet;
+        run->capture = i == 0 ? capture : NULL;
+        run->decode = i == 0 && (capture != NULL || util);
+        run->golden = i == 0 ? golden : NULL;
+        run->compare = compare;
+
+        if (prefix != NULL) {
+            char name[256];
+            snprintf(name, sizeof(name), "%s.%d.log", prefix, i);
+            if ((run->log = fopen(name, "w")) == NULL) {
+                printf("ERROR: cannot open log '%s'\n", name);
+                return 1;
+            }
+        } else {
+            run->log = threads == 1 ? stdout : NULL;
+        }
+    }
+
+    printf("Simulating ULPI (host <-> function loopback), %d thread(s)\n", threads);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (threads == 1) {
+        lb_run(&runs[0]);
+    } else {
+        for (int i=0; i<threads; i++) {
+            pthread_create(&runs[i].thread, NULL, lb_run, &runs[i]);
+        }
+        for (int i=0; i<threads; i++) {
+            pthread_join(runs[i].thread, NULL);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Merge the results
+    static usb_gen_t gen;
+    uint64_t cycles = 0, bytes_out = 0, bytes_in = 0, ctl_bytes = 0, ctl_cycles = 0;
+    uint32_t xacts = 0, retries = 0, naks = 0, nyets = 0, stalls = 0, errors = 0;
+    uint64_t sh_checked = 0, sh_unknown = 0, sh_errors = 0, sh_bytes = 0;
+
+    printf("\n\n");
+    for (int i=0; i<threads; i++) {
+        const lb_runner_t* run = &runs[i];
+        const usb_loopback_t* lb = &run->lb;
+
+        if (run->result < 0) {
+            failed++;
+            printf("  thread %d (seed: %u, nak: %u, nyet: %d) FAILED at cycle %lu: %s\n",
+                   run->index, run->seed, run->nak_rate, run->nyet, lb->host.cycle,
+                   lb->fail != NULL ? lb->fail : "unknown");
+        }
+        cycles += lb->host.cycle;
+        xacts += lb->xacts;
+        retries += lb->retries;
+        bytes_out += lb->bytes_out;
+        bytes_in += lb->bytes_in;
+        ctl_bytes += lb->ctl_bytes;
+        ctl_cycles += lb->ctl_cycles;
+        naks += lb->func.naks;
+        nyets += lb->func.nyets;
+        stalls += lb->func.stalls;
+        errors += lb->func.errors;
+        sh_checked += lb->shadow.checked;
+        sh_unknown += lb->shadow.unknown;
+        sh_errors += lb->shadow.errors;
+        sh_bytes += shadow_bytes(&lb->shadow);
+        usbgen_merge(&gen, &run->gen);
+
+        if (run->log != NULL && run->log != stdout) {
+            fclose(run->log);
         }
-        memcpy(&bus, &upd, sizeof(ulpi_bus_t));
     }
 
-    // Do some transactions
-    printf("Starting ULPI transactions\n");
+    const double secs = elapsed(&t0, &t1);
 
-    printf("Requesting CONFIG DESCRIPTOR\n");
-    result = stdreq_get_descriptor(host, 0x01);
-    if (result < 0) {
-        printf("ERROR: %d\n", result);
-        exit(1);
+    printf("Loopback %s (%d of %d threads) after %lu cycles\n",
+           failed > 0 ? "FAILED" : "PASSED", threads - failed, threads, cycles);
+    printf("  transactions:\t%u (retries: %u)\n", xacts, retries);
+    printf("  bytes:\t%lu OUT, %lu IN\n", bytes_out, bytes_in);
+    if (ctl_cycles > 0) {
+        // 60 MHz ULPI clock, so bytes/cycle * 60 gives MB/s
+        printf("  control:\t%lu bytes in %lu cycles (%.3f bytes/cycle, %.2f MB/s)\n",
+               ctl_bytes, ctl_cycles, (double)ctl_bytes / (double)ctl_cycles,
+               (double)ctl_bytes * 60.0 / (double)ctl_cycles);
+    }
+    if (gen.issued > 0) {
+        usbgen_report(&gen);
+    }
+    if (sh_checked + sh_unknown > 0) {
+        printf("  shadow:\t%lu bytes checked (%lu unknown), %lu mismatches, %lu bytes used\n",
+               sh_checked, sh_unknown, sh_errors, sh_bytes);
     }
+    printf("  handshakes:\t%u NAK, %u NYET, %u STALL\n", naks, nyets, stalls);
+    printf("  errors:\t%u\n", errors);
+    printf("  wall-time:\t%.3f s (%.2f Mcycles/s)\n", secs,
+           secs > 0.0 ? (double)cycles * 1e-6 / secs : 0.0);
+    if (capture != NULL) {
+        printf("  capture:\t%u packets (%lu bytes) written to '%s'\n",
+               runs[0].pcap.packets, runs[0].pcap.bytes, capture);
+    }
+    if (util) {
+        const uint64_t* classes = runs[0].pcap.cycles;
+        uint64_t total = 0;
 
-    while (host->op != HostIdle) {
-        result = usbh_step(host, &bus, &upd);
-        if (result < 0) {
-            printf("ERROR: %d\n", result);
-            break;
+        for (int i=0; i<ULPI_NUM_CLASSES; i++) {
+            total += classes[i];
+        }
+        printf("  utilisation:\t(thread 0, %lu cycles)\n", total);
+        for (int i=0; i<ULPI_NUM_CLASSES && total > 0; i++) {
+            printf("    %-12s %10lu  %5.1f%%\n", ulpi_class_string((ulpi_class_t)i),
+                   classes[i], (double)classes[i] * 100.0 / (double)total);
         }
-        memcpy(&bus, &upd, sizeof(ulpi_bus_t));
     }
 
-    // Disconnect device
+    for (int i=0; i<threads; i++) {
+        loopback_free(&runs[i].lb);
+    }
+    free(runs);
 
-    // Done
-    free(host);
-    return 0;
+    return failed > 0 ? 1 : 0;
 }
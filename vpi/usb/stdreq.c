@@ -24,6 +24,7 @@ static int stdreq_start(usb_host_t* host, const usb_stdreq_t* req)
     xfer->tok2 = (tok >> 8) & 0xFF;
     xfer->type = SETUP;
     xfer->stage = NoXfer; // AssertDir;
+    xfer->hsk = 0;
 
     // SETUP DATA0 (OUT) packet info, for the std. req.
     xfer->tx_len = 8;
@@ -36,12 +37,41 @@ static int stdreq_start(usb_host_t* host, const usb_stdreq_t* req)
     xfer->rx_len = host->len;
     xfer->rx_ptr = 0;
 
+    // DATA stage, which is sized by 'bMaxPacketSize0', once that is known
+    host->ctl.len = req->wLength;
+    host->ctl.ptr = 0;
+    host->ctl.max_packet = host->eptab.max_packet0 > 0 ? host->eptab.max_packet0 : MAX_CONFIG_SIZE;
+    host->ctl.in = (req->bmRequestType & 0x80) != 0 && req->wLength > 0;
+    host->ctl.last = false;
+
     host->op = HostSETUP;
     host->step = 0;
 
     return 1;
 }
 
+/**
+ * Queue-up a control transfer, with a DATA stage of upto 'host->len' bytes;
+ * i.e., that may span many packets. For a control-write, the 'req->data' is
+ * copied to the host buffer, and for a control-read, the data is received into
+ * the host buffer.
+ */
+int stdreq_control(usb_host_t* host, const usb_stdreq_t* req)
+{
+    if (host->op != HostIdle || req->wLength > host->len) {
+        return -1;
+    }
+
+    if ((req->bmRequestType & 0x80) == 0 && req->wLength > 0) {
+        if (req->data == NULL) {
+            return -1;
+        }
+        memcpy(host->buf, req->data, req->wLength);
+    }
+
+    return stdreq_start(host, req);
+}
+
 /**
  * Configure a USB device to use the given 'addr'.
  */
@@ -85,13 +115,13 @@ int stdreq_get_descriptor(usb_host_t* host, uint16_t num)
     }
 
     usb_stdreq_t req;
-    usb_desc_t* desc = malloc(sizeof(usb_desc_t));
-    desc->dtype = num; // Todo: string-descriptor type
-    desc->value.dat = host->buf;
+    usb_desc_t desc;
+    desc.dtype = num; // Todo: string-descriptor type
+    desc.value.dat = host->buf;
 
-    if (get_descriptor(&req, num, 0, MAX_CONFIG_SIZE, desc) < 0) {
-        printf("HOST\t#%8lu cyc =>\tUSBH GET DESCRIPTOR failed [%s:%d]\n",
-               host->cycle, __FILE__, __LINE__);
+    if (get_descriptor(&req, num, 0, MAX_CONFIG_SIZE, &desc) < 0) {
+        ulpi_printf("HOST\t#%8lu cyc =>\tUSBH GET DESCRIPTOR failed [%s:%d]\n",
+                    host->cycle, __FILE__, __LINE__);
         return -1;
     }
 
@@ -142,7 +172,7 @@ int stdreq_get_desc_config(usb_host_t* host, uint16_t len)
         return -1;
     }
 
-    if (len > MAX_CONFIG_SIZE || len == 0) {
+    if (len > host->len || len == 0) {
 	len = MAX_CONFIG_SIZE;
     }
 
@@ -186,12 +216,12 @@ int stdreq_set_config(usb_host_t* host, uint8_t conf)
 
 void stdreq_show(usb_stdreq_t* req)
 {
-    printf("STD_REQ = {\n");
-    printf("  bmRequestType:\t  0x%02x,\n", req->bmRequestType);
-    printf("  bRequest:     \t  0x%02x,\n", req->bRequest);
-    printf("  wValue:       \t0x%04x,\n", req->wValue);
-    printf("  wIndex:       \t0x%04x,\n", req->wIndex);
-    printf("  wLength:      \t0x%04x\n};\n", req->wLength);
+    ulpi_printf("STD_REQ = {\n");
+    ulpi_printf("  bmRequestType:\t  0x%02x,\n", req->bmRequestType);
+    ulpi_printf("  bRequest:     \t  0x%02x,\n", req->bRequest);
+    ulpi_printf("  wValue:       \t0x%04x,\n", req->wValue);
+    ulpi_printf("  wIndex:       \t0x%04x,\n", req->wIndex);
+    ulpi_printf("  wLength:      \t0x%04x\n};\n", req->wLength);
 }
 
 /**
@@ -211,7 +241,7 @@ int stdreq_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     case 0:
         // SETUP (SETUP)
         if (xfer->type != SETUP) {
-            printf(
+            ulpi_printf(
                 "HOST\t#%8lu cyc =>\tHost transfer not configured for SETUP [%s:%d]\n",
                 host->cycle, __FILE__, __LINE__);
             show_host(host);
@@ -249,9 +279,9 @@ int stdreq_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case 4:
-        // DATA1 (DATA)
-        if (xfer->type != UpDATA1) {
-            xfer->type = UpDATA1;
+        // DATAx (DATA), or the ZDP of the STATUS stage
+        if (xfer->type != UpDATA0 && xfer->type != UpDATA1) {
+            xfer->type = xfer->ep_seq[0] == SIG0 ? UpDATA0 : UpDATA1;
             xfer->stage = NoXfer;
             xfer->rx_len = MAX_PACKET_SIZE;
             xfer->rx_ptr = 0;
@@ -278,8 +308,8 @@ int stdreq_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case 7:
-        // ZDP (STATUS)
-        if (xfer->type != DnDATA1) {
+        // DATAx (DATA), as set up by 'stdreq_next()', or else the ZDP (STATUS)
+        if (xfer->type != DnDATA0 && xfer->type != DnDATA1) {
             xfer->type = DnDATA1;
             xfer->stage = NoXfer;
             xfer->tx_len = 0;
@@ -298,14 +328,14 @@ int stdreq_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
 
     default:
         // ERROR
-        printf("Invalid SETUP transaction step: %u [%s:%d]\n",
-               host->step, __FILE__, __LINE__);
+        ulpi_printf("Invalid SETUP transaction step: %u [%s:%d]\n",
+                    host->step, __FILE__, __LINE__);
         show_host(host);
         return -1;
     }
 
     if (result < 0) {
-        printf("SETUP transaction failed [%s:%d]\n", __FILE__, __LINE__);
+        ulpi_printf("SETUP transaction failed [%s:%d]\n", __FILE__, __LINE__);
         show_host(host);
         ulpi_bus_show(in);
     } else if (result > 1) {
@@ -317,6 +347,139 @@ int stdreq_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     return result;
 }
 
+/**
+ * Advance to the next packet of a control transfer, once the current packet
+ * (of 'host->step') has been sent/received; i.e., the IN, or OUT, DATA stage
+ * continues until a short packet, or until 'wLength' bytes, with the DATAx
+ * sequence bit toggled after each ACK, and then the STATUS stage (which is
+ * always DATA1) is issued in the opposite direction.
+ *
+ * Steps 3-5 (IN, DATAx, ACK) are the DATA stage of a control-read, or else the
+ * STATUS stage, and steps 6-8 (OUT, DATAx, ACK) are the DATA stage of a
+ * control-write, or else the STATUS stage.
+ *
+ * Returns:
+ *  -2  --  STALLed;
+ *  -1  --  failure/error;
+ *   0  --  the next packet has been queued (or re-queued, after a NAK); OR
+ *   1  --  completed, and the DATA stage is in the host buffer.
+ */
+int stdreq_next(usb_host_t* host)
+{
+    transfer_t* xfer = &host->xfer;
+    usb_control_t* ctl = &host->ctl;
+    const bool status = ctl->in ? host->step >= 6 : host->step < 6;
+    uint16_t len;
+
+    switch (host->step) {
+
+    case 2:
+        // ACK (SETUP)
+        if (xfer->hsk != USBPID_ACK) {
+            ulpi_printf("HOST\t#%8lu cyc =>\tSETUP not ACK'd [%s:%d]\n",
+                        host->cycle, __FILE__, __LINE__);
+            return -1;
+        }
+        xfer->ep_seq[0] = SIG1;
+        host->step = ctl->in || ctl->len == 0 ? 3 : 6;
+        break;
+
+    case 4:
+        // DATAx (DATA), or ZDP (STATUS)
+        if (xfer->hsk == USBPID_NAK) {
+            host->step = 3;
+            break;
+        } else if (xfer->hsk == USBPID_STALL) {
+            host->op = HostIdle;
+            return -2;
+        } else if (status) {
+            if (xfer->rx_len != 0) {
+                ulpi_printf("HOST\t#%8lu cyc =>\tSTATUS stage not a ZDP [%s:%d]\n",
+                            host->cycle, __FILE__, __LINE__);
+                return -1;
+            }
+        } else if (xfer->rx_len > ctl->max_packet || xfer->rx_len > ctl->len - ctl->ptr) {
+            ulpi_printf("HOST\t#%8lu cyc =>\tBabble (%d bytes, at %u of %u) [%s:%d]\n",
+                        host->cycle, xfer->rx_len, ctl->ptr, ctl->len, __FILE__, __LINE__);
+            return -1;
+        } else {
+            memcpy(&host->buf[ctl->ptr], xfer->rx, xfer->rx_len);
+            ctl->ptr += xfer->rx_len;
+            ctl->last = xfer->rx_len < ctl->max_packet || ctl->ptr >= ctl->len;
+        }
+        host->step = 5;
+        break;
+
+    case 5:
+        // ACK (DATA), or ACK (STATUS)
+        if (status) {
+            host->op = HostIdle;
+            return 1;
+        }
+        transfer_ack(xfer);
+        if (ctl->last) {
+            xfer->ep_seq[0] = SIG1;
+            host->step = 6;
+        } else {
+            host->step = 3;
+        }
+        break;
+
+    case 6:
+        // OUT, so queue the next DATAx packet, or the ZDP (STATUS)
+        len = ctl->len - ctl->ptr;
+        len = status ? 0 : len < ctl->max_packet ? len : ctl->max_packet;
+        memcpy(xfer->tx, &host->buf[ctl->ptr], len);
+        xfer->type = xfer->ep_seq[0] == SIG0 ? DnDATA0 : DnDATA1;
+        xfer->stage = NoXfer;
+        xfer->tx_len = len;
+        xfer->tx_ptr = 0;
+        if (len > 0) {
+            const uint16_t crc = crc16_calc(xfer->tx, len);
+            xfer->crc1 = crc & 0xFF;
+            xfer->crc2 = (crc >> 8) & 0xFF;
+        } else {
+            xfer->crc1 = 0x00;
+            xfer->crc2 = 0x00;
+        }
+        host->step = 7;
+        break;
+
+    case 8:
+        // ACK (DATA), or ACK (STATUS)
+        if (xfer->hsk == USBPID_NAK) {
+            host->step = 6;
+            break;
+        } else if (xfer->hsk == USBPID_STALL) {
+            host->op = HostIdle;
+            return -2;
+        } else if (xfer->hsk != USBPID_ACK && xfer->hsk != USBPID_NYET) {
+            ulpi_printf("HOST\t#%8lu cyc =>\tOUT not ACK'd (0x%x) [%s:%d]\n",
+                        host->cycle, xfer->hsk, __FILE__, __LINE__);
+            return -1;
+        } else if (status) {
+            host->op = HostIdle;
+            return 1;
+        }
+        // Note: 'ack_recv_step()' has already toggled the sequence bit
+        ctl->ptr += xfer->tx_len;
+        if (xfer->tx_len < ctl->max_packet || ctl->ptr >= ctl->len) {
+            xfer->ep_seq[0] = SIG1;
+            host->step = 3;
+        } else {
+            host->step = 6;
+        }
+        break;
+
+    default:
+        // SETUP, DATA0 (SETUP), IN, and DATAx (OUT), so just advance
+        host->step++;
+        break;
+    }
+
+    return 0;
+}
+
 
 // -- Testbench -- //
 
@@ -340,7 +503,7 @@ void test_stdreq_get_desc(uint16_t num)
     ulpi_bus_t bus = {0};
     int result;
 
-    printf("Issuing 'GET DESCRIPTOR' [%s:%d]", __FILE__, __LINE__);
+    ulpi_printf("Issuing 'GET DESCRIPTOR' [%s:%d]", __FILE__, __LINE__);
 
     // -- Stage 1: SETUP -- //
 
@@ -380,5 +543,83 @@ void test_stdreq_get_desc(uint16_t num)
     assert(ulpi_step_with(datax_send_step, &xfer, &bus, user_func_step, NULL) == 1);
     xfer.ep_seq[0] = SIG0; // 'ACK'
 
-    printf("\t\tSUCCESS\n");
+    ulpi_printf("\t\tSUCCESS\n");
+}
+
+/**
+ * Step through multi-packet control transfers, packet-by-packet, by setting
+ * the handshakes & packet-lengths that the ULPI step-functions would give.
+ */
+void test_stdreq_next(void)
+{
+    usb_host_t host;
+    transfer_t* xfer = &host.xfer;
+    uint8_t data[100];
+    usb_stdreq_t req = {0xC0, 0x01, 0x0000, 0x0000, 200, NULL};
+
+    ulpi_printf("Testing multi-packet control transfers");
+    usbh_init(&host);
+    host.op = HostIdle;
+    host.eptab.max_packet0 = 64;
+
+    // Control-read, that ends with a ZDP, as 128 bytes is less than 'wLength'
+    assert(stdreq_control(&host, &req) == 1 && host.ctl.in);
+    assert(stdreq_next(&host) == 0 && stdreq_next(&host) == 0 && host.step == 2);
+    xfer->hsk = USBPID_ACK;
+    assert(stdreq_next(&host) == 0 && host.step == 3 && xfer->ep_seq[0] == SIG1);
+
+    for (int i=0; i<4; i++) {
+        assert(stdreq_next(&host) == 0 && host.step == 4);
+        xfer->hsk = i == 1 ? USBPID_NAK : 0;
+        xfer->rx_len = i < 3 ? 64 : 0;
+        memset(xfer->rx, i, 64);
+        assert(stdreq_next(&host) == 0);
+        if (i == 1) {
+            // NAK'd, so re-issue the IN, with the same sequence bit
+            assert(host.step == 3 && xfer->ep_seq[0] == SIG0 && host.ctl.ptr == 64);
+            continue;
+        }
+        assert(host.step == 5 && host.ctl.last == (i == 3));
+        assert(stdreq_next(&host) == 0);
+    }
+    assert(host.ctl.ptr == 128 && host.buf[127] == 2 && host.buf[63] == 0);
+    assert(host.step == 6 && xfer->ep_seq[0] == SIG1);
+    assert(stdreq_next(&host) == 0 && host.step == 7);
+    assert(xfer->type == DnDATA1 && xfer->tx_len == 0);
+    assert(stdreq_next(&host) == 0 && host.step == 8);
+    xfer->hsk = USBPID_ACK;
+    assert(stdreq_next(&host) == 1 && host.op == HostIdle);
+
+    // Control-write, of a max-sized and then a short packet, and an IN STATUS
+    for (int i=0; i<sizeof(data); i++) {
+        data[i] = i;
+    }
+    req.bmRequestType = 0x40;
+    req.bRequest = 0x02;
+    req.wLength = sizeof(data);
+    req.data = data;
+    assert(stdreq_control(&host, &req) == 1 && !host.ctl.in);
+    stdreq_next(&host);
+    stdreq_next(&host);
+    xfer->hsk = USBPID_ACK;
+    assert(stdreq_next(&host) == 0 && host.step == 6);
+
+    assert(stdreq_next(&host) == 0 && xfer->type == DnDATA1 && xfer->tx_len == 64);
+    assert(stdreq_next(&host) == 0 && host.step == 8);
+    xfer->hsk = USBPID_ACK;
+    transfer_ack(xfer);
+    assert(stdreq_next(&host) == 0 && host.step == 6);
+    assert(stdreq_next(&host) == 0 && xfer->type == DnDATA0 && xfer->tx_len == 36);
+    assert(xfer->tx[35] == 99);
+    assert(stdreq_next(&host) == 0 && host.step == 8);
+    xfer->hsk = USBPID_ACK;
+    transfer_ack(xfer);
+    assert(stdreq_next(&host) == 0 && host.step == 3 && xfer->ep_seq[0] == SIG1);
+    assert(stdreq_next(&host) == 0 && host.step == 4);
+    xfer->hsk = 0;
+    xfer->rx_len = 0;
+    assert(stdreq_next(&host) == 0 && host.step == 5);
+    assert(stdreq_next(&host) == 1 && host.op == HostIdle && host.ctl.ptr == 100);
+
+    ulpi_printf("\t\tSUCCESS\n");
 }
@@ -78,6 +78,9 @@ int get_descriptor(usb_stdreq_t* req, uint16_t type, uint16_t lang, uint16_t len
 // void stdreq_init(stdreq_steps_t* steps);
 void stdreq_show(usb_stdreq_t* req);
 int stdreq_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out);
+int stdreq_next(usb_host_t* host);
+
+int stdreq_control(usb_host_t* host, const usb_stdreq_t* req);
 
 int stdreq_get_descriptor(usb_host_t* host, uint16_t num);
 int stdreq_get_desc_device(usb_host_t* host);
@@ -90,6 +93,7 @@ int stdreq_set_config(usb_host_t* host, uint8_t conf);
 // -- Unit Tests -- //
 
 void test_stdreq_get_desc(uint16_t num);
+void test_stdreq_next(void);
 
 
 #endif  /* __STDREQ_H__ */
@@ -2,9 +2,13 @@
 #include "usbcrc.h"
 
 #include <assert.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef __profile
+#include <time.h>
+#endif
 
 //
 // Todo:
@@ -64,6 +68,86 @@ static const char stage_strings[20][16] = {
 };
 
 
+//
+//  Logging & Random Numbers
+///
+
+/**
+ * Each thread has its own log, so that concurrent host/function pairs don't
+ * contend for 'stdout' (or interleave their output).
+ */
+static _Thread_local FILE* ulpi_log = NULL;
+static _Thread_local bool ulpi_quiet = false;
+
+#ifdef __profile
+static _Thread_local uint64_t ulpi_log_time = 0;
+
+/**
+ * Total time that the calling thread has spent writing log messages.
+ */
+uint64_t ulpi_log_ns(void)
+{
+    return ulpi_log_time;
+}
+
+/**
+ * Bill time spent logging by other means (e.g., 'vpi_printf()'), to the
+ * calling thread.
+ */
+void ulpi_log_add(uint64_t ns)
+{
+    ulpi_log_time += ns;
+}
+#endif  /* __profile */
+
+/**
+ * Redirect the calling thread's log messages, or discard them if NULL.
+ */
+void ulpi_log_set(FILE* log)
+{
+    ulpi_log = log;
+    ulpi_quiet = log == NULL;
+}
+
+int ulpi_printf(const char* fmt, ...)
+{
+    va_list args;
+    int len;
+
+    if (ulpi_quiet) {
+        return 0;
+    }
+#ifdef __profile
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+#endif
+    va_start(args, fmt);
+    len = vfprintf(ulpi_log != NULL ? ulpi_log : stdout, fmt, args);
+    va_end(args);
+#ifdef __profile
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ulpi_log_add((uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ull +
+                 (uint64_t)(t1.tv_nsec - t0.tv_nsec));
+#endif
+
+    return len;
+}
+
+/**
+ * Xorshift32 generator, with the state held by the caller, so that each
+ * model instance has its own (reproducible) sequence.
+ */
+uint32_t ulpi_rand(uint32_t* state)
+{
+    uint32_t x = *state != 0 ? *state : 0x2545F491u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
 //
 //  Helper Routines
 ///
@@ -73,9 +157,14 @@ const char* transfer_type_string(const transfer_t* xfer)
     return type_strings[xfer->type];
 }
 
-char* transfer_string(const transfer_t* xfer)
+const char* transfer_stage_string(uint8_t stage)
+{
+    return stage < sizeof(stage_strings) / sizeof(stage_strings[0]) ?
+        stage_strings[stage] : "Unknown";
+}
+
+char* transfer_string(const transfer_t* xfer, char* str)
 {
-    static char str[256];
     const uint16_t tok = ((uint16_t)xfer->tok2 << 8) | xfer->tok1;
     const uint16_t crc = ((uint16_t)xfer->crc2 << 8) | xfer->crc1;
     uint16_t seq_val = 0;
@@ -85,7 +174,7 @@ char* transfer_string(const transfer_t* xfer)
         if (xfer->ep_seq[i] == 0) {
             continue;
         } else if (xfer->ep_seq[i] > 1) {
-            printf("\n[%s:%d] YUCKY seq[%d] = 0x%x\n\n", __FILE__, __LINE__, i, xfer->ep_seq[i]);
+            ulpi_printf("\n[%s:%d] YUCKY seq[%d] = 0x%x\n\n", __FILE__, __LINE__, i, xfer->ep_seq[i]);
             seq_str[0] = '0';
             seq_str[1] = 'x';
             seq_str[2] = 'X';
@@ -100,7 +189,7 @@ char* transfer_string(const transfer_t* xfer)
         sprintf(seq_str, "0x%04x", seq_val);
     }
 
-    sprintf(str, "addr: %u, ep: %u, type: %d (%s), stage: %d (%s), ep_seq: %s, "
+    snprintf(str, ULPI_STRING_LEN, "addr: %u, ep: %u, type: %d (%s), stage: %d (%s), ep_seq: %s, "
             "cycle: %u, tx: <%p>, tx_len: %d, tx_ptr: %d, rx: <%p>, rx_len: %d, "
             "rx_ptr: %d, tok: 0x%04x, crc: 0x%04x",
             xfer->address, xfer->endpoint, xfer->type, type_strings[xfer->type],
@@ -114,23 +203,24 @@ char* transfer_string(const transfer_t* xfer)
 
 void transfer_show(const transfer_t* xfer)
 {
-    printf("Transfer = {\n  %s\n};\n", transfer_string(xfer));
+    char str[ULPI_STRING_LEN];
+    ulpi_printf("Transfer = {\n  %s\n};\n", transfer_string(xfer, str));
 }
 
-char* ulpi_bus_string(const ulpi_bus_t* bus)
+char* ulpi_bus_string(const ulpi_bus_t* bus, char* str)
 {
-    static char str[256];
     unsigned int dat = bus->data.b << 8 | bus->data.a;
-    sprintf(str, "clock: %u, rst#: %u, dir: %u, nxt: %u, stp: %u, data: 0x%x",
+    snprintf(str, ULPI_STRING_LEN, "clock: %u, rst#: %u, dir: %u, nxt: %u, stp: %u, data: 0x%x",
             bus->clock, bus->rst_n, bus->dir, bus->nxt, bus->stp, dat);
     return str;
 }
 
 void ulpi_bus_show(const ulpi_bus_t* bus)
 {
-    printf("%s\n", ulpi_bus_string(bus));
+    char str[ULPI_STRING_LEN];
+    ulpi_printf("%s\n", ulpi_bus_string(bus, str));
     // unsigned int dat = bus->data.b << 8 | bus->data.a;
-    // printf("clock: %u, rst#: %u, dir: %u, nxt: %u, stp: %u, data: 0x%x\n",
+    // ulpi_printf("clock: %u, rst#: %u, dir: %u, nxt: %u, stp: %u, data: 0x%x\n",
     //        bus->clock, bus->rst_n, bus->dir, bus->nxt, bus->stp, dat);
 }
 
@@ -145,6 +235,31 @@ void ulpi_bus_idle(ulpi_bus_t* bus)
     bus->data.b = 0x00;
 }
 
+/**
+ * Combine the signals driven by the PHY and the link, into the values that both
+ * will see at the next clock-edge.
+ * Note: the link only drives 'data' if it saw 'dir' deasserted, at the previous
+ *   clock-edge.
+ */
+void ulpi_bus_merge(ulpi_bus_t* bus, const ulpi_bus_t* phy, const ulpi_bus_t* link)
+{
+    bus->clock = phy->clock;
+    bus->rst_n = phy->rst_n;
+    bus->dir = phy->dir;
+    bus->nxt = phy->nxt;
+    bus->stp = link->stp;
+
+    if (phy->dir == SIG1) {
+        bus->data = phy->data;
+    } else if (link->dir == SIG0) {
+        bus->data = link->data;
+    } else {
+        // Bus turn-around cycle, so nothing is driving 'data'
+        bus->data.a = 0x00;
+        bus->data.b = 0xFF;
+    }
+}
+
 void transfer_out(transfer_t* xfer, uint8_t addr, uint8_t ep)
 {
     xfer->address = addr;
@@ -218,8 +333,8 @@ int check_rx_crc16(transfer_t* xfer)
         uint16_t cod = crc16_calc(xfer->rx, xfer->rx_ptr);
         xfer->crc1 = crc & 0xFF;
         xfer->crc2 = (crc >> 8) & 0xFF;
-        printf("[%s:%d] CRC16: 0x%04X (check code: 0x%04X, length: %d)\n",
-               __FILE__, __LINE__, crc, cod, len);
+        ulpi_printf("[%s:%d] CRC16: 0x%04X (check code: 0x%04X, length: %d)\n",
+                    __FILE__, __LINE__, crc, cod, len);
         return xfer->crc1 == xfer->rx[len] && xfer->crc2 == xfer->rx[len+1] && cod == 0x4FFE;
     } else {
         return xfer->rx[0] == 0x00 && xfer->rx[1] == 0x00;
@@ -246,10 +361,10 @@ int drive_eop(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
     case Token2:
     case DATAxCRC2:
     case HskPID:
-        assert(in->nxt == SIG1);
-        assert(in->data.b == 0x00);
+        ULPI_CHECK(in->nxt == SIG1);
+        ULPI_CHECK(in->data.b == 0x00);
     case DATAxStop:
-        assert(in->dir == SIG1);
+        ULPI_CHECK(in->dir == SIG1);
         out->dir = SIG1;
         out->nxt = SIG0;
         out->data.a = 0x4D;
@@ -258,9 +373,9 @@ int drive_eop(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case EndRXCMD:
-        assert(out->dir == SIG1);
-        assert(out->nxt == SIG0);
-        assert(out->data.b == 0x00);
+        ULPI_CHECK(out->dir == SIG1);
+        ULPI_CHECK(out->nxt == SIG0);
+        ULPI_CHECK(out->data.b == 0x00);
         out->dir = SIG0;
         out->data.a = 0x00;
         out->data.b = 0xFF;
@@ -268,16 +383,16 @@ int drive_eop(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case LineIdle:
-        assert(in->dir == SIG0);
-        assert(in->nxt == SIG0);
-        assert(in->data.a == 0x00);
+        ULPI_CHECK(in->dir == SIG0);
+        ULPI_CHECK(in->nxt == SIG0);
+        ULPI_CHECK(in->data.a == 0x00);
         xfer->type = XferIdle;
         xfer->stage = NoXfer;
         return 1;
 
     default:
-        printf("[%s:%d] Not a valid EOP stage: %u (%s)\n", __FILE__, __LINE__,
-               xfer->stage, stage_strings[xfer->stage]);
+        ulpi_printf("[%s:%d] Not a valid EOP stage: %u (%s)\n", __FILE__, __LINE__,
+                    xfer->stage, stage_strings[xfer->stage]);
         return -1;
     }
 
@@ -296,33 +411,33 @@ int drive_eop(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
     case Token2:
     case DATAxCRC2:
     case HskPID:
-        assert(in->dir == SIG1);
-        assert(in->nxt == SIG1);
-        assert(in->data.b == 0x00);
+        ULPI_CHECK(in->dir == SIG1);
+        ULPI_CHECK(in->nxt == SIG1);
+        ULPI_CHECK(in->data.b == 0x00);
         out->nxt = SIG0;
         out->data.a = 0x4C; // RX CMD: RxActive = 0
         xfer->stage = EndRXCMD;
         break;
 
     case DATAxStop:
-        assert(in->nxt == SIG0);
+        ULPI_CHECK(in->nxt == SIG0);
         out->data.a = 0x4C;
         out->data.b = 0x00;
         xfer->stage = EndRXCMD;
         break;
 
     case EndRXCMD:
-        assert(out->dir == SIG1);
-        assert(out->nxt == SIG0);
-        assert(out->data.b == 0x00);
+        ULPI_CHECK(out->dir == SIG1);
+        ULPI_CHECK(out->nxt == SIG0);
+        ULPI_CHECK(out->data.b == 0x00);
         out->data.a = 0x4D;
         xfer->stage = EOP;
         break;
 
     case EOP:
-        assert(out->dir == SIG1);
-        assert(out->nxt == SIG0);
-        assert(out->data.b == 0x00);
+        ULPI_CHECK(out->dir == SIG1);
+        ULPI_CHECK(out->nxt == SIG0);
+        ULPI_CHECK(out->data.b == 0x00);
         out->dir = SIG0;
         out->data.a = 0x00;
         out->data.b = 0xFF;
@@ -330,16 +445,16 @@ int drive_eop(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case LineIdle:
-        assert(in->dir == SIG0);
-        assert(in->nxt == SIG0);
-        assert(in->data.a == 0x00);
+        ULPI_CHECK(in->dir == SIG0);
+        ULPI_CHECK(in->nxt == SIG0);
+        ULPI_CHECK(in->data.a == 0x00);
         xfer->type = XferIdle;
         xfer->stage = NoXfer;
         return 1;
 
     default:
-        printf("[%s:%d] Not a valid EOP stage: %u (%s)\n", __FILE__, __LINE__,
-               xfer->stage, stage_strings[xfer->stage]);
+        ulpi_printf("[%s:%d] Not a valid EOP stage: %u (%s)\n", __FILE__, __LINE__,
+                    xfer->stage, stage_strings[xfer->stage]);
         return -1;
     }
 
@@ -416,7 +531,7 @@ uint8_t transfer_type_to_pid(transfer_t* xfer)
         pid = USBPID_DATA1;
         break;
     default:
-        printf("[%s:%d] Invalid transfer type\n", __FILE__, __LINE__);
+        ulpi_printf("[%s:%d] Invalid transfer type\n", __FILE__, __LINE__);
         return 255;
     }
     if (xfer->type < UpACK) {
@@ -432,7 +547,7 @@ uint8_t transfer_type_to_pid(transfer_t* xfer)
 int token_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
 {
     if (xfer->stage > NoXfer && xfer->stage < LineIdle && in->dir != SIG1) {
-        printf(
+        ulpi_printf(
             "[%s:%d] Invalid ULPI bus signal levels for token-transmission\n",
             __FILE__, __LINE__);
         return -1;
@@ -478,9 +593,9 @@ int token_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
             break;
 
         case Token1:
-            assert(out->dir == SIG1);
-            assert(out->nxt == SIG1);
-            assert(out->data.b == 0x00);
+            ULPI_CHECK(out->dir == SIG1);
+            ULPI_CHECK(out->nxt == SIG1);
+            ULPI_CHECK(out->data.b == 0x00);
             out->data.a = xfer->tok2;
             xfer->stage = Token2;
             break;
@@ -491,7 +606,7 @@ int token_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     default:
-        printf("[%s:%d] Not a TOKEN: %u\n", __FILE__, __LINE__, xfer->type);
+        ulpi_printf("[%s:%d] Not a TOKEN: %u\n", __FILE__, __LINE__, xfer->type);
         return -1;
     }
 
@@ -503,7 +618,7 @@ int datax_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
     uint8_t pid = xfer->type == DnDATA0 ? 0xC3 : 0x4B;
 
     if (!check_seq(xfer, pid & 0x0f)) {
-        printf("[%s:%d] Invalid send DATAx parity: 0x%02x\n", __FILE__, __LINE__, pid);
+        ulpi_printf("[%s:%d] Invalid send DATAx parity: 0x%02x\n", __FILE__, __LINE__, pid);
         return -1;
     }
     memcpy(out, in, sizeof(ulpi_bus_t));
@@ -515,7 +630,7 @@ int datax_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         case NoXfer:
             // If ULPI bus is idle, grab it by asserting 'DIR'
             if (in->data.a != 0x00 || in->stp != SIG0) {
-                printf(
+                ulpi_printf(
                     "[%s:%d] ULPI bus not idle (data = %x, stp = %u) cannot send DATAx\n",
                     __FILE__, __LINE__,
                     (unsigned)in->data.a << 8 | (unsigned)in->data.b, in->stp);
@@ -582,7 +697,7 @@ int datax_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         }
         break;
     default:
-        printf("[%s:%d] Not a DATAx packet: %u\n", __FILE__, __LINE__, xfer->type);
+        ulpi_printf("[%s:%d] Not a DATAx packet: %u\n", __FILE__, __LINE__, xfer->type);
         return -1;
     }
 
@@ -599,6 +714,7 @@ int datax_recv_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         switch (xfer->stage) {
         case NoXfer:
             out->dir = SIG0;
+            xfer->hsk = 0;
             if (in->data.a != 0x00) {
                 out->nxt = SIG1;
                 xfer->stage = DATAxPID;
@@ -606,25 +722,29 @@ int datax_recv_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
             break;
 
         case DATAxPID:
-            assert(in->dir == SIG0);
-            assert(in->nxt == SIG1);
-            assert(in->data.b == 0x00);
+            ULPI_CHECK(in->dir == SIG0);
+            ULPI_CHECK(in->nxt == SIG1);
+            ULPI_CHECK(in->data.b == 0x00);
             out->nxt = SIG0;
             xfer->stage = DATAxBody;
             xfer->rx_ptr = 0;
-            if (in->data.a != ULPITX_DATA0 && in->data.a != ULPITX_DATA1) {
-                printf("[%s:%d] Invalid PID value: 0x%02x\n",
-                       __FILE__, __LINE__, in->data.a);
+            if (in->data.a == ULPITX_NAK || in->data.a == ULPITX_STALL) {
+                // Handshake instead of data, so just wait for 'STP'
+                xfer->hsk = in->data.a & 0x0F;
+                xfer->stage = HskPID;
+            } else if (in->data.a != ULPITX_DATA0 && in->data.a != ULPITX_DATA1) {
+                ulpi_printf("[%s:%d] Invalid PID value: 0x%02x\n",
+                            __FILE__, __LINE__, in->data.a);
                 return -2;
             } else if (!check_seq(xfer, in->data.a & 0x0F)) {
-                printf("[%s:%d] Invalid PID DATAx sequence bit: 0x%02x\n",
-                       __FILE__, __LINE__, in->data.a);
+                ulpi_printf("[%s:%d] Invalid PID DATAx sequence bit: 0x%02x\n",
+                            __FILE__, __LINE__, in->data.a);
                 return -3;
             }
             break;
 
         case DATAxBody:
-            assert(in->dir == SIG0);
+            ULPI_CHECK(in->dir == SIG0);
             // assert(in->data.b == 0x00); // Todo: not required, due to CRC16 checks !?
             if (in->stp == SIG1) {
                 // Turn around the ULPI bus, so that we can send an RX CMD
@@ -640,23 +760,45 @@ int datax_recv_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
                 out->data.b = 0xFF;
                 xfer->stage = DATAxStop;
 #endif  /* !__fast_eop */
+                if (xfer->rx_ptr < 2) {
+                    ulpi_printf("[%s:%d] DATAx packet too short\n", __FILE__, __LINE__);
+                    return -1;
+                }
                 xfer->rx_len = xfer->rx_ptr - 2;
                 if (check_rx_crc16(xfer) < 1) {
                     return -1;
                 }
             } else if (in->nxt == SIG1) {
+                if (xfer->rx_ptr >= MAX_PACKET_SIZE + 2) {
+                    ulpi_printf("[%s:%d] DATAx packet too long\n", __FILE__, __LINE__);
+                    return -1;
+                }
                 xfer->rx[xfer->rx_ptr++] = in->data.a;
             } else {
                 out->nxt = SIG1;
             }
             break;
 
+        case HskPID:
+            ULPI_CHECK(in->dir == SIG0);
+            out->nxt = SIG0;
+            if (in->stp == SIG1) {
+                xfer->stage = HskStop;
+            }
+            break;
+
+        case HskStop:
+            ulpi_printf("[%s:%d] %s received\n", __FILE__, __LINE__,
+                        xfer->hsk == USBPID_NAK ? "NAK" : "STALL");
+            xfer->stage = NoXfer;
+            return 1;
+
         default:
             return drive_eop(xfer, in, out);
         }
         break;
     default:
-        printf("[%s:%d] Not a DATAx packet: %u\n", __FILE__, __LINE__, xfer->type);
+        ulpi_printf("[%s:%d] Not a DATAx packet: %u\n", __FILE__, __LINE__, xfer->type);
         return -1;
     }
 
@@ -671,8 +813,8 @@ int ack_recv_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
 {
     if (xfer->type != UpACK) {
         transfer_show(xfer);
-        printf("[%s:%d] Not an upstream 'ACK' transfer: %d (%s)\n", __FILE__,
-               __LINE__, xfer->type, type_strings[xfer->type]);
+        ulpi_printf("[%s:%d] Not an upstream 'ACK' transfer: %d (%s)\n", __FILE__,
+                    __LINE__, xfer->type, type_strings[xfer->type]);
         return -1;
     }
 
@@ -682,22 +824,40 @@ int ack_recv_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         if (!ulpi_bus_is_idle(in)) {
             switch (in->data.a) {
             case ULPITX_ACK:
-                printf("[%s:%d] ACK received\n", __FILE__, __LINE__);
+                ulpi_printf("[%s:%d] ACK received\n", __FILE__, __LINE__);
                 out->nxt = SIG1;
                 xfer->stage = HskPID;
+                xfer->hsk = USBPID_ACK;
                 transfer_ack(xfer);
                 break;
+            case ULPITX_NYET:
+                // Data accepted, but the function has no room for more
+                ulpi_printf("[%s:%d] NYET received\n", __FILE__, __LINE__);
+                out->nxt = SIG1;
+                xfer->stage = HskPID;
+                xfer->hsk = USBPID_NYET;
+                transfer_ack(xfer);
+                break;
+            case ULPITX_NAK:
+            case ULPITX_STALL:
+                // Data not accepted, so the sequence bit is unchanged
+                ulpi_printf("[%s:%d] %s received\n", __FILE__, __LINE__,
+                            in->data.a == ULPITX_NAK ? "NAK" : "STALL");
+                out->nxt = SIG1;
+                xfer->stage = HskPID;
+                xfer->hsk = in->data.a & 0x0F;
+                break;
             default:
-                printf("[%s:%d] Unexpected TX CMD: 0x%02x\n",
-                       __FILE__, __LINE__, in->data.a);
+                ulpi_printf("[%s:%d] Unexpected TX CMD: 0x%02x\n",
+                            __FILE__, __LINE__, in->data.a);
                 return -1;
             }
         }
         break;
 
     case HskPID:
-        assert(in->dir == SIG0);
-        assert(in->data.b == 0x00);
+        ULPI_CHECK(in->dir == SIG0);
+        ULPI_CHECK(in->data.b == 0x00);
         out->nxt = SIG0;
         if (in->stp == SIG1) {
             xfer->stage = HskStop;
@@ -706,15 +866,15 @@ int ack_recv_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
 
     case HskStop:
         // Todo: RX CMD !?
-        assert(in->dir == SIG0);
-        assert(in->nxt == SIG0);
-        assert(in->stp == SIG0);
+        ULPI_CHECK(in->dir == SIG0);
+        ULPI_CHECK(in->nxt == SIG0);
+        ULPI_CHECK(in->stp == SIG0);
         xfer->stage = XferIdle;
         return 1;
 
     default:
-        printf("[%s:%d] Unexpected ACK receive stage: %u (%s)\n",
-               __FILE__, __LINE__, xfer->stage, stage_strings[xfer->stage]);
+        ulpi_printf("[%s:%d] Unexpected ACK receive stage: %u (%s)\n",
+                    __FILE__, __LINE__, xfer->stage, stage_strings[xfer->stage]);
         return -1;
     }
 
@@ -729,8 +889,8 @@ int ack_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
 {
     if (xfer->type != DnACK) {
         transfer_show(xfer);
-        printf("[%s:%d] Not a downstream 'ACK' transfer: %d (%s)\n", __FILE__,
-               __LINE__, xfer->type, type_strings[xfer->type]);
+        ulpi_printf("[%s:%d] Not a downstream 'ACK' transfer: %d (%s)\n", __FILE__,
+                    __LINE__, xfer->type, type_strings[xfer->type]);
         return -1;
     }
 
@@ -738,8 +898,8 @@ int ack_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
 
     case NoXfer:
         if (!ulpi_bus_is_idle(in)) {
-            printf("[%s:%d] ULPI bus is busy, not ready to send 'ACK'\n",
-                   __FILE__, __LINE__);
+            ulpi_printf("[%s:%d] ULPI bus is busy, not ready to send 'ACK'\n",
+                        __FILE__, __LINE__);
             return -1;
         }
         out->dir = SIG1;
@@ -750,9 +910,9 @@ int ack_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case AssertDir:
-        assert(in->dir == SIG1);
-        assert(in->nxt == SIG1);
-        assert(in->stp == SIG0);
+        ULPI_CHECK(in->dir == SIG1);
+        ULPI_CHECK(in->nxt == SIG1);
+        ULPI_CHECK(in->stp == SIG0);
         out->nxt = SIG0;
         out->data.a = 0x5D; // RX CMD: RxActive = 1
         out->data.b = 0x00;
@@ -760,10 +920,10 @@ int ack_send_step(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     case InitRXCMD:
-        assert(in->dir == SIG1);
-        assert(in->nxt == SIG0);
-        assert(in->stp == SIG0);
-        assert(in->data.b == 0x00);
+        ULPI_CHECK(in->dir == SIG1);
+        ULPI_CHECK(in->nxt == SIG0);
+        ULPI_CHECK(in->stp == SIG0);
+        ULPI_CHECK(in->data.b == 0x00);
         out->nxt = SIG1;
         out->data.a = transfer_type_to_pid(xfer);
         xfer->stage = HskPID;
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 
 // #define __fast_eop
@@ -18,6 +19,9 @@
 #define SIGZ 2
 #define SIGX 3
 
+// Size of the buffers for the bus- and transfer-strings
+#define ULPI_STRING_LEN 256
+
 
 /**
  * VPI scalar value, 0-5.
@@ -169,13 +173,14 @@ typedef struct {
     uint8_t tx[MAX_PACKET_SIZE];
     int tx_len;
     int tx_ptr;
-    uint8_t rx[MAX_PACKET_SIZE];
+    uint8_t rx[MAX_PACKET_SIZE + 2]; // Includes the CRC16 bytes
     int rx_len;
     int rx_ptr;
     uint8_t tok1;
     uint8_t tok2;
     uint8_t crc1;
     uint8_t crc2;
+    uint8_t hsk; // PID of the last handshake, or 0 if none
 } transfer_t;
 
 
@@ -200,6 +205,20 @@ static inline bool ulpi_bus_is_idle(const ulpi_bus_t* bus)
             bus->dir == SIG0 && bus->nxt == SIG0 && bus->stp == SIG0);
 }
 
+/**
+ * Checks a bus-value that was driven by the other side of the ULPI bus, and
+ * fails the step-function (rather than aborting) if the check fails, as
+ * malformed bus input is an error of the device under test.
+ */
+#define ULPI_CHECK(cond)                                                \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            ulpi_printf("[%s:%d] ULPI bus check failed: %s\n",         \
+                        __FILE__, __LINE__, #cond);                     \
+            return -1;                                                  \
+        }                                                               \
+    } while (0)
+
 static inline bool check_pid(const ulpi_bus_t* bus)
 {
     if (bus->data.b != 0x00) {
@@ -218,15 +237,25 @@ static inline bool check_seq(const transfer_t* xfer, const uint8_t pid)
 }
 
 int check_rx_crc16(transfer_t* xfer);
+
+void ulpi_log_set(FILE* log);
+int ulpi_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+#ifdef __profile
+uint64_t ulpi_log_ns(void);
+void ulpi_log_add(uint64_t ns);
+#endif
+uint32_t ulpi_rand(uint32_t* state);
 int drive_eop(transfer_t* xfer, const ulpi_bus_t* in, ulpi_bus_t* out);
 
 void ulpi_bus_idle(ulpi_bus_t* bus);
+void ulpi_bus_merge(ulpi_bus_t* bus, const ulpi_bus_t* phy, const ulpi_bus_t* link);
 void ulpi_bus_show(const ulpi_bus_t* bus);
-char* ulpi_bus_string(const ulpi_bus_t* bus);
+char* ulpi_bus_string(const ulpi_bus_t* bus, char* str);
 
 void transfer_show(const transfer_t* xfer);
 const char* transfer_type_string(const transfer_t* xfer);
-char* transfer_string(const transfer_t* xfer);
+const char* transfer_stage_string(uint8_t stage);
+char* transfer_string(const transfer_t* xfer, char* str);
 uint8_t transfer_type_to_pid(transfer_t* xfer);
 void transfer_out(transfer_t* xfer, uint8_t addr, uint8_t ep);
 void transfer_in(transfer_t* xfer, uint8_t addr, uint8_t ep);
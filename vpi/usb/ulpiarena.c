@@ -0,0 +1,139 @@
+#include "ulpiarena.h"
+#include "ulpi.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Chunk headers are padded, so that the data is aligned (as 'malloc()' is)
+#define CHUNK_HEADER  ((sizeof(ulpi_chunk_t) + ULPI_ARENA_ALIGN - 1) & ~(size_t)(ULPI_ARENA_ALIGN - 1))
+#define CHUNK_DATA(c) ((uint8_t*)(c) + CHUNK_HEADER)
+
+
+static ulpi_chunk_t* arena_chunk(ulpi_arena_t* arena, size_t size)
+{
+    const size_t bytes = size > ULPI_ARENA_CHUNK ? size : ULPI_ARENA_CHUNK;
+    ulpi_chunk_t* chunk = (ulpi_chunk_t*)malloc(CHUNK_HEADER + bytes);
+
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = bytes;
+    chunk->used = 0;
+    arena->reserved += bytes;
+
+    return chunk;
+}
+
+ulpi_arena_t* ulpi_arena_create(void)
+{
+    ulpi_arena_t* arena = (ulpi_arena_t*)malloc(sizeof(ulpi_arena_t));
+    memset(arena, 0, sizeof(ulpi_arena_t));
+    arena->chunks = arena_chunk(arena, ULPI_ARENA_CHUNK);
+    arena->head = arena->chunks;
+    return arena;
+}
+
+void ulpi_arena_free(ulpi_arena_t* arena)
+{
+    ulpi_chunk_t* chunk;
+
+    if (arena == NULL) {
+        return;
+    }
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+    free(arena);
+}
+
+/**
+ * Allocate from the current chunk, else from the next (previously reserved)
+ * chunk that fits, and only reserve another chunk once they are all used.
+ */
+void* ulpi_arena_alloc(ulpi_arena_t* arena, size_t size)
+{
+    ulpi_chunk_t* chunk = arena->head;
+    void* ptr;
+
+    size = (size + ULPI_ARENA_ALIGN - 1) & ~(size_t)(ULPI_ARENA_ALIGN - 1);
+
+    while (chunk->used + size > chunk->size) {
+        if (chunk->next == NULL) {
+            chunk->next = arena_chunk(arena, size);
+            if (chunk->next == NULL) {
+                return NULL;
+            }
+        }
+        chunk = chunk->next;
+    }
+
+    ptr = CHUNK_DATA(chunk) + chunk->used;
+    memset(ptr, 0, size);
+    chunk->used += size;
+    arena->head = chunk;
+    arena->used += size;
+    arena->allocs++;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+
+    return ptr;
+}
+
+/**
+ * Release all of the allocations, but keep the chunks, for reuse.
+ */
+void ulpi_arena_reset(ulpi_arena_t* arena)
+{
+    for (ulpi_chunk_t* chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->head = arena->chunks;
+    arena->used = 0;
+    arena->resets++;
+}
+
+void ulpi_arena_show(const ulpi_arena_t* arena, const char* name)
+{
+    ulpi_printf("ARENA\t%s: %u allocs, %u resets, peak: %lu bytes, reserved: %lu bytes\n",
+                name, arena->allocs, arena->resets, arena->peak, arena->reserved);
+}
+
+
+// -- Unit Tests -- //
+
+/**
+ * Resets have to reuse the chunks, so that the reserved memory stays flat
+ * across many tests, including for allocations larger than a chunk.
+ */
+void test_arena(void)
+{
+    ulpi_arena_t* arena = ulpi_arena_create();
+    uint8_t* a;
+    uint8_t* b;
+
+    ulpi_printf("Testing arena allocations");
+
+    a = (uint8_t*)ulpi_arena_alloc(arena, 3);
+    b = (uint8_t*)ulpi_arena_alloc(arena, 100);
+    assert(((uintptr_t)a & (ULPI_ARENA_ALIGN - 1)) == 0 && b == a + ULPI_ARENA_ALIGN);
+    assert(arena->used == 16 + 112 && b[99] == 0);
+
+    for (int i=0; i<1000; i++) {
+        ulpi_arena_reset(arena);
+        a = (uint8_t*)ulpi_arena_alloc(arena, ULPI_ARENA_CHUNK - 64);
+        b = (uint8_t*)ulpi_arena_alloc(arena, 3 * ULPI_ARENA_CHUNK);
+        memset(a, 0xA5, ULPI_ARENA_CHUNK - 64);
+        memset(b, 0x5A, 3 * ULPI_ARENA_CHUNK);
+        assert(ulpi_arena_alloc(arena, 64) != NULL);
+    }
+    assert(arena->reserved == 5 * ULPI_ARENA_CHUNK && arena->resets == 1000);
+    assert(arena->peak == 4 * ULPI_ARENA_CHUNK);
+
+    ulpi_arena_free(arena);
+    ulpi_printf("\t\tSUCCESS\n");
+}
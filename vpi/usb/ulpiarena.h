@@ -0,0 +1,47 @@
+#ifndef __ULPIARENA_H__
+#define __ULPIARENA_H__
+/**
+ * Bump-allocator for test-cases, and their transactions, so that everything
+ * allocated for a test is released at once, when the test completes, and its
+ * chunks are then reused by the next test.
+ * NOTE:
+ *  - chunks are kept (and reused) across resets, so the memory in use is that
+ *    of the largest test, rather than of all the tests so far;
+ *  - allocations are zeroed, and 16-byte aligned;
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define ULPI_ARENA_CHUNK 65536
+#define ULPI_ARENA_ALIGN 16
+
+
+typedef struct __ulpi_chunk {
+    struct __ulpi_chunk* next;
+    size_t size;
+    size_t used;
+} ulpi_chunk_t;
+
+typedef struct {
+    ulpi_chunk_t* chunks;
+    ulpi_chunk_t* head;         // chunk currently being allocated from
+    size_t used;
+    size_t peak;
+    size_t reserved;
+    uint32_t allocs;
+    uint32_t resets;
+} ulpi_arena_t;
+
+
+ulpi_arena_t* ulpi_arena_create(void);
+void ulpi_arena_free(ulpi_arena_t* arena);
+void* ulpi_arena_alloc(ulpi_arena_t* arena, size_t size);
+void ulpi_arena_reset(ulpi_arena_t* arena);
+void ulpi_arena_show(const ulpi_arena_t* arena, const char* name);
+
+void test_arena(void);
+
+
+#endif  /* __ULPIARENA_H__ */
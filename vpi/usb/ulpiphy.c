@@ -39,11 +39,55 @@
 #endif /* !__short_timers */
 
 
-// Initialisation/reset/default values for the ULPI PHY registers.
-static const uint8_t ULPI_REG_DEFAULTS[10] = {
-    0x24, 0x04, 0x06, 0x00, 0x41, 0x41, 0x41, 0x00, 0x00, 0x00
+// Initialisation/reset/default values for the ULPI PHY registers, where the
+// write, set, and clear addresses of a register all read back its value.
+static const uint8_t ULPI_REG_DEFAULTS[UPHY_NUM_REGS] = {
+    [VendorIDLow]           = 0x24,
+    [VendorIDHigh]          = 0x04,
+    [ProductIDLow]          = 0x06,
+    [ProductIDHigh]         = 0x00,
+    [FunctionControlWrite]  = 0x41, 0x41, 0x41,
+    [InterfaceControlWrite] = 0x00, 0x00, 0x00,
+    [OTGControlWrite]       = 0x06, 0x06, 0x06,
+    [USBIntEnRiseWrite]     = 0x1F, 0x1F, 0x1F,
+    [USBIntEnFallWrite]     = 0x1F, 0x1F, 0x1F,
+    [USBIntStatus]          = 0x00,
+    [USBIntLatch]           = 0x00,
+    [Debug]                 = 0x00,
+    [ScratchWrite]          = 0x00, 0x00, 0x00,
 };
 
+static const char phy_op_strings[22][16] = {
+    {"Disconnected"},
+    {"ErrorResetB"},
+    {"Undefined"},
+    {"PowerOn"},
+    {"RefClkValid"},
+    {"Starting"},
+    {"WaitForIdle"},
+    {"StatusRXCMD"},
+    {"PhyIdle"},
+    {"PhyRecv"},
+    {"PhySend"},
+    {"PhyREGW"},
+    {"PhyREGI"},
+    {"PhyStop"},
+    {"PhyREGR"},
+    {"PhyREGZ"},
+    {"PhyREGO"},
+    {"PhySuspend"},
+    {"PhyResume"},
+    {"PhyChirpJ"},
+    {"PhyChirpK"},
+    {"HostChirp"}
+};
+
+
+const char* phy_op_string(int8_t op)
+{
+    return op >= Disconnected && op <= HostChirp ? phy_op_strings[op+3] : "Unknown";
+}
+
 
 bool ulpi_phy_is_idle(const ulpi_phy_t* phy)
 {
@@ -74,10 +118,44 @@ bool ulpi_phy_is_reg_write(const ulpi_phy_t* phy, const ulpi_bus_t* in)
  */
 static bool ulpi_phy_is_chirp(const ulpi_phy_t* phy)
 {
-    // printf("PHY function-control register: 0x%x\n", phy->state.regs[UPHY_REG_FN_CTRL]);
+    // ulpi_printf("PHY function-control register: 0x%x\n", phy->state.regs[UPHY_REG_FN_CTRL]);
     return (phy->state.regs[UPHY_REG_FN_CTRL] & 0x1C) == 0x14;
 }
 
+/**
+ * Register write, with the set/clear semantics of the write/set/clear address
+ * triples, and where writes to the read-only registers are ignored. Returns
+ * the address of the register that was written.
+ */
+static uint8_t uphy_reg_write(ulpi_phy_t* phy, uint8_t addr, uint8_t value)
+{
+    uint8_t* regs = phy->state.regs;
+
+    if (addr < FunctionControlWrite || (addr >= USBIntStatus && addr <= Debug)) {
+        return addr;
+    } else if (addr <= USBIntEnFallClear || (addr >= ScratchWrite && addr <= ScratchClear)) {
+        const uint8_t base = addr - (addr - FunctionControlWrite) % 3;
+
+        switch (addr - base) {
+        case 0:
+            regs[base] = value;
+            break;
+        case 1:
+            regs[base] |= value;
+            break;
+        default:
+            regs[base] &= ~value;
+            break;
+        }
+        regs[base + 1] = regs[base];
+        regs[base + 2] = regs[base];
+        return base;
+    }
+
+    regs[addr] = value;
+    return addr;
+}
+
 static uint32_t ulpi_bus_data_hex(const ulpi_bus_t* in)
 {
     return (uint32_t)in->data.b << 8 | (uint32_t)in->data.a;
@@ -100,7 +178,7 @@ static int uphy_chirp_kj_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t*
         break;
 
     default:
-        printf("Unexpected PHY state: 0x%x (%u)\n", phy->state.op, phy->state.op);
+        ulpi_printf("Unexpected PHY state: 0x%x (%u)\n", phy->state.op, phy->state.op);
         break;
     }
 
@@ -124,7 +202,7 @@ static int uphy_txcmd_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* ou
     uint8_t txcmd = in->data.a & UPHY_TXCMD_MASK;
     uint8_t regpid = in->data.a & 0x3F;
 
-    assert(in->dir == SIG0 && in->nxt == SIG0);
+    ULPI_CHECK(in->dir == SIG0 && in->nxt == SIG0);
 
     switch (txcmd) {
 
@@ -141,17 +219,17 @@ static int uphy_txcmd_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* ou
         break;
 
     case UPHY_REGR_BITS:
-        phy->state.regnum = in->data.a & 0x3F;
-        phy->state.op = PhyREGR;
-        break;
-
     case UPHY_REGW_BITS:
-        phy->state.regnum = in->data.a & 0x3F;
-        phy->state.op = PhyREGW;
+        if (regpid == ExtendedReg) {
+            ulpi_printf("Unsupported (extended) PHY register access: 0x%x\n", in->data.a);
+            return -1;
+        }
+        phy->state.regnum = regpid;
+        phy->state.op = txcmd == UPHY_REGR_BITS ? PhyREGR : PhyREGW;
         break;
 
     default:
-        printf("Invalid TX CMD bits: 0x%x\n", in->data.a);
+        ulpi_printf("Invalid TX CMD bits: 0x%x\n", in->data.a);
         return -1;
     }
 
@@ -175,7 +253,7 @@ static void uphy_reset(ulpi_phy_t* phy)
 // Todo ...
 ulpi_phy_t* phy_init(void)
 {
-    ulpi_phy_t* phy = (ulpi_phy_t*)malloc(sizeof(ulpi_phy_t));
+    ulpi_phy_t* phy = (ulpi_phy_t*)calloc(1, sizeof(ulpi_phy_t));
     uphy_reset(phy);
 
     phy->bus.clock = SIGX;
@@ -201,7 +279,7 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
     }
     memcpy(out, in, sizeof(ulpi_bus_t));
 
-    assert(in->clock == SIG1);
+    ULPI_CHECK(in->clock == SIG1);
 
     const int8_t op = phy->state.op;
     switch (op) {
@@ -237,11 +315,11 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
         } else if (ulpi_bus_is_idle(&phy->bus) && in->data.b == 0x00 && in->data.a != 0x00) {
             // Idle -> Busy
             // Todo: we only allow REG(R/W) commands, during start-up
-            assert((in->data.a & 0x80) == 0x80);
+            ULPI_CHECK((in->data.a & 0x80) == 0x80);
             return uphy_txcmd_step(phy, in, out);
         } else {
-            printf("Invalid start-up, SE0 expected for 2.5 us (0x%x)\n",
-                   ulpi_bus_data_hex(in));
+            ulpi_printf("Invalid start-up, SE0 expected for 2.5 us (0x%x)\n",
+                        ulpi_bus_data_hex(in));
             phy->state.op = Undefined;
             return -1;
         }
@@ -300,7 +378,7 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
                 break;
 
             default:
-                printf("Invalid line speed-state: 0x%x\n", phy->state.speed);
+                ulpi_printf("Invalid line speed-state: 0x%x\n", phy->state.speed);
                 return -1;
             }
         }
@@ -317,8 +395,8 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
                 // Idle -> Busy
                 return uphy_txcmd_step(phy, in, out);
             } else if (!ulpi_bus_is_idle(in)) {
-                printf("Unexpected non-TX CMD, while idle: 0x%x\n",
-                       ulpi_bus_data_hex(in));
+                ulpi_printf("Unexpected non-TX CMD, while idle: 0x%x\n",
+                            ulpi_bus_data_hex(in));
                 return -1;
             } else if (phy->state.update != 0) {
                 // Send an RX CMD
@@ -340,7 +418,7 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
             out->nxt = SIG1;
             phy->state.op = PhyREGI;
         } else {
-            printf("Invalid UPLI bus (TXCMD) value: 0x%x\n", ulpi_bus_data_hex(in));
+            ulpi_printf("Invalid UPLI bus (TXCMD) value: 0x%x\n", ulpi_bus_data_hex(in));
             phy->state.op = Undefined;
             return -1;
         }
@@ -351,22 +429,22 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
             out->dir = SIG0;
             out->nxt = SIG0;
             // PHY electrical settings may have changed, so schedule an RX CMD
-            phy->state.update = phy->state.regnum == UPHY_REG_FN_CTRL;
-            phy->state.regs[phy->state.regnum] = in->data.a;
+            phy->state.update =
+                uphy_reg_write(phy, phy->state.regnum, in->data.a) == UPHY_REG_FN_CTRL;
             phy->state.op = PhyStop;
         } else {
-            printf("Invalid UPLI bus data: 0x%x\n", ulpi_bus_data_hex(in));
+            ulpi_printf("Invalid UPLI bus data: 0x%x\n", ulpi_bus_data_hex(in));
             phy->state.op = Undefined;
             return -1;
         }
         break;
 
     case PhyStop:
-        assert(in->dir == SIG0 && in->nxt == SIG0);
+        ULPI_CHECK(in->dir == SIG0 && in->nxt == SIG0);
         if (in->stp == SIG1) {
             phy->state.op = PhyIdle;
         } else {
-            printf("Expected link to assert 'stp' (%u)\n", in->stp);
+            ulpi_printf("Expected link to assert 'stp' (%u)\n", in->stp);
             phy->state.op = Undefined;
             return -1;
         }
@@ -415,7 +493,7 @@ int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out)
         break;
 
     default:
-        printf("Unexpected PHY state: 0x%x (%u)\n", phy->state.op, phy->state.op);
+        ulpi_printf("Unexpected PHY state: 0x%x (%u)\n", phy->state.op, phy->state.op);
         phy->state.op = Undefined;
         return -1;
     }
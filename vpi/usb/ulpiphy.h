@@ -21,11 +21,29 @@ typedef enum __ulpi_reg_map {
     InterfaceControlWrite = 7,
     InterfaceControlSet,
     InterfaceControlClear,
+    OTGControlWrite = 0x0A,
+    OTGControlSet,
+    OTGControlClear,
+    USBIntEnRiseWrite = 0x0D,
+    USBIntEnRiseSet,
+    USBIntEnRiseClear,
+    USBIntEnFallWrite = 0x10,
+    USBIntEnFallSet,
+    USBIntEnFallClear,
+    USBIntStatus = 0x13,
+    USBIntLatch,
+    Debug,
+    ScratchWrite = 0x16,
+    ScratchSet,
+    ScratchClear,
+    ExtendedReg = 0x2F,         // escape for extended register-addresses
+    VendorSpecific = 0x30,
 } ulpi_reg_map_t;
 
 
 #define UPHY_REG_FN_CTRL 4
 #define UPHY_REG_IF_CTRL 7
+#define UPHY_NUM_REGS    0x40   // the immediate register-address space
 
 
 #define XCVR_SELECT_MASK 0x03
@@ -93,7 +111,7 @@ typedef struct {
     uint32_t timer;
     int8_t op;
     RX_CMD_t rx_cmd;
-    uint8_t regs[10];
+    uint8_t regs[UPHY_NUM_REGS];
     uint8_t regnum;
     uint8_t update;
     uint8_t speed;
@@ -122,6 +140,7 @@ static inline void phy_drive_rx_cmd(ulpi_phy_t* phy)
 ulpi_phy_t* phy_init(void);
 void phy_free(ulpi_phy_t* phy);
 int uphy_step(ulpi_phy_t* phy, const ulpi_bus_t* in, ulpi_bus_t* out);
+const char* phy_op_string(int8_t op);
 
 
 #endif  /* __ULPIPHY_H__ */
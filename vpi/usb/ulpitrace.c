@@ -0,0 +1,178 @@
+#include "ulpitrace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#define FNV_OFFSET 0xCBF29CE484222325ull
+#define FNV_PRIME  0x00000100000001B3ull
+
+
+/**
+ * Read the checkpoints of the golden file, which must have been recorded with
+ * the same window-size.
+ */
+static int trace_load(ulpi_trace_t* trace, const char* path)
+{
+    char line[128];
+    uint64_t num = 0, size = 1024;
+    unsigned window = 0;
+
+    if (fgets(line, sizeof(line), trace->file) == NULL ||
+        sscanf(line, ULPI_TRACE_HEADER "%u", &window) != 1) {
+        ulpi_printf("[%s:%d] '%s' is not a ULPI trace\n", __FILE__, __LINE__, path);
+        return -1;
+    } else if (window != trace->window) {
+        ulpi_printf("[%s:%d] '%s' has a window of %u cycles, not %u\n", __FILE__,
+                    __LINE__, path, window, trace->window);
+        return -1;
+    }
+
+    trace->golden = (uint64_t*)malloc(size * sizeof(uint64_t));
+    while (fgets(line, sizeof(line), trace->file) != NULL) {
+        uint64_t index, first, last, hash;
+
+        if (sscanf(line, "%lu %lu %lu %lx",
+                   &index, &first, &last, &hash) != 4 || index != num) {
+            ulpi_printf("[%s:%d] '%s' has a bad checkpoint: %s", __FILE__, __LINE__,
+                        path, line);
+            free(trace->golden);
+            trace->golden = NULL;
+            return -1;
+        }
+        if (num == size) {
+            size *= 2;
+            trace->golden = (uint64_t*)realloc(trace->golden, size * sizeof(uint64_t));
+        }
+        trace->golden[num++] = hash;
+        trace->golden_end = last + 1;
+    }
+    trace->golden_num = num;
+
+    return 0;
+}
+
+/**
+ * Record, or compare, the checkpoint for the current window, which covers the
+ * 'len' cycles that precede 'trace->cycle'.
+ */
+static int trace_checkpoint(ulpi_trace_t* trace, uint64_t len)
+{
+    const uint64_t index = trace->checkpoints++;
+    const uint64_t last = trace->cycle - 1;
+    const uint64_t first = trace->cycle - len;
+    const uint64_t hash = trace->hash;
+
+    trace->hash = FNV_OFFSET;
+
+    if (!trace->compare) {
+        fprintf(trace->file, "%lu %lu %lu %016lx\n",
+                index, first, last, hash);
+        return 0;
+    } else if (index >= trace->golden_num) {
+        ulpi_printf("ULPI trace diverged at window %lu (cycles %lu..%lu): the golden "
+                    "trace ends at cycle %lu\n", index, first, last, trace->golden_end);
+    } else if (trace->golden[index] != hash) {
+        ulpi_printf("ULPI trace diverged at window %lu (cycles %lu..%lu): hash %016lx, "
+                    "expected %016lx\n",
+                    index, first, last, hash, trace->golden[index]);
+    } else {
+        return 0;
+    }
+
+    trace->diverged = true;
+    return -1;
+}
+
+
+//
+//  Public API Routines
+///
+
+/**
+ * Open the trace file, for recording the checkpoints, or, if 'compare' is set,
+ * load the golden checkpoints from it.
+ */
+int ulpi_trace_open(ulpi_trace_t* trace, const char* path, bool compare, uint32_t window)
+{
+    memset(trace, 0, sizeof(ulpi_trace_t));
+    trace->compare = compare;
+    trace->window = window > 0 ? window : ULPI_TRACE_WINDOW;
+    trace->hash = FNV_OFFSET;
+
+    if ((trace->file = fopen(path, compare ? "r" : "w")) == NULL) {
+        ulpi_printf("[%s:%d] cannot open ULPI trace '%s'\n", __FILE__, __LINE__, path);
+        return -1;
+    } else if (!compare) {
+        fprintf(trace->file, ULPI_TRACE_HEADER "%u\n", trace->window);
+        return 0;
+    }
+
+    int result = trace_load(trace, path);
+    fclose(trace->file);
+    trace->file = NULL;
+
+    return result;
+}
+
+/**
+ * Fold the bus values of this clock-edge into the hash of the current window.
+ * Returns -1 once the trace diverges from the golden trace.
+ */
+int ulpi_trace_step(ulpi_trace_t* trace, const ulpi_bus_t* bus)
+{
+    const uint8_t vals[6] = {
+        bus->rst_n, bus->dir, bus->nxt, bus->stp, bus->data.a, bus->data.b
+    };
+    uint64_t hash = trace->hash;
+
+    if (trace->diverged) {
+        return -1;
+    }
+
+    for (int i=0; i<6; i++) {
+        hash = (hash ^ vals[i]) * FNV_PRIME;
+    }
+    trace->hash = hash;
+
+    if (++trace->cycle % trace->window == 0) {
+        return trace_checkpoint(trace, trace->window);
+    }
+    return 0;
+}
+
+/**
+ * Emit the checkpoint for the final (partial) window, and when comparing,
+ * check that the golden trace is not any longer.
+ * Returns -1 if the trace diverged, or could not be written.
+ */
+int ulpi_trace_close(ulpi_trace_t* trace)
+{
+    const uint64_t rem = trace->cycle % trace->window;
+    int result = trace->diverged ? -1 : 0;
+
+    if (result == 0 && rem > 0) {
+        result = trace_checkpoint(trace, rem);
+    }
+
+    if (result == 0 && trace->compare && trace->checkpoints < trace->golden_num) {
+        ulpi_printf("ULPI trace diverged: it ended at cycle %lu, but the golden trace "
+                    "has %lu more window(s)\n", trace->cycle,
+                    trace->golden_num - trace->checkpoints);
+        trace->diverged = true;
+        result = -1;
+    } else if (result == 0 && trace->compare) {
+        ulpi_printf("ULPI trace matches the golden trace (%lu windows, %lu cycles)\n",
+                    trace->checkpoints, trace->cycle);
+    }
+
+    if (trace->file != NULL && fclose(trace->file) != 0 && result == 0) {
+        ulpi_printf("[%s:%d] cannot write the ULPI trace\n", __FILE__, __LINE__);
+        result = -1;
+    }
+    trace->file = NULL;
+    free(trace->golden);
+    trace->golden = NULL;
+
+    return result;
+}
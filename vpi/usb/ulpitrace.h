@@ -0,0 +1,42 @@
+#ifndef __ULPITRACE_H__
+#define __ULPITRACE_H__
+/**
+ * Golden-trace regression of the ULPI bus, by folding each cycle's bus values
+ * into a hash, and emitting a checkpoint every 'window' cycles. Checkpoints
+ * are either recorded to a (text) file, or compared against a previously
+ * recorded (golden) file, stopping at the first window that diverges.
+ * NOTE:
+ *  - each window is hashed independently, so a divergence is localised to the
+ *    cycle-range of its window;
+ *  - the 'clock' signal is not hashed, as it is sampled at its edges;
+ */
+
+#include "ulpi.h"
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define ULPI_TRACE_WINDOW 1024
+#define ULPI_TRACE_HEADER "# ulpi-trace window="
+
+
+typedef struct {
+    FILE* file;
+    bool compare;
+    uint32_t window;
+    uint64_t cycle;
+    uint64_t hash;
+    uint64_t* golden;
+    uint64_t golden_num;
+    uint64_t golden_end;
+    uint64_t checkpoints;
+    bool diverged;
+} ulpi_trace_t;
+
+
+int ulpi_trace_open(ulpi_trace_t* trace, const char* path, bool compare, uint32_t window);
+int ulpi_trace_step(ulpi_trace_t* trace, const ulpi_bus_t* bus);
+int ulpi_trace_close(ulpi_trace_t* trace);
+
+
+#endif  /* __ULPITRACE_H__ */
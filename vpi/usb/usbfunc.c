@@ -1,17 +1,11 @@
 #include "usbfunc.h"
+#include "usbcrc.h"
+
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
 
-static int fn_token_recv_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out);
-static int fn_datax_recv_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out);
-static int fn_datax_send_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out);
-
-static int fn_send_ack_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out);
-static int fn_recv_ack_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out);
-
-
 //
 //  Helper Routines and Data
 ///
@@ -21,420 +15,663 @@ static char hstates[9][8] = {
     {"SOF"}, {"SETUP"}, {"BulkOUT"}, {"BulkIN"}
 };
 
-static char fstates[6][8] = {
-    {"IDLE"}, {"RECV"}, {"RXCMD"}, {"RxPID"}, {"BUSY"}, {"EOT"}
+static char fstates[5][8] = {
+    {"IDLE"}, {"RECV"}, {"RXCMD"}, {"SEND"}, {"EOT"}
+};
+
+static const uint8_t dev_desc[18] = {
+    0x12, DESC_DEVICE, 0x00, 0x02,  // bLength, bDescriptorType, bcdUSB
+    0xFF, 0x00, 0x00, FUNC_EP0_SIZE, // class, sub-class, protocol, EP0 size
+    0xCE, 0xFA, 0xDE, 0x0B,         // idVendor, idProduct
+    0x00, 0x00, 0x01, 0x02,         // bcdDevice, iManufacturer, iProduct
+    0x03, 0x01                      // iSerialNumber, bNumConfigurations
+};
+
+static const uint8_t conf_desc[46] = {
+    // Configuration
+    0x09, DESC_CONFIGURATION, 0x2E, 0x00, 0x01, 0x01, 0x00, 0x80, 0x32,
+    // Interface
+    0x09, DESC_INTERFACE, 0x00, 0x00, 0x04, 0xFF, 0x00, 0x00, 0x00,
+    // Bulk IN & Bulk OUT (loopback) endpoints
+    0x07, DESC_ENDPOINT, 0x80 | FUNC_BULK_IN_EP, 0x02, 0x00, 0x02, 0x00,
+    0x07, DESC_ENDPOINT, FUNC_BULK_OUT_EP, 0x02, 0x00, 0x02, 0x00,
+    // Bulk IN & Bulk OUT (DDR3) endpoints
+    0x07, DESC_ENDPOINT, 0x80 | FUNC_DDR3_IN_EP, 0x02, 0x00, 0x02, 0x00,
+    0x07, DESC_ENDPOINT, FUNC_DDR3_OUT_EP, 0x02, 0x00, 0x02, 0x00
+};
+
+static const char* str_desc[4] = {
+    NULL, "psuggate", "ULPI Loopback", "C0FFEE"
 };
 
+
 static void func_show(usb_func_t* func)
 {
-    printf("State\t = %d\t(%s)\n", func->state, fstates[func->state]);
-    printf("OP   \t = %d\t(%s)\n", func->op, hstates[func->op - HostError]);
-    printf("Step \t = %d\n", func->step);
-    printf("Timer\t = %d\n", func->turnaround);
+    ulpi_printf("State\t = %d\t(%s)\n", func->state, fstates[func->state]);
+    ulpi_printf("OP   \t = %d\t(%s)\n", func->op, hstates[func->op - HostError]);
+    ulpi_printf("Step \t = %d\n", func->step);
+    ulpi_printf("Timer\t = %d\n", func->turnaround);
 }
 
-static int ulpi_bus_rx(const ulpi_bus_t* in) {
-    if (in->dir != SIG1 || in->data.b != 0x00) {
-        return -1;
-    } else if (in->nxt == SIG0 && (in->data.a & RX_EVENT_MASK) == RX_ACTIVE_BITS) {
-        return 0;
-    } else if (in->nxt == SIG1) {
-        return 1;
+static uint16_t fifo_space(const usbf_fifo_t* fifo)
+{
+    return fifo->count < FUNC_FIFO_DEPTH ? FUNC_FIFO_SIZE - fifo->level : 0;
+}
+
+static void fifo_push(usbf_fifo_t* fifo, const uint8_t* data, uint16_t len)
+{
+    uint8_t tail = (fifo->head + fifo->count) % FUNC_FIFO_DEPTH;
+    assert(len <= fifo_space(fifo));
+
+    for (int i=0; i<len; i++) {
+        fifo->data[fifo->wr_ptr] = data[i];
+        fifo->wr_ptr = (fifo->wr_ptr + 1) % FUNC_FIFO_SIZE;
     }
-    return -1;
+    fifo->lens[tail] = len;
+    fifo->level += len;
+    fifo->count++;
 }
 
-static int fn_token_recv_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
+static uint16_t fifo_peek(const usbf_fifo_t* fifo, uint8_t* data)
 {
-    if (in->dir != SIG1 && func->xfer.stage < Token2) {
-        printf("Unexpected early termination of packet-receive\n");
-        return -1;
+    uint16_t len = fifo->lens[fifo->head];
+    for (int i=0; i<len; i++) {
+        data[i] = fifo->data[(fifo->rd_ptr + i) % FUNC_FIFO_SIZE];
     }
-    memcpy(out, in, sizeof(ulpi_bus_t));
-    int rx = ulpi_bus_rx(in);
-
-    switch (func->xfer.stage) {
-    case AssertDir:
-        // If 'NXT' is asserted, then we are receiving a packet, else invalid
-        // ULPI bus signals
-        if (in->nxt == SIG1) {
-            func->xfer.stage = InitRXCMD;
-            return 0;
-        }
+    return len;
+}
+
+static void fifo_pop(usbf_fifo_t* fifo)
+{
+    uint16_t len = fifo->lens[fifo->head];
+    fifo->rd_ptr = (fifo->rd_ptr + len) % FUNC_FIFO_SIZE;
+    fifo->head = (fifo->head + 1) % FUNC_FIFO_DEPTH;
+    fifo->level -= len;
+    fifo->count--;
+}
+
+/**
+ * Apply the NAK-policy, which NAKs one in every 'nak_rate' bulk transactions.
+ */
+static bool func_nak_policy(usb_func_t* func)
+{
+    if (func->nak_rate == 0 || ++func->nak_count < func->nak_rate) {
+        return false;
+    }
+    func->nak_count = 0;
+    return true;
+}
+
+
+//
+//  Response Set-Up Routines
+///
+
+static void func_hsk(usb_func_t* func, uint8_t type)
+{
+    func->xfer.type = type;
+    switch (type) {
+    case UpNAK:
+        func->naks++;
         break;
+    case UpNYET:
+        func->nyets++;
+        break;
+    case UpSTALL:
+        func->stalls++;
+        break;
+    }
+}
+
+static void func_data(usb_func_t* func, bit_t seq, const uint8_t* data, uint16_t len)
+{
+    transfer_t* xfer = &func->xfer;
+    const uint16_t crc = crc16_calc(data, len);
+
+    if (len > 0) {
+        memcpy(xfer->tx, data, len);
+    }
+    xfer->type = seq == SIG0 ? UpDATA0 : UpDATA1;
+    xfer->tx_len = len;
+    xfer->tx_ptr = 0;
+    xfer->crc1 = crc & 0xFF;
+    xfer->crc2 = (crc >> 8) & 0xFF;
+    func->step = 1; // Waiting for 'ACK'
+}
+
+static uint16_t func_string(uint8_t* buf, uint8_t index)
+{
+    const char* str = str_desc[index];
+    uint16_t len = 2;
+
+    if (str == NULL) {
+        // Language IDs: US English
+        buf[len++] = 0x09;
+        buf[len++] = 0x04;
+    } else {
+        while (*str != '\0' && len < MAX_CONFIG_SIZE) {
+            buf[len++] = *str++;
+            buf[len++] = 0x00;
+        }
+    }
+    buf[0] = len;
+    buf[1] = DESC_STRING;
+
+    return len;
+}
+
 
-    case InitRXCMD:
-        if (in->nxt == SIG1 && check_pid(in)) {
-            switch (in->data.a & 0x0F) {
-            case USBPID_OUT:
-            case USBPID_IN:
-            case USBPID_SETUP:
-            case USBPID_SOF:
-                func->xfer.stage = TokenPID;
-                return 0;
-            default:
-                printf("Token PID expected\n");
+//
+//  Control Pipe
+///
+
+/**
+ * Vendor requests read, or write, 'wLength' bytes of the register block, from
+ * the offset 'wValue', and these can span many packets; e.g., for bulk register
+ * dumps via the control pipe.
+ */
+static void func_vendor(usb_func_t* func, const usb_stdreq_t* req)
+{
+    const bool read = (req->bmRequestType & 0x80) != 0;
+
+    if (req->wValue > FUNC_REGS_SIZE || req->wLength > FUNC_REGS_SIZE - req->wValue ||
+        req->bRequest != (read ? FUNC_VENDOR_READ : FUNC_VENDOR_WRITE)) {
+        ulpi_printf("FUNC\t#%8lu cyc =>\tInvalid vendor request: 0x%02x [%s:%d]\n",
+                    func->cycle, req->bRequest, __FILE__, __LINE__);
+        func->ctl = CtlStall;
+    } else if (req->wLength == 0) {
+        func->ctl = CtlStatusIn;
+    } else if (read) {
+        memcpy(func->ctl_buf, &func->regs[req->wValue], req->wLength);
+        func->ctl = CtlDataIn;
+        func->ctl_len = req->wLength;
+    } else {
+        func->ctl = CtlDataOut;
+        func->ctl_len = req->wLength;
+    }
+}
+
+/**
+ * Process the DATA0 packet of a SETUP transaction, and stage the response.
+ */
+static void func_setup(usb_func_t* func, const uint8_t* dat)
+{
+    usb_stdreq_t* req = &func->req;
+    uint16_t len = 0;
+
+    req->bmRequestType = dat[0];
+    req->bRequest = dat[1];
+    req->wValue = (uint16_t)dat[3] << 8 | dat[2];
+    req->wIndex = (uint16_t)dat[5] << 8 | dat[4];
+    req->wLength = (uint16_t)dat[7] << 8 | dat[6];
+    req->data = NULL;
+
+    // SETUP resets the sequence bits, and is always acknowledged
+    func->seq_in[0] = SIG1;
+    func->seq_out[0] = SIG1;
+    func->ctl_ptr = 0;
+    func->ctl = CtlDataIn;
+    func_hsk(func, UpACK);
+
+    if ((req->bmRequestType & 0x60) == 0x40) {
+        func_vendor(func, req);
+        return;
+    }
+
+    switch (req->bRequest) {
+
+    case STDREQ_GET_DESCRIPTOR: {
+        const uint8_t index = req->wValue & 0xFF;
+        switch (req->wValue >> 8) {
+        case DESC_DEVICE:
+            len = sizeof(dev_desc);
+            memcpy(func->ctl_buf, dev_desc, len);
+            break;
+        case DESC_CONFIGURATION:
+            len = sizeof(conf_desc);
+            memcpy(func->ctl_buf, conf_desc, len);
+            break;
+        case DESC_STRING:
+            if (index < 4) {
+                len = func_string(func->ctl_buf, index);
                 break;
             }
+            // Fall-through
+        default:
+            func->ctl = CtlStall;
+            break;
         }
         break;
+    }
 
-    case TokenPID:
-        if (rx < 0) {
-            break;
-        } else if (rx > 0) {
-            func->xfer.stage = Token1;
-        }
-        return 0;
+    case STDREQ_GET_CONFIGURATION:
+        func->ctl_buf[0] = func->config;
+        len = 1;
+        break;
 
-    case Token1:
-        if (rx < 0) {
-            break;
-        } else if (rx > 0) {
-            func->xfer.tok1 = in->data.a;
-            func->xfer.stage = Token2;
-        }
-        return 0;
+    case STDREQ_GET_INTERFACE:
+        func->ctl_buf[0] = 0x00;
+        len = 1;
+        break;
 
-    case Token2:
-        if (rx < 0) {
+    case STDREQ_GET_STATUS:
+        func->ctl_buf[0] = 0x00;
+        func->ctl_buf[1] = 0x00;
+        len = 2;
+        break;
+
+    case STDREQ_SET_ADDRESS:
+        // New address is used after the STATUS stage
+        func->next_addr = req->wValue & 0x7F;
+        func->ctl = CtlStatusIn;
+        break;
+
+    case STDREQ_SET_CONFIGURATION:
+        if (req->wValue > 1) {
+            func->ctl = CtlStall;
             break;
-        } else if (rx > 0) {
-            func->xfer.tok2 = in->data.a;
-            func->xfer.stage = EndRXCMD;
         }
-        return 0;
+        func->config = req->wValue;
+        func->seq_in[FUNC_BULK_IN_EP] = SIG0;
+        func->seq_out[FUNC_BULK_OUT_EP] = SIG0;
+        func->seq_in[FUNC_DDR3_IN_EP] = SIG0;
+        func->seq_out[FUNC_DDR3_OUT_EP] = SIG0;
+        memset(&func->fifo, 0, sizeof(usbf_fifo_t));
+        memset(&func->resp, 0, sizeof(usbf_fifo_t));
+        func->ctl = CtlStatusIn;
+        break;
 
-    case EndRXCMD:
-        if (in->nxt == SIG0 && (in->data.a & RX_EVENT_MASK) != RX_ACTIVE_BITS) {
-            func->xfer.stage = EOP;
-            return 0;
-        }
+    case STDREQ_SET_INTERFACE:
+        func->ctl = req->wValue == 0 ? CtlStatusIn : CtlStall;
         break;
 
-    case EOP:
-        if (in->nxt == SIG0) {
-            func->step++;
-            return 1;
+    case STDREQ_CLEAR_FEATURE:
+        // ENDPOINT_HALT, which just resets the sequence bit
+        if ((req->wIndex & 0x80) != 0) {
+            func->seq_in[req->wIndex & 0x0F] = SIG0;
+        } else {
+            func->seq_out[req->wIndex & 0x0F] = SIG0;
         }
-        return 0;
+        func->ctl = CtlStatusIn;
+        break;
 
     default:
+        ulpi_printf("FUNC\t#%8lu cyc =>\tUnsupported request: 0x%02x [%s:%d]\n",
+                    func->cycle, req->bRequest, __FILE__, __LINE__);
+        func->ctl = CtlStall;
         break;
     }
 
-    printf("Token-step failed\n");
-    return -1;
+    if (func->ctl == CtlDataIn) {
+        func->ctl_len = len < req->wLength ? len : req->wLength;
+    }
 }
 
-static int fn_datax_recv_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
+static void func_ep0_in(usb_func_t* func)
 {
-    if (in->dir != SIG1 && func->xfer.stage < EndRXCMD) {
-        printf("Unexpected early termination of packet-receive\n");
-        return -1;
-    }
-    memcpy(out, in, sizeof(ulpi_bus_t));
+    uint16_t len;
 
-    switch (func->xfer.stage) {
-
-    case NoXfer:
-        if (in->dir != SIG1) {
-            // Todo: use a turn-around timer, instead of the above termination-
-            //   condition !?
-            func->turnaround++;
-            return 0;
-        } else if (in->dir == SIG1 && in->nxt == SIG1) {
-            func->xfer.stage = AssertDir;
-            return 0;
+    switch (func->ctl) {
+    case CtlDataIn:
+        if (func_nak_policy(func)) {
+            func_hsk(func, UpNAK);
+            break;
         }
-        break;
-
-    case AssertDir:
-        // If 'NXT' is asserted, then we are receiving a packet, else invalid
-        // ULPI bus signals
-        if (in->nxt == SIG0 && (in->data.a & RX_EVENT_MASK) == RX_ACTIVE_BITS) {
-            func->xfer.stage = InitRXCMD;
-            return 0;
+        len = func->ctl_len - func->ctl_ptr;
+        if (len > FUNC_EP0_SIZE) {
+            len = FUNC_EP0_SIZE;
         }
+        func_data(func, func->seq_in[0], &func->ctl_buf[func->ctl_ptr], len);
         break;
 
-    case InitRXCMD:
-        if (in->nxt == SIG1 && check_pid(in)) {
-            if (check_seq(&func->xfer, in->data.a & 0x0F)) {
-                func->xfer.stage = DATAxPID;
-                func->xfer.rx_ptr = 0;
-                func->xfer.rx_len = 0;
-                return 0;
-            }
-        }
-        printf("DATAx PID expected\n");
+    case CtlStatusIn:
+        func_data(func, SIG1, NULL, 0);
         break;
 
-    case DATAxPID:
-    case DATAxBody:
-        if (in->nxt == SIG1) {
-            func->xfer.rx[func->xfer.rx_ptr++] = in->data.a;
-            return 0;
-        } else if (in->nxt == SIG0) {
-            // If 'NXT' deasserts, could be a wait-state, or end-of-packet
-            if (in->data.a & RX_EVENT_MASK != RX_ACTIVE_BITS) {
-                // Todo: End-of-Packet, so check CRC16
-                func->xfer.stage = EndRXCMD;
-                func->xfer.rx_len = func->xfer.rx_ptr - 2;
-                func->step++;
-            }
-            return 0;
-        }
-        printf("Receiving DATAx packet failed\n");
+    default:
+        func_hsk(func, UpSTALL);
         break;
+    }
+}
 
-    case EndRXCMD:
-    case EOP:
-        func->xfer.type = UpACK;
-        return 0;
+static void func_ep0_ack(usb_func_t* func)
+{
+    transfer_t* xfer = &func->xfer;
+    func->seq_in[0] = !func->seq_in[0];
 
-    default:
-        printf("Unexpected DATAx receive-step\n");
-        break;
+    if (func->ctl == CtlDataIn) {
+        func->ctl_ptr += xfer->tx_len;
+        if (xfer->tx_len < FUNC_EP0_SIZE || func->ctl_ptr >= func->req.wLength) {
+            func->ctl = CtlStatusOut;
+        }
+    } else if (func->ctl == CtlStatusIn) {
+        if (func->req.bRequest == STDREQ_SET_ADDRESS) {
+            func->addr = func->next_addr;
+            ulpi_printf("FUNC\t#%8lu cyc =>\tAddress set to: 0x%02x [%s:%d]\n",
+                        func->cycle, func->addr, __FILE__, __LINE__);
+        }
+        func->ctl = CtlIdle;
+    }
+}
+
+/**
+ * DATAx packet of the DATA stage, of a control-write, which is committed to
+ * the registers once the short, or final, packet has been received.
+ */
+static void func_ep0_out(usb_func_t* func, bit_t seq, const uint8_t* data, uint16_t len)
+{
+    const usb_stdreq_t* req = &func->req;
+
+    if (seq != func->seq_out[0]) {
+        // Repeat of a packet that was already accepted, so drop it
+        func_hsk(func, UpACK);
+    } else if (len > FUNC_EP0_SIZE || len > func->ctl_len - func->ctl_ptr) {
+        ulpi_printf("FUNC\t#%8lu cyc =>\tControl-write overrun [%s:%d]\n",
+                    func->cycle, __FILE__, __LINE__);
+        func->ctl = CtlStall;
+        func_hsk(func, UpSTALL);
+    } else if (func_nak_policy(func)) {
+        func_hsk(func, UpNAK);
+    } else {
+        memcpy(&func->ctl_buf[func->ctl_ptr], data, len);
+        func->ctl_ptr += len;
+        func->seq_out[0] = !seq;
+        if (len < FUNC_EP0_SIZE || func->ctl_ptr >= func->ctl_len) {
+            memcpy(&func->regs[req->wValue], func->ctl_buf, func->ctl_ptr);
+            func->ctl = CtlStatusIn;
+        }
+        func_hsk(func, UpACK);
     }
+}
+
+
+//
+//  Bulk Endpoints
+///
 
-    return -1;
+/**
+ * Packet FIFO that the Bulk IN endpoint sends from, or NULL if not a Bulk IN
+ * endpoint.
+ */
+static usbf_fifo_t* func_in_fifo(usb_func_t* func, uint8_t ep)
+{
+    return ep == FUNC_BULK_IN_EP ? &func->fifo : ep == FUNC_DDR3_IN_EP ? &func->resp : NULL;
 }
 
-static int fn_datax_send_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
+/**
+ * Execute a DDR3 memory-request, and queue its response, where the number of
+ * beats is limited so that a FETCH response fits within a single packet.
+ * Returns -1 for malformed requests, which are STALLed.
+ */
+static int func_ddr3_cmd(usb_func_t* func, const uint8_t* data, uint16_t len)
 {
-    if (in->dir != SIG0) {
-        printf("Packet transmission interrupted\n");
+    uint8_t res[MAX_PACKET_SIZE];
+
+    if (len < DDR3_CMD_SIZE) {
         return -1;
     }
-    memcpy(out, in, sizeof(ulpi_bus_t));
 
-    switch (func->xfer.stage) {
-    case NoXfer: {
-        // Drive ULPI 'Transmit' onto bus
-        uint8_t pid = func->xfer.ep_seq[func->xfer.endpoint] == 0 ? ULPITX_DATA0 : ULPITX_DATA1;
-        out->data.a = pid;
-        out->data.b = 0x00;
-        out->stp = SIG0;
-        func->xfer.stage = DATAxPID;
-        return 0;
-    }
+    const uint16_t size = ((uint16_t)data[1] + 1) * DDR3_BEAT_SIZE;
+    const uint32_t addr = (uint32_t)data[2] | (uint32_t)data[3] << 8 |
+        (uint32_t)data[4] << 16 | (uint32_t)(data[5] & 0x0F) << 24;
+    res[1] = data[5] >> 4;
 
-    case DATAxPID:
-        if (in->nxt == SIG1) {
-            if (func->xfer.tx_len > 0) {
-                out->data.a = func->xfer.tx[func->xfer.tx_ptr++];
-                out->data.b = 0x00;
-                out->stp = SIG0;
-                func->xfer.stage = DATAxBody;
-            } else {
-                // Send a ZDP:
-                out->data.a = func->xfer.crc1;
-                out->data.b = 0x00;
-                out->stp = SIG0;
-                func->xfer.stage = DATAxCRC1;
-            }
+    if (data[0] == DDR3_CMD_STORE && len == DDR3_CMD_SIZE + size) {
+        for (int i=0; i<size; i++) {
+            func->mem[(addr + i) & (FUNC_DDR3_SIZE - 1)] = data[DDR3_CMD_SIZE + i];
         }
-        return 0;
-
-    case DATAxBody:
-        if (in->nxt == SIG1) {
-            if (func->xfer.tx_ptr < func->xfer.tx_len) {
-                out->data.a = func->xfer.tx[func->xfer.tx_ptr++];
-                out->data.b = 0x00;
-                out->stp = SIG0;
-            } else {
-                out->data.a = func->xfer.crc1;
-                out->data.b = 0x00;
-                out->stp = SIG0;
-                func->xfer.stage = DATAxCRC1;
-            }
+        res[0] = DDR3_RES_WDONE;
+        fifo_push(&func->resp, res, 2);
+    } else if (data[0] == DDR3_CMD_FETCH && len == DDR3_CMD_SIZE &&
+               size + 2 <= MAX_PACKET_SIZE) {
+        for (int i=0; i<size; i++) {
+            res[2 + i] = func->mem[(addr + i) & (FUNC_DDR3_SIZE - 1)];
         }
-        return 0;
+        res[0] = DDR3_RES_RDATA;
+        fifo_push(&func->resp, res, size + 2);
+    } else {
+        ulpi_printf("FUNC\t#%8lu cyc =>\tInvalid DDR3 request: 0x%02x (%u bytes) [%s:%d]\n",
+                    func->cycle, data[0], len, __FILE__, __LINE__);
+        return -1;
+    }
 
-    case DATAxCRC1:
-        if (in->nxt == SIG1) {
-            out->data.a = func->xfer.crc2;
-            out->data.b = 0x00;
-            out->stp = SIG1;
-            func->xfer.stage = DATAxCRC2;
-        }
-        return 0;
+    return 0;
+}
 
-    case DATAxCRC2:
-        // After 2nd CRC byte has been transferred, set the ULPI bus to idle
-        if (in->nxt == SIG1) {
-            out->data.a = 0x00;
-            out->data.b = 0x00;
-            out->stp = SIG0;
-            func->xfer.stage = EOP;
-        }
-        return 0;
+static void func_bulk_in(usb_func_t* func, uint8_t ep)
+{
+    usbf_fifo_t* fifo = func_in_fifo(func, ep);
 
-    case EOP:
-        out->data.a = 0x00;
-        out->data.b = 0x00;
-        out->stp = SIG0;
-        return 0;
+    if (fifo == NULL || func->config == 0) {
+        func_hsk(func, UpSTALL);
+    } else if (fifo->count == 0 || func_nak_policy(func)) {
+        func_hsk(func, UpNAK);
+    } else {
+        uint8_t buf[MAX_PACKET_SIZE] = {0};
+        uint16_t len = fifo_peek(fifo, buf);
+        func_data(func, func->seq_in[ep], buf, len);
+    }
+}
 
-    default:
-        break;
+/**
+ * PING of an OUT endpoint, which is ACKed if that endpoint has space for a
+ * (maximum-size) packet.
+ */
+static void func_ping(usb_func_t* func, uint8_t ep)
+{
+    const bool ddr3 = ep == FUNC_DDR3_OUT_EP;
+    const usbf_fifo_t* fifo = ddr3 ? &func->resp : &func->fifo;
+
+    if (ep == 0) {
+        func_hsk(func, UpACK);
+    } else if ((ep != FUNC_BULK_OUT_EP && !ddr3) || func->config == 0) {
+        func_hsk(func, UpSTALL);
+    } else if (fifo_space(fifo) < MAX_PACKET_SIZE) {
+        func_hsk(func, UpNAK);
+    } else {
+        func_hsk(func, UpACK);
     }
+}
 
-    return -1;
+static void func_bulk_out(usb_func_t* func, uint8_t ep, bit_t seq, const uint8_t* data, uint16_t len)
+{
+    const bool ddr3 = ep == FUNC_DDR3_OUT_EP;
+    usbf_fifo_t* fifo = ddr3 ? &func->resp : &func->fifo;
+
+    if ((ep != FUNC_BULK_OUT_EP && !ddr3) || func->config == 0) {
+        func_hsk(func, UpSTALL);
+    } else if (seq != func->seq_out[ep]) {
+        // Repeat of a packet that was already accepted, so drop it
+        func_hsk(func, UpACK);
+    } else if ((ddr3 ? MAX_PACKET_SIZE : len) > fifo_space(fifo) || func_nak_policy(func)) {
+        // Memory-requests wait for space for their (largest) response
+        func_hsk(func, UpNAK);
+    } else if (ddr3) {
+        if (func_ddr3_cmd(func, data, len) < 0) {
+            func_hsk(func, UpSTALL);
+        } else {
+            func->seq_out[ep] = !seq;
+            func_hsk(func, UpACK);
+        }
+    } else {
+        fifo_push(fifo, data, len);
+        func->seq_out[ep] = !seq;
+        if (func->nyet && fifo_space(fifo) < MAX_PACKET_SIZE) {
+            func_hsk(func, UpNYET);
+        } else {
+            func_hsk(func, UpACK);
+        }
+    }
 }
 
-static int fn_recv_ack_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
+
+//
+//  Packet-Level Routines
+///
+
+/**
+ * Process a complete packet, from the host, and stage any response.
+ */
+static void func_recv_packet(usb_func_t* func)
 {
-    memcpy(out, in, sizeof(ulpi_bus_t));
+    transfer_t* xfer = &func->xfer;
+    const uint8_t pid = func->rx_pid & 0x0F;
+    const int len = xfer->rx_ptr;
+
+    if ((func->rx_pid >> 4) != (pid ^ 0x0F) || xfer->rx_len < 0) {
+        ulpi_printf("FUNC\t#%8lu cyc =>\tInvalid packet (PID = 0x%02x) [%s:%d]\n",
+                    func->cycle, func->rx_pid, __FILE__, __LINE__);
+        func->errors++;
+        return;
+    }
 
-    switch (func->xfer.stage) {
+    switch (pid) {
 
-    case NoXfer:
-        if (ulpi_bus_is_idle(in)) {
-            // Wait for 'ACK'
-            func->turnaround++;
-            return 0;
-        } else if (in->dir == SIG1 && in->nxt == SIG1) {
-            func->xfer.stage = InitRXCMD;
-            return 0;
-        }
-        printf("Invalid ULPI bus signal levels, while waiting for 'ACK'\n");
+    case USBPID_SOF:
         break;
 
-    case AssertDir:
-        if (in->dir == SIG1 && in->nxt == SIG0 && in->data.b == 0x00 &&
-            (in->data.a & RX_EVENT_MASK) == RX_ACTIVE_BITS) {
-            func->xfer.stage = InitRXCMD;
-            return 0;
+    case USBPID_SETUP:
+    case USBPID_OUT:
+    case USBPID_IN:
+    case USBPID_PING: {
+        const uint16_t tok = (uint16_t)xfer->rx[1] << 8 | xfer->rx[0];
+        if (len != 2 || !crc5_check(tok)) {
+            func->errors++;
+            break;
+        } else if ((tok & 0x7F) != func->addr) {
+            // Not for us
+            func->op = HostIdle;
+            break;
         }
-
-    case InitRXCMD:
-        if (in->dir == SIG1 && in->nxt == SIG1 && check_pid(in) &&
-            in->data.b == 0x00 && (in->data.a & 0x0F) == USBPID_ACK) {
-            func->xfer.stage = HskPID;
-            return 0;
+        xfer->endpoint = (tok >> 7) & 0x0F;
+        xfer->tok1 = xfer->rx[0];
+        xfer->tok2 = xfer->rx[1];
+
+        if (pid == USBPID_SETUP) {
+            func->op = HostSETUP;
+        } else if (pid == USBPID_OUT) {
+            func->op = HostBulkOUT;
+        } else if (pid == USBPID_IN) {
+            func->op = HostBulkIN;
+            if (xfer->endpoint == 0) {
+                func_ep0_in(func);
+            } else {
+                func_bulk_in(func, xfer->endpoint);
+            }
+        } else {
+            func_ping(func, xfer->endpoint);
         }
-        printf("Handshake 'ACK' PID expected\n");
         break;
+    }
 
-    case HskPID:
-        if (in->dir != SIG0 || in->nxt != SIG0) {
-            printf("Expected ULPI bus turn-around\n");
+    case USBPID_DATA0:
+    case USBPID_DATA1: {
+        const bit_t seq = pid == USBPID_DATA1 ? SIG1 : SIG0;
+        if (func->op != HostSETUP && func->op != HostBulkOUT) {
             break;
+        } else if (len < 2 || !crc16_check(xfer->rx, len)) {
+            // Corrupted, so no handshake
+            ulpi_printf("FUNC\t#%8lu cyc =>\tCRC16 error [%s:%d]\n",
+                        func->cycle, __FILE__, __LINE__);
+            func->errors++;
+        } else if (func->op == HostSETUP) {
+            if (xfer->endpoint != 0 || len != 10 || seq != SIG0) {
+                func->errors++;
+            } else {
+                func_setup(func, xfer->rx);
+            }
+        } else if (xfer->endpoint == 0 && func->ctl == CtlDataOut) {
+            func_ep0_out(func, seq, xfer->rx, len - 2);
+        } else if (xfer->endpoint == 0) {
+            // STATUS stage, of a control-read
+            if (func->ctl == CtlDataIn || func->ctl == CtlStatusOut) {
+                func->ctl = CtlIdle;
+                func_hsk(func, UpACK);
+            } else {
+                func_hsk(func, UpSTALL);
+            }
+        } else {
+            func_bulk_out(func, xfer->endpoint, seq, xfer->rx, len - 2);
         }
-        func->step++;
-        func->xfer.stage = NoXfer;
-        return 1;
-
-    default:
+        func->op = HostIdle;
         break;
     }
 
-    return -1;
-}
-
-static int fn_send_ack_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
-{
-    if (in->dir != SIG0) {
-        printf("Handshake transmission interrupted\n");
-        return -1;
-    }
-    memcpy(out, in, sizeof(ulpi_bus_t));
-
-    switch (func->xfer.stage) {
-    case NoXfer:
-        // Drive ULPI 'Transmit' onto bus, with 'ACK' PID
-        out->data.a = ULPITX_ACK;
-        out->data.b = 0x00;
-        out->stp = SIG0;
-        func->xfer.stage = HskPID;
-        return 0;
-
-    case HskPID:
-        // Once the PID has been accepted, assert 'STP'
-        if (in->nxt == SIG1) {
-            out->data.a = 0x00;
-            out->data.b = 0x00;
-            out->stp = SIG1;
-            func->xfer.stage = HskStop;
+    case USBPID_ACK:
+        if (func->op == HostBulkIN && func->step == 1) {
+            if (xfer->endpoint == 0) {
+                func_ep0_ack(func);
+            } else {
+                fifo_pop(func_in_fifo(func, xfer->endpoint));
+                func->seq_in[xfer->endpoint] = !func->seq_in[xfer->endpoint];
+            }
         }
-        return 0;
-
-    case HskStop:
-        // Return ULPI bus to idle
-        out->data.a = 0x00;
-        out->data.b = 0x00;
-        out->stp = SIG0;
-        func->xfer.stage = EOP;
-        func->step++;
-        return 0;
-
-    case EOP:
-        // Done
-        out->data.a = 0x00;
-        out->data.b = 0x00;
-        out->stp = SIG0;
-        return 0;
+        func->op = HostIdle;
+        func->step = 0;
+        break;
 
     default:
+        ulpi_printf("FUNC\t#%8lu cyc =>\tUnexpected PID: 0x%x [%s:%d]\n",
+                    func->cycle, pid, __FILE__, __LINE__);
+        func->errors++;
         break;
     }
-        
-    return -1;
 }
 
-static int stdreq_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
+/**
+ * Drive the TX CMD for the staged response packet.
+ */
+static void func_send_start(usb_func_t* func, ulpi_bus_t* out)
 {
-    return -1;
+    transfer_t* xfer = &func->xfer;
+    const uint8_t pid = transfer_type_to_pid(xfer) & 0x0F;
+
+    out->stp = SIG0;
+    out->data.a = 0x40 | pid;
+    out->data.b = 0x00;
+    xfer->stage = xfer->type < UpDATA0 ? HskPID : DATAxPID;
+    func->state = FuncSend;
 }
 
 /**
- * Steps through the various phases and packets of a complete transaction.
+ * Transmit the staged packet, advancing each time the PHY asserts 'nxt'.
  */
-static int func_xfer_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
+static void func_send_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
 {
-    if (func->step == 0) {
-        // Token step
-        return fn_token_recv_step(func, in, out);
-    }
-
-    switch (func->op) {
+    transfer_t* xfer = &func->xfer;
 
-    case HostBulkOUT:
-        if (func->step < 2) {
-            return fn_datax_recv_step(func, in, out);
-        } else if (func->step < 3) {
-            return fn_send_ack_step(func, in, out);
-        }
-        return 1;
-
-    case HostBulkIN:
-        if (func->step < 2) {
-            return fn_datax_send_step(func, in, out);
-        } else if (func->step < 3) {
-            return fn_recv_ack_step(func, in, out);
-        }
-        return 1;
+    if (in->nxt != SIG1) {
+        // Wait-state, so keep driving the current byte
+        return;
+    }
 
-    case HostSETUP:
-        if (func->step < 2) {
-            return fn_datax_recv_step(func, in, out);
-        } else if (func->step < 3) {
-            return fn_recv_ack_step(func, in, out);
+    switch (xfer->stage) {
+    case DATAxPID:
+    case DATAxBody:
+        if (xfer->tx_ptr < xfer->tx_len) {
+            out->data.a = xfer->tx[xfer->tx_ptr++];
+            xfer->stage = DATAxBody;
+        } else {
+            out->data.a = xfer->crc1;
+            xfer->stage = DATAxCRC1;
         }
-        return 1;
+        break;
 
-    case HostSOF:
-        printf("SOF should have already been processed\n");
+    case DATAxCRC1:
+        out->data.a = xfer->crc2;
+        xfer->stage = DATAxCRC2;
         break;
 
-    default:
-        printf("Invalid host-wait state: %u\n", func->op);
+    case DATAxCRC2:
+    case HskPID:
+        // Last byte accepted, so end the packet
+        out->stp = SIG1;
+        out->data.a = 0x00;
+        xfer->type = XferIdle;
+        xfer->stage = NoXfer;
+        func->state = FuncEOT;
         break;
     }
-
-    return -1;
 }
 
 
@@ -447,136 +684,118 @@ static int func_xfer_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* ou
  */
 void usbf_init(usb_func_t* func)
 {
-    func->cycle = 0ul;
+    memset(func, 0, sizeof(usb_func_t));
     func->op = HostReset;
-    func->step = 0u;
-    func->turnaround = 0;
-    func->addr = 0;
+    func->state = FuncIdle;
+    func->dir = SIG0;
 }
 
 /**
- * Step through a complete USB transaction (which is at least 3x packets).
+ * Set the flow-control policy for the bulk endpoints, where 'nak_rate' NAKs one
+ * in every 'nak_rate' transactions (or never, if zero), and 'nyet' responds with
+ * NYET when the FIFO cannot accept another max-sized packet.
+ */
+void usbf_policy(usb_func_t* func, uint16_t nak_rate, bool nyet)
+{
+    func->nak_rate = nak_rate;
+    func->nak_count = 0;
+    func->nyet = nyet;
+}
+
+/**
+ * Step the link by one clock-cycle, using the bus values sampled at the clock-
+ * edge, and computing the next values for 'stp' and 'data'.
  */
 int usbf_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
 {
-    ulpi_bus_show(in);
+    transfer_t* xfer = &func->xfer;
+    const bit_t dir = func->dir;
 
     if (in->rst_n != SIG1) {
-        printf("ULPI PHY has RST# asserted\n");
+        ulpi_printf("ULPI PHY has RST# asserted\n");
         return -1;
     } else if (in->clock != SIG1) {
-        printf("ULPI PHY must be driven at the positive clock-edge\n");
+        ulpi_printf("ULPI PHY must be driven at the positive clock-edge\n");
         return -1;
     }
 
-    switch (func->state) {
+    memcpy(out, in, sizeof(ulpi_bus_t));
+    func->cycle++;
+    func->dir = in->dir;
 
-    case FuncIdle:
-        if (ulpi_bus_is_idle(in)) {
-            memcpy(out, in, sizeof(ulpi_bus_t));
-            return 0;
+    if (in->dir == SIG1) {
+        // PHY owns the bus, so receive RX CMDs and packets
+        out->stp = SIG0;
+
+        if (func->state == FuncSend || func->state == FuncEOT) {
+            ulpi_printf("FUNC\t#%8lu cyc =>\tPacket transmission interrupted [%s:%d]\n",
+                        func->cycle, __FILE__, __LINE__);
+            func->errors++;
+            func->state = FuncIdle;
         }
 
-        // If 'DIR' asserts then we are waiting for a token, or merely receiving
-        // an RX CMD
-        if (in->dir == SIG1) {
-            if (in->nxt > SIG1) {
-                printf("Invalid NXT signal level: %u\n", in->nxt);
+        if (dir == SIG0) {
+            // Bus turn-around, and 'nxt' indicates the start of a packet
+            if (in->nxt == SIG1) {
+                func->state = FuncRecv;
+                xfer->type = XferIdle;
+                xfer->stage = AssertDir;
+                xfer->rx_ptr = 0;
+                xfer->rx_len = 0;
             } else {
-                func->state = in->nxt == SIG0 ? FuncRXCMD : FuncRecv;
-                memcpy(out, in, sizeof(ulpi_bus_t));
-                return 0;
+                func->state = FuncRXCMD;
+            }
+        } else if (func->state == FuncRecv) {
+            if (in->nxt == SIG1) {
+                if (xfer->stage == AssertDir) {
+                    func->rx_pid = in->data.a;
+                    xfer->stage = DATAxBody;
+                } else if (xfer->rx_ptr < MAX_PACKET_SIZE + 2) {
+                    xfer->rx[xfer->rx_ptr++] = in->data.a;
+                } else {
+                    xfer->rx_len = -1; // Babble
+                }
+            } else if ((in->data.a & RX_EVENT_MASK) != RX_ACTIVE_BITS) {
+                // RX CMD with 'RxActive' deasserted, so end-of-packet
+                func->state = FuncRXCMD;
+                func_recv_packet(func);
             }
         }
-        printf("Invalid ULPI bus signal levels\n");
-        break;
-
-    case FuncRXCMD:
-        if (in->dir == SIG1 && in->nxt == SIG0) {
-            // Stay in 'FuncRXCMD' until 'DIR' deasserts
-            return 0;
-        } else if (in->dir == SIG0) {
-            func->state = FuncIdle;
-            memcpy(out, in, sizeof(ulpi_bus_t));
-            return 0;
-        }
-        printf("Invalid ULPI bus signal levels\n");
-        break;
+        return 0;
+    }
 
-    case FuncRecv:
-        // We are expecting an RX CMD followed by a USB token
-        if (in->dir == SIG1 && in->nxt == SIG0 && in->data.b == 0x00 &&
-            (in->data.a & RX_EVENT_MASK) == RX_ACTIVE_BITS) {
-            func->state = FuncRxPID;
-            memcpy(out, in, sizeof(ulpi_bus_t));
-            return 0;
+    if (dir == SIG1) {
+        // PHY has just released the bus
+        if (func->state == FuncRecv) {
+            func_recv_packet(func);
         }
-        break;
+        func->state = FuncIdle;
+        func->turnaround = 0;
+    }
 
-    case FuncRxPID:
-        // When 'NXT' asserts, we have received a USB PID for the packet
-        if (in->dir == SIG1) {
-            if (in->nxt == SIG1 && check_pid(in)) {
-                func->state = FuncBusy;
-                func->step = 0u; // We are at the "TOKEN" step
-                func->xfer.stage = Token1;
-
-                switch (in->data.a & 0x0F) {
-                case USBPID_OUT:
-                    func->op = HostBulkOUT;
-                    func->xfer.type = OUT;
-                    break;
-
-                case USBPID_IN:
-                    func->op = HostBulkIN;
-                    func->xfer.type = IN;
-                    break;
-
-                case USBPID_SETUP:
-                    func->op = HostSETUP;
-                    func->xfer.type = SETUP;
-                    break;
-
-                case USBPID_SOF:
-                    func->op = HostSOF;
-                    func->xfer.type = SOF;
-                    break;
-
-                default:
-                    printf("Expecting token\n");
-                    return -1;
-                }
+    switch (func->state) {
 
-                memcpy(out, in, sizeof(ulpi_bus_t));
-                return 0;
-            } else if (in->nxt == SIG0 && in->data.b == 0x00) {
-                if ((in->data.a & RX_EVENT_MASK) == RX_ACTIVE_BITS) {
-                    // Just another RX CMD
-                    memcpy(out, in, sizeof(ulpi_bus_t));
-                    return 0;
-                }
-            }
-        }
-        printf("Failed to receive a USB packet\n");
+    case FuncSend:
+        func_send_step(func, in, out);
         break;
 
-    case FuncBusy:
-        return func_xfer_step(func, in, out);
-
     case FuncEOT:
-        if (ulpi_bus_is_idle(in)) {
-            // Todo: is this stuff correct ?!
-            func->xfer.type = XferIdle;
-            func->xfer.stage = NoXfer;
-            memcpy(out, in, sizeof(ulpi_bus_t));
-            return 1;
-        }
-
+        func->state = FuncIdle;
+        func->turnaround = 0;
+        // Fall-through
     default:
+        out->stp = SIG0;
+        out->data.a = 0x00;
+        out->data.b = 0x00;
+
+        if (xfer->type >= UpACK && xfer->type <= UpDATA1 &&
+            func->turnaround++ >= DELAY_LINK_RX_TX_MIN) {
+            func_send_start(func, out);
+        }
         break;
     }
 
-    return -1;
+    return 0;
 }
 
 
@@ -587,78 +806,40 @@ int usbf_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out)
 void test_func_recv(void)
 {
     ulpi_bus_t bus = {0};
-    ulpi_bus_t out;
-    int result = 0;
-    uint16_t index = 0;
     uint8_t packet[8] = {
         0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x40, 0x00
     };
+    const uint16_t crc = crc16_calc(packet, 8);
     transfer_t host = {0};
     usb_func_t func = {0};
-    uint8_t pid;
 
     // Bring the USB bus & device to idle.
-    func.op = HostIdle;
-    func.state = FuncIdle;
-    bus.clock = SIG1;
-    bus.rst_n = SIG1;
-    assert(usbf_step(&func, &bus, &out) == 0);
-    memcpy(&bus, &out, sizeof(ulpi_bus_t));
+    usbf_init(&func);
+    ulpi_bus_idle(&bus);
 
     // Transmit a 'SETUP' token to the device.
     host.type = SETUP;
-    host.tok1 = 0x00;
-    host.tok2 = 0x10;
+    transfer_tok(&host);
 
+    ulpi_printf("Testing 'SETUP'");
     assert(ulpi_step_with(token_send_step, &host, &bus, (user_fn_t)usbf_step, (void*)(&func)) == 1);
-    printf("Token Sent\n");
+    assert(func.op == HostSETUP);
 
     // Host-to-device transmission of a DATA0 packet, containing the parameters
     // of the CONTROL request.
     host.type = DnDATA0;
-    host.crc1 = 0xDD;
-    host.crc2 = 0x94;
+    host.crc1 = crc & 0xFF;
+    host.crc2 = crc >> 8;
     host.tx_len = 8;
     memcpy(&host.tx, &packet, sizeof(packet));
-    func_show(&func);
 
     assert(ulpi_step_with(datax_send_step, &host, &bus, (user_fn_t)usbf_step, (void*)(&func)) == 1);
-    printf("DATA0 Sent\n");
-
-#if 0
 
-    bus.dir = SIG1;
-    bus.nxt = SIG1;
-    bus.data.a = ((uint8_t)(~pid & 0x0f) << 4) | pid;
-
-    func.xfer.type = UpDATA1;
-    func.xfer.stage = DATAxPID;
-    func.xfer.ep_seq[0] = 1;
-    func.xfer.rx_len = 64;
-
-    do {
-        result = usbf_step(&func, &bus, &out);
-        memcpy(&bus, &out, sizeof(ulpi_bus_t));
-
-        if (func.xfer.stage == DATAxBody) {
-            printf(".");
-            bus.data.a = packet[index++];
-            if (index >= length) {
-                bus.stp = SIG1;
-            }
-        } else {
-            bus.stp = SIG0;
-        }
-    } while (result == 0);
-
-    if (result < 0) {
-        printf("\t\tERROR\n");
-    } else if (result > 0) {
-        printf("\t\tSUCCESS\n");
+    if (func.ctl != CtlDataIn || func.ctl_len != sizeof(dev_desc) ||
+        func.xfer.type != UpACK || func.errors != 0) {
+        ulpi_printf("\t\tERROR\n");
+        func_show(&func);
     } else {
-        printf("\t\tHAIL SEITAN\n");
+        ulpi_printf("\t\tSUCCESS\n");
     }
-
-#endif /* 0 */
-
 }
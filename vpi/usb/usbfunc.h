@@ -1,20 +1,82 @@
 #ifndef __USBFUNC_H__
 #define __USBFUNC_H__
-
+/**
+ * Simulates the link-side of a USB function (device), with a control pipe for
+ * the standard requests, a Bulk OUT -> FIFO -> Bulk IN loopback, and a pair of
+ * Bulk endpoints for DDR3 memory-requests (backed by a small memory window).
+ * NOTE:
+ *  - the link drives 'stp', and 'data' while 'dir' is deasserted, and samples
+ *    the bus at each (positive) clock-edge, like the RTL cores;
+ *  - the endpoint numbers match the testbench defaults;
+ */
 
 #include "usbhost.h"
+#include "stdreq.h"
 #include <stdint.h>
 
 
+#define FUNC_BULK_IN_EP  1
+#define FUNC_BULK_OUT_EP 2
+#define FUNC_DDR3_IN_EP  3
+#define FUNC_DDR3_OUT_EP 5
+
+#define FUNC_EP0_SIZE    64
+#define FUNC_FIFO_SIZE   2048
+#define FUNC_FIFO_DEPTH  16
+
+// Vendor requests, for reading & writing a block of registers, via EP0
+#define FUNC_REGS_SIZE   4096
+#define FUNC_VENDOR_READ  0x01
+#define FUNC_VENDOR_WRITE 0x02
+
+// DDR3 memory-request commands, and responses (as for 'memreq'), where each
+// command is: {CMD, BEATS - 1, ADDR[7:0], ADDR[15:8], ADDR[23:16], {ID, ADDR[27:24]}},
+// followed by the (32-bit) beats of a STORE, and the responses are {RES, ID},
+// followed by the beats of a FETCH
+#define DDR3_CMD_STORE   0x01
+#define DDR3_RES_WDONE   0x02
+#define DDR3_RES_WFAIL   0x03
+#define DDR3_CMD_FETCH   0x80
+#define DDR3_RES_RDATA   0x81
+#define DDR3_RES_RFAIL   0x82
+#define DDR3_CMD_SIZE    6
+#define DDR3_BEAT_SIZE   4
+
+// The memory window wraps, so all 28-bit addresses are accepted
+#define FUNC_DDR3_SIZE   (1u << 16)
+
+
 typedef enum {
     FuncIdle,
     FuncRecv,
     FuncRXCMD,
-    FuncRxPID,
-    FuncBusy,
+    FuncSend,
     FuncEOT,
 } usbf_state;
 
+typedef enum {
+    CtlIdle,
+    CtlDataIn,
+    CtlDataOut,
+    CtlStatusOut,
+    CtlStatusIn,
+    CtlStall,
+} usbf_ctl_t;
+
+/**
+ * Packet FIFO, for the Bulk OUT -> Bulk IN loopback, and for the responses to
+ * the DDR3 memory-requests.
+ */
+typedef struct {
+    uint8_t data[FUNC_FIFO_SIZE];
+    uint16_t lens[FUNC_FIFO_DEPTH];
+    uint16_t rd_ptr;
+    uint16_t wr_ptr;
+    uint16_t level;
+    uint8_t head;
+    uint8_t count;
+} usbf_fifo_t;
+
 typedef struct __usb_func {
     uint64_t cycle;
     host_op_t op;
@@ -23,10 +85,37 @@ typedef struct __usb_func {
     transfer_t xfer;
     uint16_t turnaround;
     uint8_t addr;
+    bit_t dir;
+    uint8_t rx_pid;
+    // Control pipe
+    uint8_t ctl;
+    uint8_t next_addr;
+    uint8_t config;
+    usb_stdreq_t req;
+    uint8_t ctl_buf[FUNC_REGS_SIZE];
+    uint16_t ctl_len;
+    uint16_t ctl_ptr;
+    uint8_t regs[FUNC_REGS_SIZE];
+    // Endpoints
+    bit_t seq_in[16];
+    bit_t seq_out[16];
+    usbf_fifo_t fifo;
+    usbf_fifo_t resp;
+    uint8_t mem[FUNC_DDR3_SIZE];
+    // Flow-control policy
+    uint16_t nak_rate;
+    uint16_t nak_count;
+    bool nyet;
+    // Statistics
+    uint32_t naks;
+    uint32_t nyets;
+    uint32_t stalls;
+    uint32_t errors;
 } usb_func_t;
 
 
 void usbf_init(usb_func_t* func);
+void usbf_policy(usb_func_t* func, uint16_t nak_rate, bool nyet);
 int usbf_step(usb_func_t* func, const ulpi_bus_t* in, ulpi_bus_t* out);
 
 
@@ -0,0 +1,666 @@
+#include "usbgen.h"
+#include "stdreq.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+
+//
+//  Helper Routines and Data
+///
+
+static const char gen_kinds[GEN_NUM_KINDS][8] = {
+    {"CONTROL"}, {"BulkOUT"}, {"BulkIN"}, {"STORE"}, {"FETCH"}
+};
+
+
+static int gen_failed(usb_gen_t* gen, const char* mesg, const int line)
+{
+    const gen_xact_t* x = &gen->xact;
+
+    ulpi_printf("GEN\t#%8u xact =>\tFAILED: %s (%s, %u bytes, addr: 0x%07x) [%s:%d]\n",
+                gen->issued, mesg, gen_kinds[x->kind], x->size, x->addr, __FILE__, line);
+    if (gen->fail == NULL) {
+        gen->fail = mesg;
+    }
+    return -1;
+}
+
+/**
+ * Random length, from the (shaped) range, and limited to at most 'limit'.
+ */
+static uint16_t gen_range(usb_gen_t* gen, const gen_range_t* range, uint16_t limit)
+{
+    const uint16_t max = range->max < limit ? range->max : limit;
+    const uint16_t min = range->min < max ? range->min : max;
+    const uint32_t span = (uint32_t)(max - min) + 1;
+    uint32_t x = ulpi_rand(&gen->rng);
+
+    switch (range->shape) {
+    case GenShort:
+        // Product of two uniform variates, so that short lengths dominate
+        return min + (uint16_t)((uint64_t)(x % span) * (ulpi_rand(&gen->rng) % span) / span);
+
+    case GenEdges:
+        switch (x & 7) {
+        case 0: return min;
+        case 1: return min < max ? min + 1 : max;
+        case 2: return max > min ? max - 1 : min;
+        case 3: return max;
+        default: break;
+        }
+        x = ulpi_rand(&gen->rng);
+        // Fall-through
+    default:
+        return min + (uint16_t)(x % span);
+    }
+}
+
+/**
+ * Move the (aligned) address of a burst of 'bytes' so that it is within the
+ * window, and does not cross a 4 KiB boundary.
+ */
+static uint32_t gen_place(const gen_config_t* cfg, uint32_t offset, uint16_t bytes)
+{
+    const uint32_t mask = ~(cfg->addr_align - 1);
+    const uint32_t room = cfg->addr_size > bytes ? cfg->addr_size - bytes : 0;
+    uint32_t addr = (cfg->addr_base + (offset < room ? offset : room)) & mask;
+    const uint32_t page = (addr + bytes - 1) & ~(GEN_AXI_BOUNDARY - 1);
+
+    if (addr < page) {
+        addr = page - bytes >= cfg->addr_base ? (page - bytes) & mask : page;
+    }
+    return addr & GEN_ADDR_MASK;
+}
+
+/**
+ * Random (aligned) address, within the window, for a burst of 'bytes' that
+ * does not cross a 4 KiB boundary.
+ */
+static uint32_t gen_address(usb_gen_t* gen, uint16_t bytes)
+{
+    const gen_config_t* cfg = &gen->cfg;
+    const uint32_t room = cfg->addr_size > bytes ? cfg->addr_size - bytes : 0;
+
+    return gen_place(cfg, ulpi_rand(&gen->rng) % (room + 1), bytes);
+}
+
+/**
+ * Address for a FETCH, which (most of the time) starts within one of the most
+ * recent STOREs, so that most of the bytes fetched have known values, rather
+ * than being drawn uniformly over a window that is mostly unwritten.
+ */
+static uint32_t gen_fetch_address(usb_gen_t* gen, uint16_t bytes)
+{
+    const uint32_t num = gen->stored < GEN_MAX_STORED ? gen->stored : GEN_MAX_STORED;
+
+    if (num == 0 || ulpi_rand(&gen->rng) % 100 >= GEN_FETCH_STORED) {
+        return gen_address(gen, bytes);
+    }
+
+    // Prefer a (random) STORE that the FETCH fits within, else the largest
+    const uint32_t first = ulpi_rand(&gen->rng) % num;
+    const gen_burst_t* b = &gen->stores[first];
+
+    for (uint32_t i=0; i<num && b->size < bytes; i++) {
+        const gen_burst_t* c = &gen->stores[(first + i) % num];
+        b = c->size > b->size ? c : b;
+    }
+
+    const uint32_t span = b->size > bytes ? b->size - bytes + 1 : 1;
+    const uint32_t offset = b->addr - gen->cfg.addr_base + ulpi_rand(&gen->rng) % span;
+
+    return gen_place(&gen->cfg, offset, bytes);
+}
+
+/**
+ * Pick the kind of the next transaction, by weight, but keeping the loopback
+ * FIFO within its depth, and draining it once all transactions were issued.
+ */
+static gen_kind_t gen_pick(usb_gen_t* gen)
+{
+    const gen_config_t* cfg = &gen->cfg;
+    uint32_t total = 0, r;
+    int kind;
+
+    if (cfg->loopback && gen->issued >= cfg->count) {
+        return GenBulkIn;
+    }
+
+    for (int i=0; i<GEN_NUM_KINDS; i++) {
+        total += cfg->weights[i];
+    }
+    r = ulpi_rand(&gen->rng) % total;
+    for (kind=0; r >= cfg->weights[kind]; kind++) {
+        r -= cfg->weights[kind];
+    }
+
+    if (cfg->loopback) {
+        if (kind == GenBulkIn && gen->count == 0) {
+            kind = GenBulkOut;
+        } else if (kind == GenBulkOut && gen->count >= GEN_MAX_PENDING) {
+            kind = GenBulkIn;
+        }
+    }
+    return (gen_kind_t)kind;
+}
+
+/**
+ * Fill in the (6-byte) DDR3 request, which is followed by the beats of a STORE.
+ */
+static void gen_ddr3_cmd(gen_xact_t* x, uint8_t cmd, uint16_t beats)
+{
+    x->data[0] = cmd;
+    x->data[1] = (uint8_t)(beats - 1);
+    x->data[2] = x->addr & 0xFF;
+    x->data[3] = (x->addr >> 8) & 0xFF;
+    x->data[4] = (x->addr >> 16) & 0xFF;
+    x->data[5] = ((x->addr >> 24) & 0x0F) | (x->id << 4);
+}
+
+/**
+ * Random control request, which is a (partial) device, or configuration,
+ * descriptor, or a vendor register write, or read, if supported.
+ */
+static void gen_control(usb_gen_t* gen, const usb_host_t* host, gen_xact_t* x)
+{
+    usb_stdreq_t* req = &x->req;
+    const uint32_t r = ulpi_rand(&gen->rng) % (gen->cfg.vendor_regs ? 4 : 2);
+
+    req->wIndex = 0;
+    req->data = NULL;
+    x->addr = 0;
+
+    if (r < 2) {
+        const uint16_t total = r == 0 ? 18 : host->eptab.total > 0 ? host->eptab.total : 9;
+        req->bmRequestType = 0x80;
+        req->bRequest = STDREQ_GET_DESCRIPTOR;
+        req->wValue = (r == 0 ? DESC_DEVICE : DESC_CONFIGURATION) << 8;
+        req->wLength = 1 + ulpi_rand(&gen->rng) % MAX_CONFIG_SIZE;
+        x->size = req->wLength < total ? req->wLength : total;
+    } else {
+        x->addr = ulpi_rand(&gen->rng) % FUNC_REGS_SIZE;
+        req->bmRequestType = r == 2 ? 0x40 : 0xC0;
+        req->bRequest = r == 2 ? FUNC_VENDOR_WRITE : FUNC_VENDOR_READ;
+        req->wValue = x->addr;
+        req->wLength = gen_range(gen, &gen->cfg.vendor, FUNC_REGS_SIZE - x->addr);
+        x->size = req->wLength;
+        if (r == 2) {
+            for (int i=0; i<x->size; i++) {
+                gen->blob[i] = ulpi_rand(&gen->rng);
+            }
+            req->data = gen->blob;
+        }
+    }
+    x->len = req->wLength;
+}
+
+/**
+ * Queue-up the current packet, of the current transaction.
+ */
+static int gen_issue(usb_gen_t* gen, usb_host_t* host)
+{
+    const gen_xact_t* x = &gen->xact;
+    host->op = HostIdle;
+
+    switch (x->kind) {
+    case GenControl:
+        return stdreq_control(host, &x->req);
+    case GenBulkOut:
+        return usbh_bulk_out(host, gen->ep_bulk_out, x->data, x->len);
+    case GenBulkIn:
+        return usbh_bulk_in(host, gen->ep_bulk_in);
+    default:
+        if (x->step == 0) {
+            return usbh_bulk_out(host, gen->ep_ddr3_out, x->data, x->len);
+        }
+        return usbh_bulk_in(host, gen->ep_ddr3_in);
+    }
+}
+
+/**
+ * Transaction completed, so record its latency, and release the host.
+ */
+static int gen_complete(usb_gen_t* gen, usb_host_t* host, uint16_t bytes)
+{
+    const gen_xact_t* x = &gen->xact;
+    gen_stats_t* st = &gen->stats[x->kind];
+    const uint32_t lat = (uint32_t)(host->cycle - x->start);
+
+    st->count++;
+    st->bytes += bytes;
+    st->cycles += lat;
+    st->lat_min = st->count == 1 || lat < st->lat_min ? lat : st->lat_min;
+    st->lat_max = lat > st->lat_max ? lat : st->lat_max;
+    gen->cycles = host->cycle - gen->start;
+
+    host->op = HostIdle;
+    host->xfer.type = XferIdle;
+    host->xfer.stage = NoXfer;
+
+    return 1;
+}
+
+
+// -- Scoreboard -- //
+
+static int gen_check_control(usb_gen_t* gen, const usb_host_t* host)
+{
+    const gen_xact_t* x = &gen->xact;
+    const usb_stdreq_t* req = &x->req;
+
+    if (host->ctl.ptr != x->size) {
+        ulpi_printf("GEN\t#%8u xact =>\tExpected %u bytes, transferred %u\n",
+                    gen->issued, x->size, host->ctl.ptr);
+        return gen_failed(gen, "control DATA-stage length", __LINE__);
+    } else if (req->bRequest == STDREQ_GET_DESCRIPTOR) {
+        const uint8_t type = req->wValue >> 8;
+        if ((x->size > 0 && host->buf[0] != (type == DESC_DEVICE ? 18 : 9)) ||
+            (x->size > 1 && host->buf[1] != type)) {
+            return gen_failed(gen, "descriptor header", __LINE__);
+        }
+    } else if (req->bRequest == FUNC_VENDOR_WRITE) {
+        memcpy(&gen->regs[x->addr], gen->blob, x->size);
+        memset(&gen->known[x->addr], 1, x->size);
+    } else {
+        for (int i=0; i<x->size; i++) {
+            if (gen->known[x->addr + i] && host->buf[i] != gen->regs[x->addr + i]) {
+                ulpi_printf("GEN\t#%8u xact =>\tRegister 0x%03x: expected 0x%02x, read 0x%02x\n",
+                            gen->issued, x->addr + i, gen->regs[x->addr + i], host->buf[i]);
+                return gen_failed(gen, "vendor register read-back", __LINE__);
+            }
+        }
+    }
+    return 0;
+}
+
+static int gen_check_bulk_in(usb_gen_t* gen, const uint8_t* data, int len)
+{
+    if (len > gen->max_bulk) {
+        return gen_failed(gen, "Bulk IN packet exceeds 'wMaxPacketSize'", __LINE__);
+    } else if (gen->cfg.loopback) {
+        const uint16_t exp = gen->lens[gen->head];
+        if (gen->count == 0) {
+            return gen_failed(gen, "unexpected Bulk IN data", __LINE__);
+        } else if (len != exp || memcmp(data, gen->pending[gen->head], len) != 0) {
+            ulpi_printf("GEN\t#%8u xact =>\tExpected %u bytes, received %d\n",
+                        gen->issued, exp, len);
+            return gen_failed(gen, "Bulk IN data mismatch", __LINE__);
+        }
+        gen->head = (gen->head + 1) % GEN_MAX_PENDING;
+        gen->count--;
+    }
+    return 0;
+}
+
+/**
+ * Check the header of the response, then record the STORE data in, or check
+ * the FETCH data against, the host's DDR3 shadow (if it has one).
+ */
+static int gen_check_ddr3(usb_gen_t* gen, usb_host_t* host, const uint8_t* data, int len)
+{
+    const gen_xact_t* x = &gen->xact;
+    const bool store = x->kind == GenStore;
+    const int exp = store ? 2 : 2 + x->size;
+
+    if (len != exp) {
+        ulpi_printf("GEN\t#%8u xact =>\tExpected a %d-byte response, received %d\n",
+                    gen->issued, exp, len);
+        return gen_failed(gen, "DDR3 response length", __LINE__);
+    } else if (data[0] != (store ? DDR3_RES_WDONE : DDR3_RES_RDATA) || data[1] != x->id) {
+        ulpi_printf("GEN\t#%8u xact =>\tResponse: 0x%02x (ID: %u), for request ID: %u\n",
+                    gen->issued, data[0], data[1], x->id);
+        return gen_failed(gen, "DDR3 response", __LINE__);
+    }
+
+    if (host->shadow == NULL) {
+        return 0;
+    } else if (store) {
+        shadow_store(host->shadow, x->addr, &x->data[DDR3_CMD_SIZE], x->size);
+    } else if (shadow_check(host->shadow, x->addr, &data[2], x->size) > 0) {
+        ulpi_printf("GEN\t#%8u xact =>\tFETCH data mismatch, at 0x%07x (expected: 0x%02x, got: 0x%02x)\n",
+                    gen->issued, host->shadow->bad_addr, host->shadow->bad_exp,
+                    host->shadow->bad_got);
+        return gen_failed(gen, "DDR3 data mismatch", __LINE__);
+    }
+    return 0;
+}
+
+
+//
+//  Public API Routines
+///
+
+const char* usbgen_kind_string(gen_kind_t kind)
+{
+    return kind < GEN_NUM_KINDS ? gen_kinds[kind] : "invalid";
+}
+
+/**
+ * Default mix, for the function model, of mostly bulk traffic, with maximum-
+ * sized and empty packets over-represented, mostly short DDR3 bursts, and a
+ * 64 KiB DDR3 address window.
+ */
+void usbgen_defaults(gen_config_t* cfg, uint32_t seed, uint32_t count)
+{
+    static const uint16_t weights[GEN_NUM_KINDS] = { 1, 3, 3, 2, 2 };
+
+    memset(cfg, 0, sizeof(gen_config_t));
+    cfg->seed = seed;
+    cfg->count = count;
+    memcpy(cfg->weights, weights, sizeof(weights));
+    cfg->bulk = (gen_range_t){ 0, MAX_PACKET_SIZE, GenEdges };
+    cfg->beats = (gen_range_t){ 1, 128, GenShort };
+    cfg->vendor = (gen_range_t){ 1, 256, GenUniform };
+    cfg->addr_base = 0;
+    cfg->addr_size = FUNC_DDR3_SIZE;
+    cfg->addr_align = 16;
+    cfg->loopback = true;
+    cfg->vendor_regs = true;
+}
+
+void usbgen_init(usb_gen_t* gen, const gen_config_t* cfg)
+{
+    uint32_t total = 0;
+
+    memset(gen, 0, sizeof(usb_gen_t));
+    memcpy(&gen->cfg, cfg, sizeof(gen_config_t));
+    gen->rng = cfg->seed;
+    gen->ep_bulk_in = FUNC_BULK_IN_EP;
+    gen->ep_bulk_out = FUNC_BULK_OUT_EP;
+    gen->ep_ddr3_in = FUNC_DDR3_IN_EP;
+    gen->ep_ddr3_out = FUNC_DDR3_OUT_EP;
+    gen->max_bulk = MAX_PACKET_SIZE;
+    gen->max_beats = (MAX_PACKET_SIZE - DDR3_CMD_SIZE) / DDR3_BEAT_SIZE;
+
+    for (int i=0; i<GEN_NUM_KINDS; i++) {
+        total += cfg->weights[i];
+    }
+    assert(total > 0 && cfg->addr_align >= DDR3_BEAT_SIZE &&
+           (cfg->addr_align & (cfg->addr_align - 1)) == 0);
+}
+
+/**
+ * Use the Bulk endpoints discovered by 'GET CONFIG DESCRIPTOR' (if it has been
+ * issued), where the second Bulk IN, and Bulk OUT, endpoints are for DDR3, and
+ * limit the packet-sizes to their 'wMaxPacketSize'.
+ */
+void usbgen_bind(usb_gen_t* gen, const usb_host_t* host)
+{
+    const usb_eptab_t* tab = &host->eptab;
+    const usb_endpoint_t* eps[4] = {
+        desc_endpoint(tab, EP_DIR_IN, EP_TYPE_BULK, 0),
+        desc_endpoint(tab, 0x00, EP_TYPE_BULK, 0),
+        desc_endpoint(tab, EP_DIR_IN, EP_TYPE_BULK, 1),
+        desc_endpoint(tab, 0x00, EP_TYPE_BULK, 1),
+    };
+    uint16_t maxp[4];
+
+    for (int i=0; i<4; i++) {
+        maxp[i] = eps[i] != NULL && eps[i]->max_packet > 0 &&
+            eps[i]->max_packet < MAX_PACKET_SIZE ? eps[i]->max_packet : MAX_PACKET_SIZE;
+    }
+    gen->ep_bulk_in = eps[0] != NULL ? eps[0]->address & 0x0F : gen->ep_bulk_in;
+    gen->ep_bulk_out = eps[1] != NULL ? eps[1]->address & 0x0F : gen->ep_bulk_out;
+    gen->ep_ddr3_in = eps[2] != NULL ? eps[2]->address & 0x0F : gen->ep_ddr3_in;
+    gen->ep_ddr3_out = eps[3] != NULL ? eps[3]->address & 0x0F : gen->ep_ddr3_out;
+
+    gen->max_bulk = maxp[0] < maxp[1] ? maxp[0] : maxp[1];
+    gen->max_beats = (maxp[3] - DDR3_CMD_SIZE) / DDR3_BEAT_SIZE;
+    if ((maxp[2] - 2) / DDR3_BEAT_SIZE < gen->max_beats) {
+        gen->max_beats = (maxp[2] - 2) / DDR3_BEAT_SIZE;
+    }
+}
+
+/**
+ * All transactions have been issued (and, for loopback, all of the Bulk OUT
+ * packets have been read back).
+ */
+bool usbgen_done(const usb_gen_t* gen)
+{
+    return gen->issued >= gen->cfg.count && gen->count == 0;
+}
+
+/**
+ * Generate the next random transaction, and queue-up its first packet.
+ */
+int usbgen_start(usb_gen_t* gen, usb_host_t* host)
+{
+    gen_xact_t* x = &gen->xact;
+    uint16_t beats;
+
+    if (gen->issued == 0) {
+        gen->start = host->cycle;
+    }
+    x->kind = gen_pick(gen);
+    x->step = 0;
+    x->retries = 0;
+    x->addr = 0;
+    x->id = ulpi_rand(&gen->rng) & 0x0F;
+    x->start = host->cycle;
+    gen->issued++;
+
+    switch (x->kind) {
+    case GenControl:
+        gen_control(gen, host, x);
+        break;
+
+    case GenBulkOut:
+        x->len = gen_range(gen, &gen->cfg.bulk, gen->max_bulk);
+        x->size = x->len;
+        for (int i=0; i<x->len; i++) {
+            x->data[i] = ulpi_rand(&gen->rng);
+        }
+        break;
+
+    case GenBulkIn:
+        x->len = 0;
+        x->size = 0;
+        break;
+
+    case GenStore:
+    case GenFetch:
+        beats = gen_range(gen, &gen->cfg.beats, gen->max_beats);
+        beats = beats > 0 ? beats : 1;
+        x->size = beats * DDR3_BEAT_SIZE;
+        x->addr = x->kind == GenFetch ? gen_fetch_address(gen, x->size) :
+            gen_address(gen, x->size);
+        x->len = DDR3_CMD_SIZE;
+        gen_ddr3_cmd(x, x->kind == GenStore ? DDR3_CMD_STORE : DDR3_CMD_FETCH, beats);
+        if (x->kind == GenStore) {
+            gen_burst_t* b = &gen->stores[gen->stored++ % GEN_MAX_STORED];
+            b->addr = x->addr;
+            b->size = x->size;
+            for (int i=0; i<x->size; i++) {
+                x->data[x->len++] = ulpi_rand(&gen->rng);
+            }
+        }
+        break;
+
+    default:
+        return gen_failed(gen, "invalid transaction-kind", __LINE__);
+    }
+
+    if (gen_issue(gen, host) < 0) {
+        return gen_failed(gen, "transaction set-up", __LINE__);
+    }
+    return 0;
+}
+
+/**
+ * Check the packet that has just completed, and then queue-up the next packet
+ * of the transaction, or retry it, if NAK'd.
+ * Returns:
+ *  -1  --  failure, or the response did not match the scoreboard;
+ *  0   --  next packet queued; OR
+ *  1   --  transaction completed, and checked.
+ */
+int usbgen_next(usb_gen_t* gen, usb_host_t* host)
+{
+    gen_xact_t* x = &gen->xact;
+    const transfer_t* xfer = &host->xfer;
+    int result;
+
+    if (x->kind == GenControl) {
+        if ((host->step == 4 || host->step == 8) && xfer->hsk == USBPID_NAK) {
+            gen->stats[GenControl].naks++;
+        }
+        result = stdreq_next(host);
+        if (result < 0) {
+            return gen_failed(gen, result == -2 ? "control request STALLed" :
+                              "control transfer", __LINE__);
+        } else if (result == 0) {
+            return 0;
+        } else if (gen_check_control(gen, host) < 0) {
+            return -1;
+        }
+        return gen_complete(gen, host, x->size);
+    }
+
+    if (xfer->hsk == USBPID_NAK) {
+        gen->stats[x->kind].naks++;
+        if (x->kind == GenBulkIn && !gen->cfg.loopback) {
+            // Nothing to send, which is a valid response
+            return gen_complete(gen, host, 0);
+        } else if (++x->retries >= GEN_MAX_RETRIES) {
+            return gen_failed(gen, "retries exceeded", __LINE__);
+        }
+        return gen_issue(gen, host) < 0 ? gen_failed(gen, "retry set-up", __LINE__) : 0;
+    } else if (xfer->hsk != USBPID_ACK && xfer->hsk != USBPID_NYET) {
+        return gen_failed(gen, "not acknowledged", __LINE__);
+    }
+
+    switch (x->kind) {
+    case GenBulkOut:
+        if (gen->cfg.loopback) {
+            const uint8_t tail = (gen->head + gen->count) % GEN_MAX_PENDING;
+            memcpy(gen->pending[tail], x->data, x->len);
+            gen->lens[tail] = x->len;
+            gen->count++;
+        }
+        return gen_complete(gen, host, x->size);
+
+    case GenBulkIn:
+        if (gen_check_bulk_in(gen, xfer->rx, xfer->rx_len) < 0) {
+            return -1;
+        }
+        return gen_complete(gen, host, xfer->rx_len);
+
+    default:
+        if (x->step == 0) {
+            // Request accepted, so fetch its response
+            x->step = 1;
+            x->retries = 0;
+            return gen_issue(gen, host) < 0 ? gen_failed(gen, "response set-up", __LINE__) : 0;
+        } else if (gen_check_ddr3(gen, host, xfer->rx, xfer->rx_len) < 0) {
+            return -1;
+        }
+        return gen_complete(gen, host, x->size);
+    }
+}
+
+/**
+ * Accumulate the statistics of each generator into the 'total', where the
+ * cycles are summed, as each generator runs its own host.
+ */
+void usbgen_merge(usb_gen_t* total, const usb_gen_t* gen)
+{
+    for (int i=0; i<GEN_NUM_KINDS; i++) {
+        gen_stats_t* dst = &total->stats[i];
+        const gen_stats_t* src = &gen->stats[i];
+
+        if (src->count == 0) {
+            continue;
+        }
+        dst->lat_min = dst->count == 0 || src->lat_min < dst->lat_min ? src->lat_min : dst->lat_min;
+        dst->lat_max = src->lat_max > dst->lat_max ? src->lat_max : dst->lat_max;
+        dst->count += src->count;
+        dst->naks += src->naks;
+        dst->bytes += src->bytes;
+        dst->cycles += src->cycles;
+    }
+    total->issued += gen->issued;
+    total->cycles += gen->cycles;
+}
+
+/**
+ * Bandwidth of each transaction-kind is its payload bytes over the cycles of
+ * the whole run, so that these sum to the achieved (mixed) bandwidth, and the
+ * latencies are from queueing the first packet, until the transaction has
+ * completed (including its retries).
+ */
+void usbgen_report(const usb_gen_t* gen)
+{
+    const double cycles = gen->cycles > 0 ? (double)gen->cycles : 1.0;
+    uint64_t bytes = 0;
+
+    ulpi_printf("  random:\t%u transactions in %lu cycles\n", gen->issued, gen->cycles);
+    ulpi_printf("    %-8s %8s %10s %8s %8s %24s %6s\n", "kind", "count", "bytes",
+                "B/cycle", "MB/s", "latency min/avg/max", "NAKs");
+
+    for (int i=0; i<GEN_NUM_KINDS; i++) {
+        const gen_stats_t* st = &gen->stats[i];
+        if (st->count == 0) {
+            continue;
+        }
+        bytes += st->bytes;
+        // 60 MHz ULPI clock, so bytes/cycle * 60 gives MB/s
+        ulpi_printf("    %-8s %8u %10lu %8.3f %8.2f %8u/%7lu/%7u %6u\n", gen_kinds[i],
+                    st->count, st->bytes, (double)st->bytes / cycles,
+                    (double)st->bytes * 60.0 / cycles, st->lat_min,
+                    st->cycles / st->count, st->lat_max, st->naks);
+    }
+    ulpi_printf("    %-8s %8u %10lu %8.3f %8.2f\n", "total", gen->issued, bytes,
+                (double)bytes / cycles, (double)bytes * 60.0 / cycles);
+}
+
+
+//
+//  Generator Unit Tests
+///
+
+/**
+ * Check that the lengths stay within their ranges, that the addresses obey
+ * their constraints, and that the weights (and loopback limits) are applied.
+ */
+void test_usbgen(void)
+{
+    static usb_gen_t gen;
+    gen_config_t cfg;
+    const gen_range_t ranges[3] = {
+        { 0, MAX_PACKET_SIZE, GenEdges }, { 1, 128, GenShort }, { 3, 3, GenUniform }
+    };
+
+    ulpi_printf("Testing 'usbgen'");
+    usbgen_defaults(&cfg, 0x1234, 1000);
+    cfg.addr_base = 0x07FFE000;
+    cfg.addr_size = 0x2000;
+    cfg.addr_align = 32;
+    usbgen_init(&gen, &cfg);
+
+    for (int i=0; i<10000; i++) {
+        const gen_range_t* range = &ranges[i % 3];
+        const uint16_t len = gen_range(&gen, range, 126);
+        assert(len >= range->min && len <= range->max && len <= 126);
+
+        const uint16_t bytes = 4 * (1 + gen_range(&gen, &ranges[1], 126));
+        const uint32_t addr = i & 1 ? gen_fetch_address(&gen, bytes) : gen_address(&gen, bytes);
+        assert(addr >= cfg.addr_base && addr + bytes <= cfg.addr_base + cfg.addr_size);
+        assert((addr & 31) == 0);
+        assert((addr / GEN_AXI_BOUNDARY) == ((addr + bytes - 1) / GEN_AXI_BOUNDARY));
+        if ((i & 1) == 0) {
+            gen.stores[gen.stored++ % GEN_MAX_STORED] = (gen_burst_t){ addr, bytes };
+        }
+    }
+
+    // Only Bulk IN, so the loopback has to substitute Bulk OUT, when empty
+    memset(cfg.weights, 0, sizeof(cfg.weights));
+    cfg.weights[GenBulkIn] = 1;
+    usbgen_init(&gen, &cfg);
+    assert(gen_pick(&gen) == GenBulkOut);
+    gen.count = GEN_MAX_PENDING;
+    assert(gen_pick(&gen) == GenBulkIn);
+
+    ulpi_printf("\t\tSUCCESS\n");
+}
@@ -0,0 +1,153 @@
+#ifndef __USBGEN_H__
+#define __USBGEN_H__
+/**
+ * Constrained-random USB transaction generator, that issues seeded mixes of
+ * control, Bulk OUT/IN, and DDR3 STORE/FETCH transactions to the host model,
+ * and checks each of the responses against its scoreboard.
+ * NOTE:
+ *  - works at the packet-level, like 'stdreq_next()', so that the same
+ *    generator can be stepped by a '$ulpi_step' test-case, and by the loopback
+ *    (without a simulator);
+ *  - Bulk IN data is only checked against the Bulk OUT packets if the function
+ *    loops them back ('loopback'), otherwise a NAK is a valid (empty) response;
+ *  - DDR3 bursts are kept within the address window, and never cross a 4 KiB
+ *    boundary (as for AXI4), which requires a window at least twice the size
+ *    of the largest burst;
+ *  - most FETCHes start within one of the recent STOREs, so that the data
+ *    read back can be checked (by the function's DDR3 shadow);
+ */
+
+#include "usbfunc.h"
+#include "usbhost.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define GEN_MAX_PENDING  4          // Bulk OUT packets awaiting loop-back
+#define GEN_MAX_RETRIES  4096       // NAKs before a transaction has failed
+#define GEN_AXI_BOUNDARY 4096u
+#define GEN_ADDR_MASK    0x0FFFFFFFu
+#define GEN_MAX_STORED   16         // recent STOREs, that FETCHes re-read
+#define GEN_FETCH_STORED 80         // percentage of FETCHes that re-read
+
+
+typedef enum {
+    GenControl,
+    GenBulkOut,
+    GenBulkIn,
+    GenStore,
+    GenFetch,
+    GEN_NUM_KINDS
+} gen_kind_t;
+
+typedef enum {
+    GenUniform,                 // uniform over [min, max]
+    GenShort,                   // biased towards 'min'
+    GenEdges,                   // mostly 'min', 'max', and their neighbours
+} gen_shape_t;
+
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    gen_shape_t shape;
+} gen_range_t;
+
+/**
+ * Weights of each transaction-kind (which need not sum to any value), and the
+ * length-distributions, and address-constraints, of the transactions.
+ */
+typedef struct {
+    uint32_t seed;
+    uint32_t count;             // transactions to issue
+    uint16_t weights[GEN_NUM_KINDS];
+    gen_range_t bulk;           // bytes per Bulk OUT packet
+    gen_range_t beats;          // 32-bit beats per STORE/FETCH
+    gen_range_t vendor;         // bytes per vendor register request
+    uint32_t addr_base;         // DDR3 address window (aligned)
+    uint32_t addr_size;
+    uint32_t addr_align;        // power of 2, and at least 4
+    bool loopback;              // Bulk IN returns the Bulk OUT packets
+    bool vendor_regs;           // supports the vendor register requests
+} gen_config_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t naks;
+    uint64_t bytes;             // payload bytes
+    uint64_t cycles;            // sum of the latencies
+    uint32_t lat_min;
+    uint32_t lat_max;
+} gen_stats_t;
+
+/**
+ * Address-range of a STORE, for FETCHes to re-read.
+ */
+typedef struct {
+    uint32_t addr;
+    uint16_t size;
+} gen_burst_t;
+
+/**
+ * The transaction being issued, where DDR3 requests have a command (and data)
+ * packet, followed by a response packet.
+ */
+typedef struct {
+    gen_kind_t kind;
+    uint8_t step;
+    uint8_t id;
+    uint16_t len;               // bytes of the OUT packet, or of the request
+    uint16_t size;              // payload bytes
+    uint32_t addr;
+    uint16_t retries;
+    uint64_t start;
+    usb_stdreq_t req;
+    uint8_t data[MAX_PACKET_SIZE];
+} gen_xact_t;
+
+typedef struct {
+    gen_config_t cfg;
+    uint32_t rng;
+    uint32_t issued;
+    gen_xact_t xact;
+    // Endpoints, discovered from the host's endpoint table
+    uint8_t ep_bulk_in;
+    uint8_t ep_bulk_out;
+    uint8_t ep_ddr3_in;
+    uint8_t ep_ddr3_out;
+    uint16_t max_bulk;
+    uint16_t max_beats;
+    // Scoreboard
+    uint8_t pending[GEN_MAX_PENDING][MAX_PACKET_SIZE];
+    uint16_t lens[GEN_MAX_PENDING];
+    uint8_t head;
+    uint8_t count;
+    uint8_t blob[FUNC_REGS_SIZE];
+    uint8_t regs[FUNC_REGS_SIZE];
+    uint8_t known[FUNC_REGS_SIZE];
+    gen_burst_t stores[GEN_MAX_STORED];
+    uint32_t stored;
+    // Statistics
+    gen_stats_t stats[GEN_NUM_KINDS];
+    uint64_t start;
+    uint64_t cycles;
+    const char* fail;
+} usb_gen_t;
+
+
+const char* usbgen_kind_string(gen_kind_t kind);
+
+void usbgen_defaults(gen_config_t* cfg, uint32_t seed, uint32_t count);
+void usbgen_init(usb_gen_t* gen, const gen_config_t* cfg);
+void usbgen_bind(usb_gen_t* gen, const usb_host_t* host);
+
+bool usbgen_done(const usb_gen_t* gen);
+int usbgen_start(usb_gen_t* gen, usb_host_t* host);
+int usbgen_next(usb_gen_t* gen, usb_host_t* host);
+
+void usbgen_merge(usb_gen_t* total, const usb_gen_t* gen);
+void usbgen_report(const usb_gen_t* gen);
+
+void test_usbgen(void);
+
+
+#endif  /* __USBGEN_H__ */
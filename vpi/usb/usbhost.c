@@ -14,7 +14,6 @@
 #include <string.h>
 
 
-#define HOST_BUF_LEN    16384u
 #define TURNAROUND_TIMER 40
 
 #define NXT_MASK (0xFu)
@@ -53,7 +52,7 @@ static int is_ulpi_phy_turn(const ulpi_bus_t* in)
 static int start_host_to_func(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
 {
     if (host->xfer.stage > AssertDir) {
-        printf("\nHOST\t#%8lu cyc =>\tERROR, stage = %d\n", host->cycle, host->xfer.stage);
+        ulpi_printf("\nHOST\t#%8lu cyc =>\tERROR, stage = %d\n", host->cycle, host->xfer.stage);
         return -1;
     } else if (host->xfer.stage == NoXfer && is_ulpi_phy_idle(in)) {
         // Happy path, Step I:
@@ -69,7 +68,7 @@ static int start_host_to_func(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t
         out->data.b = 0x00;
         host->xfer.stage = InitRXCMD;
     } else {
-        printf("\nHOST\t#%8lu cyc =>\tERROR, dir = %d, nxt = %d\n", host->cycle, in->dir, in->nxt);
+        ulpi_printf("\nHOST\t#%8lu cyc =>\tERROR, dir = %d, nxt = %d\n", host->cycle, in->dir, in->nxt);
         out->dir = SIGX;
         out->nxt = SIGX;
         out->data.a = 0xFF; // Todo: RX CMD
@@ -108,7 +107,7 @@ static int bulk_out_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out
     case DnDATA0:
     case DnDATA1:
         if (xfer->tx_ptr < xfer->tx_len && in->nxt == SIG1 &&
-            (rand() & NXT_MASK) == NXT_MASK) {
+            (ulpi_rand(&host->rng) & NXT_MASK) == NXT_MASK) {
             out->nxt = SIG0;
             out->data.a = 0x5D;
             return 0;
@@ -127,22 +126,25 @@ static int bulk_out_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out
         if (host->cycle >= xfer->cycle) {
             xfer->type = XferIdle;
             xfer->stage = NoXfer;
-            printf("HOST\t#%8lu cyc =>\tTimeOut [%s:%d]\n",
-                   host->cycle, __FILE__, __LINE__);
+            ulpi_printf("HOST\t#%8lu cyc =>\tTimeOut [%s:%d]\n",
+                        host->cycle, __FILE__, __LINE__);
             return 1;
         }
         result = ack_recv_step(xfer, in, out);
         if (result > 0) {
-            printf("HOST\t#%8lu cyc =>\tBulk OUT ACK [%s:%d]\n",
-                   host->cycle, __FILE__, __LINE__);
+            ulpi_printf("HOST\t#%8lu cyc =>\tBulk OUT %s [%s:%d]\n", host->cycle,
+                        xfer->hsk == USBPID_ACK ? "ACK" :
+                        xfer->hsk == USBPID_NYET ? "NYET" :
+                        xfer->hsk == USBPID_NAK ? "NAK" : "STALL",
+                        __FILE__, __LINE__);
             xfer->type = XferIdle;
             xfer->stage = NoXfer;
         }
         return result;
 
     default:
-        printf("[%s:%d] Unexpected 'Bulk OUT' transfer-type: %u (%s)\n",
-               __FILE__, __LINE__, xfer->type, transfer_type_string(xfer));
+        ulpi_printf("[%s:%d] Unexpected 'Bulk OUT' transfer-type: %u (%s)\n",
+                    __FILE__, __LINE__, xfer->type, transfer_type_string(xfer));
         ulpi_bus_show(in);
         return -1;
     }
@@ -180,7 +182,7 @@ static int bulk_in_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     case UpDATA1:
         result = datax_recv_step(xfer, in, out);
         // result = datax_recv_step(xfer, in, out);
-        if (xfer->rx_ptr == 0 && host->cycle >= xfer->cycle) {
+        if (xfer->rx_ptr == 0 && xfer->hsk == 0 && host->cycle >= xfer->cycle) {
             // No data received before time-out period elapsed
             xfer->type = TimeOut;
         } else if (result < -2) {
@@ -191,12 +193,19 @@ static int bulk_in_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
             return 0;
         } else if (result < 0) {
             return result;
+        } else if (result > 0 && xfer->hsk != 0) {
+            // 'NAK' or 'STALL', instead of data, so no 'ACK' required
+            ulpi_printf("HOST\t#%8lu cyc =>\tBulk IN %s [%s:%d]\n", host->cycle,
+                        xfer->hsk == USBPID_NAK ? "NAK" : "STALL", __FILE__, __LINE__);
+            xfer->type = XferIdle;
+            xfer->stage = NoXfer;
+            return 1;
         } else if (result > 0) {
             xfer->type = DnACK;
             xfer->stage = NoXfer;
         } else {
             if (xfer->rx_ptr > 0 && out->nxt == SIG1 &&
-                (rand() & NXT_MASK) == NXT_MASK) {
+                (ulpi_rand(&host->rng) & NXT_MASK) == NXT_MASK) {
                 out->nxt = SIG0;
             }
         }
@@ -205,6 +214,7 @@ static int bulk_in_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     case DnACK:
         result = ack_send_step(xfer, in, out);
         if (result > 0) {
+            xfer->hsk = USBPID_ACK;
             transfer_ack(xfer);
             xfer->type = XferIdle;
             xfer->stage = NoXfer;
@@ -215,12 +225,12 @@ static int bulk_in_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
         if (host->cycle >= xfer->cycle) {
             xfer->type = XferIdle;
             xfer->stage = NoXfer;
-            printf("HOST\t#%8lu cyc =>\tTimeOut [%s:%d]\n",
-                   host->cycle, __FILE__, __LINE__);
+            ulpi_printf("HOST\t#%8lu cyc =>\tTimeOut [%s:%d]\n",
+                        host->cycle, __FILE__, __LINE__);
             return 1;
         }
         if (xfer->stage == DATAxBody) {
-            assert(in->dir == SIG0 && in->data.b == 0x00);
+            ULPI_CHECK(in->dir == SIG0 && in->data.b == 0x00);
             if (in->stp == SIG1) {
                 // Turn around the ULPI bus, so that we can send an RX CMD
                 out->nxt = SIG0;
@@ -234,11 +244,17 @@ static int bulk_in_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
                 out->data.b = 0xFF;
                 xfer->stage = DATAxStop;
 #endif  /* !__fast_eop */
+                if (xfer->rx_ptr < 2) {
+                    return -1;
+                }
                 xfer->rx_len = xfer->rx_ptr - 2;
                 if (check_rx_crc16(xfer) < 1) {
                     return -1;
                 }
             } else if (in->nxt == SIG1) {
+                if (xfer->rx_ptr >= MAX_PACKET_SIZE + 2) {
+                    return -1;
+                }
                 xfer->rx[xfer->rx_ptr++] = in->data.a;
             } else {
                 out->nxt = SIG1;
@@ -253,8 +269,8 @@ static int bulk_in_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
         return 1;
 
     default:
-        printf("[%s:%d] Unexpected 'Bulk IN' transfer-type: %u (%s)\n",
-               __FILE__, __LINE__, xfer->type, transfer_type_string(xfer));
+        ulpi_printf("[%s:%d] Unexpected 'Bulk IN' transfer-type: %u (%s)\n",
+                    __FILE__, __LINE__, xfer->type, transfer_type_string(xfer));
         ulpi_bus_show(in);
         return -1;
     }
@@ -274,6 +290,8 @@ static void usbh_reset(usb_host_t* host)
     host->addr = 0;
     host->error_count = 0;
     memset(&host->xfer, 0, sizeof(transfer_t));
+    memset(&host->eptab, 0, sizeof(usb_eptab_t));
+    memset(&host->ctl, 0, sizeof(usb_control_t));
 }
 
 /**
@@ -288,14 +306,21 @@ void usbh_init(usb_host_t* host)
     usbh_reset(host);
     host->cycle = 0ul;
     host->sof = 0u;
-    host->buf = (uint8_t*)malloc(HOST_BUF_LEN);
     host->len = HOST_BUF_LEN;
     host->guard = GUARDIAN;
+    host->rng = 1u;
+    host->shadow = NULL;
+}
+
+const char* host_op_string(int8_t op)
+{
+    return op >= HostError && op <= HostBulkIN ? host_op_strings[op+1] : "Unknown";
 }
 
 int host_string(usb_host_t* host, char* str, const int indent)
 {
-    static char sp[64] = {0};
+    char sp[64] = {0};
+    char bus[ULPI_STRING_LEN], xfer[ULPI_STRING_LEN];
     int idx = 0;
     assert(indent < 60);
 
@@ -306,8 +331,8 @@ int host_string(usb_host_t* host, char* str, const int indent)
     idx += sprintf(&str[idx], "%scycle: %lu,\n", sp, host->cycle);
     idx += sprintf(&str[idx], "%sop: %d (%s),\n", sp, host->op, host_op_strings[host->op+1]);
     idx += sprintf(&str[idx], "%sstep: %u,\n", sp, host->step);
-    idx += sprintf(&str[idx], "%sprev: {\n%s  %s\n%s},\n", sp, sp, ulpi_bus_string(&host->prev), sp);
-    idx += sprintf(&str[idx], "%sxfer: {\n%s  %s\n%s},\n", sp, sp, transfer_string(&host->xfer), sp);
+    idx += sprintf(&str[idx], "%sprev: {\n%s  %s\n%s},\n", sp, sp, ulpi_bus_string(&host->prev, bus), sp);
+    idx += sprintf(&str[idx], "%sxfer: {\n%s  %s\n%s},\n", sp, sp, transfer_string(&host->xfer, xfer), sp);
     idx += sprintf(&str[idx], "%ssof: 0x%x (%u),\n", sp, host->sof, host->sof);
     idx += sprintf(&str[idx], "%stimer: %d,\n", sp, host->turnaround);
     idx += sprintf(&str[idx], "%saddr: 0x%02x,\n", sp, host->addr);
@@ -322,7 +347,7 @@ void show_host(usb_host_t* host)
     char* str = malloc(4096);
     int len = host_string(host, str, 2);
     assert(len < 4096);
-    printf("USB_HOST = {\n%s};\n", str);
+    ulpi_printf("USB_HOST = {\n%s};\n", str);
     free(str);
 }
 
@@ -347,14 +372,52 @@ int usbh_reset_device(usb_host_t* host, uint8_t addr)
     return -1;
 }
 
-int usbh_bulk_out(usb_host_t* host, uint8_t* data, uint16_t len)
+/**
+ * Queue-up a 'Bulk OUT' transaction, of upto 'MAX_PACKET_SIZE' bytes.
+ */
+int usbh_bulk_out(usb_host_t* host, uint8_t ep, const uint8_t* data, uint16_t len)
 {
-    return -1;
+    transfer_t* xfer = &host->xfer;
+
+    if (host->op != HostIdle || len > MAX_PACKET_SIZE) {
+        return -1;
+    }
+
+    host->op = HostBulkOUT;
+    host->step = 0;
+    transfer_out(xfer, host->addr, ep);
+    transfer_tok(xfer);
+    xfer->hsk = 0;
+
+    memcpy(xfer->tx, data, len);
+    xfer->tx_len = len;
+
+    const uint16_t crc = crc16_calc(xfer->tx, len);
+    xfer->crc1 = crc & 0xFF;
+    xfer->crc2 = (crc >> 8) & 0xFF;
+
+    return 0;
 }
 
-int usbh_bulk_in(usb_host_t* host, uint8_t* data, uint16_t* len)
+/**
+ * Queue-up a 'Bulk IN' transaction, and the received data will be stored in
+ * 'host->xfer.rx[]'.
+ */
+int usbh_bulk_in(usb_host_t* host, uint8_t ep)
 {
-    return -1;
+    transfer_t* xfer = &host->xfer;
+
+    if (host->op != HostIdle) {
+        return -1;
+    }
+
+    host->op = HostBulkIN;
+    host->step = 0;
+    transfer_in(xfer, host->addr, ep);
+    transfer_tok(xfer);
+    xfer->hsk = 0;
+
+    return 0;
 }
 
 /**
@@ -374,15 +437,15 @@ int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     //
     if (in->rst_n == SIG0) {
         if (host->prev.rst_n != SIG0) {
-            printf("\nHOST\t#%8lu cyc =>\tReset issued [%s:%d]\n", cycle, __FILE__, __LINE__);
+            ulpi_printf("\nHOST\t#%8lu cyc =>\tReset issued [%s:%d]\n", cycle, __FILE__, __LINE__);
             usbh_reset(host);
         }
         out->dir = SIG0;
         out->nxt = SIG0;
     } else if ((cycle % SOF_N_TICKS) == 0ul) {
         if (host->op > HostIdle) {
-            printf("\nHOST\t#%8lu cyc =>\tTransaction cancelled for SOF [%s:%d]\n",
-                   cycle, __FILE__, __LINE__);
+            ulpi_printf("\nHOST\t#%8lu cyc =>\tTransaction cancelled for SOF [%s:%d]\n",
+                        cycle, __FILE__, __LINE__);
         } else if (host->op < HostIdle) {
             // Ignore SOF
         } else {
@@ -393,7 +456,7 @@ int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
             host->xfer.type = SOF;
             host->xfer.tok1 = crc & 0xFF;
             host->xfer.tok2 = (crc >> 8) & 0xFF;
-            printf("\nHOST\t#%8lu cyc =>\tSOF [%s:%d]\n", cycle, __FILE__, __LINE__);
+            ulpi_printf("\nHOST\t#%8lu cyc =>\tSOF [%s:%d]\n", cycle, __FILE__, __LINE__);
         }
     }
 
@@ -406,13 +469,13 @@ int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     case HostReset: {
         uint32_t step = ++host->step;
         if (step < 2) {
-            printf("\nHOST\t#%8lu cyc =>\tRESET START [%s:%d]\n", cycle,
-                   __FILE__, __LINE__);
+            ulpi_printf("\nHOST\t#%8lu cyc =>\tRESET START [%s:%d]\n", cycle,
+                        __FILE__, __LINE__);
         } else if (step >= RESET_TICKS) {
             host->op = HostIdle;
             host->step = 0u;
-            printf("\nHOST\t#%8lu cyc =>\tRESET END [%s:%d]\n", cycle, __FILE__,
-                   __LINE__);
+            ulpi_printf("\nHOST\t#%8lu cyc =>\tRESET END [%s:%d]\n", cycle, __FILE__,
+                        __LINE__);
         }
         result = 0;
         break;
@@ -422,7 +485,7 @@ int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     case HostResume:
     case HostIdle:
         // Nothing to do ...
-        printf(".");
+        ulpi_printf(".");
         host->step++;
         result = 0;
         break;
@@ -437,7 +500,7 @@ int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
     case HostSETUP:
         result = stdreq_step(host, in, out);
         if (result > 0) {
-            printf("\nHOST\t#%8lu cyc =>\tSUCCESS [%s:%d]\n", cycle, __FILE__, __LINE__);
+            ulpi_printf("\nHOST\t#%8lu cyc =>\tSUCCESS [%s:%d]\n", cycle, __FILE__, __LINE__);
         }
         return result;
 
@@ -449,15 +512,15 @@ int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out)
 
     default:
         host->step++;
-        printf("\nHOST\t#%8lu cyc =>\tERROR [%s:%d]\n", cycle, __FILE__, __LINE__);
+        ulpi_printf("\nHOST\t#%8lu cyc =>\tERROR [%s:%d]\n", cycle, __FILE__, __LINE__);
         break;
     }
 
     memcpy(&host->prev, in, sizeof(ulpi_bus_t));
 
     if (host->guard != GUARDIAN) {
-        printf("HOST\t#%8lu cyc =>\tOverRun (guard = 0x%016lu) [%s:%d]\n",
-               host->cycle, host->guard, __FILE__, __LINE__);
+        ulpi_printf("HOST\t#%8lu cyc =>\tOverRun (guard = 0x%016lu) [%s:%d]\n",
+                    host->cycle, host->guard, __FILE__, __LINE__);
         return -1;
     }
 
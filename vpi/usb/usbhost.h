@@ -7,11 +7,14 @@
  *  - to generate SOF's and EOF's, needs additional structure;
  */
 
+#include "ddr3shadow.h"
+#include "descriptor.h"
 #include "ulpi.h"
 
 
 #define MAX_PACKET_LEN 512
 #define MAX_CONFIG_LEN 64
+#define HOST_BUF_LEN   16384u
 
 
 //
@@ -67,6 +70,19 @@ typedef struct {
     float error_rate;
 } host_mode_t;
 
+/**
+ * DATA-stage progress of the current control transfer, which may span several
+ * packets (of up to 'bMaxPacketSize0' bytes each), with the data held in the
+ * host buffer.
+ */
+typedef struct {
+    uint16_t len;               // 'wLength'
+    uint16_t ptr;               // bytes transferred, so far
+    uint16_t max_packet;
+    bool in;                    // control-read, with a DATA stage
+    bool last;                  // final DATA packet (short, or reached 'wLength')
+} usb_control_t;
+
 typedef struct {
     uint64_t cycle;
     host_op_t op;
@@ -78,18 +94,26 @@ typedef struct {
     uint8_t addr;
     uint8_t error_count;
     uint16_t len;
-    uint8_t* buf;
+    uint8_t buf[HOST_BUF_LEN];
     uint64_t guard;
+    uint32_t rng;
+    usb_eptab_t eptab;
+    usb_control_t ctl;
+    ddr3_shadow_t* shadow;      // DDR3 scoreboard (if non-NULL)
 } usb_host_t;
 
 
 void show_host(usb_host_t* host);
 int host_string(usb_host_t* host, char* str, const int indent);
+const char* host_op_string(int8_t op);
 
 void usbh_init(usb_host_t* host);
 int usbh_step(usb_host_t* host, const ulpi_bus_t* in, ulpi_bus_t* out);
 int usbh_busy(usb_host_t* host);
 
+int usbh_bulk_out(usb_host_t* host, uint8_t ep, const uint8_t* data, uint16_t len);
+int usbh_bulk_in(usb_host_t* host, uint8_t ep);
+
 // int usbh_send(usb_host_t* host, usb_xact_t* xact);
 int usbh_recv(usb_host_t* host, usb_packet_t* packet);
 int usbh_next(usb_host_t* host, usb_packet_t* packet);
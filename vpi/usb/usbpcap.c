@@ -0,0 +1,351 @@
+#include "usbpcap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//
+//  Buffered pcap Writer
+///
+
+static int pcap_flush(usb_pcap_t* pcap)
+{
+    if (pcap->len > 0 && fwrite(pcap->buf, 1, pcap->len, pcap->file) != pcap->len) {
+        ulpi_printf("[%s:%d] pcap write failed\n", __FILE__, __LINE__);
+        return -1;
+    }
+    pcap->len = 0;
+    return 0;
+}
+
+static int pcap_append(usb_pcap_t* pcap, const void* data, uint32_t len)
+{
+    if (pcap->len + len > USB_PCAP_BUF_SIZE && pcap_flush(pcap) < 0) {
+        return -1;
+    }
+    memcpy(&pcap->buf[pcap->len], data, len);
+    pcap->len += len;
+    return 0;
+}
+
+/**
+ * Create the capture file, and write the (nanosecond-resolution) pcap header,
+ * or just decode (and classify) the bus cycles, if 'path' is NULL.
+ */
+int usb_pcap_open(usb_pcap_t* pcap, const char* path)
+{
+    const uint32_t header[6] = {
+        USB_PCAP_MAGIC_NS,
+        2u | (4u << 16),            // version 2.4
+        0u,                         // GMT
+        0u,                         // timestamp accuracy
+        USB_PCAP_MAX_PACKET,        // snap-length
+        LINKTYPE_USB_2_0
+    };
+
+    memset(pcap, 0, sizeof(usb_pcap_t));
+    pcap->op = PcapIdle;
+    ulpi_bus_idle(&pcap->prev);
+
+    if (path == NULL) {
+        return 0;
+    } else if ((pcap->file = fopen(path, "wb")) == NULL) {
+        ulpi_printf("[%s:%d] cannot create pcap file '%s'\n", __FILE__, __LINE__, path);
+        return -1;
+    }
+    pcap->buf = (uint8_t*)malloc(USB_PCAP_BUF_SIZE);
+
+    return pcap_append(pcap, header, sizeof(header));
+}
+
+int usb_pcap_close(usb_pcap_t* pcap)
+{
+    int result = 0;
+
+    if (pcap->file != NULL) {
+        result = pcap_flush(pcap);
+        fclose(pcap->file);
+        pcap->file = NULL;
+    }
+    free(pcap->buf);
+    pcap->buf = NULL;
+
+    return result;
+}
+
+/**
+ * Append a packet record, truncating packets that exceed the snap-length.
+ */
+int usb_pcap_write(usb_pcap_t* pcap, uint64_t t_ns, const uint8_t* pkt, uint32_t len)
+{
+    const uint32_t incl = len < USB_PCAP_MAX_PACKET ? len : USB_PCAP_MAX_PACKET;
+    const uint32_t record[4] = {
+        (uint32_t)(t_ns / 1000000000ull),
+        (uint32_t)(t_ns % 1000000000ull),
+        incl,
+        len
+    };
+
+    pcap->packets++;
+    pcap->bytes += len;
+    pcap->truncated += incl < len;
+
+    if (pcap->file == NULL) {
+        return 0;
+    }
+
+    if (pcap_append(pcap, record, sizeof(record)) < 0) {
+        return -1;
+    }
+    return pcap_append(pcap, pkt, incl);
+}
+
+
+//
+//  ULPI Decoder
+///
+
+static const char class_strings[ULPI_NUM_CLASSES][16] = {
+    {"idle"},
+    {"RX CMD"},
+    {"TX CMD/reg"},
+    {"token"},
+    {"payload"},
+    {"PID/CRC16"},
+    {"handshake"},
+    {"turnaround"},
+    {"nxt wait"},
+};
+
+const char* ulpi_class_string(ulpi_class_t cls)
+{
+    return cls < ULPI_NUM_CLASSES ? class_strings[cls] : "unknown";
+}
+
+static void pcap_begin(usb_pcap_t* pcap, uint64_t t_ns)
+{
+    pcap->pkt_ns = t_ns;
+    pcap->pkt_len = 0;
+    pcap->pkt_cycles = 0;
+}
+
+static void pcap_byte(usb_pcap_t* pcap, uint8_t byte)
+{
+    if (pcap->pkt_len < USB_PCAP_MAX_PACKET) {
+        pcap->pkt[pcap->pkt_len] = byte;
+    }
+    if (pcap->pkt_len < UINT32_MAX) {
+        pcap->pkt_len++;
+    }
+}
+
+/**
+ * The cycles that carried packet bytes can only be classified once the PID is
+ * known (and for DATAx packets, once the end is reached, to find the CRC16).
+ */
+static void pcap_classify(usb_pcap_t* pcap)
+{
+    const uint32_t n = pcap->pkt_cycles;
+
+    if (n == 0) {
+        return;
+    } else if (pcap->pkt_len == 0) {
+        pcap->cycles[UlpiTxCmd] += n;
+    } else {
+        switch (pcap->pkt[0] & 0x03) {
+        case 0x03: {
+            const uint32_t crc = n < 3 ? n : 3;
+            pcap->cycles[UlpiCrc] += crc;
+            pcap->cycles[UlpiPayload] += n - crc;
+            break;
+        }
+        case 0x02:
+            pcap->cycles[UlpiHandshake] += n;
+            break;
+        default:
+            pcap->cycles[UlpiToken] += n;
+            break;
+        }
+    }
+    pcap->pkt_cycles = 0;
+}
+
+static void pcap_drop(usb_pcap_t* pcap)
+{
+    pcap_classify(pcap);
+    pcap->pkt_len = 0;
+}
+
+static int pcap_end(usb_pcap_t* pcap)
+{
+    const uint32_t len = pcap->pkt_len;
+
+    pcap_classify(pcap);
+    pcap->pkt_len = 0;
+    pcap->op = PcapIdle;
+
+    return len > 0 ? usb_pcap_write(pcap, pcap->pkt_ns, pcap->pkt, len) : 0;
+}
+
+static ulpi_class_t pcap_packet_cycle(usb_pcap_t* pcap)
+{
+    pcap->pkt_cycles++;
+    return ULPI_NUM_CLASSES;
+}
+
+/**
+ * Decode the ULPI bus values for the current clock-edge, and classify the
+ * cycle.
+ *
+ * While 'dir' is asserted, the PHY is driving the bus: the first cycle is a
+ * turnaround, then each cycle that has 'nxt' asserted carries a received
+ * byte, and the rest are RX CMDs, with the packet ending once RX CMD shows
+ * that 'RxActive' has been deasserted, or when 'dir' is deasserted.
+ *
+ * While 'dir' is deasserted, the link is driving the bus: a "transmit" TX CMD
+ * carries the PID, and the PHY accepts it (and then each subsequent byte) by
+ * asserting 'nxt', until the link asserts 'stp' to end the packet. Cycles
+ * where the link waits for 'nxt' are wait-states.
+ */
+int usb_pcap_step(usb_pcap_t* pcap, const ulpi_bus_t* bus, uint64_t t_ns)
+{
+    const bool turnaround = bus->dir != pcap->prev.dir;
+    const bool valid = bus->data.b == 0x00;
+    ulpi_class_t cls = UlpiIdle;
+    int result = 0;
+
+    memcpy(&pcap->prev, bus, sizeof(ulpi_bus_t));
+
+    if (bus->rst_n != SIG1) {
+        pcap->op = PcapIdle;
+        pcap_drop(pcap);
+        pcap->regr = 0;
+        pcap->cycles[UlpiIdle]++;
+        return 0;
+    }
+
+    if (bus->dir == SIG1) {
+        if (pcap->op == PcapTxCmd || pcap->op == PcapSend) {
+            // PHY aborted the link's transmission
+            pcap->op = PcapIdle;
+            pcap_drop(pcap);
+        }
+
+        if (turnaround || !valid) {
+            if (turnaround && !pcap->regr) {
+                pcap_begin(pcap, t_ns);
+                pcap->op = PcapRecv;
+            }
+            cls = turnaround ? UlpiTurn : UlpiIdle;
+        } else if (pcap->regr) {
+            // Register-read data
+            cls = UlpiTxCmd;
+        } else if (bus->nxt == SIG1) {
+            if (pcap->pkt_len == 0) {
+                pcap->pkt_ns = t_ns;
+            }
+            pcap_byte(pcap, bus->data.a);
+            cls = pcap_packet_cycle(pcap);
+        } else {
+            cls = UlpiRxCmd;
+            if ((bus->data.a & RX_ACTIVE_BITS) == 0 && pcap->op == PcapRecv) {
+                result = pcap_end(pcap);
+            } else if ((bus->data.a & RX_EVENT_MASK) == RX_EVENT_MASK) {
+                // RX error, so discard the packet
+                pcap_drop(pcap);
+            }
+        }
+
+        if (cls < ULPI_NUM_CLASSES) {
+            pcap->cycles[cls]++;
+        }
+        return result;
+    }
+
+    if (turnaround) {
+        if (pcap->op == PcapRecv) {
+            result = pcap_end(pcap);
+        }
+        pcap->op = PcapIdle;
+        pcap->regr = 0;
+        pcap->cycles[UlpiTurn]++;
+        return result;
+    }
+
+    switch (pcap->op) {
+    case PcapIdle:
+    case PcapRecv:
+        if (!valid || bus->data.a == 0x00) {
+            pcap->op = PcapIdle;
+            break;
+        }
+        switch (bus->data.a & 0xC0) {
+        case 0x40: {
+            // Transmit, with the PID in the lower nibble
+            const uint8_t pid = bus->data.a & 0x0F;
+            pcap_begin(pcap, t_ns);
+            pcap_byte(pcap, pid | ((pid ^ 0x0F) << 4));
+            pcap->op = pid != USBPID_RESERVED ? PcapTxCmd : PcapReg;
+            break;
+        }
+        case 0xC0:
+            pcap->regr = 1;
+            pcap->op = PcapReg;
+            break;
+        default:
+            pcap->op = PcapReg;
+            break;
+        }
+        if (pcap->op == PcapTxCmd) {
+            if (bus->nxt == SIG1) {
+                pcap->op = PcapSend;
+                cls = pcap_packet_cycle(pcap);
+            } else {
+                cls = UlpiWait;
+            }
+        } else {
+            cls = UlpiTxCmd;
+        }
+        break;
+
+    case PcapTxCmd:
+        if (bus->stp == SIG1) {
+            pcap->op = PcapIdle;
+            pcap_drop(pcap);
+            cls = UlpiTxCmd;
+        } else if (bus->nxt == SIG1) {
+            pcap->op = PcapSend;
+            cls = pcap_packet_cycle(pcap);
+        } else {
+            cls = UlpiWait;
+        }
+        break;
+
+    case PcapSend:
+        if (bus->stp == SIG1) {
+            result = pcap_end(pcap);
+            cls = UlpiTxCmd;
+        } else if (bus->nxt == SIG1 && valid) {
+            pcap_byte(pcap, bus->data.a);
+            cls = pcap_packet_cycle(pcap);
+        } else {
+            cls = UlpiWait;
+        }
+        break;
+
+    case PcapReg:
+        cls = UlpiTxCmd;
+        if (bus->stp == SIG1) {
+            pcap->op = PcapIdle;
+        } else if (!pcap->regr && ulpi_bus_is_idle(bus)) {
+            pcap->op = PcapIdle;
+            cls = UlpiIdle;
+        }
+        break;
+    }
+
+    if (cls < ULPI_NUM_CLASSES) {
+        pcap->cycles[cls]++;
+    }
+    return result;
+}
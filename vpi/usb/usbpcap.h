@@ -0,0 +1,80 @@
+#ifndef __USBPCAP_H__
+#define __USBPCAP_H__
+/**
+ * Decodes the ULPI bus traffic, sampled at each clock-edge, into complete USB
+ * packets (tokens, DATAx, and handshakes, including their CRCs), and writes
+ * them to a pcap file, with the USB 2.0 link-type, so that captures can be
+ * opened with Wireshark (and other USB analysers).
+ * Each cycle is also classified, to measure the bus utilisation, and how much
+ * of it is protocol overhead.
+ * NOTE:
+ *  - packets are timestamped (in ns) at the clock-edge of their PID byte;
+ *  - the cycles of each packet are classified once it ends;
+ *  - register reads & writes, and RX CMDs, are not captured;
+ *  - writes are buffered, so call 'usb_pcap_close()' to flush the file;
+ */
+
+#include "ulpi.h"
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define LINKTYPE_USB_2_0    288
+#define USB_PCAP_MAGIC_NS   0xA1B23C4Du
+#define USB_PCAP_BUF_SIZE   65536
+#define USB_PCAP_MAX_PACKET 1027    // PID + 1024 bytes (isochronous) + CRC16
+
+
+/**
+ * Classes of ULPI bus cycles, where the DATAx PIDs are counted along with the
+ * CRC16 bytes, as packet overhead.
+ */
+typedef enum {
+    UlpiIdle,
+    UlpiRxCmd,
+    UlpiTxCmd,      // TX CMDs, register accesses, and 'stp'
+    UlpiToken,
+    UlpiPayload,
+    UlpiCrc,
+    UlpiHandshake,
+    UlpiTurn,
+    UlpiWait,       // link waiting on 'nxt'
+} ulpi_class_t;
+
+#define ULPI_NUM_CLASSES 9
+
+typedef enum {
+    PcapIdle,
+    PcapRecv,
+    PcapTxCmd,
+    PcapSend,
+    PcapReg,
+} usb_pcap_op_t;
+
+typedef struct {
+    FILE* file;
+    uint8_t* buf;
+    uint32_t len;
+    usb_pcap_op_t op;
+    uint8_t regr;
+    ulpi_bus_t prev;
+    uint64_t pkt_ns;
+    uint32_t pkt_len;
+    uint32_t pkt_cycles;
+    uint8_t pkt[USB_PCAP_MAX_PACKET];
+    uint64_t cycles[ULPI_NUM_CLASSES];
+    uint32_t packets;
+    uint32_t truncated;
+    uint64_t bytes;
+} usb_pcap_t;
+
+
+int usb_pcap_open(usb_pcap_t* pcap, const char* path);
+int usb_pcap_close(usb_pcap_t* pcap);
+int usb_pcap_write(usb_pcap_t* pcap, uint64_t t_ns, const uint8_t* pkt, uint32_t len);
+int usb_pcap_step(usb_pcap_t* pcap, const ulpi_bus_t* bus, uint64_t t_ns);
+
+const char* ulpi_class_string(ulpi_class_t cls);
+
+
+#endif  /* __USBPCAP_H__ */